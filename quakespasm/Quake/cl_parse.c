@@ -369,6 +369,14 @@ void CL_ParseServerInfo (void)
 
 	// copy the naked name of the map file to the cl structure -- O.S
 	COM_StripExtension (COM_SkipPath(model_precache[1]), cl.mapname, sizeof(cl.mapname));
+	if (!sv.active)	// a local server began tracking the map already
+		Mem_BeginMap (cl.mapname);
+
+	// let the disk work ahead of the loaders below
+	for (i = 1; i < nummodels; i++)
+		Mod_Prefetch (model_precache[i]);
+	for (i = 1; i < numsounds; i++)
+		S_PrefetchSound (sound_precache[i]);
 
 	for (i = 1; i < nummodels; i++)
 	{
@@ -387,6 +395,8 @@ void CL_ParseServerInfo (void)
 		CL_KeepaliveMessage ();
 	}
 	S_EndPrecaching ();
+	COM_FlushPrefetch ();
+	COM_DumpFileStats (cl.mapname);
 
 // local state
 	cl_entities[0].model = cl.worldmodel = cl.model_precache[1];
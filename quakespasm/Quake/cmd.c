@@ -35,10 +35,24 @@ typedef struct cmdalias_s
 	struct cmdalias_s	*next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
+	struct cmdalias_s	*hashnext;
 } cmdalias_t;
 
 cmdalias_t	*cmd_alias;
 
+/*
+Commands and aliases are also kept in hash tables next to their lists, so
+that executing a line doesn't walk every name there is. The lists stay as
+they are for listing and completion, which want them in order. Names hash
+without case, because Cmd_ExecuteString matches them that way.
+*/
+#define	CMD_HASHSIZE	256	// power of two
+
+static cmdalias_t	*alias_hash[CMD_HASHSIZE];
+
+static lookupstat_t	cmd_lookupstat, alias_lookupstat;
+static double		lookupstat_time;	// realtime at the last reset
+
 qboolean	cmd_wait;
 
 //=============================================================================
@@ -65,7 +79,77 @@ void Cmd_Wait_f (void)
 =============================================================================
 */
 
-sizebuf_t	cmd_text;
+/*
+The text that is still to be executed is data[start..end). Cbuf_Execute only
+moves start forward, so a script runs in time linear to its size instead of
+moving everything after each line down. Inserted text goes into the room
+that executed lines left in front of start when it fits, and the buffer
+grows when text doesn't fit at all.
+*/
+#define	CBUF_MINSIZE	(1<<18)		// spike -- was 8192, but modern configs can be _HUGE_, at least if they contain lots of comments/docs for things.
+#define	CBUF_MAXSIZE	(64<<20)
+
+typedef struct
+{
+	char	*data;
+	int		size;
+	int		start;
+	int		end;
+} cmdbuf_t;
+
+static cmdbuf_t	cmd_text;
+
+static void Cbuf_Alloc (cmdbuf_t *buf, int size)
+{
+	buf->data = (char *) malloc (size);
+	if (!buf->data)
+		Sys_Error ("Cbuf_Alloc: failed on %i bytes", size);
+	buf->size = size;
+	buf->start = buf->end = 0;
+	Mem_Track (MEMPOOL_MALLOC, "cmdbuf", size);
+}
+
+static void Cbuf_Free (cmdbuf_t *buf)
+{
+	Mem_Track (MEMPOOL_MALLOC, "cmdbuf", -buf->size);
+	free (buf->data);
+	buf->data = NULL;
+	buf->size = buf->start = buf->end = 0;
+}
+
+/*
+============
+Cbuf_Reserve
+
+Makes room for length more bytes, leaving gap free bytes in front of the
+text. Returns false if the text would get too big.
+============
+*/
+static qboolean Cbuf_Reserve (int length, int gap)
+{
+	cmdbuf_t	old;
+	int		used, size;
+
+	used = cmd_text.end - cmd_text.start;
+	if (used + length > CBUF_MAXSIZE)
+		return false;
+
+	if (used + length > cmd_text.size)
+	{
+		for (size = cmd_text.size; size < used + length; size *= 2)
+			;
+		old = cmd_text;
+		Cbuf_Alloc (&cmd_text, q_min(size, CBUF_MAXSIZE));
+		memcpy (cmd_text.data + gap, old.data + old.start, used);
+		Cbuf_Free (&old);
+	}
+	else
+		memmove (cmd_text.data + gap, cmd_text.data + cmd_text.start, used);
+
+	cmd_text.start = gap;
+	cmd_text.end = gap + used;
+	return true;
+}
 
 /*
 ============
@@ -74,7 +158,7 @@ Cbuf_Init
 */
 void Cbuf_Init (void)
 {
-	SZ_Alloc (&cmd_text, 1<<18);		// space for commands and script files. spike -- was 8192, but modern configs can be _HUGE_, at least if they contain lots of comments/docs for things.
+	Cbuf_Alloc (&cmd_text, CBUF_MINSIZE);	// space for commands and script files
 }
 
 
@@ -91,13 +175,14 @@ void Cbuf_AddText (const char *text)
 
 	l = Q_strlen (text);
 
-	if (cmd_text.cursize + l >= cmd_text.maxsize)
+	if (cmd_text.end + l > cmd_text.size && !Cbuf_Reserve (l, 0))
 	{
 		Con_Printf ("Cbuf_AddText: overflow\n");
 		return;
 	}
 
-	SZ_Write (&cmd_text, text, Q_strlen (text));
+	memcpy (cmd_text.data + cmd_text.end, text, l);
+	cmd_text.end += l;
 }
 
 
@@ -107,34 +192,23 @@ Cbuf_InsertText
 
 Adds command text immediately after the current command
 Adds a \n to the text
-FIXME: actually change the command buffer to do less copying
 ============
 */
 void Cbuf_InsertText (const char *text)
 {
-	char	*temp;
-	int		templen;
+	int		l;
 
-// copy off any commands still remaining in the exec buffer
-	templen = cmd_text.cursize;
-	if (templen)
-	{
-		temp = (char *) Z_Malloc (templen);
-		Q_memcpy (temp, cmd_text.data, templen);
-		SZ_Clear (&cmd_text);
-	}
-	else
-		temp = NULL;	// shut up compiler
+	l = Q_strlen (text) + 1;
 
-// add the entire text of the file
-	Cbuf_AddText (text);
-	SZ_Write (&cmd_text, "\n", 1);
-// add the copied off data
-	if (templen)
+	if (cmd_text.start < l && !Cbuf_Reserve (l, l))
 	{
-		SZ_Write (&cmd_text, temp, templen);
-		Z_Free (temp);
+		Con_Printf ("Cbuf_InsertText: overflow\n");
+		return;
 	}
+
+	cmd_text.start -= l;
+	memcpy (cmd_text.data + cmd_text.start, text, l - 1);
+	cmd_text.data[cmd_text.start + l - 1] = '\n';
 }
 
 /*
@@ -144,18 +218,19 @@ Cbuf_Execute
 */
 void Cbuf_Execute (void)
 {
-	int		i;
+	int		i, end;
 	char	*text;
 	char	line[1024];
 	int		quotes;
 
-	while (cmd_text.cursize)
+	while (cmd_text.start < cmd_text.end)
 	{
 // find a \n or ; line break
-		text = (char *)cmd_text.data;
+		text = cmd_text.data + cmd_text.start;
+		end = cmd_text.end - cmd_text.start;
 
 		quotes = 0;
-		for (i=0 ; i< cmd_text.cursize ; i++)
+		for (i=0 ; i< end ; i++)
 		{
 			if (text[i] == '"')
 				quotes++;
@@ -176,18 +251,12 @@ void Cbuf_Execute (void)
 			line[i] = 0;
 		}
 
-// delete the text from the command buffer and move remaining commands down
-// this is necessary because commands (exec, alias) can insert data at the
-// beginning of the text buffer
-
-		if (i == cmd_text.cursize)
-			cmd_text.cursize = 0;
+// take the line off the front of the command buffer; commands (exec, alias)
+// can insert text in front of what remains
+		if (i == end)
+			cmd_text.start = cmd_text.end = 0;
 		else
-		{
-			i++;
-			cmd_text.cursize -= i;
-			memmove (text, text + i, cmd_text.cursize);
-		}
+			cmd_text.start += i + 1;
 
 // execute the command line
 		Cmd_ExecuteString (line, src_command);
@@ -199,6 +268,73 @@ void Cbuf_Execute (void)
 			break;
 		}
 	}
+
+// give back what a huge script made the buffer grow to
+	if (cmd_text.start == cmd_text.end)
+	{
+		cmd_text.start = cmd_text.end = 0;
+		if (cmd_text.size > CBUF_MINSIZE)
+		{
+			Cbuf_Free (&cmd_text);
+			Cbuf_Alloc (&cmd_text, CBUF_MINSIZE);
+		}
+	}
+}
+
+/*
+============
+Cbuf_Bench_f
+
+Runs a generated script of alias commands, like a large config, through a
+command buffer of its own and times it
+============
+*/
+static void Cbuf_Bench_f (void)
+{
+	cmdbuf_t	saved;
+	char		*script, *p;
+	int		i, lines, size, length;
+	double		start, time;
+
+	lines = (Cmd_Argc() > 1) ? Q_atoi (Cmd_Argv(1)) : 100000;
+	if (lines < 1)
+	{
+		Con_Printf ("cbuf_bench [lines] : time executing a script, 100000 lines by default\n");
+		return;
+	}
+
+	size = lines * 64 + 1;
+	script = p = (char *) malloc (size);
+	if (!script)
+	{
+		Con_Printf ("cbuf_bench: couldn't allocate %i bytes\n", size);
+		return;
+	}
+	for (i = 0; i < lines; i++)
+	{
+		if (i & 1)
+			p += sprintf (p, "alias _cbufbench \"impulse %i\"\n", i);
+		else
+			p += sprintf (p, "// line %i of the benchmark script\n", i);
+	}
+	length = (int)(p - script);
+
+// run it in a buffer of its own, so nothing queued gets executed early
+	saved = cmd_text;
+	Cbuf_Alloc (&cmd_text, CBUF_MINSIZE);
+
+	start = Sys_PreciseTime ();
+	Cbuf_InsertText (script);
+	Cbuf_Execute ();
+	time = Sys_PreciseTime () - start;
+
+	Cbuf_Free (&cmd_text);
+	cmd_text = saved;
+	free (script);
+	Cmd_ExecuteString ("unalias _cbufbench", src_command);
+
+	Con_Printf ("%i lines, %i KB in %.1f ms, %.0f lines/s\n", lines,
+		    length / 1024, time * 1000.0, lines / q_max(time, 1e-9));
 }
 
 /*
@@ -259,6 +395,7 @@ void Cmd_Exec_f (void)
 {
 	char	*f;
 	int		mark;
+	const char	*requester;
 
 	if (Cmd_Argc () != 2)
 	{
@@ -267,7 +404,9 @@ void Cmd_Exec_f (void)
 	}
 
 	mark = Hunk_LowMark ();
+	requester = COM_SetFileRequester ("config");
 	f = (char *)COM_LoadHunkFile (Cmd_Argv(1), NULL);
+	COM_SetFileRequester (requester);
 	if (!f)
 	{
 		Con_Printf ("couldn't exec %s\n",Cmd_Argv(1));
@@ -296,6 +435,41 @@ void Cmd_Echo_f (void)
 	Con_Printf ("\n");
 }
 
+/*
+===============
+Cmd_FindAlias
+
+exact: compare with case, as the alias commands always have
+===============
+*/
+static cmdalias_t *Cmd_FindAlias (const char *name, qboolean exact)
+{
+	cmdalias_t	*a;
+
+	alias_lookupstat.lookups++;
+	for (a = alias_hash[COM_HashStringNoCase (name) & (CMD_HASHSIZE - 1)]; a; a = a->hashnext)
+	{
+		alias_lookupstat.probes++;
+		if (exact ? !strcmp (name, a->name) : !q_strcasecmp (name, a->name))
+			return a;
+	}
+	alias_lookupstat.misses++;
+	return NULL;
+}
+
+static void Cmd_FreeAlias (cmdalias_t *alias)
+{
+	cmdalias_t	**link;
+
+	link = &alias_hash[COM_HashStringNoCase (alias->name) & (CMD_HASHSIZE - 1)];
+	while (*link != alias)
+		link = &(*link)->hashnext;
+	*link = alias->hashnext;
+
+	Z_Free (alias->value);
+	Z_Free (alias);
+}
+
 /*
 ===============
 Cmd_Alias_f -- johnfitz -- rewritten
@@ -322,9 +496,9 @@ void Cmd_Alias_f (void)
 			Con_SafePrintf ("no alias commands found\n");
 		break;
 	case 2: //output current alias string
-		for (a = cmd_alias ; a ; a=a->next)
-			if (!strcmp(Cmd_Argv(1), a->name))
-				Con_Printf ("   %s: %s", a->name, a->value);
+		a = Cmd_FindAlias (Cmd_Argv(1), true);
+		if (a)
+			Con_Printf ("   %s: %s", a->name, a->value);
 		break;
 	default: //set alias string
 		s = Cmd_Argv(1);
@@ -335,22 +509,19 @@ void Cmd_Alias_f (void)
 		}
 
 		// if the alias allready exists, reuse it
-		for (a = cmd_alias ; a ; a=a->next)
-		{
-			if (!strcmp(s, a->name))
-			{
-				Z_Free (a->value);
-				break;
-			}
-		}
-
-		if (!a)
+		a = Cmd_FindAlias (s, true);
+		if (a)
+			Z_Free (a->value);
+		else
 		{
 			a = (cmdalias_t *) Z_Malloc (sizeof(cmdalias_t));
 			a->next = cmd_alias;
 			cmd_alias = a;
+			strcpy (a->name, s);
+			i = COM_HashStringNoCase (s) & (CMD_HASHSIZE - 1);
+			a->hashnext = alias_hash[i];
+			alias_hash[i] = a;
 		}
-		strcpy (a->name, s);
 
 		// copy the rest of the command line
 		cmd[0] = 0;		// start out with a null string
@@ -399,8 +570,7 @@ void Cmd_Unalias_f (void)
 				else
 					cmd_alias  = a->next;
 
-				Z_Free (a->value);
-				Z_Free (a);
+				Cmd_FreeAlias (a);
 				return;
 			}
 			prev = a;
@@ -422,8 +592,7 @@ void Cmd_Unaliasall_f (void)
 	while (cmd_alias)
 	{
 		blah = cmd_alias->next;
-		Z_Free(cmd_alias->value);
-		Z_Free(cmd_alias);
+		Cmd_FreeAlias (cmd_alias);
 		cmd_alias = blah;
 	}
 }
@@ -441,6 +610,7 @@ typedef struct cmd_function_s
 	struct cmd_function_s	*next;
 	const char		*name;
 	xcommand_t		function;
+	struct cmd_function_s	*hashnext;
 } cmd_function_t;
 
 
@@ -458,6 +628,66 @@ cmd_source_t	cmd_source;
 cmd_function_t	*cmd_functions;		// possible commands to execute
 //johnfitz
 
+static cmd_function_t	*cmd_hash[CMD_HASHSIZE];
+
+/*
+============
+Cmd_FindCommand
+
+exact: compare with case, like Cmd_Exists always has
+============
+*/
+static cmd_function_t *Cmd_FindCommand (const char *name, qboolean exact)
+{
+	cmd_function_t	*cmd;
+
+	cmd_lookupstat.lookups++;
+	for (cmd = cmd_hash[COM_HashStringNoCase (name) & (CMD_HASHSIZE - 1)]; cmd; cmd = cmd->hashnext)
+	{
+		cmd_lookupstat.probes++;
+		if (exact ? !Q_strcmp (name, cmd->name) : !q_strcasecmp (name, cmd->name))
+			return cmd;
+	}
+	cmd_lookupstat.misses++;
+	return NULL;
+}
+
+/*
+============
+Cmd_LookupStats_f
+
+how often commands, aliases and cvars are looked up by name, and how many
+names each lookup had to compare
+============
+*/
+static void Cmd_PrintLookupStat (const char *what, const lookupstat_t *stat, double seconds)
+{
+	Con_Printf ("%-8s %9i %8.1f/s %9i %5.2f\n", what, stat->lookups,
+		    stat->lookups / seconds, stat->misses,
+		    stat->lookups ? stat->probes / (double)stat->lookups : 0.0);
+}
+
+static void Cmd_LookupStats_f (void)
+{
+	double	seconds;
+
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+	{
+		memset (&cmd_lookupstat, 0, sizeof(cmd_lookupstat));
+		memset (&alias_lookupstat, 0, sizeof(alias_lookupstat));
+		memset (&cvar_lookupstat, 0, sizeof(cvar_lookupstat));
+		lookupstat_time = realtime;
+		return;
+	}
+
+	seconds = q_max (realtime - lookupstat_time, 0.001);
+	Con_Printf ("in the last %.1f seconds:\n", seconds);
+	Con_Printf ("           lookups     rate    misses probes\n");
+	Cmd_PrintLookupStat ("commands", &cmd_lookupstat, seconds);
+	Cmd_PrintLookupStat ("aliases", &alias_lookupstat, seconds);
+	Cmd_PrintLookupStat ("cvars", &cvar_lookupstat, seconds);
+}
+
 /*
 ============
 Cmd_List_f -- johnfitz
@@ -575,6 +805,8 @@ void Cmd_Init (void)
 
 	Cmd_AddCommand ("apropos", Cmd_Apropos_f);
 	Cmd_AddCommand ("find", Cmd_Apropos_f);
+	Cmd_AddCommand ("lookup_stats", Cmd_LookupStats_f);
+	Cmd_AddCommand ("cbuf_bench", Cbuf_Bench_f);
 }
 
 /*
@@ -670,6 +902,7 @@ void	Cmd_AddCommand (const char *cmd_name, xcommand_t function)
 {
 	cmd_function_t	*cmd;
 	cmd_function_t	*cursor,*prev; //johnfitz -- sorted list insert
+	unsigned int	hash;
 
 	if (host_initialized)	// because hunk allocation would get stomped
 		Sys_Error ("Cmd_AddCommand after host_initialized");
@@ -682,18 +915,18 @@ void	Cmd_AddCommand (const char *cmd_name, xcommand_t function)
 	}
 
 // fail if the command already exists
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	if (Cmd_FindCommand (cmd_name, true))
 	{
-		if (!Q_strcmp (cmd_name, cmd->name))
-		{
-			Con_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Con_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = (cmd_function_t *) Hunk_Alloc (sizeof(cmd_function_t));
 	cmd->name = cmd_name;
 	cmd->function = function;
+	hash = COM_HashStringNoCase (cmd_name) & (CMD_HASHSIZE - 1);
+	cmd->hashnext = cmd_hash[hash];
+	cmd_hash[hash] = cmd;
 
 	//johnfitz -- insert each entry in alphabetical order
 	if (cmd_functions == NULL || strcmp(cmd->name, cmd_functions->name) < 0) //insert at front
@@ -723,15 +956,7 @@ Cmd_Exists
 */
 qboolean	Cmd_Exists (const char *cmd_name)
 {
-	cmd_function_t	*cmd;
-
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
-	{
-		if (!Q_strcmp (cmd_name,cmd->name))
-			return true;
-	}
-
-	return false;
+	return Cmd_FindCommand (cmd_name, true) != NULL;
 }
 
 
@@ -764,7 +989,6 @@ const char *Cmd_CompleteCommand (const char *partial)
 Cmd_ExecuteString
 
 A complete command line has been parsed, so try to execute it
-FIXME: lookupnoadd the token to speed search?
 ============
 */
 void	Cmd_ExecuteString (const char *text, cmd_source_t src)
@@ -780,23 +1004,19 @@ void	Cmd_ExecuteString (const char *text, cmd_source_t src)
 		return;		// no tokens
 
 // check functions
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	cmd = Cmd_FindCommand (cmd_argv[0], false);
+	if (cmd)
 	{
-		if (!q_strcasecmp (cmd_argv[0],cmd->name))
-		{
-			cmd->function ();
-			return;
-		}
+		cmd->function ();
+		return;
 	}
 
 // check alias
-	for (a=cmd_alias ; a ; a=a->next)
+	a = Cmd_FindAlias (cmd_argv[0], false);
+	if (a)
 	{
-		if (!q_strcasecmp (cmd_argv[0], a->name))
-		{
-			Cbuf_InsertText (a->value);
-			return;
-		}
+		Cbuf_InsertText (a->value);
+		return;
 	}
 
 // check cvars
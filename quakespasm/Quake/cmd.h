@@ -83,6 +83,15 @@ extern	cmd_source_t	cmd_source;
 
 void	Cmd_Init (void);
 
+typedef struct
+{
+	int	lookups;
+	int	probes;		// names compared
+	int	misses;
+} lookupstat_t;
+
+extern	lookupstat_t	cvar_lookupstat;	// kept by Cvar_FindVar, shown by lookup_stats
+
 void	Cmd_AddCommand (const char *cmd_name, xcommand_t function);
 // called by the init functions of other parts of the program to
 // register commands and functions to call for them.
@@ -25,6 +25,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "q_ctype.h"
 #include <errno.h>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
 
 static char	*largv[MAX_NUM_ARGVS + 1];
 static char	argvdummy[] = " ";
@@ -547,6 +550,40 @@ float Q_atof (const char *str)
 	return val*sign;
 }
 
+/*
+============
+COM_HashString
+
+32 bit FNV-1a hash of a string, used for the name lookup tables.
+COM_HashStringNoCase folds ascii case first so that it can back
+q_strcasecmp lookups.
+============
+*/
+unsigned int COM_HashString (const char *str)
+{
+	unsigned int	hash = 2166136261u;
+
+	while (*str)
+	{
+		hash ^= (byte)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+unsigned int COM_HashStringNoCase (const char *str)
+{
+	unsigned int	hash = 2166136261u;
+
+	while (*str)
+	{
+		hash ^= (byte)q_tolower(*str);
+		hash *= 16777619u;
+		str++;
+	}
+	return hash;
+}
+
 /*
 ============================================================================
 
@@ -990,6 +1027,120 @@ void SZ_Print (sizebuf_t *buf, const char *data)
 	}
 }
 
+/*
+============
+SZ_Reserve
+
+Makes room for length more bytes in a sizebuf whose data came from malloc
+(or is still NULL), for building a file in memory before its size is known
+============
+*/
+void SZ_Reserve (sizebuf_t *buf, int length)
+{
+	byte	*data;
+	int	maxsize;
+
+	if (buf->cursize + length <= buf->maxsize)
+		return;
+	maxsize = q_max (buf->maxsize * 2, 65536);
+	while (maxsize < buf->cursize + length)
+		maxsize *= 2;
+	data = (byte *) realloc (buf->data, maxsize);
+	if (!data)
+		Sys_Error ("SZ_Reserve: failed on allocation of %i bytes", maxsize);
+	Mem_Track (MEMPOOL_MALLOC, "sizebuf", maxsize - buf->maxsize);
+	buf->data = data;
+	buf->maxsize = maxsize;
+}
+
+void SZ_FreeReserved (sizebuf_t *buf)
+{
+	Mem_Track (MEMPOOL_MALLOC, "sizebuf", -buf->maxsize);
+	free (buf->data);
+	buf->data = NULL;
+	buf->maxsize = 0;
+	buf->cursize = 0;
+}
+
+void SZ_Printf (sizebuf_t *buf, const char *fmt, ...)
+{
+	va_list	argptr;
+	int	len;
+
+	SZ_Reserve (buf, 1024);
+	for (;;)
+	{
+		va_start (argptr, fmt);
+		len = q_vsnprintf ((char *)buf->data + buf->cursize, buf->maxsize - buf->cursize, fmt, argptr);
+		va_end (argptr);
+		if (len < buf->maxsize - buf->cursize)
+			break;
+		SZ_Reserve (buf, len + 1);
+	}
+	buf->cursize += len;
+}
+
+/*
+============
+SZ_ReadLong
+
+Reading back what MSG_Write* put in a sizebuf that isn't net_message:
+cursize is the read position, and overflowed is set instead of reading
+past maxsize
+============
+*/
+int SZ_ReadByte (sizebuf_t *buf)
+{
+	if (buf->cursize + 1 > buf->maxsize)
+	{
+		buf->overflowed = true;
+		return 0;
+	}
+	return buf->data[buf->cursize++];
+}
+
+int SZ_ReadLong (sizebuf_t *buf)
+{
+	const byte	*p;
+
+	if (buf->cursize + 4 > buf->maxsize)
+	{
+		buf->overflowed = true;
+		return 0;
+	}
+	p = buf->data + buf->cursize;
+	buf->cursize += 4;
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+float SZ_ReadFloat (sizebuf_t *buf)
+{
+	union
+	{
+		float	f;
+		int	l;
+	} dat;
+
+	dat.l = SZ_ReadLong (buf);
+	return dat.f;
+}
+
+const char *SZ_ReadString (sizebuf_t *buf)
+{
+	const byte	*s, *end;
+
+	s = buf->data + buf->cursize;
+	end = (const byte *) memchr (s, 0, buf->maxsize - buf->cursize);
+	if (!end)
+	{
+		buf->overflowed = true;
+		buf->cursize = buf->maxsize;
+		return "";
+	}
+	buf->cursize += end - s + 1;
+	return (const char *) s;
+}
+
 
 //============================================================================
 
@@ -1442,9 +1593,11 @@ void COM_Init (void)
 ============
 va
 
-does a varargs printf into a temp buffer. cycles between
-4 different static buffers. the number of buffers cycled
-is defined in VA_NUM_BUFFS.
+does a varargs printf into a temp buffer. the string is taken from
+the scratch arena and stays good until the frame ends; before the
+arena is up, or when it runs low, it cycles between 4 different
+static buffers. the number of buffers cycled is defined in
+VA_NUM_BUFFS.
 FIXME: make this buffer size safe someday
 ============
 */
@@ -1463,11 +1616,18 @@ char *va (const char *format, ...)
 {
 	va_list		argptr;
 	char		*va_buf;
+	int		len;
+	qboolean	scratch;
 
-	va_buf = get_va_buffer ();
+	va_buf = (char *) Scratch_TryAlloc (VA_BUFFERLEN);
+	scratch = (va_buf != NULL);
+	if (!scratch)
+		va_buf = get_va_buffer ();
 	va_start (argptr, format);
-	q_vsnprintf (va_buf, VA_BUFFERLEN, format, argptr);
+	len = q_vsnprintf (va_buf, VA_BUFFERLEN, format, argptr);
 	va_end (argptr);
+	if (scratch && len < VA_BUFFERLEN)
+		Scratch_Shrink (va_buf, len + 1);
 
 	return va_buf;
 }
@@ -1508,6 +1668,13 @@ int	file_from_pak;		// ZOID: global indicating that file came from a pak
 searchpath_t	*com_searchpaths;
 searchpath_t	*com_base_searchpaths;
 
+static qboolean	com_mappaks;	// map pak files instead of reading from them
+static pack_t		*com_foundpak;	// set by COM_FindFile for pak hits
+static packfile_t	*com_foundfile;
+static char		com_foundpath[MAX_OSPATH];	// pak or loose file it came from
+static searchpath_t	*com_foundsearch;
+static struct fsstat_s	*com_foundstat;	// I/O record of the last file looked up
+
 /*
 ============
 COM_Path_f
@@ -1522,7 +1689,8 @@ static void COM_Path_f (void)
 	{
 		if (s->pack)
 		{
-			Con_Printf ("%s (%i files)\n", s->pack->filename, s->pack->numfiles);
+			Con_Printf ("%s (%i files%s)\n", s->pack->filename, s->pack->numfiles,
+					s->pack->mapbase ? ", mapped" : "");
 		}
 		else
 			Con_Printf ("%s\n", s->filename);
@@ -1544,6 +1712,7 @@ void COM_WriteFile (const char *filename, const void *data, int len)
 	Sys_mkdir (com_gamedir); //johnfitz -- if we've switched to a nonexistant gamedir, create it now so we don't crash
 
 	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, filename);
+	COM_InvalidateFileIndex ();
 
 	handle = Sys_FileOpenWrite (name);
 	if (handle == -1)
@@ -1595,184 +1764,1400 @@ long COM_filelength (FILE *f)
 }
 
 /*
-===========
-COM_FindFile
+=============================================================================
 
-Finds the file in the search path.
-Sets com_filesize and one of handle or file
-If neither of file or handle is set, this
-can be used for detecting a file's presence.
-===========
+PAK FILE INDEX
+
+All pak directories in the search path are hashed into a single table
+which maps a file name to the highest priority pak that contains it.
+Loose files in game directories are still probed on disk in search
+order, so the priority between directories and paks is unchanged.
+
+Misses for optional files (external textures, .lit and .ent files)
+are remembered until the search path changes, which saves a disk probe
+per game directory on every retry.
+
+=============================================================================
 */
-static int COM_FindFile (const char *filename, int *handle, FILE **file,
-							unsigned int *path_id)
+
+typedef struct fsindex_s
 {
 	searchpath_t	*search;
-	char		netpath[MAX_OSPATH];
-	pack_t		*pak;
-	int		i, findtime;
+	packfile_t	*file;
+	struct fsindex_s	*next;
+} fsindex_t;
 
-	if (file && handle)
-		Sys_Error ("COM_FindFile: both handle and file set");
+typedef struct fsmiss_s
+{
+	struct fsmiss_s	*next;
+	char		name[1];	// variable sized
+} fsmiss_t;
 
-	file_from_pak = 0;
+#define	FS_MISS_HASHSIZE	256
+#define	FS_MAX_MISSES		4096
 
-//
-// search through the path, one element at a time
-//
-	for (search = com_searchpaths; search; search = search->next)
+static fsindex_t	*fs_index;
+static fsindex_t	**fs_hashtable;
+static unsigned int	fs_hashmask;
+static int		fs_numindexed;
+static qboolean		fs_index_dirty = true;
+
+static fsmiss_t		*fs_misses[FS_MISS_HASHSIZE];
+static int		fs_nummisses;
+
+static struct
+{
+	int	lookups;
+	int	pakhits;
+	int	dirhits;
+	int	misses;
+	int	cachedmisses;
+	int	rebuilds;
+} fs_indexstats;
+
+static struct	/* see BACKGROUND PREFETCH below */
+{
+	int	queued;
+	int	claimed;
+	int	waited;		// claims that blocked on a busy worker
+	int	unused;		// finished but never claimed
+} fs_prefetchstats;
+
+/*
+============
+COM_InvalidateFileIndex
+
+Must be called whenever the search path changes or when a file may
+have appeared in a game directory.
+============
+*/
+void COM_InvalidateFileIndex (void)
+{
+	fsmiss_t	*miss, *next;
+	int		i;
+
+	COM_FlushPrefetch ();	// jobs point into the old search path
+
+	for (i = 0; i < FS_MISS_HASHSIZE; i++)
 	{
-		if (search->pack)	/* look through all the pak file elements */
+		for (miss = fs_misses[i]; miss; miss = next)
 		{
-			pak = search->pack;
-			for (i = 0; i < pak->numfiles; i++)
-			{
-				if (strcmp(pak->files[i].name, filename) != 0)
-					continue;
-				// found it!
-				com_filesize = pak->files[i].filelen;
-				file_from_pak = 1;
-				if (path_id)
-					*path_id = search->path_id;
-				if (handle)
-				{
-					*handle = pak->handle;
-					Sys_FileSeek (pak->handle, pak->files[i].filepos);
-					return com_filesize;
-				}
-				else if (file)
-				{ /* open a new file on the pakfile */
-					*file = fopen (pak->filename, "rb");
-					if (*file)
-						fseek (*file, pak->files[i].filepos, SEEK_SET);
-					return com_filesize;
-				}
-				else /* for COM_FileExists() */
-				{
-					return com_filesize;
-				}
-			}
+			next = miss->next;
+			free (miss);
 		}
-		else	/* check a file in the directory tree */
-		{
-			if (!registered.value)
-			{ /* if not a registered version, don't ever go beyond base */
-				if ( strchr (filename, '/') || strchr (filename,'\\'))
-					continue;
-			}
+		fs_misses[i] = NULL;
+	}
+	fs_nummisses = 0;
+	fs_index_dirty = true;
+}
 
-			q_snprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
-			findtime = Sys_FileTime (netpath);
-			if (findtime == -1)
-				continue;
+/*
+============
+COM_RebuildFileIndex
+============
+*/
+static void COM_RebuildFileIndex (void)
+{
+	searchpath_t	*search;
+	fsindex_t	*entry, *other;
+	unsigned int	hash;
+	int		i, numfiles, tablesize;
+
+	free (fs_index);
+	free (fs_hashtable);
+	fs_index = NULL;
+	fs_hashtable = NULL;
+	fs_hashmask = 0;
+	fs_numindexed = 0;
+	fs_index_dirty = false;
+	fs_indexstats.rebuilds++;
+
+	numfiles = 0;
+	for (search = com_searchpaths; search; search = search->next)
+	{
+		if (search->pack)
+			numfiles += search->pack->numfiles;
+	}
+	if (!numfiles)
+		return;
 
-			if (path_id)
-				*path_id = search->path_id;
-			if (handle)
-			{
-				com_filesize = Sys_FileOpenRead (netpath, &i);
-				*handle = i;
-				return com_filesize;
-			}
-			else if (file)
-			{
-				*file = fopen (netpath, "rb");
-				com_filesize = (*file == NULL) ? -1 : COM_filelength (*file);
-				return com_filesize;
-			}
-			else
+	for (tablesize = 64; tablesize < numfiles; tablesize <<= 1)
+		;
+	fs_index = (fsindex_t *) malloc (numfiles * sizeof(fsindex_t));
+	fs_hashtable = (fsindex_t **) calloc (tablesize, sizeof(fsindex_t *));
+	if (!fs_index || !fs_hashtable)
+		Sys_Error ("COM_RebuildFileIndex: out of memory for %i files", numfiles);
+	fs_hashmask = tablesize - 1;
+
+	// walk the search path in priority order and only keep the first
+	// occurrence of each name, just like the linear search did.
+	entry = fs_index;
+	for (search = com_searchpaths; search; search = search->next)
+	{
+		if (!search->pack)
+			continue;
+		for (i = 0; i < search->pack->numfiles; i++)
+		{
+			hash = COM_HashString (search->pack->files[i].name) & fs_hashmask;
+			for (other = fs_hashtable[hash]; other; other = other->next)
 			{
-				return 0; /* dummy valid value for COM_FileExists() */
+				if (!strcmp(other->file->name, search->pack->files[i].name))
+					break;
 			}
+			if (other)
+				continue;
+			entry->search = search;
+			entry->file = &search->pack->files[i];
+			entry->next = fs_hashtable[hash];
+			fs_hashtable[hash] = entry;
+			entry++;
 		}
 	}
+	fs_numindexed = entry - fs_index;
+}
 
-	if (strcmp(COM_FileGetExtension(filename), "pcx") != 0
-		&& strcmp(COM_FileGetExtension(filename), "tga") != 0
-		&& strcmp(COM_FileGetExtension(filename), "lit") != 0
-		&& strcmp(COM_FileGetExtension(filename), "ent") != 0)
-		Con_DPrintf ("FindFile: can't find %s\n", filename);
-	else	Con_DPrintf2("FindFile: can't find %s\n", filename);
-		// Log pcx, tga, lit, ent misses only if (developer.value >= 2)
+static fsindex_t *COM_FindIndexedFile (const char *filename)
+{
+	fsindex_t	*entry;
 
-	if (handle)
-		*handle = -1;
-	if (file)
-		*file = NULL;
-	com_filesize = -1;
-	return com_filesize;
+	if (!fs_hashtable)
+		return NULL;
+	for (entry = fs_hashtable[COM_HashString(filename) & fs_hashmask]; entry; entry = entry->next)
+	{
+		if (!strcmp(entry->file->name, filename))
+			return entry;
+	}
+	return NULL;
 }
 
+static qboolean COM_FileIsOptional (const char *filename)
+{
+	const char	*ext = COM_FileGetExtension (filename);
 
-/*
-===========
-COM_FileExists
+	return (!strcmp(ext, "pcx") || !strcmp(ext, "tga") ||
+		!strcmp(ext, "lit") || !strcmp(ext, "ent"));
+}
 
-Returns whether the file is found in the quake filesystem.
-===========
-*/
-qboolean COM_FileExists (const char *filename, unsigned int *path_id)
+static qboolean COM_IsCachedMiss (const char *filename)
 {
-	int ret = COM_FindFile (filename, NULL, NULL, path_id);
-	return (ret == -1) ? false : true;
-}
+	fsmiss_t	*miss;
 
-/*
-===========
-COM_OpenFile
+	for (miss = fs_misses[COM_HashString(filename) & (FS_MISS_HASHSIZE - 1)]; miss; miss = miss->next)
+	{
+		if (!strcmp(miss->name, filename))
+			return true;
+	}
+	return false;
+}
 
-filename never has a leading slash, but may contain directory walks
-returns a handle and a length
-it may actually be inside a pak file
-===========
-*/
-int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id)
+static void COM_CacheMiss (const char *filename)
 {
-	return COM_FindFile (filename, handle, NULL, path_id);
+	fsmiss_t	*miss;
+	unsigned int	hash;
+	size_t		len;
+
+	if (fs_nummisses >= FS_MAX_MISSES)
+		return;
+	len = strlen (filename);
+	miss = (fsmiss_t *) malloc (sizeof(fsmiss_t) + len);
+	if (!miss)
+		return;
+	memcpy (miss->name, filename, len + 1);
+	hash = COM_HashString (filename) & (FS_MISS_HASHSIZE - 1);
+	miss->next = fs_misses[hash];
+	fs_misses[hash] = miss;
+	fs_nummisses++;
 }
 
 /*
-===========
-COM_FOpenFile
-
-If the requested file is inside a packfile, a new FILE * will be opened
-into the file.
-===========
+============
+COM_FileIndex_f
+============
 */
-int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id)
+static void COM_FileIndex_f (void)
 {
-	return COM_FindFile (filename, NULL, file, path_id);
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+	{
+		memset (&fs_indexstats, 0, sizeof(fs_indexstats));
+		memset (&fs_prefetchstats, 0, sizeof(fs_prefetchstats));
+		return;
+	}
+
+	if (fs_index_dirty)
+		COM_RebuildFileIndex ();
+	Con_Printf ("%i pak files indexed in %i buckets, %i rebuilds\n",
+		fs_numindexed, fs_hashtable ? (int)(fs_hashmask + 1) : 0,
+		fs_indexstats.rebuilds);
+	Con_Printf ("lookups: %i\n", fs_indexstats.lookups);
+	Con_Printf ("pak hits: %i\n", fs_indexstats.pakhits);
+	Con_Printf ("dir hits: %i\n", fs_indexstats.dirhits);
+	Con_Printf ("misses: %i (%i from cache, %i names cached)\n",
+		fs_indexstats.misses, fs_indexstats.cachedmisses, fs_nummisses);
+	Con_Printf ("prefetch: %i queued, %i claimed (%i waited), %i unused\n",
+		fs_prefetchstats.queued, fs_prefetchstats.claimed,
+		fs_prefetchstats.waited, fs_prefetchstats.unused);
 }
 
 /*
-============
-COM_CloseFile
+=============================================================================
 
-If it is a pak file handle, don't really close it
-============
+ZIP (PK3) ARCHIVES
+
+The central directory of a zip is read once into the same packfile_t
+table an id pak uses, so zip entries go through the pak index like any
+other file. Local headers are parsed when an entry is first opened.
+Deflated entries need zlib; without it they are left out of the table.
+
+=============================================================================
 */
-void COM_CloseFile (int h)
-{
-	searchpath_t	*s;
 
-	for (s = com_searchpaths; s; s = s->next)
-		if (s->pack && s->pack->handle == h)
-			return;
+#define	ZIP_LOCAL_SIG		0x04034b50
+#define	ZIP_CDIR_SIG		0x02014b50
+#define	ZIP_EOCD_SIG		0x06054b50
+#define	ZIP_LOCAL_SIZE		30
+#define	ZIP_CDIR_SIZE		46
+#define	ZIP_EOCD_SIZE		22
+#define	ZIP_MAX_COMMENT		65535
 
-	Sys_FileClose (h);
+#define	ZIP_STORED		0
+#define	ZIP_DEFLATED		8
+
+static unsigned int ZIP_Short (const byte *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int ZIP_Long (const byte *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
 }
 
+static qboolean ZIP_MethodSupported (unsigned int method, unsigned int complen, unsigned int len)
+{
+	if (method == ZIP_STORED)
+		return complen == len;
+#ifdef USE_ZLIB
+	if (method == ZIP_DEFLATED)
+		return true;
+#endif
+	return false;
+}
 
 /*
 ============
-COM_LoadFile
+COM_ResolveZipEntry
 
-Filename are reletive to the quake directory.
-Allways appends a 0 byte.
+Skips the local header of a zip entry, leaving filepos at its data.
 ============
 */
-#define	LOADFILE_ZONE		0
-#define	LOADFILE_HUNK		1
+static qboolean COM_ResolveZipEntry (pack_t *pak, packfile_t *file)
+{
+	byte	header[ZIP_LOCAL_SIZE];
+
+	Sys_FileSeek (pak->handle, file->filepos);
+	if (Sys_FileRead (pak->handle, header, ZIP_LOCAL_SIZE) != ZIP_LOCAL_SIZE ||
+	    ZIP_Long (header) != ZIP_LOCAL_SIG)
+	{
+		Con_Printf ("Bad zip entry %s in %s\n", file->name, pak->filename);
+		return false;
+	}
+	file->filepos += ZIP_LOCAL_SIZE + ZIP_Short (header + 26) + ZIP_Short (header + 28);
+	file->zipheader = false;
+	return true;
+}
+
+#ifdef USE_ZLIB
+#define	ZIP_BUFFERSIZE		16384
+
+/* For a deflated entry, fh->start and fh->pos are offsets into the
+ * inflated data, so codecs can still narrow the window by moving start.
+ * The stream only ever inflates forward: it catches up to start + pos
+ * lazily on the next read, and restarts from the beginning of the
+ * entry when that lies behind. */
+typedef struct zipstream_s
+{
+	z_stream	strm;
+	long		compstart;	// file offset of the deflated data
+	long		complen;	// size of the deflated data
+	long		compread;	// deflated bytes fed to zlib so far
+	long		outpos;		// inflated bytes produced so far
+	byte		buffer[ZIP_BUFFERSIZE];
+} zipstream_t;
+
+static qboolean FS_ZipOpen (fshandle_t *fh, long complen)
+{
+	zipstream_t	*zs;
+
+	zs = (zipstream_t *) calloc (1, sizeof(zipstream_t));
+	if (!zs)
+		return false;
+	if (inflateInit2 (&zs->strm, -MAX_WBITS) != Z_OK)	// raw deflate, no zlib header
+	{
+		free (zs);
+		return false;
+	}
+	zs->compstart = fh->start;
+	zs->complen = complen;
+	fh->zip = zs;
+	fh->start = 0;
+	fh->pos = 0;
+	return true;
+}
+
+static void FS_ZipClose (fshandle_t *fh)
+{
+	inflateEnd (&fh->zip->strm);
+	free (fh->zip);
+	fh->zip = NULL;
+}
+
+static long FS_ZipInflate (fshandle_t *fh, void *ptr, long len)
+{
+	zipstream_t	*zs = fh->zip;
+	size_t		count;
+	int		err;
+
+	zs->strm.next_out = (Bytef *) ptr;
+	zs->strm.avail_out = len;
+	while (zs->strm.avail_out)
+	{
+		if (!zs->strm.avail_in && zs->compread < zs->complen)
+		{
+			count = q_min (ZIP_BUFFERSIZE, zs->complen - zs->compread);
+			count = fread (zs->buffer, 1, count, fh->file);
+			if (!count)
+				break;
+			zs->compread += count;
+			zs->strm.next_in = zs->buffer;
+			zs->strm.avail_in = count;
+		}
+		err = inflate (&zs->strm, Z_NO_FLUSH);
+		if (err == Z_STREAM_END)
+			break;
+		if (err != Z_OK)
+		{
+			if (err != Z_BUF_ERROR)
+				errno = EIO;
+			break;
+		}
+	}
+
+	len -= zs->strm.avail_out;
+	zs->outpos += len;
+	return len;
+}
+
+static qboolean FS_ZipSync (fshandle_t *fh)
+{
+	zipstream_t	*zs = fh->zip;
+	byte		junk[1024];
+	long		target, count;
+
+	target = fh->start + fh->pos;
+	if (target < zs->outpos)
+	{	// can't inflate backwards, start over
+		inflateReset (&zs->strm);
+		zs->strm.avail_in = 0;
+		zs->compread = 0;
+		zs->outpos = 0;
+		clearerr (fh->file);
+		fseek (fh->file, zs->compstart, SEEK_SET);
+	}
+	while (zs->outpos < target)
+	{
+		count = q_min ((long) sizeof(junk), target - zs->outpos);
+		if (FS_ZipInflate (fh, junk, count) != count)
+			return false;
+	}
+	return true;
+}
+
+static long FS_ZipRead (fshandle_t *fh, void *ptr, long len)
+{
+	if (!FS_ZipSync (fh))
+		return 0;
+	len = FS_ZipInflate (fh, ptr, len);
+	fh->pos += len;
+	return len;
+}
+
+/*
+============
+COM_InflateToTempFile
+
+stdio users can't read a deflated entry in place, so hand them an
+inflated copy in a temporary file instead. closes f.
+============
+*/
+static FILE *COM_InflateToTempFile (FILE *f, packfile_t *file)
+{
+	fshandle_t	fh;
+	FILE		*tmp;
+	byte		buf[4096];
+	long		count, total;
+
+	memset (&fh, 0, sizeof(fh));
+	fh.file = f;
+	fh.start = ftell (f);
+	fh.length = file->filelen;
+	tmp = tmpfile ();
+	if (!tmp || !FS_ZipOpen (&fh, file->deflatedlen))
+	{
+		Con_Printf ("Couldn't inflate %s\n", file->name);
+		if (tmp)
+			fclose (tmp);
+		fclose (f);
+		return NULL;
+	}
+
+	total = 0;
+	while ((count = FS_ZipRead (&fh, buf, q_min((long) sizeof(buf), fh.length - fh.pos))) > 0)
+	{
+		fwrite (buf, 1, count, tmp);
+		total += count;
+	}
+	FS_fclose (&fh);
+	if (total != file->filelen)
+		Con_Printf ("%s: inflated %ld of %d bytes\n", file->name, total, file->filelen);
+
+	rewind (tmp);
+	return tmp;
+}
+
+/*
+============
+COM_ReadDeflated
+
+Inflates a whole zip entry into buf, for COM_LoadFile and the prefetch
+workers. Only touches its own file handle, so it is thread safe.
+============
+*/
+static int COM_ReadDeflated (const char *zipfile, int filepos, int filelen, int deflatedlen, byte *buf)
+{
+	fshandle_t	fh;
+	long		count;
+
+	memset (&fh, 0, sizeof(fh));
+	fh.file = fopen (zipfile, "rb");
+	if (!fh.file)
+		return 0;
+	fh.start = filepos;
+	fh.length = filelen;
+	fseek (fh.file, fh.start, SEEK_SET);
+	if (!FS_ZipOpen (&fh, deflatedlen))
+	{
+		fclose (fh.file);
+		return 0;
+	}
+	count = FS_ZipRead (&fh, buf, filelen);
+	FS_fclose (&fh);
+	return count;
+}
+#endif	/* USE_ZLIB */
+
+/*
+=============================================================================
+
+FILE I/O STATISTICS
+
+Every file that is looked up gets a record of where it was found, how
+often it was looked up and opened, how much was read from it, how often
+it was seeked in and how long all that took, and which subsystem asked
+for it last. "fs_stats" lists the worst files; with fs_stats_dump set
+the records are written to fsstats_<map>.csv in the game dir after each
+map load and then cleared, so every file covers one load.
+
+=============================================================================
+*/
+
+#define	FS_STATS_HASHSIZE	1024
+#define	FS_MAX_STATS		8192
+
+typedef struct fsstat_s
+{
+	char		name[MAX_QPATH];
+	char		source[MAX_QPATH];	// gamedir/pak or gamedir it came from
+	const char	*requester;
+	int		lookups;
+	int		opens;
+	int		seeks;
+	int		bytes;
+	double		time;
+	struct fsstat_s	*next;
+} fsstat_t;
+
+cvar_t		fs_stats_dump = {"fs_stats_dump", "0", CVAR_NONE};
+
+static fsstat_t		*fs_stats[FS_STATS_HASHSIZE];
+static int		fs_numstats;
+static int		fs_untracked;	// lookups after FS_MAX_STATS was reached
+static const char	*fs_requester = "engine";
+
+/*
+============
+COM_SetFileRequester
+
+Names the subsystem that the following file accesses are made for and
+returns the previous one, which the caller should restore when done.
+============
+*/
+const char *COM_SetFileRequester (const char *requester)
+{
+	const char	*old = fs_requester;
+
+	fs_requester = requester;
+	return old;
+}
+
+static fsstat_t *COM_FileStat (const char *filename)
+{
+	fsstat_t	*stat;
+	unsigned int	hash;
+
+	if (strlen(filename) >= MAX_QPATH)
+		return NULL;
+
+	hash = COM_HashString (filename) & (FS_STATS_HASHSIZE - 1);
+	for (stat = fs_stats[hash]; stat; stat = stat->next)
+	{
+		if (!strcmp(stat->name, filename))
+			return stat;
+	}
+
+	if (fs_numstats >= FS_MAX_STATS)
+	{
+		fs_untracked++;
+		return NULL;
+	}
+	stat = (fsstat_t *) calloc (1, sizeof(fsstat_t));
+	if (!stat)
+		return NULL;
+	q_strlcpy (stat->name, filename, sizeof(stat->name));
+	stat->next = fs_stats[hash];
+	fs_stats[hash] = stat;
+	fs_numstats++;
+	return stat;
+}
+
+/* the records are only zeroed: open streams keep pointing at theirs */
+static void COM_ClearFileStats (void)
+{
+	fsstat_t	*stat;
+	int		i;
+
+	for (i = 0; i < FS_STATS_HASHSIZE; i++)
+	{
+		for (stat = fs_stats[i]; stat; stat = stat->next)
+		{
+			stat->lookups = stat->opens = stat->seeks = stat->bytes = 0;
+			stat->time = 0;
+		}
+	}
+	fs_untracked = 0;
+}
+
+static int COM_CompareFileStats (const void *a, const void *b)
+{
+	const fsstat_t	*sa = *(const fsstat_t **) a;
+	const fsstat_t	*sb = *(const fsstat_t **) b;
+
+	if (sa->time != sb->time)
+		return (sa->time < sb->time) ? 1 : -1;
+	return sb->bytes - sa->bytes;
+}
+
+/* returns the records used since the last reset, sorted by time spent,
+   worst first. free() it. */
+static fsstat_t **COM_SortedFileStats (int *count)
+{
+	fsstat_t	**list, *stat;
+	int		i;
+
+	list = (fsstat_t **) malloc ((fs_numstats + 1) * sizeof(fsstat_t *));
+	if (!list)
+		return NULL;
+	for (i = *count = 0; i < FS_STATS_HASHSIZE; i++)
+	{
+		for (stat = fs_stats[i]; stat; stat = stat->next)
+		{
+			if (stat->lookups || stat->bytes || stat->seeks)
+				list[(*count)++] = stat;
+		}
+	}
+	qsort (list, *count, sizeof(fsstat_t *), COM_CompareFileStats);
+	return list;
+}
+
+/* "gamedir/pak0.pak" or "gamedir", enough to tell search paths apart */
+static const char *COM_ShortSourceName (const char *path, qboolean pak)
+{
+	const char	*p, *last = NULL, *prev = NULL;
+
+	for (p = path; *p; p++)
+	{
+		if (*p == '/' || *p == '\\')
+		{
+			prev = last;
+			last = p;
+		}
+	}
+	if (!last)
+		return path;
+	if (pak && prev)	// keep the gamedir of a pak
+		return prev + 1;
+	return last + 1;
+}
+
+static qboolean COM_WriteFileStats (const char *filename)
+{
+	fsstat_t	**list;
+	FILE		*f;
+	int		i, count;
+
+	list = COM_SortedFileStats (&count);
+	if (!list)
+		return false;
+	f = fopen (filename, "w");
+	if (!f)
+	{
+		free (list);
+		return false;
+	}
+	fprintf (f, "file,source,requester,lookups,opens,seeks,bytes,msec\n");
+	for (i = 0; i < count; i++)
+	{
+		fprintf (f, "\"%s\",\"%s\",%s,%i,%i,%i,%i,%.3f\n",
+			list[i]->name, list[i]->source, list[i]->requester,
+			list[i]->lookups, list[i]->opens, list[i]->seeks,
+			list[i]->bytes, list[i]->time * 1000.0);
+	}
+	fclose (f);
+	free (list);
+	return true;
+}
+
+/*
+============
+COM_DumpFileStats
+
+Called when a map has finished loading. Writes the records gathered
+since the last dump to a CSV file if fs_stats_dump is set.
+============
+*/
+void COM_DumpFileStats (const char *mapname)
+{
+	char	name[MAX_OSPATH];
+
+	if (!fs_stats_dump.value || !fs_numstats)
+		return;
+
+	q_snprintf (name, sizeof(name), "%s/fsstats_%s.csv", com_gamedir, mapname);
+	if (COM_WriteFileStats (name))
+		Con_DPrintf ("wrote %s\n", name);
+	else
+		Con_Printf ("COM_DumpFileStats: couldn't write %s\n", name);
+	COM_ClearFileStats ();
+}
+
+/*
+============
+COM_FileStats_f
+
+fs_stats [count]		list the files that took longest
+fs_stats reset
+fs_stats dump <file>		write all records as CSV into the game dir
+============
+*/
+static void COM_FileStats_f (void)
+{
+	fsstat_t	**list;
+	char		name[MAX_OSPATH];
+	double		time = 0;
+	int		i, count, num, bytes = 0, lookups = 0;
+
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+	{
+		COM_ClearFileStats ();
+		return;
+	}
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "dump"))
+	{
+		if (Cmd_Argc() != 3 || strstr(Cmd_Argv(2), ".."))
+		{
+			Con_Printf ("usage: fs_stats dump <file.csv>\n");
+			return;
+		}
+		q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv(2));
+		if (COM_WriteFileStats (name))
+			Con_Printf ("wrote %s\n", name);
+		else
+			Con_Printf ("couldn't write %s\n", name);
+		return;
+	}
+
+	count = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 20;
+	list = COM_SortedFileStats (&num);
+	if (!list)
+		return;
+
+	Con_Printf ("   msec    bytes seek look requester  file (source)\n");
+	for (i = 0; i < num; i++)
+	{
+		if (i < count)
+		{
+			Con_Printf ("%7.2f %8i %4i %4i %-10s %s (%s)\n",
+				list[i]->time * 1000.0, list[i]->bytes, list[i]->seeks,
+				list[i]->lookups, list[i]->requester, list[i]->name,
+				list[i]->source[0] ? list[i]->source : "not found");
+		}
+		time += list[i]->time;
+		bytes += list[i]->bytes;
+		lookups += list[i]->lookups;
+	}
+	Con_Printf ("%i files, %i lookups, %i bytes, %.2f msec\n",
+		num, lookups, bytes, time * 1000.0);
+	if (fs_untracked)
+		Con_Printf ("%i lookups not tracked, table full\n", fs_untracked);
+	free (list);
+}
+
+/*
+===========
+COM_SearchFile
+
+Does the actual lookup for COM_FindFile.
+===========
+*/
+static int COM_SearchFile (const char *filename, int *handle, FILE **file,
+							unsigned int *path_id)
+{
+	searchpath_t	*search;
+	char		netpath[MAX_OSPATH];
+	pack_t		*pak;
+	fsindex_t	*found;
+	qboolean	optional;
+	int		i, findtime;
+
+	file_from_pak = 0;
+	com_foundpak = NULL;
+	com_foundfile = NULL;
+	com_foundsearch = NULL;
+
+	if (fs_index_dirty)
+		COM_RebuildFileIndex ();
+	fs_indexstats.lookups++;
+
+	optional = COM_FileIsOptional (filename);
+	if (optional && COM_IsCachedMiss (filename))
+	{
+		fs_indexstats.misses++;
+		fs_indexstats.cachedmisses++;
+		goto _notfound;
+	}
+
+	found = COM_FindIndexedFile (filename);
+
+//
+// search through the path, one element at a time
+//
+	for (search = com_searchpaths; search; search = search->next)
+	{
+		if (search->pack)	/* the index knows the only pak that can serve it */
+		{
+			if (!found || found->search != search)
+				continue;
+			// found it!
+			pak = search->pack;
+			if (found->file->zipheader && !COM_ResolveZipEntry (pak, found->file))
+				continue;
+			fs_indexstats.pakhits++;
+			com_filesize = found->file->filelen;
+			file_from_pak = 1;
+			com_foundpak = pak;
+			com_foundfile = found->file;
+			com_foundsearch = search;
+			q_strlcpy (com_foundpath, pak->filename, sizeof(com_foundpath));
+			if (path_id)
+				*path_id = search->path_id;
+			if (handle)
+			{
+				*handle = pak->handle;
+				Sys_FileSeek (pak->handle, found->file->filepos);
+				return com_filesize;
+			}
+			else if (file)
+			{ /* open a new file on the pakfile */
+				*file = fopen (pak->filename, "rb");
+				if (*file)
+					fseek (*file, found->file->filepos, SEEK_SET);
+				return com_filesize;
+			}
+			else /* for COM_FileExists() */
+			{
+				return com_filesize;
+			}
+		}
+		else	/* check a file in the directory tree */
+		{
+			if (!registered.value)
+			{ /* if not a registered version, don't ever go beyond base */
+				if ( strchr (filename, '/') || strchr (filename,'\\'))
+					continue;
+			}
+
+			q_snprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
+			findtime = Sys_FileTime (netpath);
+			if (findtime == -1)
+				continue;
+
+			fs_indexstats.dirhits++;
+			q_strlcpy (com_foundpath, netpath, sizeof(com_foundpath));
+			com_foundsearch = search;
+			if (path_id)
+				*path_id = search->path_id;
+			if (handle)
+			{
+				com_filesize = Sys_FileOpenRead (netpath, &i);
+				*handle = i;
+				return com_filesize;
+			}
+			else if (file)
+			{
+				*file = fopen (netpath, "rb");
+				com_filesize = (*file == NULL) ? -1 : COM_filelength (*file);
+				return com_filesize;
+			}
+			else
+			{
+				return 0; /* dummy valid value for COM_FileExists() */
+			}
+		}
+	}
+
+	fs_indexstats.misses++;
+	if (!optional)
+		Con_DPrintf ("FindFile: can't find %s\n", filename);
+	else
+	{	// Log pcx, tga, lit, ent misses only if (developer.value >= 2)
+		Con_DPrintf2("FindFile: can't find %s\n", filename);
+		COM_CacheMiss (filename);
+	}
+
+_notfound:
+	if (handle)
+		*handle = -1;
+	if (file)
+		*file = NULL;
+	com_filesize = -1;
+	return com_filesize;
+}
+
+/*
+===========
+COM_FindFile
+
+Finds the file in the search path.
+Sets com_filesize and one of handle or file
+If neither of file or handle is set, this
+can be used for detecting a file's presence.
+===========
+*/
+static int COM_FindFile (const char *filename, int *handle, FILE **file,
+							unsigned int *path_id)
+{
+	fsstat_t	*stat;
+	double		time;
+	int		len;
+
+	if (file && handle)
+		Sys_Error ("COM_FindFile: both handle and file set");
+
+	time = Sys_PreciseTime ();
+	len = COM_SearchFile (filename, handle, file, path_id);
+
+	com_foundstat = stat = COM_FileStat (filename);
+	if (stat)
+	{
+		stat->lookups++;
+		stat->requester = fs_requester;
+		if (com_foundsearch)
+		{
+			if (com_foundpak)
+				q_strlcpy (stat->source, COM_ShortSourceName (com_foundpak->filename, true), sizeof(stat->source));
+			else
+				q_strlcpy (stat->source, COM_ShortSourceName (com_foundsearch->filename, false), sizeof(stat->source));
+			if (handle || file)
+			{
+				stat->opens++;
+				if (com_foundpak)
+					stat->seeks++;
+			}
+		}
+		stat->time += Sys_PreciseTime () - time;
+	}
+	return len;
+}
+
+/*
+============
+COM_TraceRead
+
+Adds a read of the file that was found last to its I/O record.
+============
+*/
+static void COM_TraceRead (int bytes, double starttime)
+{
+	if (com_foundstat)
+	{
+		com_foundstat->bytes += bytes;
+		com_foundstat->time += Sys_PreciseTime () - starttime;
+	}
+}
+
+
+/*
+===========
+COM_FileExists
+
+Returns whether the file is found in the quake filesystem.
+===========
+*/
+qboolean COM_FileExists (const char *filename, unsigned int *path_id)
+{
+	int ret = COM_FindFile (filename, NULL, NULL, path_id);
+	return (ret == -1) ? false : true;
+}
+
+/*
+===========
+COM_OpenFile
+
+filename never has a leading slash, but may contain directory walks
+returns a handle and a length
+it may actually be inside a pak file
+===========
+*/
+int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id)
+{
+	return COM_FindFile (filename, handle, NULL, path_id);
+}
+
+/*
+===========
+COM_FOpenFile
+
+If the requested file is inside a packfile, a new FILE * will be opened
+into the file.
+===========
+*/
+int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id)
+{
+	int	len;
+
+	len = COM_FindFile (filename, NULL, file, path_id);
+#ifdef USE_ZLIB
+	if (*file && com_foundfile && com_foundfile->deflatedlen)
+	{
+		*file = COM_InflateToTempFile (*file, com_foundfile);
+		if (!*file)
+			len = com_filesize = -1;
+	}
+#endif
+	return len;
+}
+
+/*
+===========
+COM_FOpenStream
+
+Opens the file for the FS_*() functions. Deflated zip entries are
+inflated while they are read instead of up front.
+===========
+*/
+int COM_FOpenStream (const char *filename, fshandle_t *fh, unsigned int *path_id)
+{
+	FILE	*f;
+	int	len;
+
+	memset (fh, 0, sizeof(fshandle_t));
+	len = COM_FindFile (filename, NULL, &f, path_id);
+	if (len == -1 || !f)
+		return -1;
+
+	fh->file = f;
+	fh->pak = file_from_pak;
+	fh->start = ftell (f);
+	fh->length = len;
+	fh->stat = com_foundstat;
+#ifdef USE_ZLIB
+	if (com_foundfile && com_foundfile->deflatedlen && !FS_ZipOpen (fh, com_foundfile->deflatedlen))
+	{
+		fclose (f);
+		return -1;
+	}
+#endif
+	return len;
+}
+
+/*
+============
+COM_CloseFile
+
+If it is a pak file handle, don't really close it
+============
+*/
+void COM_CloseFile (int h)
+{
+	searchpath_t	*s;
+
+	for (s = com_searchpaths; s; s = s->next)
+		if (s->pack && s->pack->handle == h)
+			return;
+
+	Sys_FileClose (h);
+}
+
+
+/*
+=============================================================================
+
+BACKGROUND PREFETCH
+
+When a list of files is known to be loaded soon (the precache lists in
+the serverinfo message, or a map and its .lit/.ent), the main thread
+looks them up and queues them here. A few worker threads then read or
+inflate them into malloc'd memory, or fault in their pages if the pak
+is mapped. COM_LoadFile claims the finished data instead of reading
+the file itself, so the main thread only waits for the disk when it
+catches up with the workers.
+
+Workers never touch the search path, the hunk or the console; lookups,
+allocation and parsing all stay on the main thread.
+
+=============================================================================
+*/
+
+#define	MAX_PREFETCH_THREADS	4
+#define	MAX_PREFETCH_BYTES	(64 * 1024 * 1024)
+
+typedef enum
+{
+	PF_QUEUED,
+	PF_BUSY,
+	PF_DONE
+} pfstate_t;
+
+typedef struct prefetch_s
+{
+	char		name[MAX_QPATH];
+	char		source[MAX_OSPATH];	// pak or loose file to read
+	int		filepos, filelen;
+	int		deflatedlen;
+	const byte	*mapped;	// in a mapped pak, only fault the pages in
+	byte		*data;		// malloc'd file contents, set by the worker
+	pfstate_t	state;
+	struct prefetch_s	*next;
+} prefetch_t;
+
+cvar_t		fs_prefetch = {"fs_prefetch", "1", CVAR_NONE};
+
+static prefetch_t	*prefetch_jobs;		// in queue order
+static int		prefetch_bytes;
+static int		prefetch_numthreads;
+static SDL_Thread	*prefetch_threads[MAX_PREFETCH_THREADS];
+static qboolean		prefetch_quit;		// COM_ShutdownPrefetch wants the threads back
+static SDL_mutex	*prefetch_lock;
+static SDL_cond		*prefetch_wake;		// a job was queued
+static SDL_cond		*prefetch_done;		// a job was finished
+
+static void COM_RunPrefetch (prefetch_t *job)
+{
+	volatile byte	sum;
+	FILE		*f;
+	int		i;
+
+	if (job->mapped)
+	{
+		for (i = 0, sum = 0; i < job->filelen; i += 4096)
+			sum += job->mapped[i];
+		return;
+	}
+
+	job->data = (byte *) malloc (job->filelen);
+	if (!job->data)
+		return;
+#ifdef USE_ZLIB
+	if (job->deflatedlen)
+	{
+		if (COM_ReadDeflated (job->source, job->filepos, job->filelen, job->deflatedlen, job->data) == job->filelen)
+			return;
+	}
+	else
+#endif
+	if ((f = fopen (job->source, "rb")) != NULL)
+	{
+		fseek (f, job->filepos, SEEK_SET);
+		i = fread (job->data, 1, job->filelen, f);
+		fclose (f);
+		if (i == job->filelen)
+			return;
+	}
+	free (job->data);	// the main thread will read it itself
+	job->data = NULL;
+}
+
+static int COM_PrefetchThread (void *unused)
+{
+	prefetch_t	*job;
+
+	SDL_LockMutex (prefetch_lock);
+	while (!prefetch_quit)
+	{
+		for (job = prefetch_jobs; job; job = job->next)
+		{
+			if (job->state == PF_QUEUED)
+				break;
+		}
+		if (!job)
+		{
+			SDL_CondWait (prefetch_wake, prefetch_lock);
+			continue;
+		}
+
+		job->state = PF_BUSY;
+		SDL_UnlockMutex (prefetch_lock);
+		COM_RunPrefetch (job);
+		SDL_LockMutex (prefetch_lock);
+		job->state = PF_DONE;
+		SDL_CondBroadcast (prefetch_done);
+	}
+	SDL_UnlockMutex (prefetch_lock);
+	return 0;
+}
+
+static qboolean COM_StartPrefetchThreads (void)
+{
+	SDL_Thread	*thread;
+
+	if (prefetch_numthreads)
+		return true;
+	if (prefetch_numthreads == -1)
+		return false;	// failed before
+
+	prefetch_lock = SDL_CreateMutex ();
+	prefetch_wake = SDL_CreateCond ();
+	prefetch_done = SDL_CreateCond ();
+	if (!prefetch_lock || !prefetch_wake || !prefetch_done)
+	{
+		prefetch_numthreads = -1;
+		return false;
+	}
+	while (prefetch_numthreads < CLAMP(1, host_parms->numcpus - 1, MAX_PREFETCH_THREADS))
+	{
+#if defined(USE_SDL2)
+		thread = SDL_CreateThread (COM_PrefetchThread, "prefetch", NULL);
+#else
+		thread = SDL_CreateThread (COM_PrefetchThread, NULL);
+#endif
+		if (!thread)
+			break;
+		prefetch_threads[prefetch_numthreads++] = thread;
+	}
+	if (!prefetch_numthreads)
+	{
+		prefetch_numthreads = -1;
+		return false;
+	}
+	return true;
+}
+
+/*
+============
+COM_PrefetchFile
+
+Starts reading the file in the background. Missing files are ignored.
+============
+*/
+void COM_PrefetchFile (const char *path)
+{
+	prefetch_t	*job, **link;
+	int		len;
+
+	if (!fs_prefetch.value || !COM_StartPrefetchThreads ())
+		return;
+
+	SDL_LockMutex (prefetch_lock);
+	for (link = &prefetch_jobs; *link; link = &(*link)->next)
+	{
+		if (!strcmp((*link)->name, path))
+			break;
+	}
+	SDL_UnlockMutex (prefetch_lock);
+	if (*link)
+		return;	// already queued
+	if (strlen(path) >= MAX_QPATH)
+		return;
+
+	len = COM_FindFile (path, NULL, NULL, NULL);
+	if (len >= 0 && !com_foundfile)
+	{	// loose file, COM_FindFile doesn't give its size
+		FILE	*f = fopen (com_foundpath, "rb");
+		len = f ? COM_filelength (f) : -1;
+		if (f)
+			fclose (f);
+	}
+	if (len <= 0 || prefetch_bytes + len > MAX_PREFETCH_BYTES)
+		return;
+
+	job = (prefetch_t *) calloc (1, sizeof(prefetch_t));
+	if (!job)
+		return;
+	q_strlcpy (job->name, path, sizeof(job->name));
+	q_strlcpy (job->source, com_foundpath, sizeof(job->source));
+	job->filelen = len;
+	if (com_foundfile)
+	{
+		job->filepos = com_foundfile->filepos;
+		job->deflatedlen = com_foundfile->deflatedlen;
+		if (com_foundpak->mapbase && !job->deflatedlen &&
+		    job->filepos >= 0 && len <= com_foundpak->mapsize - job->filepos)
+			job->mapped = com_foundpak->mapbase + job->filepos;
+	}
+	if (!job->mapped)
+		prefetch_bytes += len;
+	fs_prefetchstats.queued++;
+
+	SDL_LockMutex (prefetch_lock);
+	job->state = PF_QUEUED;
+	*link = job;
+	SDL_CondSignal (prefetch_wake);
+	SDL_UnlockMutex (prefetch_lock);
+}
+
+/*
+============
+COM_ClaimPrefetch
+
+Takes the prefetch job for path out of the queue, waiting for it if a
+worker is on it. Copies its data to buf and returns true if it read the
+whole file; otherwise the caller has to load the file itself. A NULL
+buf only waits for the job, which is enough for mapped paks.
+============
+*/
+static qboolean COM_ClaimPrefetch (const char *path, byte *buf, int len)
+{
+	prefetch_t	*job, **link;
+	qboolean	ok;
+
+	if (!prefetch_jobs)
+		return false;
+
+	SDL_LockMutex (prefetch_lock);
+	for (link = &prefetch_jobs; *link; link = &(*link)->next)
+	{
+		if (!strcmp((*link)->name, path))
+			break;
+	}
+	job = *link;
+	if (!job)
+	{
+		SDL_UnlockMutex (prefetch_lock);
+		return false;
+	}
+	if (job->state == PF_BUSY)
+	{
+		fs_prefetchstats.waited++;
+		while (job->state == PF_BUSY)
+			SDL_CondWait (prefetch_done, prefetch_lock);
+	}
+	ok = (job->state == PF_DONE && (job->data || job->mapped) && job->filelen == len);
+	*link = job->next;	// not queued or busy anymore, safe to drop
+	SDL_UnlockMutex (prefetch_lock);
+
+	if (ok && buf && job->data)
+		memcpy (buf, job->data, len);
+	if (ok)
+		fs_prefetchstats.claimed++;
+	if (buf && !job->data)
+		ok = false;	// only faulted in, the caller reads it
+	if (!job->mapped)
+		prefetch_bytes -= job->filelen;
+	free (job->data);
+	free (job);
+	return ok;
+}
+
+/*
+============
+COM_FlushPrefetch
+
+Drops all prefetched data which wasn't claimed, waiting for busy
+workers. Call it once the files that were prefetched have been loaded.
+============
+*/
+void COM_FlushPrefetch (void)
+{
+	prefetch_t	*job;
+
+	if (!prefetch_jobs)
+		return;
+
+	SDL_LockMutex (prefetch_lock);
+	while ((job = prefetch_jobs) != NULL)
+	{
+		if (job->state == PF_BUSY)
+		{
+			SDL_CondWait (prefetch_done, prefetch_lock);
+			continue;
+		}
+		if (job->state == PF_DONE)
+			fs_prefetchstats.unused++;
+		prefetch_jobs = job->next;
+		free (job->data);
+		free (job);
+	}
+	prefetch_bytes = 0;
+	SDL_UnlockMutex (prefetch_lock);
+}
+
+/*
+============
+COM_ShutdownPrefetch
+
+Drops the queue and joins the workers.
+============
+*/
+void COM_ShutdownPrefetch (void)
+{
+	int		i;
+
+	if (prefetch_numthreads <= 0)
+		return;
+
+	COM_FlushPrefetch ();
+	SDL_LockMutex (prefetch_lock);
+	prefetch_quit = true;
+	SDL_CondBroadcast (prefetch_wake);
+	SDL_UnlockMutex (prefetch_lock);
+	for (i = 0; i < prefetch_numthreads; i++)
+		SDL_WaitThread (prefetch_threads[i], NULL);
+
+	SDL_DestroyCond (prefetch_done);
+	SDL_DestroyCond (prefetch_wake);
+	SDL_DestroyMutex (prefetch_lock);
+	prefetch_numthreads = -1;
+}
+
+/*
+============
+COM_LoadFile
+
+Filename are reletive to the quake directory.
+Allways appends a 0 byte.
+============
+*/
+#define	LOADFILE_ZONE		0
+#define	LOADFILE_HUNK		1
 #define	LOADFILE_TEMPHUNK	2
 #define	LOADFILE_CACHE		3
 #define	LOADFILE_STACK		4
@@ -1788,6 +3173,11 @@ byte *COM_LoadFile (const char *path, int usehunk, unsigned int *path_id)
 	byte	*buf;
 	char	base[32];
 	int		len;
+	double	time;
+#ifdef USE_ZLIB
+	pack_t		*pak;
+	packfile_t	*file;
+#endif
 
 	buf = NULL;	// quiet compiler warning
 
@@ -1795,6 +3185,10 @@ byte *COM_LoadFile (const char *path, int usehunk, unsigned int *path_id)
 	len = COM_OpenFile (path, &h, path_id);
 	if (h == -1)
 		return NULL;
+#ifdef USE_ZLIB
+	pak = com_foundpak;
+	file = com_foundfile;
+#endif
 
 // extract the filename base name for hunk tag
 	COM_FileBase (path, base, sizeof(base));
@@ -1831,8 +3225,20 @@ byte *COM_LoadFile (const char *path, int usehunk, unsigned int *path_id)
 
 	((byte *)buf)[len] = 0;
 
+	time = Sys_PreciseTime ();
+	if (COM_ClaimPrefetch (path, buf, len))
+		;	// a prefetch worker already read it
+#ifdef USE_ZLIB
+	else if (file && file->deflatedlen)
+	{
+		if (COM_ReadDeflated (pak->filename, file->filepos, len, file->deflatedlen, buf) != len)
+			Con_Printf ("COM_LoadFile: couldn't inflate %s\n", path);
+	}
+	else
+#endif
 	Sys_FileRead (h, buf, len);
 	COM_CloseFile (h);
+	COM_TraceRead (len, time);
 
 	return buf;
 }
@@ -1876,17 +3282,38 @@ byte *COM_LoadMallocFile (const char *path, unsigned int *path_id)
 	return COM_LoadFile (path, LOADFILE_MALLOC, path_id);
 }
 
-byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out)
+// returns a pointer into a mapped pak, or uses the stack/temp hunk
+byte *COM_LoadMappedFile (const char *path, void *buffer, int bufsize, unsigned int *path_id)
+{
+	packfile_t	*file;
+	double		time;
+
+	if (com_mappaks)
+	{
+		if (COM_FindFile (path, NULL, NULL, path_id) == -1)
+			return NULL;
+		file = com_foundfile;
+		if (file && com_foundpak->mapbase && !file->deflatedlen &&
+		    file->filepos >= 0 && file->filelen <= com_foundpak->mapsize - file->filepos)
+		{
+			time = Sys_PreciseTime ();
+			COM_ClaimPrefetch (path, NULL, file->filelen);	// pages are faulted in
+			COM_TraceRead (file->filelen, time);
+			com_filesize = file->filelen;
+			return com_foundpak->mapbase + file->filepos;
+		}
+	}
+
+	return COM_LoadStackFile (path, buffer, bufsize, path_id);
+}
+
+static byte *COM_LoadMallocFile_OSPath_Mode (const char *path, long *len_out, const char *mode)
 {
 	FILE	*f = NULL;
 	byte	*data = NULL;
 	long	len, actuallen;
 	
-	// ericw -- this is used by Host_Loadgame_f. Translate CRLF to LF on load games,
-	// othewise multiline messages have a garbage character at the end of each line.
-	// TODO: could handle in a way that allows loading CRLF savegames on mac/linux
-	// without the junk characters appearing.
-	f = fopen (path, "rt");
+	f = fopen (path, mode);
 	if (f == NULL)
 		return NULL;
 	
@@ -1916,6 +3343,21 @@ _err_file:
 	return NULL;
 }
 
+byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out)
+{
+	// ericw -- this is used by Host_Loadgame_f. Translate CRLF to LF on load games,
+	// othewise multiline messages have a garbage character at the end of each line.
+	// TODO: could handle in a way that allows loading CRLF savegames on mac/linux
+	// without the junk characters appearing.
+	return COM_LoadMallocFile_OSPath_Mode (path, len_out, "rt");
+}
+
+// binary savegames, which must come back byte for byte
+byte *COM_LoadMallocFile_OSPath (const char *path, long *len_out)
+{
+	return COM_LoadMallocFile_OSPath_Mode (path, len_out, "rb");
+}
+
 const char *COM_ParseIntNewline(const char *buffer, int *value)
 {
 	int consumed = 0;
@@ -2013,11 +3455,155 @@ static pack_t *COM_LoadPackFile (const char *packfile)
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+	if (com_mappaks)
+		pack->mapbase = (byte *) Sys_FileMap (packfile, &pack->mapsize);
 
 	//Sys_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
 	return pack;
 }
 
+/*
+=================
+COM_LoadZipFile
+
+Takes an explicit path to a zip (pk3) file and reads its central
+directory. Entries that can't be read (directories, encrypted, other
+compression methods, overlong names) are left out.
+=================
+*/
+static pack_t *COM_LoadZipFile (const char *zipfile)
+{
+	byte		*buf, *p, *end;
+	int		ziphandle, ziplen, taillen;
+	unsigned int	numentries, cdirlen, cdirofs;
+	unsigned int	method, complen, len, ofs, namelen;
+	int		i, numfiles, skipped;
+	packfile_t	*newfiles;
+	pack_t		*pack;
+
+	ziplen = Sys_FileOpenRead (zipfile, &ziphandle);
+	if (ziplen == -1)
+		return NULL;
+
+	// find the end of central directory record
+	taillen = q_min (ziplen, ZIP_EOCD_SIZE + ZIP_MAX_COMMENT);
+	buf = (byte *) malloc (taillen);
+	if (!buf)
+		Sys_Error ("COM_LoadZipFile: out of memory for %s", zipfile);
+	Sys_FileSeek (ziphandle, ziplen - taillen);
+	if (Sys_FileRead (ziphandle, buf, taillen) != taillen)
+		taillen = 0;
+	for (p = buf + taillen - ZIP_EOCD_SIZE; p >= buf; p--)
+	{
+		if (ZIP_Long (p) == ZIP_EOCD_SIG)
+			break;
+	}
+	if (taillen < ZIP_EOCD_SIZE || p < buf)
+	{
+		Sys_Printf ("WARNING: %s is not a zip file, ignored\n", zipfile);
+		free (buf);
+		Sys_FileClose (ziphandle);
+		return NULL;
+	}
+	numentries = ZIP_Short (p + 10);
+	cdirlen = ZIP_Long (p + 12);
+	cdirofs = ZIP_Long (p + 16);
+	free (buf);
+
+	if (!numentries || cdirofs > (unsigned int) ziplen || cdirlen > (unsigned int) ziplen - cdirofs)
+	{
+		Sys_Printf ("WARNING: %s has no files or a bad directory, ignored\n", zipfile);
+		Sys_FileClose (ziphandle);
+		return NULL;
+	}
+
+	buf = (byte *) malloc (cdirlen);
+	newfiles = (packfile_t *) calloc (numentries, sizeof(packfile_t));
+	if (!buf || !newfiles)
+		Sys_Error ("COM_LoadZipFile: out of memory for %s", zipfile);
+	Sys_FileSeek (ziphandle, cdirofs);
+	if (Sys_FileRead (ziphandle, buf, cdirlen) != (int) cdirlen)
+		cdirlen = 0;
+
+	// parse the central directory
+	numfiles = skipped = 0;
+	end = buf + cdirlen;
+	for (i = 0, p = buf; i < (int) numentries; i++)
+	{
+		if (end - p < ZIP_CDIR_SIZE || ZIP_Long (p) != ZIP_CDIR_SIG)
+		{
+			Sys_Printf ("WARNING: %s has a corrupt directory\n", zipfile);
+			break;
+		}
+		method = ZIP_Short (p + 10);
+		complen = ZIP_Long (p + 20);
+		len = ZIP_Long (p + 24);
+		namelen = ZIP_Short (p + 28);
+		ofs = ZIP_Long (p + 42);
+		if (end - p < ZIP_CDIR_SIZE + namelen)
+			break;
+
+		if (!namelen || p[ZIP_CDIR_SIZE + namelen - 1] == '/')
+			;	// directory
+		else if (namelen >= MAX_QPATH || (ZIP_Short (p + 8) & 1) ||	// encrypted
+			 len > INT_MAX || complen > INT_MAX || ofs > (unsigned int) ziplen ||
+			 !ZIP_MethodSupported (method, complen, len))
+			skipped++;
+		else
+		{
+			memcpy (newfiles[numfiles].name, p + ZIP_CDIR_SIZE, namelen);
+			newfiles[numfiles].name[namelen] = 0;
+			newfiles[numfiles].filepos = ofs;
+			newfiles[numfiles].filelen = len;
+			newfiles[numfiles].deflatedlen = (method == ZIP_DEFLATED) ? complen : 0;
+			newfiles[numfiles].zipheader = true;
+			numfiles++;
+		}
+		p += ZIP_CDIR_SIZE + namelen + ZIP_Short (p + 30) + ZIP_Short (p + 32);
+	}
+	free (buf);
+
+	if (skipped)
+		Sys_Printf ("WARNING: %s: %i unsupported files ignored\n", zipfile, skipped);
+	if (!numfiles)
+	{
+		Sys_Printf ("WARNING: %s has no files, ignored\n", zipfile);
+		free (newfiles);
+		Sys_FileClose (ziphandle);
+		return NULL;
+	}
+
+	com_modified = true;	// not the original game
+
+	pack = (pack_t *) Z_Malloc (sizeof (pack_t));
+	q_strlcpy (pack->filename, zipfile, sizeof(pack->filename));
+	pack->zip = true;
+	pack->handle = ziphandle;
+	pack->numfiles = numfiles;
+	pack->files = newfiles;
+	if (com_mappaks)
+		pack->mapbase = (byte *) Sys_FileMap (zipfile, &pack->mapsize);
+
+	return pack;
+}
+
+/*
+=================
+COM_FreePack
+=================
+*/
+static void COM_FreePack (pack_t *pack)
+{
+	if (pack->mapbase)
+		Sys_FileUnmap (pack->mapbase, pack->mapsize);
+	Sys_FileClose (pack->handle);
+	if (pack->zip)
+		free (pack->files);	// can be too big for the zone
+	else
+		Z_Free (pack->files);
+	Z_Free (pack);
+}
+
 /*
 =================
 COM_AddGameDirectory -- johnfitz -- modified based on topaz's tutorial
@@ -2028,11 +3614,12 @@ static void COM_AddGameDirectory (const char *base, const char *dir)
 	int i;
 	unsigned int path_id;
 	searchpath_t *search;
-	pack_t *pak, *qspak;
+	pack_t *pak, *qspak, *zip;
 	char pakfile[MAX_OSPATH];
 	qboolean been_here = false;
 
 	q_strlcpy (com_gamedir, va("%s/%s", base, dir), sizeof(com_gamedir));
+	COM_InvalidateFileIndex ();
 
 	// assign a path_id to this game directory
 	if (com_searchpaths)
@@ -2048,10 +3635,13 @@ _add_path:
 	com_searchpaths = search;
 
 	// add any pak files in the format pak0.pak pak1.pak, ...
+	// a pakN.pk3 is added right after (so above) pakN.pak
 	for (i = 0; ; i++)
 	{
 		q_snprintf (pakfile, sizeof(pakfile), "%s/pak%i.pak", com_gamedir, i);
 		pak = COM_LoadPackFile (pakfile);
+		q_snprintf (pakfile, sizeof(pakfile), "%s/pak%i.pk3", com_gamedir, i);
+		zip = COM_LoadZipFile (pakfile);
 		if (i != 0 || path_id != 1 || fitzmode)
 			qspak = NULL;
 		else {
@@ -2068,6 +3658,13 @@ _add_path:
 			search->next = com_searchpaths;
 			com_searchpaths = search;
 		}
+		if (zip) {
+			search = (searchpath_t *) Z_Malloc(sizeof(searchpath_t));
+			search->path_id = path_id;
+			search->pack = zip;
+			search->next = com_searchpaths;
+			com_searchpaths = search;
+		}
 		if (qspak) {
 			search = (searchpath_t *) Z_Malloc(sizeof(searchpath_t));
 			search->path_id = path_id;
@@ -2075,7 +3672,7 @@ _add_path:
 			search->next = com_searchpaths;
 			com_searchpaths = search;
 		}
-		if (!pak) break;
+		if (!pak && !zip) break;
 	}
 
 	if (!been_here && host_parms->userdir != host_parms->basedir)
@@ -2153,18 +3750,16 @@ static void COM_Game_f (void)
 		Host_WriteConfiguration ();
 
 		//Kill the extra game if it is loaded
+		COM_FlushPrefetch ();	// workers may still be reading its paks
 		while (com_searchpaths != com_base_searchpaths)
 		{
 			if (com_searchpaths->pack)
-			{
-				Sys_FileClose (com_searchpaths->pack->handle);
-				Z_Free (com_searchpaths->pack->files);
-				Z_Free (com_searchpaths->pack);
-			}
+				COM_FreePack (com_searchpaths->pack);
 			search = com_searchpaths->next;
 			Z_Free (com_searchpaths);
 			com_searchpaths = search;
 		}
+		COM_InvalidateFileIndex ();
 		hipnotic = false;
 		rogue = false;
 		standard_quake = true;
@@ -2237,6 +3832,10 @@ void COM_InitFilesystem (void) //johnfitz -- modified based on topaz's tutorial
 	Cvar_RegisterVariable (&cmdline);
 	Cmd_AddCommand ("path", COM_Path_f);
 	Cmd_AddCommand ("game", COM_Game_f); //johnfitz
+	Cmd_AddCommand ("fs_index", COM_FileIndex_f);
+	Cvar_RegisterVariable (&fs_prefetch);
+	Cmd_AddCommand ("fs_stats", COM_FileStats_f);
+	Cvar_RegisterVariable (&fs_stats_dump);
 
 	i = COM_CheckParm ("-basedir");
 	if (i && i < com_argc-1)
@@ -2249,6 +3848,10 @@ void COM_InitFilesystem (void) //johnfitz -- modified based on topaz's tutorial
 	if ((com_basedir[j-1] == '\\') || (com_basedir[j-1] == '/'))
 		com_basedir[j-1] = 0;
 
+	// the loaders byte swap some headers in place, which would be
+	// applied twice to a shared mapping on big endian hosts.
+	com_mappaks = !host_bigendian && !COM_CheckParm ("-nomappak");
+
 	// start up with GAMENAME by default (id1)
 	COM_AddGameDirectory (com_basedir, GAMENAME);
 
@@ -2307,6 +3910,7 @@ size_t FS_fread(void *ptr, size_t size, size_t nmemb, fshandle_t *fh)
 	long byte_size;
 	long bytes_read;
 	size_t nmemb_read;
+	double time = 0;
 
 	if (!fh) {
 		errno = EBADF;
@@ -2324,8 +3928,21 @@ size_t FS_fread(void *ptr, size_t size, size_t nmemb, fshandle_t *fh)
 	byte_size = nmemb * size;
 	if (byte_size > fh->length - fh->pos)	/* just read to end */
 		byte_size = fh->length - fh->pos;
-	bytes_read = fread(ptr, 1, byte_size, fh->file);
-	fh->pos += bytes_read;
+	if (fh->stat)
+		time = Sys_PreciseTime();
+#ifdef USE_ZLIB
+	if (fh->zip)
+		bytes_read = FS_ZipRead(fh, ptr, byte_size);
+	else
+#endif
+	{
+		bytes_read = fread(ptr, 1, byte_size, fh->file);
+		fh->pos += bytes_read;
+	}
+	if (fh->stat) {
+		fh->stat->bytes += bytes_read;
+		fh->stat->time += Sys_PreciseTime() - time;
+	}
 
 	/* fread() must return the number of elements read,
 	 * not the total number of bytes. */
@@ -2373,7 +3990,15 @@ int FS_fseek(fshandle_t *fh, long offset, int whence)
 
 	if (offset > fh->length)	/* just seek to end */
 		offset = fh->length;
+	if (fh->stat && offset != fh->pos)
+		fh->stat->seeks++;
 
+#ifdef USE_ZLIB
+	if (fh->zip) {	/* the next read inflates up to here */
+		fh->pos = offset;
+		return 0;
+	}
+#endif
 	ret = fseek(fh->file, fh->start + offset, SEEK_SET);
 	if (ret < 0)
 		return ret;
@@ -2388,6 +4013,10 @@ int FS_fclose(fshandle_t *fh)
 		errno = EBADF;
 		return -1;
 	}
+#ifdef USE_ZLIB
+	if (fh->zip)
+		FS_ZipClose(fh);
+#endif
 	return fclose(fh->file);
 }
 
@@ -2403,6 +4032,12 @@ long FS_ftell(fshandle_t *fh)
 void FS_rewind(fshandle_t *fh)
 {
 	if (!fh) return;
+#ifdef USE_ZLIB
+	if (fh->zip) {
+		fh->pos = 0;
+		return;
+	}
+#endif
 	clearerr(fh->file);
 	fseek(fh->file, fh->start, SEEK_SET);
 	fh->pos = 0;
@@ -2436,6 +4071,14 @@ int FS_fgetc(fshandle_t *fh)
 	}
 	if (fh->pos >= fh->length)
 		return EOF;
+	if (fh->stat)
+		fh->stat->bytes++;
+#ifdef USE_ZLIB
+	if (fh->zip) {
+		byte c;
+		return (FS_ZipRead(fh, &c, 1) == 1) ? c : EOF;
+	}
+#endif
 	fh->pos += 1;
 	return fgetc(fh->file);
 }
@@ -2450,6 +4093,20 @@ char *FS_fgets(char *s, int size, fshandle_t *fh)
 	if (size > (fh->length - fh->pos) + 1)
 		size = (fh->length - fh->pos) + 1;
 
+#ifdef USE_ZLIB
+	if (fh->zip) {
+		int i, c;
+		for (i = 0; i < size - 1; ) {
+			if ((c = FS_fgetc(fh)) == EOF)
+				break;
+			s[i++] = c;
+			if (c == '\n')
+				break;
+		}
+		s[i] = 0;
+		return i ? s : NULL;
+	}
+#endif
 	ret = fgets(s, size, fh->file);
 	fh->pos = ftell(fh->file) - fh->start;
 
@@ -62,6 +62,13 @@ void SZ_Clear (sizebuf_t *buf);
 void *SZ_GetSpace (sizebuf_t *buf, int length);
 void SZ_Write (sizebuf_t *buf, const void *data, int length);
 void SZ_Print (sizebuf_t *buf, const char *data);	// strcats onto the sizebuf
+void SZ_Reserve (sizebuf_t *buf, int length);	// grows malloc'd data
+void SZ_FreeReserved (sizebuf_t *buf);
+void SZ_Printf (sizebuf_t *buf, const char *fmt, ...) FUNC_PRINTF(2,3);	// no trailing 0, grows like SZ_Reserve
+int SZ_ReadByte (sizebuf_t *buf);	// cursize is the read position
+int SZ_ReadLong (sizebuf_t *buf);
+float SZ_ReadFloat (sizebuf_t *buf);
+const char *SZ_ReadString (sizebuf_t *buf);
 
 //============================================================================
 
@@ -134,6 +141,9 @@ int Q_strncmp (const char *s1, const char *s2, int count);
 int	Q_atoi (const char *str);
 float Q_atof (const char *str);
 
+unsigned int COM_HashString (const char *str);
+unsigned int COM_HashStringNoCase (const char *str);
+
 
 #include "strl_fn.h"
 
@@ -198,14 +208,19 @@ typedef struct
 {
 	char	name[MAX_QPATH];
 	int		filepos, filelen;
+	int		deflatedlen;	// zip: size of the deflated data, 0 if stored
+	qboolean	zipheader;	// zip: filepos still points at the local header
 } packfile_t;
 
 typedef struct pack_s
 {
 	char	filename[MAX_OSPATH];
+	qboolean	zip;	// zip (pk3) archive rather than an id pak
 	int		handle;
 	int		numfiles;
 	packfile_t	*files;
+	byte	*mapbase;	// copy-on-write mapping of the whole pak, or NULL
+	int		mapsize;
 } pack_t;
 
 typedef struct searchpath_s
@@ -231,8 +246,20 @@ extern	int	file_from_pak;	// global indicating that file came from a pak
 void COM_WriteFile (const char *filename, const void *data, int len);
 int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id);
 int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id);
+struct _fshandle_t;
+int COM_FOpenStream (const char *filename, struct _fshandle_t *fh, unsigned int *path_id);
+	// fills in fh for reading with the FS_*() functions below. unlike
+	// COM_FOpenFile, deflated zip entries are inflated as they are read.
 qboolean COM_FileExists (const char *filename, unsigned int *path_id);
 void COM_CloseFile (int h);
+void COM_InvalidateFileIndex (void);
+	// flushes the pak name index and the cached misses. call it
+	// after changing the search path or creating files in it.
+void COM_PrefetchFile (const char *path);
+void COM_FlushPrefetch (void);
+void COM_ShutdownPrefetch (void);
+const char *COM_SetFileRequester (const char *requester);
+void COM_DumpFileStats (const char *mapname);
 
 // these procedures open a file using COM_FindFile and loads it into a proper
 // buffer. the buffer is allocated with a total size of com_filesize + 1. the
@@ -253,11 +280,18 @@ void COM_LoadCacheFile (const char *path, struct cache_user_s *cu,
 	// uses cache mem for allocating the buffer.
 byte *COM_LoadMallocFile (const char *path, unsigned int *path_id);
 	// allocates the buffer on the system mem (malloc).
+byte *COM_LoadMappedFile (const char *path, void *buffer, int bufsize,
+						unsigned int *path_id);
+	// returns a pointer straight into the memory mapped pak if the file
+	// is in one, otherwise same as COM_LoadStackFile. mapped data is not
+	// nul terminated (use com_filesize) and stays valid until the search
+	// path changes. writes to it are private, but persist across loads.
 
 // Opens the given path directly, ignoring search paths.
 // Returns NULL on failure, or else a '\0'-terminated malloc'ed buffer.
 // Loads in "t" mode so CRLF to LF translation is performed on Windows.
 byte *COM_LoadMallocFile_TextMode_OSPath (const char *path, long *len_out);
+byte *COM_LoadMallocFile_OSPath (const char *path, long *len_out);
 
 // Attempts to parse an int, followed by a newline.
 // Returns advanced buffer position.
@@ -285,6 +319,8 @@ typedef struct _fshandle_t
 	long start;	/* file or data start position */
 	long length;	/* file or data size */
 	long pos;	/* current position relative to start */
+	struct zipstream_s *zip;	/* inflate state for deflated zip entries */
+	struct fsstat_s *stat;	/* I/O record for fs_stats, may be NULL */
 } fshandle_t;
 
 size_t FS_fread(void *ptr, size_t size, size_t nmemb, fshandle_t *fh);
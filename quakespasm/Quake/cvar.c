@@ -24,6 +24,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 
 static cvar_t	*cvar_vars;
+
+// cvars are also hashed by name, without case, for Cvar_FindVar.
+// cvar_vars stays sorted for listing and completion.
+#define	CVAR_HASHSIZE	512	// power of two
+static cvar_t	*cvar_hash[CVAR_HASHSIZE];
+
+lookupstat_t	cvar_lookupstat;
 static char	cvar_null_string[] = "";
 
 //==============================================================================
@@ -249,12 +256,15 @@ cvar_t *Cvar_FindVar (const char *var_name)
 {
 	cvar_t	*var;
 
-	for (var = cvar_vars ; var ; var = var->next)
+	cvar_lookupstat.lookups++;
+	for (var = cvar_hash[COM_HashStringNoCase (var_name) & (CVAR_HASHSIZE - 1)] ; var ; var = var->hashnext)
 	{
+		cvar_lookupstat.probes++;
 		if (!Q_strcmp(var_name, var->name))
 			return var;
 	}
 
+	cvar_lookupstat.misses++;
 	return NULL;
 }
 
@@ -534,6 +544,7 @@ void Cvar_RegisterVariable (cvar_t *variable)
 	char	value[512];
 	qboolean	set_rom;
 	cvar_t	*cursor,*prev; //johnfitz -- sorted list insert
+	unsigned int	hash;
 
 // first check to see if it has already been defined
 	if (Cvar_FindVar (variable->name))
@@ -570,6 +581,9 @@ void Cvar_RegisterVariable (cvar_t *variable)
 		prev->next = variable;
 	}
 	//johnfitz
+	hash = COM_HashStringNoCase (variable->name) & (CVAR_HASHSIZE - 1);
+	variable->hashnext = cvar_hash[hash];
+	cvar_hash[hash] = variable;
 	variable->flags |= CVAR_REGISTERED;
 
 // copy the value off, because future sets will Z_Free it
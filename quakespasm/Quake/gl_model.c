@@ -42,6 +42,10 @@ static int	mod_novis_capacity;
 static byte	*mod_decompressed;
 static int	mod_decompressed_capacity;
 
+static void Mod_FreePVSCache (void);
+static void Mod_PVSCache_f (cvar_t *var);
+cvar_t	mod_pvscache = {"mod_pvscache", "8", CVAR_NONE};	// megabytes of decompressed PVS rows
+
 #define	MAX_MOD_KNOWN	2048 /*johnfitz -- was 512 */
 qmodel_t	mod_known[MAX_MOD_KNOWN];
 int		mod_numknown;
@@ -58,6 +62,8 @@ void Mod_Init (void)
 {
 	Cvar_RegisterVariable (&gl_subdivide_size);
 	Cvar_RegisterVariable (&external_ents);
+	Cvar_RegisterVariable (&mod_pvscache);
+	Cvar_SetCallback (&mod_pvscache, Mod_PVSCache_f);
 
 	//johnfitz -- create notexture miptex
 	r_notexture_mip = (texture_t *) Hunk_AllocName (sizeof(texture_t), "r_notexture_mip");
@@ -184,11 +190,157 @@ byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 	return mod_decompressed;
 }
 
+/*
+===================
+PVS row cache
+
+Decompressed rows of the last model asked about, as many as fit in
+mod_pvscache megabytes.  When it is full the row to replace is picked by
+a clock over the slots, so rows that keep being asked for stay.  A row
+returned from here is good until the next Mod_LeafPVS, as before.
+===================
+*/
+static qmodel_t	*mod_pvsmodel;		// the rows are for this one, NULL if none
+static int	mod_pvsrowbytes;
+static int	mod_pvsnumslots;
+static byte	*mod_pvsrows;		// [mod_pvsnumslots * mod_pvsrowbytes]
+static int	*mod_pvsslotleaf;	// leaf in each slot, -1 if empty
+static byte	*mod_pvsslotused;	// asked for since the clock last passed
+static int	*mod_pvsleafslot;	// [numleafs + 1], slot of each leaf, -1 if none
+static int	mod_pvsnumleafs;
+static int	mod_pvsclock;
+
+static struct
+{
+	double	hits, misses, flushes;
+} mod_pvsstats;
+
+static void Mod_FreePVSCache (void)
+{
+	if (mod_pvsmodel)
+	{
+		Mem_Track (MEMPOOL_MALLOC, "pvsrows", -(mod_pvsnumslots * (mod_pvsrowbytes + (int)(sizeof(int) + sizeof(byte)))
+			+ (mod_pvsnumleafs + 1) * (int)sizeof(int)));
+		mod_pvsstats.flushes++;
+	}
+	free (mod_pvsrows);
+	free (mod_pvsslotleaf);
+	free (mod_pvsslotused);
+	free (mod_pvsleafslot);
+	mod_pvsrows = NULL;
+	mod_pvsslotleaf = NULL;
+	mod_pvsslotused = NULL;
+	mod_pvsleafslot = NULL;
+	mod_pvsmodel = NULL;
+	mod_pvsnumslots = 0;
+}
+
+static void Mod_PVSCache_f (cvar_t *var)
+{
+	Mod_FreePVSCache ();
+}
+
+/*
+===================
+Mod_AllocPVSCache
+
+Returns false if not even one row fits
+===================
+*/
+static qboolean Mod_AllocPVSCache (qmodel_t *model)
+{
+	int		i;
+	double	slots;
+
+	Mod_FreePVSCache ();
+
+	mod_pvsrowbytes = (model->numleafs+7)>>3;
+	slots = q_min (mod_pvscache.value * 1024 * 1024 / q_max(mod_pvsrowbytes, 1), model->numleafs);
+	if (slots < 1)
+		return false;
+	mod_pvsnumslots = (int)slots;
+	mod_pvsnumleafs = model->numleafs;
+
+	mod_pvsrows = (byte *) malloc (mod_pvsnumslots * mod_pvsrowbytes);
+	mod_pvsslotleaf = (int *) malloc (mod_pvsnumslots * sizeof(int));
+	mod_pvsslotused = (byte *) calloc (mod_pvsnumslots, sizeof(byte));
+	mod_pvsleafslot = (int *) malloc ((mod_pvsnumleafs + 1) * sizeof(int));
+	if (!mod_pvsrows || !mod_pvsslotleaf || !mod_pvsslotused || !mod_pvsleafslot)
+		Sys_Error ("Mod_AllocPVSCache: failed on %i rows of %i bytes", mod_pvsnumslots, mod_pvsrowbytes);
+	Mem_Track (MEMPOOL_MALLOC, "pvsrows", mod_pvsnumslots * (mod_pvsrowbytes + (int)(sizeof(int) + sizeof(byte)))
+		+ (mod_pvsnumleafs + 1) * (int)sizeof(int));
+
+	for (i = 0; i < mod_pvsnumslots; i++)
+		mod_pvsslotleaf[i] = -1;
+	for (i = 0; i <= mod_pvsnumleafs; i++)
+		mod_pvsleafslot[i] = -1;
+	mod_pvsclock = 0;
+	mod_pvsmodel = model;
+	return true;
+}
+
 byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
 {
+	int		leafnum, slot;
+	byte	*row;
+
 	if (leaf == model->leafs)
 		return Mod_NoVisPVS (model);
-	return Mod_DecompressVis (leaf->compressed_vis, model);
+	if (model != mod_pvsmodel && !Mod_AllocPVSCache (model))
+		return Mod_DecompressVis (leaf->compressed_vis, model);
+
+	leafnum = leaf - model->leafs;
+	slot = mod_pvsleafslot[leafnum];
+	if (slot != -1)
+	{
+		mod_pvsstats.hits++;
+		mod_pvsslotused[slot] = 1;
+		return mod_pvsrows + slot * mod_pvsrowbytes;
+	}
+	mod_pvsstats.misses++;
+
+	while (mod_pvsslotused[mod_pvsclock])
+	{
+		mod_pvsslotused[mod_pvsclock] = 0;
+		mod_pvsclock = (mod_pvsclock + 1) % mod_pvsnumslots;
+	}
+	slot = mod_pvsclock;
+	mod_pvsclock = (mod_pvsclock + 1) % mod_pvsnumslots;
+
+	if (mod_pvsslotleaf[slot] != -1)
+		mod_pvsleafslot[mod_pvsslotleaf[slot]] = -1;
+	mod_pvsslotleaf[slot] = leafnum;
+	mod_pvsleafslot[leafnum] = slot;
+	mod_pvsslotused[slot] = 1;
+
+	row = mod_pvsrows + slot * mod_pvsrowbytes;
+	memcpy (row, Mod_DecompressVis (leaf->compressed_vis, model), mod_pvsrowbytes);
+	return row;
+}
+
+/*
+===================
+Mod_PVSCacheStats
+
+Prints and clears the row cache counts, for sv_pvsstats
+===================
+*/
+void Mod_PVSCacheStats (void)
+{
+	double	total;
+	int		i, cached;
+
+	for (i = cached = 0; i < mod_pvsnumslots; i++)
+		if (mod_pvsslotleaf[i] != -1)
+			cached++;
+
+	total = q_max (mod_pvsstats.hits + mod_pvsstats.misses, 1);
+	Con_Printf ("%8.0f PVS rows, %5.1f%% cached, %.0f flushes\n", mod_pvsstats.hits + mod_pvsstats.misses,
+		mod_pvsstats.hits * 100 / total, mod_pvsstats.flushes);
+	if (mod_pvsmodel)
+		Con_Printf ("%i of %i leafs of %s in %i slots, %i KB\n", cached, mod_pvsnumleafs, mod_pvsmodel->name,
+			mod_pvsnumslots, mod_pvsnumslots * mod_pvsrowbytes / 1024);
+	memset (&mod_pvsstats, 0, sizeof(mod_pvsstats));
 }
 
 byte *Mod_NoVisPVS (qmodel_t *model)
@@ -218,6 +370,8 @@ void Mod_ClearAll (void)
 	int		i;
 	qmodel_t	*mod;
 
+	Mod_FreePVSCache ();
+
 	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
 		if (mod->type != mod_alias)
 		{
@@ -295,6 +449,49 @@ void Mod_TouchModel (const char *name)
 	}
 }
 
+/*
+==================
+Mod_Prefetch
+
+Starts reading a model that is about to be loaded in the background,
+along with the .lit and .ent files of a map.
+==================
+*/
+void Mod_Prefetch (const char *name)
+{
+	qmodel_t	*mod;
+	char		sidecar[MAX_QPATH];
+	int		i;
+
+	if (name[0] == '*')
+		return;	// inline brush model
+
+	for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++)
+	{
+		if (!strcmp (mod->name, name))
+			break;
+	}
+	if (i < mod_numknown && !mod->needload)
+	{
+		if (mod->type != mod_alias || Cache_Check (&mod->cache))
+			return;	// still loaded
+	}
+
+	COM_PrefetchFile (name);
+	if (!q_strcasecmp (COM_FileGetExtension (name), "bsp"))
+	{
+		COM_StripExtension (name, sidecar, sizeof(sidecar));
+		COM_AddExtension (sidecar, ".lit", sizeof(sidecar));
+		COM_PrefetchFile (sidecar);
+		if (external_ents.value)
+		{
+			COM_StripExtension (name, sidecar, sizeof(sidecar));
+			COM_AddExtension (sidecar, ".ent", sizeof(sidecar));
+			COM_PrefetchFile (sidecar);
+		}
+	}
+}
+
 /*
 ==================
 Mod_LoadModel
@@ -307,6 +504,7 @@ qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 	byte	*buf;
 	byte	stackbuf[1024];		// avoid dirtying the cache heap
 	int	mod_type;
+	const char	*requester;
 
 	if (!mod->needload)
 	{
@@ -328,11 +526,14 @@ qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 	}
 
 //
-// load the file
+// load the file, straight from the pak mapping if possible since
+// the loaders copy everything they keep
 //
-	buf = COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf), & mod->path_id);
+	requester = COM_SetFileRequester ("model");
+	buf = COM_LoadMappedFile (mod->name, stackbuf, sizeof(stackbuf), & mod->path_id);
 	if (!buf)
 	{
+		COM_SetFileRequester (requester);
 		if (crash)
 			Host_Error ("Mod_LoadModel: %s not found", mod->name); //johnfitz -- was "Mod_NumForName"
 		return NULL;
@@ -367,6 +568,7 @@ qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 		Mod_LoadBrushModel (mod, buf);
 		break;
 	}
+	COM_SetFileRequester (requester);
 
 	return mod;
 }
@@ -1754,6 +1956,121 @@ void Mod_MakeHull0 (void)
 	}
 }
 
+/*
+=================
+Mod_PackHull
+
+Copies the clipnodes of hulls first..last, which share them, together with
+their planes into hullnodes, depth first from each submodel's head node so
+a trace walks memory mostly forwards.  Trees that SV_RecursiveHullCheck
+would stop on with a bad node number, that are not trees, or that are too
+deep for SV_HullCheck's stack are left unpacked and traced the old way.
+=================
+*/
+void Mod_PackHull (int first, int last, int numnodes)
+{
+	hull_t		*hull;
+	mclipnode_t	*in;
+	mplane_t	*plane;
+	mhullnode_t	*out;
+	int			*remap, *temp, *stamp, *order, *stack;
+	int			i, j, k, n, c, head, depth, sp, count, size;
+
+	for (j = first; j <= last; j++)
+	{
+		loadmodel->hulls[j].hullnodes = NULL;
+		loadmodel->hulls[j].hullremap = NULL;
+	}
+	hull = &loadmodel->hulls[first];
+	if (numnodes <= 0 || !hull->clipnodes)
+		return;
+
+	size = numnodes * 4 * sizeof(int);
+	temp = (int *) malloc (size);
+	if (!temp)
+		Sys_Error ("Mod_PackHull: failed on allocation of %i bytes", size);
+	Mem_Track (MEMPOOL_MALLOC, "hullpack", size);
+	stamp = temp;
+	order = stamp + numnodes;
+	stack = order + numnodes;	// node, depth pairs
+
+	remap = (int *) Hunk_AllocName (numnodes * sizeof(*remap), loadname);
+	for (n = 0; n < numnodes; n++)
+		remap[n] = stamp[n] = -1;
+	count = 0;
+
+	for (i = 0; i < loadmodel->numsubmodels; i++)
+	{
+		for (j = first; j <= last; j++)
+		{
+			head = loadmodel->submodels[i].headnode[j];
+			if (head < 0)
+				continue;
+			if (head >= numnodes)
+				goto fail;
+
+			stack[0] = head;
+			stack[1] = 1;
+			sp = 1;
+			while (sp)
+			{
+				sp--;
+				n = stack[sp*2];
+				depth = stack[sp*2+1];
+				if (stamp[n] == i * MAX_MAP_HULLS + j || depth > MAX_HULLDEPTH)
+					goto fail;
+				stamp[n] = i * MAX_MAP_HULLS + j;
+				if (remap[n] == -1)
+				{
+					remap[n] = count;
+					order[count++] = n;
+				}
+
+				in = hull->clipnodes + n;
+				for (k = 1; k >= 0; k--)	// children[0] comes straight after
+				{
+					c = in->children[k];
+					if (c < 0)
+						continue;
+					if (c < head || c >= numnodes || sp == numnodes)
+						goto fail;
+					stack[sp*2] = c;
+					stack[sp*2+1] = depth + 1;
+					sp++;
+				}
+			}
+		}
+	}
+
+	out = (mhullnode_t *) Hunk_AllocName (q_max(count, 1) * sizeof(*out), loadname);
+	for (i = 0; i < count; i++, out++)
+	{
+		in = hull->clipnodes + order[i];
+		plane = hull->planes + in->planenum;
+		VectorCopy (plane->normal, out->normal);
+		out->dist = plane->dist;
+		out->type = plane->type;
+		for (k = 0; k < 2; k++)
+			out->children[k] = (in->children[k] < 0) ? in->children[k] : remap[in->children[k]];
+		out->pad = 0;
+	}
+	out -= count;
+
+	for (j = first; j <= last; j++)
+	{
+		loadmodel->hulls[j].hullnodes = out;
+		loadmodel->hulls[j].hullremap = remap;
+	}
+	free (temp);
+	Mem_Track (MEMPOOL_MALLOC, "hullpack", -size);
+	return;
+
+fail:
+	Con_DPrintf ("%s: hull %i left unpacked\n", loadmodel->name, first);
+	free (temp);
+	Mem_Track (MEMPOOL_MALLOC, "hullpack", -size);
+}
+
 /*
 =================
 Mod_LoadMarksurfaces
@@ -2002,6 +2319,9 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 
 	loadmodel->type = mod_brush;
 
+	if (mod == mod_pvsmodel)	// the slot is reused for another map
+		Mod_FreePVSCache ();
+
 	header = (dheader_t *)buffer;
 
 	mod->bspversion = LittleLong (header->version);
@@ -2047,6 +2367,8 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 	Mod_LoadSubmodels (&header->lumps[LUMP_MODELS]);
 
 	Mod_MakeHull0 ();
+	Mod_PackHull (0, 0, mod->numnodes);
+	Mod_PackHull (1, 2, mod->numclipnodes);
 
 	mod->numframes = 2;		// regular and alternate animation
 
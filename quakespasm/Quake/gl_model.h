@@ -223,6 +223,19 @@ typedef struct mclipnode_s
 } mclipnode_t;
 //johnfitz
 
+// a clipnode with its plane copied in, stored in the order the tracer walks
+// them so a trace touches a few cache lines instead of two scattered arrays
+typedef struct mhullnode_s
+{
+	vec3_t		normal;
+	float		dist;
+	int			type;		// plane type, < 3 is axial
+	int			children[2]; // index into hullnodes, negative numbers are contents
+	int			pad;
+} mhullnode_t;
+
+#define	MAX_HULLDEPTH	256		// deeper hulls are left to SV_RecursiveHullCheck
+
 // !!! if this is changed, it must be changed in asm_i386.h too !!!
 typedef struct
 {
@@ -232,6 +245,8 @@ typedef struct
 	int			lastclipnode;
 	vec3_t		clip_mins;
 	vec3_t		clip_maxs;
+	mhullnode_t	*hullnodes;	// NULL if the hull could not be packed
+	int			*hullremap;	// clipnode number -> hullnodes index, -1 if not packed
 } hull_t;
 
 /*
@@ -509,10 +524,12 @@ void	Mod_ResetAll (void); // for gamedir changes (Host_Game_f)
 qmodel_t *Mod_ForName (const char *name, qboolean crash);
 void	*Mod_Extradata (qmodel_t *mod);	// handles caching
 void	Mod_TouchModel (const char *name);
+void	Mod_Prefetch (const char *name);
 
 mleaf_t *Mod_PointInLeaf (float *p, qmodel_t *model);
 byte	*Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model);
 byte	*Mod_NoVisPVS (qmodel_t *model);
+void	Mod_PVSCacheStats (void);
 
 void Mod_SetExtraFlags (qmodel_t *mod);
 
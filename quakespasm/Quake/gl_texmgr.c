@@ -231,6 +231,7 @@ static void TexMgr_Imagedump_f (void)
 	gltexture_t	*glt;
 	byte *buffer;
 	char *c;
+	int mark;
 
 	//create directory
 	q_snprintf(dirname, sizeof(dirname), "%s/imagedump", com_gamedir);
@@ -248,19 +249,21 @@ static void TexMgr_Imagedump_f (void)
 		GL_Bind (glt);
 		glPixelStorei (GL_PACK_ALIGNMENT, 1);/* for widths that aren't a multiple of 4 */
 
+		mark = Scratch_Mark ();
+
 		if (glt->flags & TEXPREF_ALPHA)
 		{
-			buffer = (byte *) malloc(glt->width*glt->height*4);
+			buffer = (byte *) Scratch_Alloc (glt->width*glt->height*4);
 			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 			Image_WriteTGA (tganame, buffer, glt->width, glt->height, 32, true);
 		}
 		else
 		{
-			buffer = (byte *) malloc(glt->width*glt->height*3);
+			buffer = (byte *) Scratch_Alloc (glt->width*glt->height*3);
 			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, buffer);
 			Image_WriteTGA (tganame, buffer, glt->width, glt->height, 24, true);
 		}
-		free (buffer);
+		Scratch_Release (mark);
 	}
 
 	Con_Printf ("dumped %i textures to %s\n", numgltextures, dirname);
@@ -344,6 +347,7 @@ gltexture_t *TexMgr_NewTexture (void)
 }
 
 static void GL_DeleteTexture (gltexture_t *texture);
+static void TexMgr_TrackBytes (gltexture_t *glt, int bytes);
 
 //ericw -- workaround for preventing TexMgr_FreeTexture during TexMgr_ReloadImages
 static qboolean in_reload_images;
@@ -577,8 +581,8 @@ void TexMgr_RecalcWarpImageSize (void)
 	//
 	// resize the textures in opengl
 	//
-	mark = Hunk_LowMark();
-	dummy = (byte *) Hunk_Alloc (gl_warpimagesize*gl_warpimagesize*4);
+	mark = Scratch_Mark ();
+	dummy = (byte *) Scratch_Alloc (gl_warpimagesize*gl_warpimagesize*4);
 
 	for (glt = active_gltextures; glt; glt = glt->next)
 	{
@@ -587,10 +591,11 @@ void TexMgr_RecalcWarpImageSize (void)
 			GL_Bind (glt);
 			glTexImage2D (GL_TEXTURE_2D, 0, gl_solid_format, gl_warpimagesize, gl_warpimagesize, 0, GL_RGBA, GL_UNSIGNED_BYTE, dummy);
 			glt->width = glt->height = gl_warpimagesize;
+			TexMgr_TrackBytes (glt, gl_warpimagesize * gl_warpimagesize * 4);
 		}
 	}
 
-	Hunk_FreeToLowMark (mark);
+	Scratch_Release (mark);
 }
 
 /*
@@ -762,7 +767,7 @@ static unsigned *TexMgr_ResampleTexture (unsigned *in, int inwidth, int inheight
 
 	outwidth = TexMgr_Pad(inwidth);
 	outheight = TexMgr_Pad(inheight);
-	out = (unsigned *) Hunk_Alloc(outwidth*outheight*4);
+	out = (unsigned *) Scratch_Alloc(outwidth*outheight*4);
 
 	xfrac = ((inwidth-1) << 16) / (outwidth-1);
 	yfrac = ((inheight-1) << 16) / (outheight-1);
@@ -944,7 +949,7 @@ static unsigned *TexMgr_8to32 (byte *in, int pixels, unsigned int *usepal)
 	int i;
 	unsigned *out, *data;
 
-	out = data = (unsigned *) Hunk_Alloc(pixels*4);
+	out = data = (unsigned *) Scratch_Alloc(pixels*4);
 
 	for (i = 0; i < pixels; i++)
 		*out++ = usepal[*in++];
@@ -967,7 +972,7 @@ static byte *TexMgr_PadImageW (byte *in, int width, int height, byte padbyte)
 
 	outwidth = TexMgr_Pad(width);
 
-	out = data = (byte *) Hunk_Alloc(outwidth*height);
+	out = data = (byte *) Scratch_Alloc(outwidth*height);
 
 	for (i = 0; i < height; i++)
 	{
@@ -996,7 +1001,7 @@ static byte *TexMgr_PadImageH (byte *in, int width, int height, byte padbyte)
 	srcpix = width * height;
 	dstpix = width * TexMgr_Pad(height);
 
-	out = data = (byte *) Hunk_Alloc(dstpix);
+	out = data = (byte *) Scratch_Alloc(dstpix);
 
 	for (i = 0; i < srcpix; i++)
 		*out++ = *in++;
@@ -1067,7 +1072,10 @@ static void TexMgr_LoadImage32 (gltexture_t *glt, unsigned *data)
 			}
 			glTexImage2D (GL_TEXTURE_2D, miplevel, internalformat, mipwidth, mipheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 		}
+		TexMgr_TrackBytes (glt, glt->width * glt->height * 4 * 4 / 3);
 	}
+	else
+		TexMgr_TrackBytes (glt, glt->width * glt->height * 4);
 
 	// set filter modes
 	TexMgr_SetFilterModes (glt);
@@ -1180,6 +1188,7 @@ static void TexMgr_LoadLightmap (gltexture_t *glt, byte *data)
 	// upload it
 	GL_Bind (glt);
 	glTexImage2D (GL_TEXTURE_2D, 0, lightmap_bytes, glt->width, glt->height, 0, gl_lightmap_format, GL_UNSIGNED_BYTE, data);
+	TexMgr_TrackBytes (glt, glt->width * glt->height * lightmap_bytes);
 
 	// set filter modes
 	TexMgr_SetFilterModes (glt);
@@ -1239,7 +1248,7 @@ gltexture_t *TexMgr_LoadImage (qmodel_t *owner, const char *name, int width, int
 	glt->source_crc = crc;
 
 	//upload it
-	mark = Hunk_LowMark();
+	mark = Scratch_Mark ();
 
 	switch (glt->source_format)
 	{
@@ -1254,7 +1263,7 @@ gltexture_t *TexMgr_LoadImage (qmodel_t *owner, const char *name, int width, int
 		break;
 	}
 
-	Hunk_FreeToLowMark(mark);
+	Scratch_Release (mark);
 
 	return glt;
 }
@@ -1276,11 +1285,12 @@ void TexMgr_ReloadImage (gltexture_t *glt, int shirt, int pants)
 {
 	byte	translation[256];
 	byte	*src, *dst, *data = NULL, *translated;
-	int	mark, size, i;
+	int	mark, smark, size, i;
 //
 // get source data
 //
 	mark = Hunk_LowMark ();
+	smark = Scratch_Mark ();
 
 	if (glt->source_file[0] && glt->source_offset)
 	{
@@ -1310,6 +1320,7 @@ void TexMgr_ReloadImage (gltexture_t *glt, int shirt, int pants)
 	{
 invalid:
 		Con_Printf ("TexMgr_ReloadImage: invalid source for %s\n", glt->name);
+		Scratch_Release (smark);
 		Hunk_FreeToLowMark(mark);
 		return;
 	}
@@ -1363,7 +1374,7 @@ invalid:
 
 		//translate texture
 		size = glt->width * glt->height;
-		dst = translated = (byte *) Hunk_Alloc (size);
+		dst = translated = (byte *) Scratch_Alloc (size);
 		src = data;
 
 		for (i = 0; i < size; i++)
@@ -1387,6 +1398,7 @@ invalid:
 		break;
 	}
 
+	Scratch_Release (smark);
 	Hunk_FreeToLowMark(mark);
 }
 
@@ -1506,6 +1518,19 @@ void GL_Bind (gltexture_t *texture)
 	}
 }
 
+/*
+================
+TexMgr_TrackBytes
+
+Tells memstats how much GL memory the texture takes now
+================
+*/
+static void TexMgr_TrackBytes (gltexture_t *glt, int bytes)
+{
+	Mem_Track (MEMPOOL_GL, glt->owner ? glt->owner->name : "engine", bytes - glt->bytes);
+	glt->bytes = bytes;
+}
+
 /*
 ================
 GL_DeleteTexture -- ericw
@@ -1517,6 +1542,7 @@ from our per-TMU cached texture binding table.
 static void GL_DeleteTexture (gltexture_t *texture)
 {
 	glDeleteTextures (1, &texture->texnum);
+	TexMgr_TrackBytes (texture, 0);
 
 	if (texture->texnum == currenttexture[0]) currenttexture[0] = GL_UNUSED_TEXTURE;
 	if (texture->texnum == currenttexture[1]) currenttexture[1] = GL_UNUSED_TEXTURE;
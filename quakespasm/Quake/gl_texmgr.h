@@ -63,6 +63,7 @@ typedef struct gltexture_s {
 	signed char			pants; //0-13 pants color, or -1 if never colormapped
 //used for rendering
 	int			visframe; //matches r_framecount if texture was bound this frame
+	int			bytes; //estimated GL memory, for memstats
 } gltexture_t;
 
 extern gltexture_t *notexture;
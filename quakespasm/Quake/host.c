@@ -135,6 +135,7 @@ void Host_EndGame (const char *message, ...)
 	else
 		CL_Disconnect ();
 
+	SV_TraceAbort ();
 	longjmp (host_abortserver, 1);
 }
 
@@ -172,6 +173,7 @@ void Host_Error (const char *error, ...)
 	cls.demonum = -1;
 	cl.intermission = 0; //johnfitz -- for errors during intermissions (changelevel with no map found, etc.)
 
+	SV_TraceAbort ();
 	inerror = false;
 
 	longjmp (host_abortserver, 1);
@@ -633,7 +635,9 @@ void Host_ServerFrame (void)
 	SV_CheckForNewClients ();
 
 // read client messages
+	sv_tracesource = TRACE_CLIENT;
 	SV_RunClients ();
+	sv_tracesource = TRACE_ENGINE;
 
 // move things around and think
 // always pause in single player if in console or menus
@@ -658,6 +662,8 @@ void Host_ServerFrame (void)
 
 // send all messages to the clients
 	SV_SendClientMessages ();
+
+	SV_TraceStatsFrame ();
 }
 
 /*
@@ -684,6 +690,9 @@ void _Host_Frame (float time)
 	if (!Host_FilterTime (time))
 		return;			// don't run too fast, or packets will flood out
 
+// whatever the last frame left in the scratch arena is gone now
+	Scratch_Reset ();
+
 // get new key events
 	Key_UpdateForDest ();
 	IN_UpdateInputMode ();
@@ -692,6 +701,9 @@ void _Host_Frame (float time)
 // allow mice or other external controllers to add commands
 	IN_Commands ();
 
+// report a savegame the last frames wrote in the background
+	Host_FinishSave (false);
+
 // process console commands
 	Cbuf_Execute ();
 
@@ -761,6 +773,7 @@ void _Host_Frame (float time)
 					pass1+pass2+pass3, pass1, pass2, pass3);
 	}
 
+	Mem_Frame ();
 	host_framecount++;
 
 }
@@ -821,7 +834,7 @@ void Host_Init (void)
 	com_argc = host_parms->argc;
 	com_argv = host_parms->argv;
 
-	Memory_Init (host_parms->membase, host_parms->memsize);
+	Memory_Init (host_parms->membase, host_parms->memsize, host_parms->memreserved);
 	Cbuf_Init ();
 	Cmd_Init ();
 	LOG_Init (host_parms);
@@ -841,7 +854,10 @@ void Host_Init (void)
 	SV_Init ();
 
 	Con_Printf ("Exe: " __TIME__ " " __DATE__ "\n");
-	Con_Printf ("%4.1f megabyte heap\n", host_parms->memsize/ (1024*1024.0));
+	if (host_parms->memreserved)
+		Con_Printf ("%4.1f megabyte heap reserved, committed as needed\n", host_parms->memsize/ (1024*1024.0));
+	else
+		Con_Printf ("%4.1f megabyte heap\n", host_parms->memsize/ (1024*1024.0));
 
 	if (cls.state != ca_dedicated)
 	{
@@ -916,6 +932,9 @@ void Host_Shutdown(void)
 	scr_disabled_for_loading = true;
 
 	Host_WriteConfiguration ();
+	Host_FinishSave (true);
+	SV_Shutdown ();
+	COM_ShutdownPrefetch ();
 
 	NET_Shutdown ();
 
@@ -988,6 +988,9 @@ LOAD / SAVE GAME
 */
 
 #define	SAVEGAME_VERSION	5
+#define	SAVEGAME_BINARY_VERSION	6	// same first two lines, then the rest in binary
+
+cvar_t	sv_savebinary = {"sv_savebinary", "0", CVAR_ARCHIVE};
 
 /*
 ===============
@@ -1016,6 +1019,123 @@ void Host_SavegameComment (char *text)
 }
 
 
+/*
+===============
+Host_FinishSave
+
+Saves are built in memory and written out by a thread, so the frame
+doesn't wait on the disk. There is only ever one in flight: this reports
+it once it is done, and with wait set, waits for it first.
+===============
+*/
+static struct
+{
+	char		name[MAX_OSPATH];
+	sizebuf_t	buf;
+	qboolean	text;		// written in text mode
+	qboolean	ok;
+	SDL_sem		*done;		// posted by the thread when it's finished
+	SDL_Thread	*thread;
+} save_job;
+
+static int Host_SaveThread (void *done)
+{
+	FILE	*f;
+
+	f = fopen (save_job.name, save_job.text ? "w" : "wb");
+	save_job.ok = f && (int)fwrite (save_job.buf.data, 1, save_job.buf.cursize, f) == save_job.buf.cursize;
+	if (f && fclose (f))
+		save_job.ok = false;
+	if (done)
+		SDL_SemPost ((SDL_sem *) done);
+	return 0;
+}
+
+void Host_FinishSave (qboolean wait)
+{
+	if (!save_job.buf.data)
+		return;
+	if (save_job.thread)
+	{
+		if (wait)
+			SDL_SemWait (save_job.done);
+		else if (SDL_SemTryWait (save_job.done) != 0)
+			return;
+		SDL_WaitThread (save_job.thread, NULL);
+		save_job.thread = NULL;
+	}
+	SZ_FreeReserved (&save_job.buf);
+
+	if (save_job.ok)
+		Con_Printf ("Saved %s\n", save_job.name);
+	else
+		Con_Printf ("ERROR: couldn't write %s.\n", save_job.name);
+}
+
+/*
+===============
+Host_SavegameText
+===============
+*/
+static void Host_SavegameText (sizebuf_t *buf)
+{
+	char	comment[SAVEGAME_COMMENT_LENGTH+1];
+	int	i;
+
+	SZ_Printf (buf, "%i\n", SAVEGAME_VERSION);
+	Host_SavegameComment (comment);
+	SZ_Printf (buf, "%s\n", comment);
+	for (i = 0; i < NUM_SPAWN_PARMS; i++)
+		SZ_Printf (buf, "%f\n", svs.clients->spawn_parms[i]);
+	SZ_Printf (buf, "%d\n", current_skill);
+	SZ_Printf (buf, "%s\n", sv.name);
+	SZ_Printf (buf, "%f\n",sv.time);
+
+// write the light styles
+
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		if (sv.lightstyles[i])
+			SZ_Printf (buf, "%s\n", sv.lightstyles[i]);
+		else
+			SZ_Printf (buf,"m\n");
+	}
+
+
+	ED_WriteGlobals (buf);
+	for (i = 0; i < sv.num_edicts; i++)
+		ED_Write (buf, EDICT_NUM(i));
+}
+
+/*
+===============
+Host_SavegameBinary
+===============
+*/
+static void Host_SavegameBinary (sizebuf_t *buf)
+{
+	char		comment[SAVEGAME_COMMENT_LENGTH+1];
+	char		text[64];
+	int		i;
+
+	Host_SavegameComment (comment);
+	q_snprintf (text, sizeof(text), "%i\n%s\n", SAVEGAME_BINARY_VERSION, comment);
+	SZ_Reserve (buf, strlen(text) + NUM_SPAWN_PARMS * 4 + 12 + MAX_QPATH);
+	SZ_Write (buf, text, strlen(text));
+	for (i = 0; i < NUM_SPAWN_PARMS; i++)
+		MSG_WriteFloat (buf, svs.clients->spawn_parms[i]);
+	MSG_WriteLong (buf, current_skill);
+	MSG_WriteString (buf, sv.name);
+	MSG_WriteFloat (buf, sv.time);
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		const char *style = sv.lightstyles[i] ? sv.lightstyles[i] : "m";
+		SZ_Reserve (buf, strlen(style) + 1);
+		MSG_WriteString (buf, style);
+	}
+	ED_SaveBinary (buf);
+}
+
 /*
 ===============
 Host_Savegame_f
@@ -1024,9 +1144,7 @@ Host_Savegame_f
 void Host_Savegame_f (void)
 {
 	char	name[MAX_OSPATH];
-	FILE	*f;
 	int	i;
-	char	comment[SAVEGAME_COMMENT_LENGTH+1];
 
 	if (cmd_source != src_command)
 		return;
@@ -1074,41 +1192,32 @@ void Host_Savegame_f (void)
 	COM_AddExtension (name, ".sav", sizeof(name));
 
 	Con_Printf ("Saving game to %s...\n", name);
-	f = fopen (name, "w");
-	if (!f)
-	{
-		Con_Printf ("ERROR: couldn't open.\n");
-		return;
-	}
-
-	fprintf (f, "%i\n", SAVEGAME_VERSION);
-	Host_SavegameComment (comment);
-	fprintf (f, "%s\n", comment);
-	for (i = 0; i < NUM_SPAWN_PARMS; i++)
-		fprintf (f, "%f\n", svs.clients->spawn_parms[i]);
-	fprintf (f, "%d\n", current_skill);
-	fprintf (f, "%s\n", sv.name);
-	fprintf (f, "%f\n",sv.time);
+	Host_FinishSave (true);
 
-// write the light styles
+	q_strlcpy (save_job.name, name, sizeof(save_job.name));
+	memset (&save_job.buf, 0, sizeof(save_job.buf));
+	save_job.text = !sv_savebinary.value;
+	if (save_job.text)
+		Host_SavegameText (&save_job.buf);
+	else
+		Host_SavegameBinary (&save_job.buf);
 
-	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	save_job.ok = false;
+	if (!save_job.done)
+		save_job.done = SDL_CreateSemaphore (0);
+	if (save_job.done)
 	{
-		if (sv.lightstyles[i])
-			fprintf (f, "%s\n", sv.lightstyles[i]);
-		else
-			fprintf (f,"m\n");
+#if defined(USE_SDL2)
+		save_job.thread = SDL_CreateThread (Host_SaveThread, "save", save_job.done);
+#else
+		save_job.thread = SDL_CreateThread (Host_SaveThread, save_job.done);
+#endif
 	}
-
-
-	ED_WriteGlobals (f);
-	for (i = 0; i < sv.num_edicts; i++)
+	if (!save_job.thread)
 	{
-		ED_Write (f, EDICT_NUM(i));
-		fflush (f);
+		Host_SaveThread (NULL);
+		Host_FinishSave (true);
 	}
-	fclose (f);
-	Con_Printf ("done.\n");
 }
 
 
@@ -1130,6 +1239,8 @@ void Host_Loadgame_f (void)
 	int	entnum;
 	int	version;
 	float	spawn_parms[NUM_SPAWN_PARMS];
+	sizebuf_t	buf;
+	long	len;
 
 	if (cmd_source != src_command)
 		return;
@@ -1161,7 +1272,20 @@ void Host_Loadgame_f (void)
 	if (start != NULL)
 		free (start);
 	
-	start = (char *) COM_LoadMallocFile_TextMode_OSPath(name, NULL);
+// don't read a save that is still being written
+	Host_FinishSave (true);
+
+	start = (char *) COM_LoadMallocFile_OSPath(name, &len);
+	if (start != NULL)
+	{
+		version = 0;
+		COM_ParseIntNewline (start, &version);
+		if (version == SAVEGAME_VERSION)
+		{	// text, read it again with CRLF translated
+			free (start);
+			start = (char *) COM_LoadMallocFile_TextMode_OSPath(name, NULL);
+		}
+	}
 	if (start == NULL)
 	{
 		Con_Printf ("ERROR: couldn't open.\n");
@@ -1170,24 +1294,51 @@ void Host_Loadgame_f (void)
 
 	data = start;
 	data = COM_ParseIntNewline (data, &version);
-	if (version != SAVEGAME_VERSION)
+	if (version == SAVEGAME_BINARY_VERSION)
+	{
+	// skip the comment, the rest is binary
+		data = strchr (data, '\n');
+		memset (&buf, 0, sizeof(buf));
+		if (data)
+		{
+			buf.data = (byte *)data + 1;
+			buf.maxsize = len - (buf.data - (byte *)start);
+		}
+		for (i = 0; i < NUM_SPAWN_PARMS; i++)
+			spawn_parms[i] = SZ_ReadFloat (&buf);
+		current_skill = SZ_ReadLong (&buf);
+		q_strlcpy (mapname, SZ_ReadString (&buf), sizeof(mapname));
+		time = SZ_ReadFloat (&buf);
+		if (!data || buf.overflowed)
+		{
+			free (start);
+			start = NULL;
+			Con_Printf ("Savegame is truncated\n");
+			return;
+		}
+		Cvar_SetValue ("skill", (float)current_skill);
+	}
+	else if (version != SAVEGAME_VERSION)
 	{
 		free (start);
 		start = NULL;
 		Con_Printf ("Savegame is version %i, not %i\n", version, SAVEGAME_VERSION);
 		return;
 	}
-	data = COM_ParseStringNewline (data);
-	for (i = 0; i < NUM_SPAWN_PARMS; i++)
-		data = COM_ParseFloatNewline (data, &spawn_parms[i]);
-// this silliness is so we can load 1.06 save files, which have float skill values
-	data = COM_ParseFloatNewline(data, &tfloat);
-	current_skill = (int)(tfloat + 0.1);
-	Cvar_SetValue ("skill", (float)current_skill);
+	else
+	{
+		data = COM_ParseStringNewline (data);
+		for (i = 0; i < NUM_SPAWN_PARMS; i++)
+			data = COM_ParseFloatNewline (data, &spawn_parms[i]);
+	// this silliness is so we can load 1.06 save files, which have float skill values
+		data = COM_ParseFloatNewline(data, &tfloat);
+		current_skill = (int)(tfloat + 0.1);
+		Cvar_SetValue ("skill", (float)current_skill);
 
-	data = COM_ParseStringNewline (data);
-	q_strlcpy (mapname, com_token, sizeof(mapname));
-	data = COM_ParseFloatNewline (data, &time);
+		data = COM_ParseStringNewline (data);
+		q_strlcpy (mapname, com_token, sizeof(mapname));
+		data = COM_ParseFloatNewline (data, &time);
+	}
 
 	CL_Disconnect_f ();
 
@@ -1207,12 +1358,23 @@ void Host_Loadgame_f (void)
 
 	for (i = 0; i < MAX_LIGHTSTYLES; i++)
 	{
+		if (version == SAVEGAME_BINARY_VERSION)
+		{
+			sv.lightstyles[i] = (const char *)Hunk_Strdup (SZ_ReadString (&buf), "lightstyles");
+			continue;
+		}
 		data = COM_ParseStringNewline (data);
 		sv.lightstyles[i] = (const char *)Hunk_Strdup (com_token, "lightstyles");
 	}
 
 // load the edicts out of the savegame file
 	entnum = -1;		// -1 is the globals
+	if (version == SAVEGAME_BINARY_VERSION)
+	{
+		ED_LoadBinary (&buf);
+		entnum = sv.num_edicts;
+		data = "";
+	}
 	while (*data)
 	{
 		data = COM_Parse (data);
@@ -1249,6 +1411,8 @@ void Host_Loadgame_f (void)
 
 	sv.num_edicts = entnum;
 	sv.time = time;
+	ED_RebuildFreeQueue ();
+	PR_ClearFindIndex ();
 
 	free (start);
 	start = NULL;
@@ -1645,6 +1809,7 @@ void Host_Spawn_f (void)
 		ent = host_client->edict;
 
 		memset (&ent->v, 0, progs->entityfields * 4);
+		PR_FindMark (ent);
 		ent->v.colormap = NUM_FOR_EDICT(ent);
 		ent->v.team = (host_client->colors & 15) + 1;
 		ent->v.netname = PR_SetEngineString(host_client->name);
@@ -1905,7 +2070,7 @@ void Host_Give_f (void)
 	case 's':
 		if (rogue)
 		{
-		    val = GetEdictFieldValue(sv_player, "ammo_shells1");
+		    val = GetEdictFieldValue(sv_player, pr_extfields.ammo_shells1);
 		    if (val)
 			val->_float = v;
 		}
@@ -1915,7 +2080,7 @@ void Host_Give_f (void)
 	case 'n':
 		if (rogue)
 		{
-		    val = GetEdictFieldValue(sv_player, "ammo_nails1");
+		    val = GetEdictFieldValue(sv_player, pr_extfields.ammo_nails1);
 		    if (val)
 		    {
 			val->_float = v;
@@ -1932,7 +2097,7 @@ void Host_Give_f (void)
 	case 'l':
 		if (rogue)
 		{
-		    val = GetEdictFieldValue(sv_player, "ammo_lava_nails");
+		    val = GetEdictFieldValue(sv_player, pr_extfields.ammo_lava_nails);
 		    if (val)
 		    {
 			val->_float = v;
@@ -1945,7 +2110,7 @@ void Host_Give_f (void)
 	case 'r':
 		if (rogue)
 		{
-		    val = GetEdictFieldValue(sv_player, "ammo_rockets1");
+		    val = GetEdictFieldValue(sv_player, pr_extfields.ammo_rockets1);
 		    if (val)
 		    {
 			val->_float = v;
@@ -1962,7 +2127,7 @@ void Host_Give_f (void)
 	case 'm':
 		if (rogue)
 		{
-		    val = GetEdictFieldValue(sv_player, "ammo_multi_rockets");
+		    val = GetEdictFieldValue(sv_player, pr_extfields.ammo_multi_rockets);
 		    if (val)
 		    {
 			val->_float = v;
@@ -1979,7 +2144,7 @@ void Host_Give_f (void)
 	case 'c':
 		if (rogue)
 		{
-		    val = GetEdictFieldValue(sv_player, "ammo_cells1");
+		    val = GetEdictFieldValue(sv_player, pr_extfields.ammo_cells1);
 		    if (val)
 		    {
 			val->_float = v;
@@ -1996,7 +2161,7 @@ void Host_Give_f (void)
 	case 'p':
 		if (rogue)
 		{
-		    val = GetEdictFieldValue(sv_player, "ammo_plasma");
+		    val = GetEdictFieldValue(sv_player, pr_extfields.ammo_plasma);
 		    if (val)
 		    {
 			val->_float = v;
@@ -2322,6 +2487,7 @@ void Host_InitCommands (void)
 	Cmd_AddCommand ("ping", Host_Ping_f);
 	Cmd_AddCommand ("load", Host_Loadgame_f);
 	Cmd_AddCommand ("save", Host_Savegame_f);
+	Cvar_RegisterVariable (&sv_savebinary);
 	Cmd_AddCommand ("give", Host_Give_f);
 
 	Cmd_AddCommand ("startdemos", Host_Startdemos_f);
@@ -81,18 +81,23 @@ TODO: search order: tga png jpg pcx lmp
 byte *Image_LoadImage (const char *name, int *width, int *height)
 {
 	FILE	*f;
+	const char	*requester;
 
+	requester = COM_SetFileRequester ("image");
 	q_snprintf (loadfilename, sizeof(loadfilename), "%s.tga", name);
 	COM_FOpenFile (loadfilename, &f, NULL);
-	if (f)
-		return Image_LoadTGA (f, width, height);
-
-	q_snprintf (loadfilename, sizeof(loadfilename), "%s.pcx", name);
-	COM_FOpenFile (loadfilename, &f, NULL);
-	if (f)
-		return Image_LoadPCX (f, width, height);
+	if (!f)
+	{
+		q_snprintf (loadfilename, sizeof(loadfilename), "%s.pcx", name);
+		COM_FOpenFile (loadfilename, &f, NULL);
+	}
+	COM_SetFileRequester (requester);
 
-	return NULL;
+	if (!f)
+		return NULL;
+	if (!q_strcasecmp (COM_FileGetExtension (loadfilename), "tga"))
+		return Image_LoadTGA (f, width, height);
+	return Image_LoadPCX (f, width, height);
 }
 
 //==============================================================================
@@ -88,6 +88,7 @@ static void Sys_InitSDL (void)
 }
 
 #define DEFAULT_MEMORY (256 * 1024 * 1024) // ericw -- was 72MB (64-bit) / 64MB (32-bit)
+#define RESERVED_MEMORY ((sizeof(void *) > 4) ? (1024 * 1024 * 1024) : (512 * 1024 * 1024))
 
 static quakeparms_t	parms;
 
@@ -119,14 +120,25 @@ int main(int argc, char *argv[])
 	Sys_Init();
 
 	parms.memsize = DEFAULT_MEMORY;
+	parms.membase = NULL;
 	if (COM_CheckParm("-heapsize"))
 	{
 		t = COM_CheckParm("-heapsize") + 1;
 		if (t < com_argc)
 			parms.memsize = Q_atoi(com_argv[t]) * 1024;
 	}
+	else if (!COM_CheckParm("-fixedheap"))
+	{	// reserve lots of address space, the hunk only uses what it needs
+		parms.membase = Sys_MemReserve (RESERVED_MEMORY);
+		if (parms.membase)
+		{
+			parms.memsize = RESERVED_MEMORY;
+			parms.memreserved = true;
+		}
+	}
 
-	parms.membase = malloc (parms.memsize);
+	if (!parms.membase)
+		parms.membase = malloc (parms.memsize);
 
 	if (!parms.membase)
 		Sys_Error ("Not enough memory free; check disk space\n");
@@ -439,6 +439,7 @@ void M_ScanSaves (void)
 	FILE	*f;
 	int	version;
 
+	Host_FinishSave (true);
 	for (i = 0; i < MAX_SAVEGAMES; i++)
 	{
 		strcpy (m_filenames[i], "--- UNUSED SLOT ---");
@@ -679,7 +679,7 @@ static void PF_traceline (void)
 {
 	float	*v1, *v2;
 	trace_t	trace;
-	int	nomonsters;
+	int	nomonsters, oldsource;
 	edict_t	*ent;
 
 	v1 = G_VECTOR(OFS_PARM0);
@@ -701,7 +701,10 @@ static void PF_traceline (void)
 	if (IS_NAN(v2[0]) || IS_NAN(v2[1]) || IS_NAN(v2[2]))
 		v2[0] = v2[1] = v2[2] = 0;
 
+	oldsource = sv_tracesource;
+	sv_tracesource = TRACE_TRACELINE;
 	trace = SV_Move (v1, vec3_origin, vec3_origin, v2, nomonsters, ent);
+	sv_tracesource = oldsource;
 
 	pr_global_struct->trace_allsolid = trace.allsolid;
 	pr_global_struct->trace_startsolid = trace.startsolid;
@@ -940,24 +943,22 @@ PF_findradius
 Returns a chain of entities that have origins within a spherical area
 
 findradius (origin, radius)
+
+The chain runs from the highest numbered entity down.  With pr_findindex,
+only the entities SV_FindRadiusEdicts hands out are checked, pr_findindex 2
+checks all of them as well and complains when the two don't agree.
 =================
 */
-static void PF_findradius (void)
+static int PF_InRadius (const int *list, int count, const float *org, float rad, int *found)
 {
-	edict_t	*ent, *chain;
-	float	rad;
-	float	*org;
+	edict_t	*ent;
 	vec3_t	eorg;
-	int	i, j;
-
-	chain = (edict_t *)sv.edicts;
-
-	org = G_VECTOR(OFS_PARM0);
-	rad = G_FLOAT(OFS_PARM1);
+	int	i, j, numfound;
 
-	ent = NEXT_EDICT(sv.edicts);
-	for (i = 1; i < sv.num_edicts; i++, ent = NEXT_EDICT(ent))
+	numfound = 0;
+	for (i = 0; i < count; i++)
 	{
+		ent = EDICT_NUM(list[i]);
 		if (ent->free)
 			continue;
 		if (ent->v.solid == SOLID_NOT)
@@ -967,10 +968,64 @@ static void PF_findradius (void)
 		if (VectorLength(eorg) > rad)
 			continue;
 
+		found[numfound++] = list[i];
+	}
+
+	return numfound;
+}
+
+static void PF_findradius (void)
+{
+	edict_t	*ent, *chain;
+	float	rad;
+	float	*org;
+	int	*list, *found, *all;
+	int	i, count, numfound, numall, mark;
+
+	chain = (edict_t *)sv.edicts;
+
+	org = G_VECTOR(OFS_PARM0);
+	rad = G_FLOAT(OFS_PARM1);
+
+	mark = Scratch_Mark ();
+	list = (int *) Scratch_Alloc (sv.num_edicts * sizeof(int));
+	found = (int *) Scratch_Alloc (sv.num_edicts * sizeof(int));
+
+	count = pr_findindex.value ? SV_FindRadiusEdicts (org, rad, list) : -1;
+	if (count < 0)
+	{
+		for (count = 0; count < sv.num_edicts - 1; count++)
+			list[count] = count + 1;
+		numfound = PF_InRadius (list, count, org, rad, found);
+	}
+	else
+	{
+		numfound = PF_InRadius (list, count, org, rad, found);
+		if (pr_findindex.value >= 2)
+		{
+			for (count = 0; count < sv.num_edicts - 1; count++)
+				list[count] = count + 1;
+			all = list;	// done with the candidates
+			numall = PF_InRadius (list, count, org, rad, all);
+			if (numall != numfound || memcmp (all, found, numall * sizeof(int)))
+			{
+				Con_Printf ("findradius '%g %g %g' %g: index found %i entities, should be %i\n",
+					org[0], org[1], org[2], rad, numfound, numall);
+				found = all;
+				numfound = numall;
+			}
+		}
+	}
+
+	for (i = 0; i < numfound; i++)
+	{
+		ent = EDICT_NUM(found[i]);
 		ent->v.chain = EDICT_TO_PROG(chain);
 		chain = ent;
 	}
 
+	Scratch_Release (mark);
+
 	RETURN_EDICT(chain);
 }
 
@@ -1032,19 +1087,229 @@ static void PF_Remove (void)
 }
 
 
-// entity (entity start, .string field, string match) find = #5;
-static void PF_Find (void)
+/*
+===============================================================================
+
+FIND INDEXES
+
+findradius goes through the area nodes, see SV_FindRadiusEdicts.  For find
+on classname, the edicts are kept on a chain per hash of the classname's
+contents, in ascending order.  Edicts whose classname is in a buffer the
+engine might write again (ftos, client names) go on a chain of their own that
+every lookup walks as well.  Writes to classname, and anything that frees,
+clears or brings back an edict, mark it, and marked edicts are moved to
+their new chain before the next lookup.
+
+===============================================================================
+*/
+
+cvar_t	pr_findindex = {"pr_findindex", "1", CVAR_NONE};
+
+#define	CLASSNAME_FIELD		((int)(offsetof(entvars_t, classname) / 4))
+
+static	int		pr_findhashsize;	// a power of two, the chain past it is the unstable one
+static	int		*pr_findhead, *pr_findtail;
+static	int		*pr_findnext, *pr_findprev, *pr_findchain;	// by edict number, chain -1 if on none
+static	byte		*pr_findmarked;
+static	int		*pr_findmarks;
+static	int		pr_numfindmarks;
+static	int		pr_findmax;		// edicts the arrays have room for
+static	qboolean	pr_findrebuild = true;	// everything goes back on its chain first
+
+/*
+=================
+PR_FieldWritten
+
+OP_ADDRESS into the PR_WATCHED fields, the progs are about to write them
+=================
+*/
+void PR_FieldWritten (edict_t *ed, int field)
+{
+	if (field == CLASSNAME_FIELD)
+		PR_FindMark (ed);
+	else if (field == (int)(offsetof(entvars_t, solid) / 4)
+	|| (field >= (int)(offsetof(entvars_t, origin) / 4) && field <= (int)(offsetof(entvars_t, origin) / 4) + 2)
+	|| (field >= (int)(offsetof(entvars_t, mins) / 4) && field <= PR_WATCHLAST))
+		SV_MarkEdictMoved (ed);
+}
+
+void PR_FindMark (edict_t *ed)
+{
+	int		num;
+
+	if (pr_findrebuild)
+		return;
+	num = NUM_FOR_EDICT(ed);
+	if (!num || pr_findmarked[num])
+		return;
+	pr_findmarked[num] = true;
+	pr_findmarks[pr_numfindmarks++] = num;
+}
+
+/*
+=================
+PR_ClearFindIndex
+
+For when edicts change wholesale, the index is built again on the next find
+=================
+*/
+void PR_ClearFindIndex (void)
+{
+	pr_findrebuild = true;
+}
+
+static int PR_FindChainFor (edict_t *ed)
+{
+	if (ed->free)
+		return -1;
+	if (!PR_StringIsStable (ed->v.classname))
+		return pr_findhashsize;
+	return COM_HashString (PR_GetString (ed->v.classname)) & (pr_findhashsize - 1);
+}
+
+static void PR_FindUnlink (int num)
+{
+	int		chain = pr_findchain[num];
+
+	if (pr_findprev[num] == -1)
+		pr_findhead[chain] = pr_findnext[num];
+	else
+		pr_findnext[pr_findprev[num]] = pr_findnext[num];
+	if (pr_findnext[num] == -1)
+		pr_findtail[chain] = pr_findprev[num];
+	else
+		pr_findprev[pr_findnext[num]] = pr_findprev[num];
+	pr_findchain[num] = -1;
+}
+
+static void PR_FindLink (int num, int chain)
+{
+	int		after;
+
+	// edicts mostly come in ascending order, so start from the tail
+	for (after = pr_findtail[chain]; after > num; after = pr_findprev[after])
+		;
+	pr_findprev[num] = after;
+	if (after == -1)
+	{
+		pr_findnext[num] = pr_findhead[chain];
+		pr_findhead[chain] = num;
+	}
+	else
+	{
+		pr_findnext[num] = pr_findnext[after];
+		pr_findnext[after] = num;
+	}
+	if (pr_findnext[num] == -1)
+		pr_findtail[chain] = num;
+	else
+		pr_findprev[pr_findnext[num]] = num;
+	pr_findchain[num] = chain;
+}
+
+static void PR_UpdateFindIndex (void)
+{
+	int		i, num, chain;
+
+	if (pr_findrebuild)
+	{
+		if (pr_findmax != sv.max_edicts)
+		{
+			if (pr_findmax)
+				Mem_Track (MEMPOOL_MALLOC, "findindex", -pr_findmax * (int)(sizeof(byte) + 4 * sizeof(int)) - (pr_findhashsize + 1) * 2 * (int)sizeof(int));
+			pr_findmax = sv.max_edicts;
+			for (pr_findhashsize = 64; pr_findhashsize < pr_findmax; pr_findhashsize <<= 1)
+				;
+			free (pr_findhead);
+			free (pr_findnext);
+			free (pr_findmarked);
+			pr_findhead = (int *) malloc ((pr_findhashsize + 1) * 2 * sizeof(int));
+			pr_findnext = (int *) malloc (pr_findmax * 4 * sizeof(int));
+			pr_findmarked = (byte *) malloc (pr_findmax * sizeof(byte));
+			if (!pr_findhead || !pr_findnext || !pr_findmarked)
+				Sys_Error ("PR_UpdateFindIndex: out of memory for %d edicts", pr_findmax);
+			pr_findtail = pr_findhead + pr_findhashsize + 1;
+			pr_findprev = pr_findnext + pr_findmax;
+			pr_findchain = pr_findprev + pr_findmax;
+			pr_findmarks = pr_findchain + pr_findmax;
+			Mem_Track (MEMPOOL_MALLOC, "findindex", pr_findmax * (int)(sizeof(byte) + 4 * sizeof(int)) + (pr_findhashsize + 1) * 2 * (int)sizeof(int));
+		}
+		memset (pr_findhead, 0xff, (pr_findhashsize + 1) * 2 * sizeof(int));
+		memset (pr_findchain, 0xff, pr_findmax * sizeof(int));
+		memset (pr_findmarked, 0, pr_findmax * sizeof(byte));
+		pr_numfindmarks = 0;
+		pr_findrebuild = false;
+
+		for (num = 1; num < sv.num_edicts; num++)
+		{
+			chain = PR_FindChainFor (EDICT_NUM(num));
+			if (chain != -1)
+				PR_FindLink (num, chain);
+		}
+		return;
+	}
+
+	for (i = 0; i < pr_numfindmarks; i++)
+	{
+		num = pr_findmarks[i];
+		pr_findmarked[num] = false;
+		chain = (num < sv.num_edicts) ? PR_FindChainFor (EDICT_NUM(num)) : -1;
+		if (chain == pr_findchain[num])
+			continue;
+		if (pr_findchain[num] != -1)
+			PR_FindUnlink (num);
+		if (chain != -1)
+			PR_FindLink (num, chain);
+	}
+	pr_numfindmarks = 0;
+}
+
+/*
+=================
+PR_FindClassname
+
+The first edict after e with classname s, same as going through all of them
+=================
+*/
+static edict_t *PR_FindClassname (int e, const char *s)
 {
-	int		e;
-	int		f;
-	const char	*s, *t;
 	edict_t	*ed;
+	int		chain, a, b, num;
 
-	e = G_EDICTNUM(OFS_PARM0);
-	f = G_INT(OFS_PARM1);
-	s = G_STRING(OFS_PARM2);
-	if (!s)
-		PR_RunError ("PF_Find: bad search string");
+	PR_UpdateFindIndex ();
+
+	chain = COM_HashString (s) & (pr_findhashsize - 1);
+	a = (pr_findchain[e] == chain) ? pr_findnext[e] : pr_findhead[chain];
+	b = (pr_findchain[e] == pr_findhashsize) ? pr_findnext[e] : pr_findhead[pr_findhashsize];
+
+	while (a != -1 || b != -1)
+	{
+		// the lower of the two chains' next edicts
+		if (b == -1 || (a != -1 && a < b))
+		{
+			num = a;
+			a = pr_findnext[a];
+		}
+		else
+		{
+			num = b;
+			b = pr_findnext[b];
+		}
+		if (num <= e)
+			continue;
+		ed = EDICT_NUM(num);
+		if (!ed->free && !strcmp(PR_GetString(ed->v.classname), s))
+			return ed;
+	}
+
+	return sv.edicts;
+}
+
+// entity (entity start, .string field, string match) find = #5;
+static edict_t *PF_FindLinear (int e, int f, const char *s)
+{
+	const char	*t;
+	edict_t	*ed;
 
 	for (e++ ; e < sv.num_edicts ; e++)
 	{
@@ -1055,13 +1320,44 @@ static void PF_Find (void)
 		if (!t)
 			continue;
 		if (!strcmp(t,s))
+			return ed;
+	}
+
+	return sv.edicts;
+}
+
+static void PF_Find (void)
+{
+	int		e;
+	int		f;
+	const char	*s;
+	edict_t	*ed, *check;
+
+	e = G_EDICTNUM(OFS_PARM0);
+	f = G_INT(OFS_PARM1);
+	s = G_STRING(OFS_PARM2);
+	if (!s)
+		PR_RunError ("PF_Find: bad search string");
+
+	if (f != CLASSNAME_FIELD || !pr_findindex.value)
+	{
+		RETURN_EDICT(PF_FindLinear (e, f, s));
+		return;
+	}
+
+	ed = PR_FindClassname (e, s);
+	if (pr_findindex.value >= 2)
+	{
+		check = PF_FindLinear (e, f, s);
+		if (check != ed)
 		{
-			RETURN_EDICT(ed);
-			return;
+			Con_Printf ("find classname \"%s\" after %i: index found %i, should be %i\n",
+				s, e, NUM_FOR_EDICT(ed), NUM_FOR_EDICT(check));
+			ed = check;
 		}
 	}
 
-	RETURN_EDICT(sv.edicts);
+	RETURN_EDICT(ed);
 }
 
 static void PR_CheckEmptyString (const char *s)
@@ -1160,7 +1456,7 @@ static void PF_walkmove (void)
 	float	yaw, dist;
 	vec3_t	move;
 	dfunction_t	*oldf;
-	int	oldself;
+	int	oldself, oldsource;
 
 	ent = PROG_TO_EDICT(pr_global_struct->self);
 	yaw = G_FLOAT(OFS_PARM0);
@@ -1181,6 +1477,8 @@ static void PF_walkmove (void)
 // save program state, because SV_movestep may call other progs
 	oldf = pr_xfunction;
 	oldself = pr_global_struct->self;
+	oldsource = sv_tracesource;
+	sv_tracesource = TRACE_WALKMOVE;
 
 	G_FLOAT(OFS_RETURN) = SV_movestep(ent, move, true);
 
@@ -1188,6 +1486,7 @@ static void PF_walkmove (void)
 // restore program state
 	pr_xfunction = oldf;
 	pr_global_struct->self = oldself;
+	sv_tracesource = oldsource;
 }
 
 /*
@@ -1202,13 +1501,17 @@ static void PF_droptofloor (void)
 	edict_t		*ent;
 	vec3_t		end;
 	trace_t		trace;
+	int		oldsource;
 
 	ent = PROG_TO_EDICT(pr_global_struct->self);
 
 	VectorCopy (ent->v.origin, end);
 	end[2] -= 256;
 
+	oldsource = sv_tracesource;
+	sv_tracesource = TRACE_DROPTOFLOOR;
 	trace = SV_Move (ent->v.origin, ent->v.mins, ent->v.maxs, end, false, ent);
+	sv_tracesource = oldsource;
 
 	if (trace.fraction == 1 || trace.allsolid)
 		G_FLOAT(OFS_RETURN) = 0;
@@ -1293,10 +1596,14 @@ PF_checkbottom
 static void PF_checkbottom (void)
 {
 	edict_t	*ent;
+	int	oldsource;
 
 	ent = G_EDICT(OFS_PARM0);
 
+	oldsource = sv_tracesource;
+	sv_tracesource = TRACE_CHECKBOTTOM;
 	G_FLOAT(OFS_RETURN) = SV_CheckBottom (ent);
+	sv_tracesource = oldsource;
 }
 
 /*
@@ -1307,10 +1614,14 @@ PF_pointcontents
 static void PF_pointcontents (void)
 {
 	float	*v;
+	int	oldsource;
 
 	v = G_VECTOR(OFS_PARM0);
 
+	oldsource = sv_tracesource;
+	sv_tracesource = TRACE_POINTCONTENTS;
 	G_FLOAT(OFS_RETURN) = SV_PointContents (v);
+	sv_tracesource = oldsource;
 }
 
 /*
@@ -1356,7 +1667,7 @@ static void PF_aim (void)
 {
 	edict_t	*ent, *check, *bestent;
 	vec3_t	start, dir, end, bestdir;
-	int		i, j;
+	int		i, j, oldsource;
 	trace_t	tr;
 	float	dist, bestdist;
 	float	speed;
@@ -1371,11 +1682,14 @@ static void PF_aim (void)
 // try sending a trace straight
 	VectorCopy (pr_global_struct->v_forward, dir);
 	VectorMA (start, 2048, dir, end);
+	oldsource = sv_tracesource;
+	sv_tracesource = TRACE_AIM;
 	tr = SV_Move (start, vec3_origin, vec3_origin, end, false, ent);
 	if (tr.ent && tr.ent->v.takedamage == DAMAGE_AIM
 		&& (!teamplay.value || ent->v.team <= 0 || ent->v.team != tr.ent->v.team) )
 	{
 		VectorCopy (pr_global_struct->v_forward, G_VECTOR(OFS_RETURN));
+		sv_tracesource = oldsource;
 		return;
 	}
 
@@ -1407,6 +1721,7 @@ static void PF_aim (void)
 			bestent = check;
 		}
 	}
+	sv_tracesource = oldsource;
 
 	if (bestent)
 	{
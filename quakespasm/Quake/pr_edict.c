@@ -28,9 +28,6 @@ dfunction_t		*pr_functions;
 
 static	char		*pr_strings;
 static	int		pr_stringssize;
-static	const char	**pr_knownstrings;
-static	int		pr_maxknownstrings;
-static	int		pr_numknownstrings;
 static	ddef_t		*pr_fielddefs;
 static	ddef_t		*pr_globaldefs;
 
@@ -55,21 +52,10 @@ int		type_size[8] = {
 };
 
 static ddef_t	*ED_FieldAtOfs (int ofs);
+static void	PR_ClearKnownStrings (void);
 static qboolean	ED_ParseEpair (void *base, ddef_t *key, const char *s);
 
-#define	MAX_FIELD_LEN	64
-#define	GEFV_CACHESIZE	2
-
-typedef struct {
-	ddef_t	*pcache;
-	char	field[MAX_FIELD_LEN];
-} gefv_cache;
-
-static gefv_cache	gefvCache[GEFV_CACHESIZE] =
-{
-		{ NULL,	"" },
-		{ NULL,	"" }
-};
+extfields_t	pr_extfields;
 
 cvar_t	nomonsters = {"nomonsters", "0", CVAR_NONE};
 cvar_t	gamecfg = {"gamecfg", "0", CVAR_NONE};
@@ -94,46 +80,241 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, progs->entityfields * 4);
 	e->free = false;
+	PR_FindMark (e);
 }
 
 /*
 =================
-ED_Alloc
+ED free queue
+
+ED_Free queues edicts in the order they are freed, so ED_Alloc only has to
+look at the front of the queue for the ones that have been free long
+enough.  Those move on to a heap that hands out the lowest numbered first,
+the edict the old scan from the start of the list would have found.
+Entries go stale when an edict is freed again or brought back some other
+way (loadgame, the pr_jit check), those are dropped when they come up.
+ED_RebuildFreeQueue builds them from the edicts themselves; a loadgame can
+leave freetimes ahead of sv.time, those wait in a queue of their own so
+the ones ED_Free adds stay in order.
+=================
+*/
+typedef struct
+{
+	int		num;
+	float		freetime;
+} edfree_t;
+
+static edfree_t	*ed_freequeue;		// freed too recently, oldest first
+static int	ed_freesize;		// a power of two, at least twice sv.max_edicts
+static int	ed_freehead, ed_freecount;
+static edfree_t	*ed_freeheap;		// free long enough, lowest number on top
+static int	ed_heapcount;
+static edfree_t	*ed_freelate;		// freed after sv.time, oldest first
+static int	ed_latehead, ed_latecount;
+
+static int ED_CompareFree (const void *a, const void *b)
+{
+	const edfree_t	*fa = (const edfree_t *)a;
+	const edfree_t	*fb = (const edfree_t *)b;
 
-Either finds a free edict, or allocates a new one.
+	if (fa->freetime != fb->freetime)
+		return (fa->freetime < fb->freetime) ? -1 : 1;
+	return fa->num - fb->num;
+}
+
+static qboolean ED_FreeEntryValid (const edfree_t *f)
+{
+	edict_t		*e;
+
+	if (f->num >= sv.num_edicts)
+		return false;
+	e = EDICT_NUM(f->num);
+	return e->free && e->freetime == f->freetime;
+}
+
+/*
 Try to avoid reusing an entity that was recently freed, because it
 can cause the client to think the entity morphed into something else
 instead of being removed and recreated, which can cause interpolated
 angles and bad trails.
-=================
 */
-edict_t *ED_Alloc (void)
+static qboolean ED_FreeLongEnough (float freetime)
 {
-	int			i;
+	// the first couple seconds of server time can involve a lot of
+	// freeing and allocating, so relax the replacement policy
+	return freetime < 2 || sv.time - freetime > 0.5;
+}
+
+static void ED_HeapDown (int i)
+{
+	edfree_t	f = ed_freeheap[i];
+	int		child;
+
+	while ((child = 2 * i + 1) < ed_heapcount)
+	{
+		if (child + 1 < ed_heapcount && ed_freeheap[child + 1].num < ed_freeheap[child].num)
+			child++;
+		if (ed_freeheap[child].num >= f.num)
+			break;
+		ed_freeheap[i] = ed_freeheap[child];
+		i = child;
+	}
+	ed_freeheap[i] = f;
+}
+
+static void ED_HeapPush (int num, float freetime)
+{
+	int		i, parent;
+
+	if (ed_heapcount == ed_freesize)
+	{	// full of stale entries, keep the others
+		for (i = parent = 0; i < ed_heapcount; i++)
+		{
+			if (ED_FreeEntryValid (&ed_freeheap[i]))
+				ed_freeheap[parent++] = ed_freeheap[i];
+		}
+		ed_heapcount = parent;
+		for (i = ed_heapcount / 2 - 1; i >= 0; i--)
+			ED_HeapDown (i);
+	}
+
+	for (i = ed_heapcount++; i > 0; i = parent)
+	{
+		parent = (i - 1) / 2;
+		if (ed_freeheap[parent].num <= num)
+			break;
+		ed_freeheap[i] = ed_freeheap[parent];
+	}
+	ed_freeheap[i].num = num;
+	ed_freeheap[i].freetime = freetime;
+}
+
+/* moves what has been free long enough from the front of a queue to the heap */
+static void ED_DrainFreeQueue (edfree_t *queue, int *head, int *count)
+{
+	edfree_t	*q;
+
+	while (*count)
+	{
+		q = &queue[*head];
+		if (ED_FreeEntryValid (q))
+		{
+			if (!ED_FreeLongEnough (q->freetime))
+				break;	// everything behind it was freed later
+			ED_HeapPush (q->num, q->freetime);
+		}
+		*head = (*head + 1) & (ed_freesize - 1);
+		(*count)--;
+	}
+}
+
+void ED_RebuildFreeQueue (void)
+{
+	int		i, size;
 	edict_t		*e;
 
+	for (size = 64; size < sv.max_edicts * 2; size <<= 1)
+		;
+	if (size > ed_freesize)
+	{
+		Mem_Track (MEMPOOL_MALLOC, "edictqueue", (size - ed_freesize) * 3 * (int)sizeof(edfree_t));
+		free (ed_freequeue);
+		ed_freequeue = (edfree_t *) malloc (size * 3 * sizeof(edfree_t));
+		if (!ed_freequeue)
+			Sys_Error ("ED_RebuildFreeQueue: out of memory");
+		ed_freeheap = ed_freequeue + size;
+		ed_freelate = ed_freequeue + size * 2;
+		ed_freesize = size;
+	}
+
+	ed_freehead = ed_freecount = ed_heapcount = 0;
+	ed_latehead = ed_latecount = 0;
 	for (i = svs.maxclients + 1; i < sv.num_edicts; i++)
 	{
 		e = EDICT_NUM(i);
-		// the first couple seconds of server time can involve a lot of
-		// freeing and allocating, so relax the replacement policy
-		if (e->free && ( e->freetime < 2 || sv.time - e->freetime > 0.5 ) )
+		if (!e->free)
+			continue;
+		if (ED_FreeLongEnough (e->freetime))
 		{
-			ED_ClearEdict (e);
-			return e;
+			ED_HeapPush (i, e->freetime);
+			continue;
 		}
+		ed_freequeue[ed_freecount].num = i;
+		ed_freequeue[ed_freecount].freetime = e->freetime;
+		ed_freecount++;
 	}
+	qsort (ed_freequeue, ed_freecount, sizeof(edfree_t), ED_CompareFree);
 
-	if (i == sv.max_edicts) //johnfitz -- use sv.max_edicts instead of MAX_EDICTS
-		Host_Error ("ED_Alloc: no free edicts (max_edicts is %i)", sv.max_edicts);
+	while (ed_freecount && ed_freequeue[ed_freecount - 1].freetime > sv.time)
+		ed_latecount++, ed_freecount--;
+	memcpy (ed_freelate, ed_freequeue + ed_freecount, ed_latecount * sizeof(edfree_t));
+}
+
+/*
+=================
+ED_TryAlloc
+
+ED_Alloc without the error, NULL when all edicts are in use
+=================
+*/
+static edict_t *ED_TryAlloc (void)
+{
+	edfree_t	f;
+	edict_t		*e;
+	qboolean	rebuilt = false;
+
+	while (1)
+	{
+		ED_DrainFreeQueue (ed_freequeue, &ed_freehead, &ed_freecount);
+		ED_DrainFreeQueue (ed_freelate, &ed_latehead, &ed_latecount);
+
+		while (ed_heapcount)
+		{
+			f = ed_freeheap[0];
+			ed_freeheap[0] = ed_freeheap[--ed_heapcount];
+			ED_HeapDown (0);
+			if (ED_FreeEntryValid (&f))
+			{
+				e = EDICT_NUM(f.num);
+				ED_ClearEdict (e);
+				return e;
+			}
+		}
 
+		if (sv.num_edicts < sv.max_edicts) //johnfitz -- use sv.max_edicts instead of MAX_EDICTS
+			break;
+		if (rebuilt)
+			return NULL;
+		// edicts might have been freed behind the queue's back
+		ED_RebuildFreeQueue ();
+		rebuilt = true;
+	}
+
+	e = EDICT_NUM(sv.num_edicts);
 	sv.num_edicts++;
-	e = EDICT_NUM(i);
 	memset(e, 0, pr_edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
+	PR_FindMark (e);
 
 	return e;
 }
 
+/*
+=================
+ED_Alloc
+
+Either finds a free edict, or allocates a new one.
+=================
+*/
+edict_t *ED_Alloc (void)
+{
+	edict_t		*e;
+
+	e = ED_TryAlloc ();
+	if (!e)
+		Host_Error ("ED_Alloc: no free edicts (max_edicts is %i)", sv.max_edicts);
+	return e;
+}
+
 /*
 =================
 ED_Free
@@ -144,9 +325,14 @@ FIXME: walk all entities and NULL out references to this entity
 */
 void ED_Free (edict_t *ed)
 {
+	qboolean	queued;
+
+	queued = ed->free && ed->freetime == (float)sv.time;	// freed twice this frame, freetime is a float
+
 	SV_UnlinkEdict (ed);		// unlink from world bsp
 
 	ed->free = true;
+	PR_FindMark (ed);
 	ed->v.model = 0;
 	ed->v.takedamage = 0;
 	ed->v.modelindex = 0;
@@ -160,6 +346,20 @@ void ED_Free (edict_t *ed)
 	ed->alpha = ENTALPHA_DEFAULT; //johnfitz -- reset alpha for next entity
 
 	ed->freetime = sv.time;
+
+	if (NUM_FOR_EDICT(ed) > svs.maxclients && ed_freesize && !queued)
+	{
+		if (ED_FreeLongEnough (ed->freetime))
+			ED_HeapPush (NUM_FOR_EDICT(ed), ed->freetime);
+		else if (ed_freecount == ed_freesize)
+			ED_RebuildFreeQueue ();	// full of stale entries, ed is in the new queue
+		else
+		{
+			ed_freequeue[(ed_freehead + ed_freecount) & (ed_freesize - 1)].num = NUM_FOR_EDICT(ed);
+			ed_freequeue[(ed_freehead + ed_freecount) & (ed_freesize - 1)].freetime = ed->freetime;
+			ed_freecount++;
+		}
+	}
 }
 
 //===========================================================================
@@ -204,21 +404,81 @@ static ddef_t *ED_FieldAtOfs (int ofs)
 
 /*
 ============
-ED_FindField
+ED_BuildNameHash
+
+The name lookups below go through hash chains of def indexes into
+pr_fielddefs, pr_globaldefs and pr_functions, built once per progs load.
+Only the first def of each name is chained, like the linear search found.
 ============
 */
-static ddef_t *ED_FindField (const char *name)
+typedef struct
 {
-	ddef_t		*def;
-	int			i;
+	int	*first;		// by hash, -1 if none
+	int	*next;		// by def
+	int	mask;
+} prnamehash_t;
 
-	for (i = 0; i < progs->numfielddefs; i++)
+static prnamehash_t	pr_fieldhash, pr_globalhash, pr_functionhash;
+
+#define	ED_DEFNAME(defs, stride, i)	PR_GetString(*(int *)((byte *)(defs) + (i) * (stride)))
+
+static void ED_BuildNameHash (prnamehash_t *hash, const void *defs, int count, int stride)
+{
+	int		i, j, h, tablesize;
+	const char	*name;
+
+	for (tablesize = 64; tablesize < count; tablesize <<= 1)
+		;
+	hash->mask = tablesize - 1;
+	hash->first = (int *) Hunk_AllocName (tablesize * sizeof(int), "prhash");
+	hash->next = (int *) Hunk_AllocName (q_max(count, 1) * sizeof(int), "prhash");
+	memset (hash->first, 0xff, tablesize * sizeof(int));
+
+	for (i = 0; i < count; i++)
 	{
-		def = &pr_fielddefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
+		name = ED_DEFNAME(defs, stride, i);
+		h = COM_HashString (name) & hash->mask;
+		for (j = hash->first[h]; j != -1; j = hash->next[j])
+		{
+			if (!strcmp(ED_DEFNAME(defs, stride, j), name))
+				break;
+		}
+		if (j != -1)
+			continue;
+		hash->next[i] = hash->first[h];
+		hash->first[h] = i;
 	}
-	return NULL;
+}
+
+/*
+============
+ED_FindName
+
+Returns the index of the def called name, or -1
+============
+*/
+static int ED_FindName (const prnamehash_t *hash, const void *defs, int stride, const char *name)
+{
+	int		i;
+
+	for (i = hash->first[COM_HashString(name) & hash->mask]; i != -1; i = hash->next[i])
+	{
+		if (!strcmp(ED_DEFNAME(defs, stride, i), name))
+			return i;
+	}
+	return -1;
+}
+
+/*
+============
+ED_FindField
+============
+*/
+static ddef_t *ED_FindField (const char *name)
+{
+	int		i = ED_FindName (&pr_fieldhash, &pr_fielddefs->s_name, sizeof(ddef_t), name);
+
+	return (i == -1) ? NULL : &pr_fielddefs[i];
 }
 
 
@@ -229,16 +489,9 @@ ED_FindGlobal
 */
 static ddef_t *ED_FindGlobal (const char *name)
 {
-	ddef_t		*def;
-	int			i;
+	int		i = ED_FindName (&pr_globalhash, &pr_globaldefs->s_name, sizeof(ddef_t), name);
 
-	for (i = 0; i < progs->numglobaldefs; i++)
-	{
-		def = &pr_globaldefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
-	}
-	return NULL;
+	return (i == -1) ? NULL : &pr_globaldefs[i];
 }
 
 
@@ -249,52 +502,40 @@ ED_FindFunction
 */
 static dfunction_t *ED_FindFunction (const char *fn_name)
 {
-	dfunction_t		*func;
-	int				i;
+	int		i = ED_FindName (&pr_functionhash, &pr_functions->s_name, sizeof(dfunction_t), fn_name);
 
-	for (i = 0; i < progs->numfunctions; i++)
-	{
-		func = &pr_functions[i];
-		if ( !strcmp(PR_GetString(func->s_name), fn_name) )
-			return func;
-	}
-	return NULL;
+	return (i == -1) ? NULL : &pr_functions[i];
 }
 
 /*
 ============
-GetEdictFieldValue
+ED_FindFieldOffset
+
+Returns the offset in ints from ed->v of a field of the given type, or -1
 ============
 */
-eval_t *GetEdictFieldValue(edict_t *ed, const char *field)
+static int ED_FindFieldOffset (const char *name, etype_t type)
 {
-	ddef_t			*def = NULL;
-	int				i;
-	static int		rep = 0;
+	ddef_t		*def = ED_FindField (name);
 
-	for (i = 0; i < GEFV_CACHESIZE; i++)
-	{
-		if (!strcmp(field, gefvCache[i].field))
-		{
-			def = gefvCache[i].pcache;
-			goto Done;
-		}
-	}
-
-	def = ED_FindField (field);
+	if (!def || (def->type & ~DEF_SAVEGLOBAL) != type)
+		return -1;
+	return def->ofs;
+}
 
-	if (strlen(field) < MAX_FIELD_LEN)
-	{
-		gefvCache[rep].pcache = def;
-		strcpy (gefvCache[rep].field, field);
-		rep ^= 1;
-	}
+/*
+============
+GetEdictFieldValue
 
-Done:
-	if (!def)
+fieldofs comes from pr_extfields, NULL if the progs don't have the field
+============
+*/
+eval_t *GetEdictFieldValue(edict_t *ed, int fieldofs)
+{
+	if (fieldofs < 0)
 		return NULL;
 
-	return (eval_t *)((char *)&ed->v + def->ofs*4);
+	return (eval_t *)((int *)&ed->v + fieldofs);
 }
 
 
@@ -513,7 +754,7 @@ ED_Write
 For savegames
 =============
 */
-void ED_Write (FILE *f, edict_t *ed)
+void ED_Write (sizebuf_t *buf, edict_t *ed)
 {
 	ddef_t	*d;
 	int		*v;
@@ -521,11 +762,11 @@ void ED_Write (FILE *f, edict_t *ed)
 	const char	*name;
 	int		type;
 
-	fprintf (f, "{\n");
+	SZ_Printf (buf, "{\n");
 
 	if (ed->free)
 	{
-		fprintf (f, "}\n");
+		SZ_Printf (buf, "}\n");
 		return;
 	}
 
@@ -549,16 +790,16 @@ void ED_Write (FILE *f, edict_t *ed)
 		if (j == type_size[type])
 			continue;
 
-		fprintf (f, "\"%s\" ", name);
-		fprintf (f, "\"%s\"\n", PR_UglyValueString(d->type, (eval_t *)v));
+		SZ_Printf (buf, "\"%s\" ", name);
+		SZ_Printf (buf, "\"%s\"\n", PR_UglyValueString(d->type, (eval_t *)v));
 	}
 
 	//johnfitz -- save entity alpha manually when progs.dat doesn't know about alpha
 	if (!pr_alpha_supported && ed->alpha != ENTALPHA_DEFAULT)
-		fprintf (f, "\"alpha\" \"%f\"\n", ENTALPHA_TOSAVE(ed->alpha));
+		SZ_Printf (buf, "\"alpha\" \"%f\"\n", ENTALPHA_TOSAVE(ed->alpha));
 	//johnfitz
 
-	fprintf (f, "}\n");
+	SZ_Printf (buf, "}\n");
 }
 
 void ED_PrintNum (int ent)
@@ -646,6 +887,143 @@ static void ED_Count (void)
 }
 
 
+/*
+=============
+ED_Bench_f
+
+Spawns and removes edicts the way a busy map does, projectiles and gibs
+that live up to a second, in an edict array of its own with the
+server's max_edicts
+=============
+*/
+static void ED_Bench_f (void)
+{
+	edict_t		*saved_edicts, **live;
+	edfree_t	*saved_queue, *saved_heap, *saved_late;
+	float		*dietime;
+	int		saved_num, saved_size, saved_head, saved_count, saved_heapcount;
+	int		saved_latehead, saved_latecount;
+	int		i, j, frames, spawns, numlive, base, allocs, peak;
+	double		saved_time, start, time;
+
+	if (!sv.active)
+	{
+		Con_Printf ("edict_bench: no server running\n");
+		return;
+	}
+	frames = (Cmd_Argc() > 1) ? Q_atoi (Cmd_Argv(1)) : 7200;
+	if (frames < 1)
+	{
+		Con_Printf ("edict_bench [frames] : time spawning and removing edicts, 7200 frames at 72fps by default\n");
+		return;
+	}
+
+// spawns per frame that keep the live and quarantined edicts within
+// the room above a half full map
+	base = sv.max_edicts / 2;
+	spawns = q_max ((sv.max_edicts - base) / 100, 1);
+
+	live = (edict_t **) malloc (sv.max_edicts * sizeof(edict_t *));
+	dietime = (float *) malloc (sv.max_edicts * sizeof(float));
+	if (!live || !dietime)
+	{
+		free (live);
+		free (dietime);
+		Con_Printf ("edict_bench: out of memory\n");
+		return;
+	}
+
+	saved_edicts = sv.edicts;
+	saved_num = sv.num_edicts;
+	saved_time = sv.time;
+	saved_queue = ed_freequeue;
+	saved_size = ed_freesize;
+	saved_head = ed_freehead;
+	saved_count = ed_freecount;
+	saved_heap = ed_freeheap;
+	saved_heapcount = ed_heapcount;
+	saved_late = ed_freelate;
+	saved_latehead = ed_latehead;
+	saved_latecount = ed_latecount;
+
+	sv.edicts = (edict_t *) malloc (sv.max_edicts * pr_edict_size);
+	if (!sv.edicts)
+	{
+		sv.edicts = saved_edicts;
+		free (live);
+		free (dietime);
+		Con_Printf ("edict_bench: out of memory\n");
+		return;
+	}
+	sv.num_edicts = svs.maxclients + 1;
+	memset (sv.edicts, 0, sv.num_edicts * pr_edict_size);
+	sv.time = 1.0;
+	ed_freequeue = NULL;
+	ed_freesize = 0;
+	ED_RebuildFreeQueue ();
+
+// nothing in here may Host_Error while the bench's edicts are in sv.edicts
+	while (sv.num_edicts < base)
+		ED_TryAlloc ();
+
+	numlive = allocs = 0;
+	peak = sv.num_edicts;
+	start = Sys_PreciseTime ();
+	for (i = 0; i < frames; i++)
+	{
+		sv.time += 1.0 / 72;
+		for (j = 0; j < numlive; )
+		{
+			if (dietime[j] > sv.time)
+			{
+				j++;
+				continue;
+			}
+			ED_Free (live[j]);
+			live[j] = live[--numlive];
+			dietime[j] = dietime[numlive];
+		}
+		for (j = 0; j < spawns; j++)
+		{
+			live[numlive] = ED_TryAlloc ();
+			if (!live[numlive])
+				break;
+			dietime[numlive] = sv.time + 0.1 + (rand() & 1023) / 1137.0;
+			numlive++;
+		}
+		allocs += j;
+		peak = q_max (peak, sv.num_edicts);
+		if (j < spawns)
+		{
+			Con_Printf ("edict_bench: ran out of edicts after %i frames\n", i + 1);
+			frames = i + 1;
+			break;
+		}
+	}
+	time = Sys_PreciseTime () - start;
+
+	free (sv.edicts);
+	free (ed_freequeue);
+	Mem_Track (MEMPOOL_MALLOC, "edictqueue", -ed_freesize * 3 * (int)sizeof(edfree_t));
+	sv.edicts = saved_edicts;
+	sv.num_edicts = saved_num;
+	sv.time = saved_time;
+	ed_freequeue = saved_queue;
+	ed_freesize = saved_size;
+	ed_freehead = saved_head;
+	ed_freecount = saved_count;
+	ed_freeheap = saved_heap;
+	ed_heapcount = saved_heapcount;
+	ed_freelate = saved_late;
+	ed_latehead = saved_latehead;
+	ed_latecount = saved_latecount;
+	free (live);
+	free (dietime);
+
+	Con_Printf ("%i frames, %i spawns and removals in %.1f ms, %.0f ns each\n", frames, allocs, time * 1000.0, time * 1e9 / q_max(allocs, 1));
+	Con_Printf ("%i edicts in use at most, max_edicts %i\n", peak, sv.max_edicts);
+}
+
 /*
 ==============================================================================
 
@@ -660,14 +1038,14 @@ FIXME: need to tag constants, doesn't really work
 ED_WriteGlobals
 =============
 */
-void ED_WriteGlobals (FILE *f)
+void ED_WriteGlobals (sizebuf_t *buf)
 {
 	ddef_t		*def;
 	int			i;
 	const char		*name;
 	int			type;
 
-	fprintf (f, "{\n");
+	SZ_Printf (buf, "{\n");
 	for (i = 0; i < progs->numglobaldefs; i++)
 	{
 		def = &pr_globaldefs[i];
@@ -680,10 +1058,10 @@ void ED_WriteGlobals (FILE *f)
 			continue;
 
 		name = PR_GetString(def->s_name);
-		fprintf (f, "\"%s\" ", name);
-		fprintf (f, "\"%s\"\n", PR_UglyValueString(type, (eval_t *)&pr_globals[def->ofs]));
+		SZ_Printf (buf, "\"%s\" ", name);
+		SZ_Printf (buf, "\"%s\"\n", PR_UglyValueString(type, (eval_t *)&pr_globals[def->ofs]));
 	}
-	fprintf (f, "}\n");
+	SZ_Printf (buf, "}\n");
 }
 
 /*
@@ -949,9 +1327,439 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 	if (!init)
 		ent->free = true;
 
+	PR_FindMark (ent);
+	SV_MarkEdictMoved (ent);
+
 	return data;
 }
 
+/*
+==============================================================================
+
+BINARY SAVEGAMES
+
+Host_Savegame_f puts ED_SaveBinary after the rest of a binary save: every
+string the progs state refers to once, the names of the fields and saved
+globals, the saved globals, and then each edict's whole field block. In
+the blocks, strings become 1 + their index in the table (0 stays the null
+string), edicts become edict numbers, and functions and fields become the
+table index of their name, so ED_LoadBinary can map everything by name
+like the text format does, even for a progs whose layout moved.
+==============================================================================
+*/
+
+static sizebuf_t	ed_savestrings;		// the table, NUL-terminated strings
+static int		*ed_savestringofs;	// by index
+static int		ed_numsavestrings, ed_maxsavestrings;
+static int		*ed_savehash;		// by hash, string index or -1
+static int		ed_savehashsize;
+
+static void ED_SaveFreeStrings (void)
+{
+	SZ_FreeReserved (&ed_savestrings);
+	Mem_Track (MEMPOOL_MALLOC, "savegame", -(ed_maxsavestrings + ed_savehashsize) * (int)sizeof(int));
+	free (ed_savestringofs);
+	free (ed_savehash);
+	ed_savestringofs = ed_savehash = NULL;
+	ed_numsavestrings = ed_maxsavestrings = ed_savehashsize = 0;
+}
+
+static void ED_SaveRehash (void)
+{
+	int	i, j, size;
+
+	size = q_max (ed_savehashsize * 2, 4096);
+	Mem_Track (MEMPOOL_MALLOC, "savegame", (size - ed_savehashsize) * (int)sizeof(int));
+	free (ed_savehash);
+	ed_savehash = (int *) malloc (size * sizeof(int));
+	if (!ed_savehash)
+		Sys_Error ("ED_SaveRehash: failed on allocation of %i bytes", size * (int)sizeof(int));
+	ed_savehashsize = size;
+	memset (ed_savehash, -1, size * sizeof(int));
+	for (i = 0; i < ed_numsavestrings; i++)
+	{
+		j = COM_HashString ((char *)ed_savestrings.data + ed_savestringofs[i]) & (size - 1);
+		while (ed_savehash[j] != -1)
+			j = (j + 1) & (size - 1);
+		ed_savehash[j] = i;
+	}
+}
+
+// returns the string's reference in the save, adding it to the table
+static int ED_SaveString (const char *s)
+{
+	int	i, len;
+
+	if (ed_numsavestrings * 2 >= ed_savehashsize)
+		ED_SaveRehash ();
+	for (i = COM_HashString (s) & (ed_savehashsize - 1); ed_savehash[i] != -1; i = (i + 1) & (ed_savehashsize - 1))
+	{
+		if (!strcmp ((char *)ed_savestrings.data + ed_savestringofs[ed_savehash[i]], s))
+			return ed_savehash[i] + 1;
+	}
+
+	if (ed_numsavestrings == ed_maxsavestrings)
+	{
+		int	maxstrings = q_max (ed_maxsavestrings * 2, 1024);
+		int	*ofs = (int *) realloc (ed_savestringofs, maxstrings * sizeof(int));
+
+		if (!ofs)
+			Sys_Error ("ED_SaveString: failed on allocation of %i bytes", maxstrings * (int)sizeof(int));
+		Mem_Track (MEMPOOL_MALLOC, "savegame", (maxstrings - ed_maxsavestrings) * (int)sizeof(int));
+		ed_savestringofs = ofs;
+		ed_maxsavestrings = maxstrings;
+	}
+	len = strlen (s) + 1;
+	SZ_Reserve (&ed_savestrings, len);
+	ed_savestringofs[ed_numsavestrings] = ed_savestrings.cursize;
+	SZ_Write (&ed_savestrings, s, len);
+	ed_savehash[i] = ed_numsavestrings;
+	return ++ed_numsavestrings;
+}
+
+static void ED_SaveLong (sizebuf_t *buf, int c)
+{
+	SZ_Reserve (buf, 4);
+	MSG_WriteLong (buf, c);
+}
+
+static int ED_SaveValue (int type, int v)
+{
+	ddef_t	*def;
+
+	switch (type)
+	{
+	case ev_string:
+		return v ? ED_SaveString (PR_GetString (v)) : 0;
+	case ev_entity:
+		return v / pr_edict_size;
+	case ev_function:
+		if (v <= 0 || v >= progs->numfunctions)
+			return 0;
+		return ED_SaveString (PR_GetString (pr_functions[v].s_name));
+	case ev_field:
+		def = v ? ED_FieldAtOfs (v) : NULL;
+		return def ? ED_SaveString (PR_GetString (def->s_name)) : 0;
+	default:
+		return v;
+	}
+}
+
+// the fields and globals ED_Write and ED_WriteGlobals would save
+static qboolean ED_SavedField (ddef_t *d)
+{
+	const char	*name = PR_GetString (d->s_name);
+	int		j = strlen (name);
+
+	return !(j > 1 && name[j - 2] == '_');	// skip _x, _y, _z vars
+}
+
+static qboolean ED_SavedGlobal (ddef_t *def)
+{
+	int	type = def->type & ~DEF_SAVEGLOBAL;
+
+	if (!(def->type & DEF_SAVEGLOBAL))
+		return false;
+	return type == ev_string || type == ev_float || type == ev_entity;
+}
+
+/*
+=============
+ED_SaveBinary
+
+Appends the progs state to a malloc'd sizebuf, see SZ_Reserve
+=============
+*/
+void ED_SaveBinary (sizebuf_t *buf)
+{
+	sizebuf_t	body;
+	ddef_t		*d;
+	edict_t		*ed;
+	int		*v;
+	int		i, j, type, count;
+	int		mark = Scratch_Mark ();
+
+	ED_SaveFreeStrings ();	// in case the last save died in a Host_Error
+	memset (&body, 0, sizeof(body));
+
+	for (i = 1, count = 0; i < progs->numfielddefs; i++)
+		count += ED_SavedField (&pr_fielddefs[i]);
+	ED_SaveLong (&body, count);
+	for (i = 1; i < progs->numfielddefs; i++)
+	{
+		d = &pr_fielddefs[i];
+		if (!ED_SavedField (d))
+			continue;
+		ED_SaveLong (&body, d->type & ~DEF_SAVEGLOBAL);
+		ED_SaveLong (&body, d->ofs);
+		ED_SaveLong (&body, ED_SaveString (PR_GetString (d->s_name)));
+	}
+
+	for (i = 0, count = 0; i < progs->numglobaldefs; i++)
+		count += ED_SavedGlobal (&pr_globaldefs[i]);
+	ED_SaveLong (&body, count);
+	for (i = 0; i < progs->numglobaldefs; i++)
+	{
+		d = &pr_globaldefs[i];
+		if (!ED_SavedGlobal (d))
+			continue;
+		type = d->type & ~DEF_SAVEGLOBAL;
+		ED_SaveLong (&body, type);
+		ED_SaveLong (&body, ED_SaveString (PR_GetString (d->s_name)));
+		ED_SaveLong (&body, ED_SaveValue (type, G_INT (d->ofs)));
+	}
+
+	ED_SaveLong (&body, progs->entityfields);
+	ED_SaveLong (&body, sv.num_edicts);
+	v = (int *) Scratch_Alloc (progs->entityfields * 4);
+	for (i = 0; i < sv.num_edicts; i++)
+	{
+		ed = EDICT_NUM(i);
+		SZ_Reserve (&body, 2 + progs->entityfields * 4);
+		MSG_WriteByte (&body, ed->free);
+		MSG_WriteByte (&body, ed->alpha);
+		if (ed->free)
+			continue;
+
+		memcpy (v, &ed->v, progs->entityfields * 4);
+		for (j = 1; j < progs->numfielddefs; j++)
+		{
+			d = &pr_fielddefs[j];
+			type = d->type & ~DEF_SAVEGLOBAL;
+			if (type == ev_string || type == ev_entity || type == ev_function || type == ev_field)
+				v[d->ofs] = ED_SaveValue (type, v[d->ofs]);
+		}
+		for (j = 0; j < progs->entityfields; j++)
+			MSG_WriteLong (&body, v[j]);
+	}
+	Scratch_Release (mark);
+
+	ED_SaveLong (buf, ed_numsavestrings);
+	ED_SaveLong (buf, ed_savestrings.cursize);
+	SZ_Reserve (buf, ed_savestrings.cursize + body.cursize);
+	SZ_Write (buf, ed_savestrings.data, ed_savestrings.cursize);
+	SZ_Write (buf, body.data, body.cursize);
+
+	SZ_FreeReserved (&body);
+	ED_SaveFreeStrings ();
+}
+
+typedef struct
+{
+	int	type, ofs;
+	ddef_t	*def;	// in the current progs, or NULL
+} loadfield_t;
+
+static const char	**ed_loadstrings;
+static int		ed_numloadstrings;
+static loadfield_t	*ed_loadfields;
+static int		ed_loadsize;	// of both, for Mem_Track
+
+static void ED_LoadFree (void)
+{
+	Mem_Track (MEMPOOL_MALLOC, "savegame", -ed_loadsize);
+	free (ed_loadstrings);
+	free (ed_loadfields);
+	ed_loadstrings = NULL;
+	ed_loadfields = NULL;
+	ed_numloadstrings = ed_loadsize = 0;
+}
+
+static void *ED_LoadAlloc (int count, int size)
+{
+	void	*p = malloc (q_max (count, 1) * size);
+
+	if (!p)
+		Sys_Error ("ED_LoadBinary: failed on allocation of %i bytes", count * size);
+	ed_loadsize += q_max (count, 1) * size;
+	Mem_Track (MEMPOOL_MALLOC, "savegame", q_max (count, 1) * size);
+	return p;
+}
+
+static const char *ED_LoadString (int ref)
+{
+	if (ref < 1 || ref > ed_numloadstrings)
+		Host_Error ("ED_LoadBinary: bad string %i", ref);
+	return ed_loadstrings[ref - 1];
+}
+
+static int ED_LoadValue (int type, int v)
+{
+	ddef_t		*def;
+	dfunction_t	*func;
+	const char	*s;
+	char		*p = NULL;
+	int		num;
+
+	switch (type)
+	{
+	case ev_string:
+		if (!v)
+			return 0;
+		s = ED_LoadString (v);
+		num = PR_AllocString (strlen (s) + 1, &p);
+		strcpy (p, s);
+		return num;
+	case ev_entity:
+		if (v < 0 || v >= sv.max_edicts)
+			Host_Error ("ED_LoadBinary: bad edict %i", v);
+		return EDICT_TO_PROG(EDICT_NUM(v));
+	case ev_function:
+		if (!v)
+			return 0;
+		s = ED_LoadString (v);
+		func = ED_FindFunction (s);
+		if (!func)
+		{
+			Con_Printf ("Can't find function %s\n", s);
+			return 0;
+		}
+		return func - pr_functions;
+	case ev_field:
+		if (!v)
+			return 0;
+		s = ED_LoadString (v);
+		def = ED_FindField (s);
+		if (!def)
+		{
+			Con_DPrintf ("Can't find field %s\n", s);
+			return 0;
+		}
+		return def->ofs;
+	default:
+		return v;
+	}
+}
+
+/*
+=============
+ED_LoadBinary
+
+Reads back what ED_SaveBinary wrote, starting at buf->cursize, and links
+the edicts like Host_Loadgame_f does for the text format
+=============
+*/
+void ED_LoadBinary (sizebuf_t *buf)
+{
+	loadfield_t	*fields;
+	sizebuf_t	strings;
+	ddef_t		*def;
+	edict_t		*ent;
+	const byte	*v, *from;
+	int		*to;
+	int		i, j, k, type, numfields, numglobals, entityfields, numedicts;
+	const char	*name;
+
+	ED_LoadFree ();	// in case the last load died in a Host_Error
+	ed_numloadstrings = SZ_ReadLong (buf);
+	memset (&strings, 0, sizeof(strings));
+	strings.maxsize = SZ_ReadLong (buf);
+	strings.data = buf->data + buf->cursize;
+	if (ed_numloadstrings < 0 || strings.maxsize < 0 || strings.maxsize > buf->maxsize - buf->cursize)
+		Host_Error ("ED_LoadBinary: savegame is corrupt");
+	buf->cursize += strings.maxsize;
+	if (ed_numloadstrings > strings.maxsize)
+		Host_Error ("ED_LoadBinary: savegame is corrupt");
+	ed_loadstrings = (const char **) ED_LoadAlloc (ed_numloadstrings, sizeof(*ed_loadstrings));
+	for (i = 0; i < ed_numloadstrings; i++)
+		ed_loadstrings[i] = SZ_ReadString (&strings);
+	if (strings.overflowed)
+		Host_Error ("ED_LoadBinary: savegame is corrupt");
+
+	numfields = SZ_ReadLong (buf);
+	if (numfields < 0 || numfields > (buf->maxsize - buf->cursize) / 12)
+		Host_Error ("ED_LoadBinary: savegame is corrupt");
+	fields = ed_loadfields = (loadfield_t *) ED_LoadAlloc (numfields, sizeof(*fields));
+	for (i = 0; i < numfields; i++)
+	{
+		fields[i].type = SZ_ReadLong (buf);
+		fields[i].ofs = SZ_ReadLong (buf);
+		name = ED_LoadString (SZ_ReadLong (buf));
+		def = ED_FindField (name);
+		if (def && (def->type & ~DEF_SAVEGLOBAL) != fields[i].type)
+			def = NULL;
+		if (!def)
+		{
+			//johnfitz -- HACK -- suppress error becuase fog/sky/alpha fields might not be mentioned in defs.qc
+			if (strncmp(name, "sky", 3) && strcmp(name, "fog") && strcmp(name, "alpha"))
+				Con_DPrintf ("\"%s\" is not a field\n", name);
+		}
+		fields[i].def = def;
+	}
+
+	numglobals = SZ_ReadLong (buf);
+	for (i = 0; i < numglobals && !buf->overflowed; i++)
+	{
+		type = SZ_ReadLong (buf);
+		name = ED_LoadString (SZ_ReadLong (buf));
+		k = SZ_ReadLong (buf);
+		def = ED_FindGlobal (name);
+		if (!def || (def->type & ~DEF_SAVEGLOBAL) != type)
+		{
+			Con_Printf ("'%s' is not a global\n", name);
+			continue;
+		}
+		G_INT(def->ofs) = ED_LoadValue (type, k);
+	}
+
+	entityfields = SZ_ReadLong (buf);
+	numedicts = SZ_ReadLong (buf);
+	if (buf->overflowed || entityfields < 0 || numedicts < 1 || numedicts > sv.max_edicts)
+		Host_Error ("ED_LoadBinary: savegame is corrupt");
+	for (i = 0; i < numfields; i++)
+	{
+		if (fields[i].def && (fields[i].ofs < 0 || fields[i].ofs + type_size[fields[i].type & 7] > entityfields))
+			Host_Error ("ED_LoadBinary: savegame is corrupt");
+	}
+
+	for (i = 0; i < numedicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (i < sv.num_edicts)
+		{
+			ent->free = false;
+			memset (&ent->v, 0, progs->entityfields * 4);
+		}
+		else
+			memset (ent, 0, pr_edict_size);
+
+		if (SZ_ReadByte (buf))
+			ent->free = true;
+		ent->alpha = SZ_ReadByte (buf);
+		if (!ent->free)
+		{
+			if (entityfields * 4 > buf->maxsize - buf->cursize)
+				Host_Error ("ED_LoadBinary: savegame is truncated");
+			v = buf->data + buf->cursize;
+			buf->cursize += entityfields * 4;
+			for (j = 0; j < numfields; j++)
+			{
+				def = fields[j].def;
+				if (!def)
+					continue;
+				to = (int *)&ent->v + def->ofs;
+				from = v + fields[j].ofs * 4;
+				for (k = 0; k < type_size[fields[j].type & 7]; k++, from += 4)
+					to[k] = ED_LoadValue (fields[j].type, from[0] | (from[1] << 8) | (from[2] << 16) | ((unsigned int)from[3] << 24));
+			}
+		}
+		if (buf->overflowed)
+			Host_Error ("ED_LoadBinary: savegame is truncated");
+
+		PR_FindMark (ent);
+		SV_MarkEdictMoved (ent);
+
+	// link it into the bsp tree
+		if (!ent->free)
+			SV_LinkEdict (ent, false);
+		else
+			SV_UnlinkEdict (ent);
+	}
+
+	sv.num_edicts = numedicts;
+	ED_LoadFree ();
+}
+
 
 /*
 ================
@@ -1049,14 +1857,13 @@ PR_LoadProgs
 void PR_LoadProgs (void)
 {
 	int			i;
-
-	// flush the non-C variable lookup cache
-	for (i = 0; i < GEFV_CACHESIZE; i++)
-		gefvCache[i].field[0] = 0;
+	const char		*requester;
 
 	CRC_Init (&pr_crc);
 
+	requester = COM_SetFileRequester ("progs");
 	progs = (dprograms_t *)COM_LoadHunkFile ("progs.dat", NULL);
+	COM_SetFileRequester (requester);
 	if (!progs)
 		Host_Error ("PR_LoadProgs: couldn't load progs.dat");
 	Con_DPrintf ("Programs occupy %iK.\n", com_filesize/1024);
@@ -1079,12 +1886,8 @@ void PR_LoadProgs (void)
 		Host_Error ("progs.dat strings go past end of file\n");
 
 	// initialize the strings
-	pr_numknownstrings = 0;
-	pr_maxknownstrings = 0;
 	pr_stringssize = progs->numstrings;
-	if (pr_knownstrings)
-		Z_Free ((void *)pr_knownstrings);
-	pr_knownstrings = NULL;
+	PR_ClearKnownStrings ();
 	PR_SetEngineString("");
 
 	pr_globaldefs = (ddef_t *)((byte *)progs + progs->ofs_globaldefs);
@@ -1120,8 +1923,6 @@ void PR_LoadProgs (void)
 		pr_globaldefs[i].s_name = LittleLong (pr_globaldefs[i].s_name);
 	}
 
-	pr_alpha_supported = false; //johnfitz
-
 	for (i = 0; i < progs->numfielddefs; i++)
 	{
 		pr_fielddefs[i].type = LittleShort (pr_fielddefs[i].type);
@@ -1129,11 +1930,6 @@ void PR_LoadProgs (void)
 			Host_Error ("PR_LoadProgs: pr_fielddefs[i].type & DEF_SAVEGLOBAL");
 		pr_fielddefs[i].ofs = LittleShort (pr_fielddefs[i].ofs);
 		pr_fielddefs[i].s_name = LittleLong (pr_fielddefs[i].s_name);
-
-		//johnfitz -- detect alpha support in progs.dat
-		if (!strcmp(pr_strings + pr_fielddefs[i].s_name,"alpha"))
-			pr_alpha_supported = true;
-		//johnfitz
 	}
 
 	for (i = 0; i < progs->numglobals; i++)
@@ -1145,6 +1941,26 @@ void PR_LoadProgs (void)
 	// properly aligned
 	pr_edict_size += sizeof(void *) - 1;
 	pr_edict_size &= ~(sizeof(void *) - 1);
+
+	ED_BuildNameHash (&pr_fieldhash, &pr_fielddefs->s_name, progs->numfielddefs, sizeof(ddef_t));
+	ED_BuildNameHash (&pr_globalhash, &pr_globaldefs->s_name, progs->numglobaldefs, sizeof(ddef_t));
+	ED_BuildNameHash (&pr_functionhash, &pr_functions->s_name, progs->numfunctions, sizeof(dfunction_t));
+
+	// resolve the optional fields the engine uses
+	pr_extfields.alpha = ED_FindFieldOffset ("alpha", ev_float);
+	pr_extfields.gravity = ED_FindFieldOffset ("gravity", ev_float);
+	pr_extfields.items2 = ED_FindFieldOffset ("items2", ev_float);
+	pr_extfields.ammo_shells1 = ED_FindFieldOffset ("ammo_shells1", ev_float);
+	pr_extfields.ammo_nails1 = ED_FindFieldOffset ("ammo_nails1", ev_float);
+	pr_extfields.ammo_lava_nails = ED_FindFieldOffset ("ammo_lava_nails", ev_float);
+	pr_extfields.ammo_rockets1 = ED_FindFieldOffset ("ammo_rockets1", ev_float);
+	pr_extfields.ammo_multi_rockets = ED_FindFieldOffset ("ammo_multi_rockets", ev_float);
+	pr_extfields.ammo_cells1 = ED_FindFieldOffset ("ammo_cells1", ev_float);
+	pr_extfields.ammo_plasma = ED_FindFieldOffset ("ammo_plasma", ev_float);
+
+	pr_alpha_supported = (pr_extfields.alpha != -1); //johnfitz -- detect alpha support in progs.dat
+
+	PR_DecodeStatements ();
 }
 
 
@@ -1158,7 +1974,9 @@ void PR_Init (void)
 	Cmd_AddCommand ("edict", ED_PrintEdict_f);
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
+	Cmd_AddCommand ("edict_bench", ED_Bench_f);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cvar_RegisterVariable (&pr_findindex);
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_RegisterVariable (&gamecfg);
 	Cvar_RegisterVariable (&scratch1);
@@ -1170,6 +1988,8 @@ void PR_Init (void)
 	Cvar_RegisterVariable (&saved2);
 	Cvar_RegisterVariable (&saved3);
 	Cvar_RegisterVariable (&saved4);
+	Cvar_RegisterVariable (&pr_engine);
+	PR_JitInit ();
 }
 
 
@@ -1195,13 +2015,102 @@ int NUM_FOR_EDICT(edict_t *e)
 //===========================================================================
 
 
-#define	PR_STRING_ALLOCSLOTS	256
+/*
+=================
+Known strings
+
+Strings outside of pr_strings are known by slot, string_t -1 - slot.
+PR_SetEngineString gives engine strings a slot, found again through a hash
+of the pointer, and PR_AllocString allocates strings that PR_FreeString
+can give back, their slots going on a free list for reuse. All of them go
+when the next progs are loaded.
+=================
+*/
+typedef struct
+{
+	const char	*string;	// NULL for a free slot
+	int		next;		// in the hash chain, or the free list
+	int		size;		// of an allocated string, 0 for an engine string
+} knownstring_t;
+
+#define	PR_STRING_MINSLOTS	1024
+
+static	knownstring_t	*pr_knownstrings;
+static	int		pr_maxknownstrings;	// a power of two, also the hash size
+static	int		pr_numknownstrings;	// slots used so far, free ones included
+static	int		pr_freeknownstring;	// -1 if none
+static	int		*pr_knownstringhash;
+
+static int PR_KnownStringHash (const char *s)
+{
+	return (int)((((size_t)s >> 3) * 2654435761u) & (pr_maxknownstrings - 1));
+}
+
+static void PR_ClearKnownStrings (void)
+{
+	int		i, bytes = 0;
+
+	for (i = 0; i < pr_numknownstrings; i++)
+	{
+		if (pr_knownstrings[i].size)
+		{
+			bytes += pr_knownstrings[i].size;
+			free ((void *)pr_knownstrings[i].string);
+		}
+	}
+	Mem_Track (MEMPOOL_MALLOC, "qcstrings", -bytes);
+	pr_numknownstrings = 0;
+	pr_freeknownstring = -1;
+	if (pr_knownstringhash)
+		memset (pr_knownstringhash, 0xff, pr_maxknownstrings * sizeof(int));
+}
 
 static void PR_AllocStringSlots (void)
 {
-	pr_maxknownstrings += PR_STRING_ALLOCSLOTS;
+	int		i, h, oldmax = pr_maxknownstrings;
+
+	pr_maxknownstrings = q_max(pr_maxknownstrings * 2, PR_STRING_MINSLOTS);
 	Con_DPrintf2("PR_AllocStringSlots: realloc'ing for %d slots\n", pr_maxknownstrings);
-	pr_knownstrings = (const char **) Z_Realloc ((void *)pr_knownstrings, pr_maxknownstrings * sizeof(char *));
+	pr_knownstrings = (knownstring_t *) realloc (pr_knownstrings, pr_maxknownstrings * sizeof(knownstring_t));
+	free (pr_knownstringhash);
+	pr_knownstringhash = (int *) malloc (pr_maxknownstrings * sizeof(int));
+	if (!pr_knownstrings || !pr_knownstringhash)
+		Sys_Error ("PR_AllocStringSlots: out of memory for %d strings", pr_maxknownstrings);
+	Mem_Track (MEMPOOL_MALLOC, "qcstrings", (pr_maxknownstrings - oldmax) * (int)(sizeof(knownstring_t) + sizeof(int)));
+
+	memset (pr_knownstringhash, 0xff, pr_maxknownstrings * sizeof(int));
+	for (i = 0; i < pr_numknownstrings; i++)
+	{
+		if (!pr_knownstrings[i].string)
+			continue;
+		h = PR_KnownStringHash (pr_knownstrings[i].string);
+		pr_knownstrings[i].next = pr_knownstringhash[h];
+		pr_knownstringhash[h] = i;
+	}
+}
+
+static int PR_NewStringSlot (const char *s, int size)
+{
+	int		i, h;
+
+	if (pr_freeknownstring != -1)
+	{
+		i = pr_freeknownstring;
+		pr_freeknownstring = pr_knownstrings[i].next;
+	}
+	else
+	{
+		if (pr_numknownstrings == pr_maxknownstrings)
+			PR_AllocStringSlots();
+		i = pr_numknownstrings++;
+	}
+
+	h = PR_KnownStringHash (s);
+	pr_knownstrings[i].string = s;
+	pr_knownstrings[i].size = size;
+	pr_knownstrings[i].next = pr_knownstringhash[h];
+	pr_knownstringhash[h] = i;
+	return i;
 }
 
 const char *PR_GetString (int num)
@@ -1210,12 +2119,12 @@ const char *PR_GetString (int num)
 		return pr_strings + num;
 	else if (num < 0 && num >= -pr_numknownstrings)
 	{
-		if (!pr_knownstrings[-1 - num])
+		if (!pr_knownstrings[-1 - num].string)
 		{
 			Host_Error ("PR_GetString: attempt to get a non-existant string %d\n", num);
 			return "";
 		}
-		return pr_knownstrings[-1 - num];
+		return pr_knownstrings[-1 - num].string;
 	}
 	else
 	{
@@ -1237,50 +2146,78 @@ int PR_SetEngineString (const char *s)
 	if (s >= pr_strings && s <= pr_strings + pr_stringssize - 2)
 		return (int)(s - pr_strings);
 #endif
-	for (i = 0; i < pr_numknownstrings; i++)
+	if (pr_maxknownstrings)
 	{
-		if (pr_knownstrings[i] == s)
-			return -1 - i;
+		for (i = pr_knownstringhash[PR_KnownStringHash(s)]; i != -1; i = pr_knownstrings[i].next)
+		{
+			if (pr_knownstrings[i].string == s)
+				return -1 - i;
+		}
 	}
 	// new unknown engine string
 	//Con_DPrintf ("PR_SetEngineString: new engine string %p\n", s);
-#if 0
-	for (i = 0; i < pr_numknownstrings; i++)
-	{
-		if (!pr_knownstrings[i])
-			break;
-	}
-#endif
-//	if (i >= pr_numknownstrings)
-//	{
-		if (i >= pr_maxknownstrings)
-			PR_AllocStringSlots();
-		pr_numknownstrings++;
-//	}
-	pr_knownstrings[i] = s;
-	return -1 - i;
+	return -1 - PR_NewStringSlot (s, 0);
 }
 
 int PR_AllocString (int size, char **ptr)
 {
-	int		i;
+	char		*s;
 
 	if (!size)
 		return 0;
-	for (i = 0; i < pr_numknownstrings; i++)
-	{
-		if (!pr_knownstrings[i])
-			break;
-	}
-//	if (i >= pr_numknownstrings)
-//	{
-		if (i >= pr_maxknownstrings)
-			PR_AllocStringSlots();
-		pr_numknownstrings++;
-//	}
-	pr_knownstrings[i] = (char *)Hunk_AllocName(size, "string");
+	s = (char *) malloc (size);
+	if (!s)
+		Sys_Error ("PR_AllocString: out of memory for %d bytes", size);
+	Mem_Track (MEMPOOL_MALLOC, "qcstrings", size);
 	if (ptr)
-		*ptr = (char *) pr_knownstrings[i];
-	return -1 - i;
+		*ptr = s;
+	return -1 - PR_NewStringSlot (s, size);
+}
+
+/*
+=================
+PR_FreeString
+
+Gives back a string from PR_AllocString, its string_t can be handed out
+again
+=================
+*/
+void PR_FreeString (int num)
+{
+	knownstring_t	*k;
+	int		i, *link;
+
+	i = -1 - num;
+	if (i < 0 || i >= pr_numknownstrings || !pr_knownstrings[i].size)
+		Host_Error ("PR_FreeString: %d is not an allocated string\n", num);
+	k = &pr_knownstrings[i];
+
+	for (link = &pr_knownstringhash[PR_KnownStringHash(k->string)]; *link != i; link = &pr_knownstrings[*link].next)
+		;
+	*link = k->next;
+
+	Mem_Track (MEMPOOL_MALLOC, "qcstrings", -k->size);
+	free ((void *)k->string);
+	k->string = NULL;
+	k->size = 0;
+	k->next = pr_freeknownstring;
+	pr_freeknownstring = i;
+
+	PR_ClearFindIndex ();	// edicts can still use it, and see a new string in its slot
+}
+
+/*
+=================
+PR_StringIsStable
+
+Strings in pr_strings and from PR_AllocString keep their contents for as
+long as they are there, engine strings can live in buffers that are reused
+=================
+*/
+qboolean PR_StringIsStable (int num)
+{
+	if (num >= 0)
+		return num < pr_stringssize;
+	return -1 - num < pr_numknownstrings && pr_knownstrings[-1 - num].size;
 }
 
@@ -40,6 +40,26 @@ dfunction_t	*pr_xfunction;
 int		pr_xstatement;
 int		pr_argc;
 
+#if (defined(__x86_64__) || (defined(__aarch64__) && !defined(__APPLE__))) && !defined(_WIN32) && !defined(PR_NO_JIT)
+#define	PR_JIT		// see QUAKEC JIT below
+#endif
+
+#ifdef PR_JIT
+static enum
+{
+	JITCHECK_NONE,
+	JITCHECK_RECORD,	// interpreting, and recording builtin calls
+	JITCHECK_BUILTIN,	// in a builtin that's being recorded
+	JITCHECK_REPLAY		// running compiled code, replaying builtin calls
+} pr_jitcheck_state;
+
+static qboolean PR_JitEnter (dfunction_t *f);
+static void PR_RunFunction (dfunction_t *f);
+static void PR_JitCheck (dfunction_t *f);
+static void PR_JitCheckBuiltin (int i);
+static void PR_JitReset (void);
+#endif
+
 static const char *pr_opnames[] =
 {
 	"DONE",
@@ -207,21 +227,420 @@ static void PR_StackTrace (void)
 }
 
 
+/*
+==============================================================================
+
+				QUAKEC PROFILER
+
+"profile start" times every QC function and builtin call with
+Sys_PreciseTime, until "profile stop". Calls are kept in a tree with a node
+per call path, which gives exclusive time per path for "profile flamegraph"
+to write out as folded stacks, and calls and time per caller and callee for
+"profile print". Inclusive time per function only counts the outermost of
+recursive calls. Timing goes through PR_EnterFunction, PR_LeaveFunction and
+PR_CallBuiltin, so it covers all the engines, but not the replay half of a
+pr_jit 2 check.
+
+==============================================================================
+*/
+
+typedef struct
+{
+	int		fnum;
+	int		parent;		// node
+	int		hashnext;	// node with the same hash of parent and fnum, 0 for none
+	int		calls;
+	double		self, total;
+} prprofnode_t;
+
+typedef struct
+{
+	int		node;
+	double		start;
+	double		children;	// time spent in calls made from here
+} prprofframe_t;
+
+typedef struct
+{
+	int		calls;
+	int		active;		// recursion depth, inclusive time is added at 0
+	double		self, total;
+} prproffunc_t;
+
+typedef struct
+{
+	int		caller, callee;
+	int		calls;
+	double		total;
+} prprofedge_t;
+
+#define	PR_PROF_MAXFRAMES	(MAX_STACK_DEPTH * 2)	// QC functions, and the builtins between them
+
+static	qboolean	pr_profiling;
+static	double		pr_profstart, pr_proftime;	// when it was started, time run before that
+static	unsigned short	pr_profcrc;
+static	int		pr_profnumfunctions;		// of the progs the profile is for
+static	prproffunc_t	*pr_proffuncs;
+static	prprofnode_t	*pr_profnodes;			// node 0 is the engine
+static	int		pr_numprofnodes, pr_maxprofnodes;
+static	int		*pr_profhash;			// pr_maxprofnodes buckets
+static	prprofframe_t	pr_profstack[PR_PROF_MAXFRAMES];
+static	int		pr_profdepth;
+
+static int PR_ProfileHash (int parent, int fnum)
+{
+	return (int)(((unsigned int)parent * 2654435761u + (unsigned int)fnum) & (pr_maxprofnodes - 1));
+}
+
+static void PR_ProfileClear (void)
+{
+	Mem_Track (MEMPOOL_MALLOC, "qcprofile", -(pr_profnumfunctions * (int)sizeof(prproffunc_t) + pr_maxprofnodes * (int)(sizeof(prprofnode_t) + sizeof(int))));
+	free (pr_proffuncs);
+	free (pr_profnodes);
+	free (pr_profhash);
+	pr_proffuncs = NULL;
+	pr_profnodes = NULL;
+	pr_profhash = NULL;
+	pr_profnumfunctions = pr_numprofnodes = pr_maxprofnodes = 0;
+	pr_profdepth = 0;
+	pr_proftime = 0;
+}
+
+static void PR_ProfileGrow (void)
+{
+	int		i, h, oldmax = pr_maxprofnodes;
+
+	pr_maxprofnodes = q_max(pr_maxprofnodes * 2, 4096);
+	pr_profnodes = (prprofnode_t *) realloc (pr_profnodes, pr_maxprofnodes * sizeof(prprofnode_t));
+	free (pr_profhash);
+	pr_profhash = (int *) calloc (pr_maxprofnodes, sizeof(int));
+	if (!pr_profnodes || !pr_profhash)
+		Sys_Error ("PR_ProfileGrow: out of memory for %d nodes", pr_maxprofnodes);
+	Mem_Track (MEMPOOL_MALLOC, "qcprofile", (pr_maxprofnodes - oldmax) * (int)(sizeof(prprofnode_t) + sizeof(int)));
+
+	for (i = 1; i < pr_numprofnodes; i++)
+	{
+		h = PR_ProfileHash (pr_profnodes[i].parent, pr_profnodes[i].fnum);
+		pr_profnodes[i].hashnext = pr_profhash[h];
+		pr_profhash[h] = i;
+	}
+}
+
+static void PR_ProfileBegin (void)
+{
+	PR_ProfileClear ();
+	pr_profnumfunctions = progs->numfunctions;
+	pr_profcrc = pr_crc;
+	pr_proffuncs = (prproffunc_t *) calloc (pr_profnumfunctions, sizeof(prproffunc_t));
+	if (!pr_proffuncs)
+		Sys_Error ("PR_ProfileBegin: out of memory for %d functions", pr_profnumfunctions);
+	Mem_Track (MEMPOOL_MALLOC, "qcprofile", pr_profnumfunctions * (int)sizeof(prproffunc_t));
+	PR_ProfileGrow ();
+	memset (&pr_profnodes[0], 0, sizeof(prprofnode_t));
+	pr_numprofnodes = 1;
+}
+
 /*
 ============
-PR_Profile_f
+PR_ProfileEnter
 
+Starts timing a call to function fnum
 ============
 */
-void PR_Profile_f (void)
+static void PR_ProfileEnter (int fnum)
+{
+	prprofframe_t	*frame;
+	prprofnode_t	*node;
+	int		parent, n, h;
+
+#ifdef PR_JIT
+	if (pr_jitcheck_state == JITCHECK_REPLAY)
+		return;
+#endif
+	if (pr_profdepth == PR_PROF_MAXFRAMES)
+		PR_RunError ("PR_ProfileEnter: too deep");
+
+	parent = pr_profdepth ? pr_profstack[pr_profdepth - 1].node : 0;
+	h = PR_ProfileHash (parent, fnum);
+	for (n = pr_profhash[h]; n; n = pr_profnodes[n].hashnext)
+	{
+		if (pr_profnodes[n].parent == parent && pr_profnodes[n].fnum == fnum)
+			break;
+	}
+	if (!n)
+	{
+		if (pr_numprofnodes == pr_maxprofnodes)
+		{
+			PR_ProfileGrow ();
+			h = PR_ProfileHash (parent, fnum);
+		}
+		n = pr_numprofnodes++;
+		node = &pr_profnodes[n];
+		memset (node, 0, sizeof(*node));
+		node->fnum = fnum;
+		node->parent = parent;
+		node->hashnext = pr_profhash[h];
+		pr_profhash[h] = n;
+	}
+	pr_profnodes[n].calls++;
+	pr_proffuncs[fnum].calls++;
+	pr_proffuncs[fnum].active++;
+
+	frame = &pr_profstack[pr_profdepth++];
+	frame->node = n;
+	frame->children = 0;
+	frame->start = Sys_PreciseTime ();
+}
+
+/*
+============
+PR_ProfileLeave
+
+Stops timing the innermost call
+============
+*/
+static void PR_ProfileLeave (void)
+{
+	prprofframe_t	*frame;
+	prprofnode_t	*node;
+	prproffunc_t	*func;
+	double		time;
+
+#ifdef PR_JIT
+	if (pr_jitcheck_state == JITCHECK_REPLAY)
+		return;
+#endif
+	if (!pr_profdepth)
+		return;		// entered before profiling started
+
+	frame = &pr_profstack[--pr_profdepth];
+	time = Sys_PreciseTime () - frame->start;
+	node = &pr_profnodes[frame->node];
+	func = &pr_proffuncs[node->fnum];
+	node->self += time - frame->children;
+	node->total += time;
+	func->self += time - frame->children;
+	if (!--func->active)
+		func->total += time;
+	if (pr_profdepth)
+		pr_profstack[pr_profdepth - 1].children += time;
+}
+
+/*
+============
+PR_ProfileUnwind
+
+Drops the calls a Host_Error left on the stack
+============
+*/
+static void PR_ProfileUnwind (void)
+{
+	while (pr_profdepth)
+		pr_proffuncs[pr_profnodes[pr_profstack[--pr_profdepth].node].fnum].active--;
+}
+
+/*
+============
+PR_ProfileProgs
+
+The profile only stays with the progs it was started with
+============
+*/
+static void PR_ProfileProgs (void)
+{
+	if (!pr_proffuncs)
+		return;
+	if (progs->numfunctions == pr_profnumfunctions && pr_crc == pr_profcrc)
+		return;
+	if (pr_profiling)
+		Con_Printf ("Different progs loaded, profile restarted\n");
+	if (pr_profiling)
+	{
+		PR_ProfileBegin ();
+		pr_profstart = Sys_PreciseTime ();
+	}
+	else
+		PR_ProfileClear ();
+}
+
+static double PR_ProfileTime (void)
+{
+	return pr_proftime + (pr_profiling ? Sys_PreciseTime () - pr_profstart : 0);
+}
+
+static int PR_ProfileCompareSelf (const void *a, const void *b)
+{
+	double	d = pr_proffuncs[*(const int *)b].self - pr_proffuncs[*(const int *)a].self;
+
+	return (d > 0) - (d < 0);
+}
+
+static int PR_ProfileCompareEdge (const void *a, const void *b)
+{
+	const prprofedge_t	*ea = (const prprofedge_t *)a;
+	const prprofedge_t	*eb = (const prprofedge_t *)b;
+
+	if (ea->caller != eb->caller)
+		return ea->caller - eb->caller;
+	return ea->callee - eb->callee;
+}
+
+static int PR_ProfileCompareTotal (const void *a, const void *b)
+{
+	double	d = ((const prprofedge_t *)b)->total - ((const prprofedge_t *)a)->total;
+
+	return (d > 0) - (d < 0);
+}
+
+static const char *PR_ProfileName (int fnum)
+{
+	return fnum ? PR_GetString (pr_functions[fnum].s_name) : "(engine)";
+}
+
+/*
+============
+PR_ProfilePrint
+
+The functions with the most exclusive time, then the caller and callee
+pairs with the most time in the callee
+============
+*/
+static void PR_ProfilePrint (int count)
+{
+	prprofedge_t	*edges;
+	prprofnode_t	*node;
+	int		*order, i, shown, numedges, calls;
+	double		time;
+
+	if (!pr_proffuncs)
+	{
+		Con_Printf ("No profile, use \"profile start\"\n");
+		return;
+	}
+
+	time = PR_ProfileTime ();
+	order = (int *) malloc (pr_profnumfunctions * sizeof(int));
+	edges = (prprofedge_t *) malloc (pr_numprofnodes * sizeof(prprofedge_t));
+	if (!order || !edges)
+		Sys_Error ("PR_ProfilePrint: out of memory");
+
+	for (i = calls = 0; i < pr_profnumfunctions; i++)
+	{
+		order[i] = i;
+		calls += pr_proffuncs[i].calls;
+	}
+	qsort (order, pr_profnumfunctions, sizeof(int), PR_ProfileCompareSelf);
+
+	Con_Printf ("%i calls in %.3f seconds%s\n", calls, time, pr_profiling ? ", still running" : "");
+	Con_Printf ("   self ms  total ms    calls function\n");
+	for (i = shown = 0; i < pr_profnumfunctions && shown < count; i++)
+	{
+		if (!pr_proffuncs[order[i]].calls)
+			continue;
+		shown++;
+		Con_Printf ("%10.3f%10.3f%9i %s%s\n", pr_proffuncs[order[i]].self * 1000,
+			pr_proffuncs[order[i]].total * 1000, pr_proffuncs[order[i]].calls,
+			PR_ProfileName (order[i]), pr_functions[order[i]].first_statement < 0 ? " (builtin)" : "");
+	}
+
+	// one edge per caller and callee, however many paths they are on
+	for (i = 1; i < pr_numprofnodes; i++)
+	{
+		node = &pr_profnodes[i];
+		edges[i - 1].caller = pr_profnodes[node->parent].fnum;
+		edges[i - 1].callee = node->fnum;
+		edges[i - 1].calls = node->calls;
+		edges[i - 1].total = node->total;
+	}
+	qsort (edges, pr_numprofnodes - 1, sizeof(prprofedge_t), PR_ProfileCompareEdge);
+	for (i = numedges = 0; i < pr_numprofnodes - 1; i++)
+	{
+		if (numedges && !PR_ProfileCompareEdge (&edges[numedges - 1], &edges[i]))
+		{
+			edges[numedges - 1].calls += edges[i].calls;
+			edges[numedges - 1].total += edges[i].total;
+		}
+		else
+			edges[numedges++] = edges[i];
+	}
+	qsort (edges, numedges, sizeof(prprofedge_t), PR_ProfileCompareTotal);
+
+	Con_Printf ("  total ms    calls caller -> callee\n");
+	for (i = 0; i < count && i < numedges; i++)
+	{
+		Con_Printf ("%10.3f%9i %s -> %s\n", edges[i].total * 1000, edges[i].calls,
+			PR_ProfileName (edges[i].caller), PR_ProfileName (edges[i].callee));
+	}
+
+	free (edges);
+	free (order);
+}
+
+/*
+============
+PR_ProfileFlamegraph
+
+Writes one line per call path with the microseconds spent in its last
+function, like flamegraph.pl takes them
+============
+*/
+static void PR_ProfileFlamegraph (const char *filename)
+{
+	char		name[MAX_OSPATH];
+	int		path[PR_PROF_MAXFRAMES];
+	int		i, n, depth, lines;
+	FILE		*f;
+
+	if (!pr_proffuncs)
+	{
+		Con_Printf ("No profile, use \"profile start\"\n");
+		return;
+	}
+	if (strstr(filename, ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, filename);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+	lines = 0;
+	for (i = 1; i < pr_numprofnodes; i++)
+	{
+		if ((int)(pr_profnodes[i].self * 1000000) <= 0)
+			continue;
+		depth = 0;
+		for (n = i; n && depth < PR_PROF_MAXFRAMES; n = pr_profnodes[n].parent)
+			path[depth++] = pr_profnodes[n].fnum;
+		while (depth--)
+			fprintf (f, "%s%c", PR_ProfileName (path[depth]), depth ? ';' : ' ');
+		fprintf (f, "%i\n", (int)(pr_profnodes[i].self * 1000000));
+		lines++;
+	}
+	fclose (f);
+
+	Con_Printf ("Wrote %i call paths to %s\n", lines, name);
+}
+
+/*
+============
+PR_ProfileCounts
+
+The statement counts profile has always printed, which also clears them
+============
+*/
+static void PR_ProfileCounts (void)
 {
 	int		i, num;
 	int		pmax;
 	dfunction_t	*f, *best;
 
-	if (!sv.active)
-		return;
-
 	num = 0;
 	do
 	{
@@ -246,6 +665,56 @@ void PR_Profile_f (void)
 	} while (best);
 }
 
+/*
+============
+PR_Profile_f
+
+profile [start | stop | print [count] | flamegraph [file]]
+============
+*/
+void PR_Profile_f (void)
+{
+	const char	*cmd = Cmd_Argv (1);
+
+	if (!sv.active)
+		return;
+
+	if (Cmd_Argc () < 2)
+		PR_ProfileCounts ();
+	else if (!strcmp (cmd, "start"))
+	{
+		PR_ProfileBegin ();
+		pr_profstart = Sys_PreciseTime ();
+		pr_profiling = true;
+		Con_Printf ("Profiling QC calls\n");
+	}
+	else if (!strcmp (cmd, "stop"))
+	{
+		if (pr_profiling)
+			pr_proftime += Sys_PreciseTime () - pr_profstart;
+		pr_profiling = false;
+		PR_ProfileUnwind ();
+	}
+	else if (!strcmp (cmd, "print"))
+		PR_ProfilePrint (Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 20);
+	else if (!strcmp (cmd, "flamegraph"))
+		PR_ProfileFlamegraph (Cmd_Argc () > 2 ? Cmd_Argv (2) : "profile.folded");
+	else
+		Con_Printf ("usage: profile [start | stop | print [count] | flamegraph [file]]\n");
+}
+
+/*
+============
+PR_ActiveFunction
+
+For attributing engine work to the QC that asked for it
+============
+*/
+int PR_ActiveFunction (void)
+{
+	return (pr_depth && pr_xfunction) ? (int)(pr_xfunction - pr_functions) : 0;
+}
+
 
 /*
 ============
@@ -290,6 +759,9 @@ static int PR_EnterFunction (dfunction_t *f)
 	if (pr_depth >= MAX_STACK_DEPTH)
 		PR_RunError("stack overflow");
 
+	if (pr_profiling)
+		PR_ProfileEnter (f - pr_functions);
+
 	// save off any locals that the new function steps on
 	c = f->locals;
 	if (localstack_used + c > LOCALSTACK_SIZE)
@@ -326,6 +798,9 @@ static int PR_LeaveFunction (void)
 	if (pr_depth <= 0)
 		Host_Error("prog stack underflow");
 
+	if (pr_profiling)
+		PR_ProfileLeave ();
+
 	// Restore locals from the stack
 	c = pr_xfunction->locals;
 	localstack_used -= c;
@@ -341,43 +816,47 @@ static int PR_LeaveFunction (void)
 	return pr_stack[pr_depth].s;
 }
 
+/*
+====================
+PR_CallBuiltin
+====================
+*/
+static void PR_CallBuiltin (dfunction_t *f, int i)
+{
+	if (pr_profiling)
+		PR_ProfileEnter (f - pr_functions);
+#ifdef PR_JIT
+	if (pr_jitcheck_state == JITCHECK_RECORD || pr_jitcheck_state == JITCHECK_REPLAY)
+		PR_JitCheckBuiltin (i);
+	else
+#endif
+	pr_builtins[i] ();
+	if (pr_profiling)
+		PR_ProfileLeave ();
+}
+
 
 /*
 ====================
-PR_ExecuteProgram
+PR_ExecuteSwitch
 
-The interpretation main loop
+The plain interpretation loop. Runs from the statement after st until the
+stack is back at exitdepth. It is what pr_engine 0 uses, and where the
+pre-decoded engine hands over once tracing is turned on.
 ====================
 */
 #define OPA ((eval_t *)&pr_globals[(unsigned short)st->a])
 #define OPB ((eval_t *)&pr_globals[(unsigned short)st->b])
 #define OPC ((eval_t *)&pr_globals[(unsigned short)st->c])
 
-void PR_ExecuteProgram (func_t fnum)
+static void PR_ExecuteSwitch (dstatement_t *st, int exitdepth, int profile)
 {
 	eval_t		*ptr;
-	dstatement_t	*st;
-	dfunction_t	*f, *newf;
-	int profile, startprofile;
+	dfunction_t	*newf;
+	int startprofile;
 	edict_t		*ed;
-	int		exitdepth;
-
-	if (!fnum || fnum >= progs->numfunctions)
-	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
-	}
-
-	f = &pr_functions[fnum];
 
-	pr_trace = false;
-
-// make a stack frame
-	exitdepth = pr_depth;
-
-	st = &pr_statements[PR_EnterFunction(f)];
-	startprofile = profile = 0;
+	startprofile = profile;
 
     while (1)
     {
@@ -553,6 +1032,8 @@ void PR_ExecuteProgram (func_t fnum)
 			PR_RunError("assignment to world entity");
 		}
 		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)sv.edicts;
+		if (PR_WATCHED(OPB->_int))
+			PR_FieldWritten (ed, OPB->_int);
 		break;
 
 	case OP_LOAD_F:
@@ -613,7 +1094,7 @@ void PR_ExecuteProgram (func_t fnum)
 			int i = -newf->first_statement;
 			if (i >= pr_numbuiltins)
 				PR_RunError("Bad builtin call number %d", i);
-			pr_builtins[i]();
+			PR_CallBuiltin (newf, i);
 			break;
 		}
 		// Normal function
@@ -652,3 +1133,1938 @@ void PR_ExecuteProgram (func_t fnum)
 #undef OPB
 #undef OPC
 
+
+
+/*
+==============================================================================
+
+				PRE-DECODED ENGINE
+
+PR_DecodeStatements translates pr_statements once per progs load into
+pr_code, where the operands are already pointers into pr_globals and the
+branch offsets and call argument counts are taken out of the operand
+fields. With GCC and clang every statement also holds the address of the
+code that runs it, and each statement jumps straight to the next one's
+(computed goto); other compilers switch on the opcode. Statement numbers
+are the same as in pr_statements, so errors, the stack trace and profile
+come out exactly as with PR_ExecuteSwitch.
+
+==============================================================================
+*/
+
+#if defined(__GNUC__) && !defined(PR_NO_COMPUTED_GOTO)
+#define	PR_COMPUTED_GOTO
+#endif
+
+typedef struct
+{
+	const void	*handler;	// computed goto target
+	eval_t		*a, *b, *c;
+	int		op;
+	int		arg;		// branch offset or argument count
+} prcode_t;
+
+static prcode_t		*pr_code;
+static const void *const *pr_handlers;	// filled in by PR_ExecuteDecoded
+
+cvar_t	pr_engine = {"pr_engine", "1", CVAR_NONE};	// 0 = PR_ExecuteSwitch
+
+/*
+====================
+PR_ExecuteDecoded
+
+Runs pr_code from statement s + 1 until the stack is back at exitdepth.
+s < 0 only fills in pr_handlers.
+====================
+*/
+#ifdef PR_COMPUTED_GOTO
+#define	OPCODE(op)	lbl_##op:
+#define	NEXT		do { code++; if (++profile > 100000) goto runaway; goto *code->handler; } while (0)
+#else
+#define	OPCODE(op)	case op:
+#define	NEXT		continue
+#endif
+
+#define	A	(code->a)
+#define	B	(code->b)
+#define	C	(code->c)
+
+static void PR_ExecuteDecoded (int s, int exitdepth)
+{
+	prcode_t	*code;
+	eval_t		*ptr;
+	dfunction_t	*newf;
+	int		profile, startprofile;
+	edict_t		*ed;
+#ifdef PR_COMPUTED_GOTO
+	static const void *const handlers[OP_BITOR + 2] =
+	{
+		[OP_DONE] = &&lbl_OP_DONE,
+		[OP_MUL_F] = &&lbl_OP_MUL_F,
+		[OP_MUL_V] = &&lbl_OP_MUL_V,
+		[OP_MUL_FV] = &&lbl_OP_MUL_FV,
+		[OP_MUL_VF] = &&lbl_OP_MUL_VF,
+		[OP_DIV_F] = &&lbl_OP_DIV_F,
+		[OP_ADD_F] = &&lbl_OP_ADD_F,
+		[OP_ADD_V] = &&lbl_OP_ADD_V,
+		[OP_SUB_F] = &&lbl_OP_SUB_F,
+		[OP_SUB_V] = &&lbl_OP_SUB_V,
+		[OP_EQ_F] = &&lbl_OP_EQ_F,
+		[OP_EQ_V] = &&lbl_OP_EQ_V,
+		[OP_EQ_S] = &&lbl_OP_EQ_S,
+		[OP_EQ_E] = &&lbl_OP_EQ_E,
+		[OP_EQ_FNC] = &&lbl_OP_EQ_FNC,
+		[OP_NE_F] = &&lbl_OP_NE_F,
+		[OP_NE_V] = &&lbl_OP_NE_V,
+		[OP_NE_S] = &&lbl_OP_NE_S,
+		[OP_NE_E] = &&lbl_OP_NE_E,
+		[OP_NE_FNC] = &&lbl_OP_NE_FNC,
+		[OP_LE] = &&lbl_OP_LE,
+		[OP_GE] = &&lbl_OP_GE,
+		[OP_LT] = &&lbl_OP_LT,
+		[OP_GT] = &&lbl_OP_GT,
+		[OP_LOAD_F] = &&lbl_OP_LOAD_F,
+		[OP_LOAD_V] = &&lbl_OP_LOAD_V,
+		[OP_LOAD_S] = &&lbl_OP_LOAD_S,
+		[OP_LOAD_ENT] = &&lbl_OP_LOAD_ENT,
+		[OP_LOAD_FLD] = &&lbl_OP_LOAD_FLD,
+		[OP_LOAD_FNC] = &&lbl_OP_LOAD_FNC,
+		[OP_ADDRESS] = &&lbl_OP_ADDRESS,
+		[OP_STORE_F] = &&lbl_OP_STORE_F,
+		[OP_STORE_V] = &&lbl_OP_STORE_V,
+		[OP_STORE_S] = &&lbl_OP_STORE_S,
+		[OP_STORE_ENT] = &&lbl_OP_STORE_ENT,
+		[OP_STORE_FLD] = &&lbl_OP_STORE_FLD,
+		[OP_STORE_FNC] = &&lbl_OP_STORE_FNC,
+		[OP_STOREP_F] = &&lbl_OP_STOREP_F,
+		[OP_STOREP_V] = &&lbl_OP_STOREP_V,
+		[OP_STOREP_S] = &&lbl_OP_STOREP_S,
+		[OP_STOREP_ENT] = &&lbl_OP_STOREP_ENT,
+		[OP_STOREP_FLD] = &&lbl_OP_STOREP_FLD,
+		[OP_STOREP_FNC] = &&lbl_OP_STOREP_FNC,
+		[OP_RETURN] = &&lbl_OP_RETURN,
+		[OP_NOT_F] = &&lbl_OP_NOT_F,
+		[OP_NOT_V] = &&lbl_OP_NOT_V,
+		[OP_NOT_S] = &&lbl_OP_NOT_S,
+		[OP_NOT_ENT] = &&lbl_OP_NOT_ENT,
+		[OP_NOT_FNC] = &&lbl_OP_NOT_FNC,
+		[OP_IF] = &&lbl_OP_IF,
+		[OP_IFNOT] = &&lbl_OP_IFNOT,
+		[OP_CALL0] = &&lbl_OP_CALL0,
+		[OP_CALL1] = &&lbl_OP_CALL1,
+		[OP_CALL2] = &&lbl_OP_CALL2,
+		[OP_CALL3] = &&lbl_OP_CALL3,
+		[OP_CALL4] = &&lbl_OP_CALL4,
+		[OP_CALL5] = &&lbl_OP_CALL5,
+		[OP_CALL6] = &&lbl_OP_CALL6,
+		[OP_CALL7] = &&lbl_OP_CALL7,
+		[OP_CALL8] = &&lbl_OP_CALL8,
+		[OP_STATE] = &&lbl_OP_STATE,
+		[OP_GOTO] = &&lbl_OP_GOTO,
+		[OP_AND] = &&lbl_OP_AND,
+		[OP_OR] = &&lbl_OP_OR,
+		[OP_BITAND] = &&lbl_OP_BITAND,
+		[OP_BITOR] = &&lbl_OP_BITOR,
+		[OP_BITOR + 1] = &&lbl_bad		// any opcode past the last
+	};
+
+	if (s < 0)
+	{
+		pr_handlers = handlers;
+		return;
+	}
+#endif
+
+	code = &pr_code[s];
+	startprofile = profile = 0;
+
+#ifdef PR_COMPUTED_GOTO
+	NEXT;
+#else
+    while (1)
+    {
+	code++;	/* next statement */
+
+	if (++profile > 100000)
+		goto runaway;
+
+	switch (code->op)
+	{
+#endif
+	OPCODE(OP_ADD_F)
+		C->_float = A->_float + B->_float;
+		NEXT;
+	OPCODE(OP_ADD_V)
+		C->vector[0] = A->vector[0] + B->vector[0];
+		C->vector[1] = A->vector[1] + B->vector[1];
+		C->vector[2] = A->vector[2] + B->vector[2];
+		NEXT;
+
+	OPCODE(OP_SUB_F)
+		C->_float = A->_float - B->_float;
+		NEXT;
+	OPCODE(OP_SUB_V)
+		C->vector[0] = A->vector[0] - B->vector[0];
+		C->vector[1] = A->vector[1] - B->vector[1];
+		C->vector[2] = A->vector[2] - B->vector[2];
+		NEXT;
+
+	OPCODE(OP_MUL_F)
+		C->_float = A->_float * B->_float;
+		NEXT;
+	OPCODE(OP_MUL_V)
+		C->_float = A->vector[0] * B->vector[0] +
+			    A->vector[1] * B->vector[1] +
+			    A->vector[2] * B->vector[2];
+		NEXT;
+	OPCODE(OP_MUL_FV)
+		C->vector[0] = A->_float * B->vector[0];
+		C->vector[1] = A->_float * B->vector[1];
+		C->vector[2] = A->_float * B->vector[2];
+		NEXT;
+	OPCODE(OP_MUL_VF)
+		C->vector[0] = B->_float * A->vector[0];
+		C->vector[1] = B->_float * A->vector[1];
+		C->vector[2] = B->_float * A->vector[2];
+		NEXT;
+
+	OPCODE(OP_DIV_F)
+		C->_float = A->_float / B->_float;
+		NEXT;
+
+	OPCODE(OP_BITAND)
+		C->_float = (int)A->_float & (int)B->_float;
+		NEXT;
+
+	OPCODE(OP_BITOR)
+		C->_float = (int)A->_float | (int)B->_float;
+		NEXT;
+
+	OPCODE(OP_GE)
+		C->_float = A->_float >= B->_float;
+		NEXT;
+	OPCODE(OP_LE)
+		C->_float = A->_float <= B->_float;
+		NEXT;
+	OPCODE(OP_GT)
+		C->_float = A->_float > B->_float;
+		NEXT;
+	OPCODE(OP_LT)
+		C->_float = A->_float < B->_float;
+		NEXT;
+	OPCODE(OP_AND)
+		C->_float = A->_float && B->_float;
+		NEXT;
+	OPCODE(OP_OR)
+		C->_float = A->_float || B->_float;
+		NEXT;
+
+	OPCODE(OP_NOT_F)
+		C->_float = !A->_float;
+		NEXT;
+	OPCODE(OP_NOT_V)
+		C->_float = !A->vector[0] && !A->vector[1] && !A->vector[2];
+		NEXT;
+	OPCODE(OP_NOT_S)
+		C->_float = !A->string || !*PR_GetString(A->string);
+		NEXT;
+	OPCODE(OP_NOT_FNC)
+		C->_float = !A->function;
+		NEXT;
+	OPCODE(OP_NOT_ENT)
+		C->_float = (PROG_TO_EDICT(A->edict) == sv.edicts);
+		NEXT;
+
+	OPCODE(OP_EQ_F)
+		C->_float = A->_float == B->_float;
+		NEXT;
+	OPCODE(OP_EQ_V)
+		C->_float = (A->vector[0] == B->vector[0]) &&
+			    (A->vector[1] == B->vector[1]) &&
+			    (A->vector[2] == B->vector[2]);
+		NEXT;
+	OPCODE(OP_EQ_S)
+		C->_float = !strcmp(PR_GetString(A->string), PR_GetString(B->string));
+		NEXT;
+	OPCODE(OP_EQ_E)
+		C->_float = A->_int == B->_int;
+		NEXT;
+	OPCODE(OP_EQ_FNC)
+		C->_float = A->function == B->function;
+		NEXT;
+
+	OPCODE(OP_NE_F)
+		C->_float = A->_float != B->_float;
+		NEXT;
+	OPCODE(OP_NE_V)
+		C->_float = (A->vector[0] != B->vector[0]) ||
+			    (A->vector[1] != B->vector[1]) ||
+			    (A->vector[2] != B->vector[2]);
+		NEXT;
+	OPCODE(OP_NE_S)
+		C->_float = strcmp(PR_GetString(A->string), PR_GetString(B->string));
+		NEXT;
+	OPCODE(OP_NE_E)
+		C->_float = A->_int != B->_int;
+		NEXT;
+	OPCODE(OP_NE_FNC)
+		C->_float = A->function != B->function;
+		NEXT;
+
+	OPCODE(OP_STORE_F)
+	OPCODE(OP_STORE_ENT)
+	OPCODE(OP_STORE_FLD)	// integers
+	OPCODE(OP_STORE_S)
+	OPCODE(OP_STORE_FNC)	// pointers
+		B->_int = A->_int;
+		NEXT;
+	OPCODE(OP_STORE_V)
+		B->vector[0] = A->vector[0];
+		B->vector[1] = A->vector[1];
+		B->vector[2] = A->vector[2];
+		NEXT;
+
+	OPCODE(OP_STOREP_F)
+	OPCODE(OP_STOREP_ENT)
+	OPCODE(OP_STOREP_FLD)	// integers
+	OPCODE(OP_STOREP_S)
+	OPCODE(OP_STOREP_FNC)	// pointers
+		ptr = (eval_t *)((byte *)sv.edicts + B->_int);
+		ptr->_int = A->_int;
+		NEXT;
+	OPCODE(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)sv.edicts + B->_int);
+		ptr->vector[0] = A->vector[0];
+		ptr->vector[1] = A->vector[1];
+		ptr->vector[2] = A->vector[2];
+		NEXT;
+
+	OPCODE(OP_ADDRESS)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = code - pr_code;
+			PR_RunError("assignment to world entity");
+		}
+		C->_int = (byte *)((int *)&ed->v + B->_int) - (byte *)sv.edicts;
+		if (PR_WATCHED(B->_int))
+			PR_FieldWritten (ed, B->_int);
+		NEXT;
+
+	OPCODE(OP_LOAD_F)
+	OPCODE(OP_LOAD_FLD)
+	OPCODE(OP_LOAD_ENT)
+	OPCODE(OP_LOAD_S)
+	OPCODE(OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		C->_int = ((eval_t *)((int *)&ed->v + B->_int))->_int;
+		NEXT;
+
+	OPCODE(OP_LOAD_V)
+		ed = PROG_TO_EDICT(A->edict);
+#ifdef PARANOID
+		NUM_FOR_EDICT(ed);	// Make sure it's in range
+#endif
+		ptr = (eval_t *)((int *)&ed->v + B->_int);
+		C->vector[0] = ptr->vector[0];
+		C->vector[1] = ptr->vector[1];
+		C->vector[2] = ptr->vector[2];
+		NEXT;
+
+	OPCODE(OP_IFNOT)
+		if (!A->_int)
+			code += code->arg - 1;	/* -1 to offset the code++ */
+		NEXT;
+
+	OPCODE(OP_IF)
+		if (A->_int)
+			code += code->arg - 1;	/* -1 to offset the code++ */
+		NEXT;
+
+	OPCODE(OP_GOTO)
+		code += code->arg - 1;		/* -1 to offset the code++ */
+		NEXT;
+
+	OPCODE(OP_CALL0)
+	OPCODE(OP_CALL1)
+	OPCODE(OP_CALL2)
+	OPCODE(OP_CALL3)
+	OPCODE(OP_CALL4)
+	OPCODE(OP_CALL5)
+	OPCODE(OP_CALL6)
+	OPCODE(OP_CALL7)
+	OPCODE(OP_CALL8)
+		pr_xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		pr_xstatement = code - pr_code;
+		pr_argc = code->arg;
+		if (!A->function)
+			PR_RunError("NULL function");
+		newf = &pr_functions[A->function];
+		if (newf->first_statement < 0)
+		{ // Built-in function
+			int i = -newf->first_statement;
+			if (i >= pr_numbuiltins)
+				PR_RunError("Bad builtin call number %d", i);
+			PR_CallBuiltin (newf, i);
+			if (pr_trace)
+			{ // traceon, carry on where statements get printed
+				PR_ExecuteSwitch (&pr_statements[code - pr_code], exitdepth, profile);
+				return;
+			}
+			NEXT;
+		}
+		// Normal function
+#ifdef PR_JIT
+		if (PR_JitEnter (newf))
+			NEXT;
+#endif
+		code = &pr_code[PR_EnterFunction(newf)];
+		NEXT;
+
+	OPCODE(OP_DONE)
+	OPCODE(OP_RETURN)
+		pr_xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		pr_xstatement = code - pr_code;
+		((int *)pr_globals)[OFS_RETURN] = ((int *)A)[0];
+		((int *)pr_globals)[OFS_RETURN + 1] = ((int *)A)[1];
+		((int *)pr_globals)[OFS_RETURN + 2] = ((int *)A)[2];
+		code = &pr_code[PR_LeaveFunction()];
+		if (pr_depth == exitdepth)
+		{ // Done
+			return;
+		}
+		NEXT;
+
+	OPCODE(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = A->_float;
+		ed->v.think = B->function;
+		NEXT;
+
+#ifdef PR_COMPUTED_GOTO
+lbl_bad:
+#else
+	default:
+#endif
+		pr_xstatement = code - pr_code;
+		PR_RunError("Bad opcode %i", code->op);
+#ifndef PR_COMPUTED_GOTO
+	}
+    }	/* end of while(1) loop */
+#endif
+
+runaway:
+	pr_xstatement = code - pr_code;
+	PR_RunError("runaway loop error");
+}
+#undef OPCODE
+#undef NEXT
+#undef A
+#undef B
+#undef C
+
+/*
+====================
+PR_DecodeStatements
+
+Builds pr_code for the progs that were just loaded
+====================
+*/
+void PR_DecodeStatements (void)
+{
+	dstatement_t	*st;
+	prcode_t	*code;
+	int		i;
+
+#ifdef PR_COMPUTED_GOTO
+	if (!pr_handlers)
+		PR_ExecuteDecoded (-1, 0);
+#endif
+
+	pr_code = (prcode_t *) Hunk_AllocName (progs->numstatements * sizeof(prcode_t), "prcode");
+	for (i = 0, st = pr_statements, code = pr_code; i < progs->numstatements; i++, st++, code++)
+	{
+		code->op = st->op;
+#ifdef PR_COMPUTED_GOTO
+		code->handler = pr_handlers[q_min(st->op, OP_BITOR + 1)];
+#endif
+		code->a = (eval_t *)&pr_globals[(unsigned short)st->a];
+		code->b = (eval_t *)&pr_globals[(unsigned short)st->b];
+		code->c = (eval_t *)&pr_globals[(unsigned short)st->c];
+		if (st->op == OP_IF || st->op == OP_IFNOT)
+			code->arg = st->b;
+		else if (st->op == OP_GOTO)
+			code->arg = st->a;
+		else if (st->op >= OP_CALL0 && st->op <= OP_CALL8)
+			code->arg = st->op - OP_CALL0;
+	}
+
+#ifdef PR_JIT
+	PR_JitReset ();
+#endif
+	PR_ProfileProgs ();
+}
+
+/*
+====================
+PR_RunFunction
+
+Runs f to its return with whichever engine is selected
+====================
+*/
+static void PR_RunFunction (dfunction_t *f)
+{
+	int	s, exitdepth;
+
+#ifdef PR_JIT
+	if (PR_JitEnter (f))
+		return;
+#endif
+	exitdepth = pr_depth;
+	s = PR_EnterFunction (f);
+	if (pr_engine.value && pr_code)
+		PR_ExecuteDecoded (s, exitdepth);
+	else
+		PR_ExecuteSwitch (&pr_statements[s], exitdepth, 0);
+}
+
+/*
+==============================================================================
+
+				QUAKEC JIT
+
+With pr_jit 1, a function that has been called PR_JIT_HOTCALLS times is
+compiled to native code, once per progs load. x86-64 and AArch64 are
+supported, except on Windows and on Apple's AArch64, which only runs
+code from MAP_JIT memory; everywhere else, and for functions that can't
+be compiled, the interpreter keeps running them.
+
+The code works on pr_globals and the edicts in memory like the
+interpreter does: rbx or x19 holds pr_globals, r12 or x20 sv.edicts, and
+float math is done with the same single precision instructions in the
+same order, so the results are the same, except for which NaN comes out
+of an operation on two of them. On AArch64 the compiler may have fused
+the multiplies and adds of the interpreter's OP_MUL_V, which the
+compiled code doesn't, so that can differ in the last bit.
+Calls, returns, string compares and STATE go through small C helpers, so
+builtins are still called from pr_builtins and the QC stack and locals
+are handled by PR_EnterFunction and PR_LeaveFunction. Instead of counting
+every statement, compiled code counts backward branches for the runaway
+check, and it doesn't add to the profile counts or print traceon output.
+
+pr_jit 2 checks the compiled code against the interpreter: every
+PR_ExecuteProgram is first run by the interpreter alone, which is what
+counts, while recording what each builtin call changed in the globals and
+edicts. Then that state is rewound and the call is run again with
+compiled code, the builtins replayed from the record rather than called,
+and the globals and edicts are compared with the interpreter's. What
+builtins do elsewhere, like the strings they return in the temp buffer,
+isn't rewound.
+
+==============================================================================
+*/
+
+cvar_t	pr_jit = {"pr_jit","0",CVAR_NONE};
+
+#ifdef PR_JIT
+
+#define	PR_JIT_HOTCALLS		16
+#define	PR_JIT_RESERVE		(32 * 1024 * 1024)
+#define	PR_JIT_PAGE		4096
+#if defined(__aarch64__)
+#define	PR_JIT_MAXSTMTBYTES	256	// more than any statement compiles to
+#else
+#define	PR_JIT_MAXSTMTBYTES	128
+#endif
+#define	PR_JIT_MAXLOOPS		100000	// backward branches before a runaway loop error
+
+typedef void (*prjitfunc_t) (void);
+
+static prjitfunc_t	*pr_jitcode;		// per function, NULL if not compiled
+static int		*pr_jitcalls;
+static byte		*pr_jitbase;
+static int		pr_jitused, pr_jitcommit;
+static byte		*pr_jitout;		// where the next instruction goes
+
+static struct
+{
+	int	compiled, failed;
+	int	checks, mismatches;
+} pr_jitstats;
+
+/*
+====================
+PR_JitReset
+
+Throws away all compiled code, called for every progs load
+====================
+*/
+static void PR_JitReset (void)
+{
+	pr_jitcode = (prjitfunc_t *) Hunk_AllocName (progs->numfunctions * sizeof(prjitfunc_t), "prjit");
+	pr_jitcalls = (int *) Hunk_AllocName (progs->numfunctions * sizeof(int), "prjit");
+	if (pr_jitbase && pr_jitcommit)
+	{
+		Sys_MemDecommit (pr_jitbase, pr_jitcommit);
+		Mem_Track (MEMPOOL_MALLOC, "qcjit", -pr_jitcommit);
+	}
+	pr_jitused = pr_jitcommit = 0;
+	memset (&pr_jitstats, 0, sizeof(pr_jitstats));
+}
+
+//
+// helpers the compiled code calls, with the statement number
+//
+
+static void PR_JitCall (int s)
+{
+	dstatement_t	*st = &pr_statements[s];
+	dfunction_t	*newf;
+	int		fnum, i;
+
+	pr_xstatement = s;
+	pr_argc = st->op - OP_CALL0;
+	fnum = ((eval_t *)&pr_globals[(unsigned short)st->a])->function;
+	if (!fnum)
+		PR_RunError("NULL function");
+	newf = &pr_functions[fnum];
+	if (newf->first_statement < 0)
+	{ // Built-in function
+		i = -newf->first_statement;
+		if (i >= pr_numbuiltins)
+			PR_RunError("Bad builtin call number %d", i);
+		PR_CallBuiltin (newf, i);
+		return;
+	}
+	PR_RunFunction (newf);
+}
+
+static void PR_JitLeave (int s)
+{
+	pr_xstatement = s;
+	PR_LeaveFunction ();
+}
+
+static void PR_JitStatement (int s)
+{
+	dstatement_t	*st = &pr_statements[s];
+	eval_t		*a = (eval_t *)&pr_globals[(unsigned short)st->a];
+	eval_t		*b = (eval_t *)&pr_globals[(unsigned short)st->b];
+	eval_t		*c = (eval_t *)&pr_globals[(unsigned short)st->c];
+	edict_t		*ed;
+
+	switch (st->op)
+	{
+	case OP_NOT_S:
+		c->_float = !a->string || !*PR_GetString(a->string);
+		break;
+	case OP_EQ_S:
+		c->_float = !strcmp(PR_GetString(a->string), PR_GetString(b->string));
+		break;
+	case OP_NE_S:
+		c->_float = strcmp(PR_GetString(a->string), PR_GetString(b->string));
+		break;
+	case OP_STATE:
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = a->_float;
+		ed->v.think = b->function;
+		break;
+	}
+}
+
+static void PR_JitRunaway (int s)
+{
+	pr_xstatement = s;
+	PR_RunError("runaway loop error");
+}
+
+static void PR_JitWorldAssign (int s)
+{
+	pr_xstatement = s;
+	PR_RunError("assignment to world entity");
+}
+
+static void PR_JitFieldWritten (int s)
+{
+	dstatement_t	*st = &pr_statements[s];
+
+	PR_FieldWritten (PROG_TO_EDICT(G_INT((unsigned short)st->a)), G_INT((unsigned short)st->b));
+}
+
+// where the branches to statements are, for PR_JitCompile to fill in
+static int		*pr_jitfixups, *pr_jitfixtargets, pr_jitnumfixups;
+
+#if defined(__x86_64__)
+
+//
+// x86-64 code generation
+//
+
+enum { R_EAX, R_ECX, R_EDX };	// and xmm0, xmm1 by number
+
+static void J_Bytes (const char *bytes, int count)
+{
+	memcpy (pr_jitout, bytes, count);
+	pr_jitout += count;
+}
+
+static void J_Int (int i)
+{
+	memcpy (pr_jitout, &i, 4);
+	pr_jitout += 4;
+}
+
+static void J_Ptr (const void *p)
+{
+	memcpy (pr_jitout, &p, sizeof(p));
+	pr_jitout += sizeof(p);
+}
+
+/* op reg, [rbx + global * 4 + extra] */
+static void J_Global (const char *op, int oplen, int reg, int global, int extra)
+{
+	J_Bytes (op, oplen);
+	*pr_jitout++ = 0x83 | (reg << 3);	// mod 10, rm rbx
+	J_Int ((unsigned short)global * 4 + extra);
+}
+
+#define	J_LoadInt(reg, g, x)	J_Global ("\x8b", 1, reg, g, x)		// mov r32, [g]
+#define	J_StoreInt(reg, g, x)	J_Global ("\x89", 1, reg, g, x)		// mov [g], r32
+#define	J_LoadFloat(xmm, g, x)	J_Global ("\xf3\x0f\x10", 3, xmm, g, x)	// movss xmm, [g]
+#define	J_StoreFloat(xmm, g, x)	J_Global ("\xf3\x0f\x11", 3, xmm, g, x)	// movss [g], xmm
+#define	J_FloatOp(op, xmm, g, x) J_Global (op, 3, xmm, g, x)		// addss etc. xmm, [g]
+#define	J_CompareFloat(g, x)	J_Global ("\x0f\x2e", 2, 0, g, x)		// ucomiss xmm0, [g]
+#define	J_LoadSigned(reg, g)	J_Global ("\x48\x63", 2, reg, g, 0)	// movsxd r64, [g]
+
+#define	ADDSS	"\xf3\x0f\x58"
+#define	SUBSS	"\xf3\x0f\x5c"
+#define	MULSS	"\xf3\x0f\x59"
+#define	DIVSS	"\xf3\x0f\x5e"
+
+/* calls helper (s) */
+static void J_Helper (void (*helper) (int), int s)
+{
+	J_Bytes ("\xbf", 1);		// mov edi, s
+	J_Int (s);
+	J_Bytes ("\x48\xb8", 2);	// mov rax, helper
+	J_Ptr ((const void *)helper);
+	J_Bytes ("\xff\xd0", 2);	// call rax
+}
+
+/* al = (xmm0 compared with [g]) is equal or not equal, counting NaNs as unequal */
+static void J_FloatEqual (int g, int x, qboolean equal)
+{
+	J_CompareFloat (g, x);
+	if (equal)
+		J_Bytes ("\x0f\x94\xc0\x0f\x9b\xc1\x20\xc8", 8);	// sete al; setnp cl; and al, cl
+	else
+		J_Bytes ("\x0f\x95\xc0\x0f\x9a\xc1\x08\xc8", 8);	// setne al; setp cl; or al, cl
+}
+
+/* al = [g] != 0.0, xmm1 has to be zero */
+static void J_FloatTrue (int g, int x)
+{
+	J_LoadFloat (0, g, x);
+	J_Bytes ("\x0f\x2e\xc1", 3);				// ucomiss xmm0, xmm1
+	J_Bytes ("\x0f\x95\xc0\x0f\x9a\xc1\x08\xc8", 8);	// setne al; setp cl; or al, cl
+}
+
+/* [g] = al ? 1.0 : 0.0 */
+static void J_StoreBool (int g)
+{
+	J_Bytes ("\x0f\xb6\xc0\xf7\xd8\x25\x00\x00\x80\x3f", 10);	// movzx eax, al; neg eax; and eax, 1.0
+	J_StoreInt (R_EAX, g, 0);
+}
+
+/* jumps to statement target, leaving the offset for PR_JitCompile to fill in */
+static void J_Jump (const char *op, int oplen, int target)
+{
+	J_Bytes (op, oplen);
+	pr_jitfixtargets[pr_jitnumfixups] = target;
+	pr_jitfixups[pr_jitnumfixups++] = (int)(pr_jitout - pr_jitbase - pr_jitused);
+	J_Int (target);
+}
+
+/* points the jump J_Jump left at at the code dist bytes further */
+static void J_Patch (byte *at, int dist)
+{
+	dist -= 4;	// from the end of the instruction
+	memcpy (at, &dist, 4);
+}
+
+/* counts a backward branch */
+static void J_LoopCheck (int s)
+{
+	J_Bytes ("\x41\xff\xcd\x75\x11", 5);	// dec r13d; jnz past the helper call
+	J_Helper (PR_JitRunaway, s);
+}
+
+static void J_Enter (void)
+{
+	J_Bytes ("\x53\x41\x54\x41\x55", 5);	// push rbx; push r12; push r13
+	J_Bytes ("\x48\xbb", 2);		// mov rbx, pr_globals
+	J_Ptr (pr_globals);
+	J_Bytes ("\x48\xb8", 2);		// mov rax, &sv.edicts
+	J_Ptr (&sv.edicts);
+	J_Bytes ("\x4c\x8b\x20", 3);		// mov r12, [rax]
+	J_Bytes ("\x41\xbd", 2);		// mov r13d, PR_JIT_MAXLOOPS
+	J_Int (PR_JIT_MAXLOOPS);
+}
+
+static void J_Leave (void)
+{
+	J_Bytes ("\x41\x5d\x41\x5c\x5b\xc3", 6);	// pop r13; pop r12; pop rbx; ret
+}
+
+/* the instruction cache sees stores */
+static void J_Flush (byte *start, byte *end)
+{
+}
+
+static void J_Statement (int s)
+{
+	dstatement_t	*st = &pr_statements[s];
+	const char	*op;
+	int		k, target;
+
+	switch (st->op)
+	{
+	case OP_ADD_F:
+	case OP_SUB_F:
+	case OP_MUL_F:
+	case OP_DIV_F:
+		op = (st->op == OP_ADD_F) ? ADDSS : (st->op == OP_SUB_F) ? SUBSS : (st->op == OP_MUL_F) ? MULSS : DIVSS;
+		J_LoadFloat (0, st->a, 0);
+		J_FloatOp (op, 0, st->b, 0);
+		J_StoreFloat (0, st->c, 0);
+		break;
+	case OP_ADD_V:
+	case OP_SUB_V:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadFloat (0, st->a, k);
+			J_FloatOp ((st->op == OP_ADD_V) ? ADDSS : SUBSS, 0, st->b, k);
+			J_StoreFloat (0, st->c, k);
+		}
+		break;
+	case OP_MUL_V:
+		J_LoadFloat (0, st->a, 0);
+		J_FloatOp (MULSS, 0, st->b, 0);
+		for (k = 4; k < 12; k += 4)
+		{
+			J_LoadFloat (1, st->a, k);
+			J_FloatOp (MULSS, 1, st->b, k);
+			J_Bytes ("\xf3\x0f\x58\xc1", 4);	// addss xmm0, xmm1
+		}
+		J_StoreFloat (0, st->c, 0);
+		break;
+	case OP_MUL_FV:
+	case OP_MUL_VF:
+		for (k = 0; k < 12; k += 4)
+		{
+			if (st->op == OP_MUL_FV)
+			{
+				J_LoadFloat (0, st->a, 0);
+				J_FloatOp (MULSS, 0, st->b, k);
+			}
+			else
+			{
+				J_LoadFloat (0, st->b, 0);
+				J_FloatOp (MULSS, 0, st->a, k);
+			}
+			J_StoreFloat (0, st->c, k);
+		}
+		break;
+
+	case OP_BITAND:
+	case OP_BITOR:
+		J_Global ("\xf3\x0f\x2c", 3, R_EAX, st->a, 0);	// cvttss2si eax, [a]
+		J_Global ("\xf3\x0f\x2c", 3, R_ECX, st->b, 0);	// cvttss2si ecx, [b]
+		J_Bytes ((st->op == OP_BITAND) ? "\x21\xc8" : "\x09\xc8", 2);	// and/or eax, ecx
+		J_Bytes ("\xf3\x0f\x2a\xc0", 4);		// cvtsi2ss xmm0, eax
+		J_StoreFloat (0, st->c, 0);
+		break;
+
+	case OP_GE:
+	case OP_GT:
+		J_LoadFloat (0, st->a, 0);
+		J_CompareFloat (st->b, 0);
+		J_Bytes ((st->op == OP_GE) ? "\x0f\x93\xc0" : "\x0f\x97\xc0", 3);	// setae/seta al
+		J_StoreBool (st->c);
+		break;
+	case OP_LE:
+	case OP_LT:
+		J_LoadFloat (0, st->b, 0);
+		J_CompareFloat (st->a, 0);
+		J_Bytes ((st->op == OP_LE) ? "\x0f\x93\xc0" : "\x0f\x97\xc0", 3);
+		J_StoreBool (st->c);
+		break;
+	case OP_EQ_F:
+	case OP_NE_F:
+		J_LoadFloat (0, st->a, 0);
+		J_FloatEqual (st->b, 0, st->op == OP_EQ_F);
+		J_StoreBool (st->c);
+		break;
+	case OP_EQ_V:
+	case OP_NE_V:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadFloat (0, st->a, k);
+			J_FloatEqual (st->b, k, st->op == OP_EQ_V);
+			if (!k)
+				J_Bytes ("\x88\xc2", 2);	// mov dl, al
+			else
+				J_Bytes ((st->op == OP_EQ_V) ? "\x20\xc2" : "\x08\xc2", 2);	// and/or dl, al
+		}
+		J_Bytes ("\x88\xd0", 2);		// mov al, dl
+		J_StoreBool (st->c);
+		break;
+	case OP_AND:
+	case OP_OR:
+		J_Bytes ("\x0f\x57\xc9", 3);		// xorps xmm1, xmm1
+		J_FloatTrue (st->a, 0);
+		J_Bytes ("\x88\xc2", 2);		// mov dl, al
+		J_FloatTrue (st->b, 0);
+		J_Bytes ((st->op == OP_AND) ? "\x20\xd0" : "\x08\xd0", 2);	// and/or al, dl
+		J_StoreBool (st->c);
+		break;
+	case OP_NOT_F:
+		J_Bytes ("\x0f\x57\xc9", 3);		// xorps xmm1, xmm1
+		J_FloatTrue (st->a, 0);
+		J_Bytes ("\x34\x01", 2);		// xor al, 1
+		J_StoreBool (st->c);
+		break;
+	case OP_NOT_V:
+		J_Bytes ("\x0f\x57\xc9", 3);		// xorps xmm1, xmm1
+		for (k = 0; k < 12; k += 4)
+		{
+			J_FloatTrue (st->a, k);
+			J_Bytes (k ? "\x08\xc2" : "\x88\xc2", 2);	// or/mov dl, al
+		}
+		J_Bytes ("\x88\xd0\x34\x01", 4);	// mov al, dl; xor al, 1
+		J_StoreBool (st->c);
+		break;
+	case OP_EQ_E:
+	case OP_EQ_FNC:
+	case OP_NE_E:
+	case OP_NE_FNC:
+		J_LoadInt (R_EAX, st->a, 0);
+		J_Global ("\x3b", 1, R_EAX, st->b, 0);	// cmp eax, [b]
+		J_Bytes ((st->op == OP_EQ_E || st->op == OP_EQ_FNC) ? "\x0f\x94\xc0" : "\x0f\x95\xc0", 3);	// sete/setne al
+		J_StoreBool (st->c);
+		break;
+	case OP_NOT_FNC:
+	case OP_NOT_ENT:
+		J_Global ("\x83", 1, 7, st->a, 0);	// cmp dword [a], 0
+		*pr_jitout++ = 0;
+		J_Bytes ("\x0f\x94\xc0", 3);		// sete al
+		J_StoreBool (st->c);
+		break;
+
+	case OP_NOT_S:
+	case OP_EQ_S:
+	case OP_NE_S:
+	case OP_STATE:
+		J_Helper (PR_JitStatement, s);
+		break;
+
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:
+		J_LoadInt (R_EAX, st->a, 0);
+		J_StoreInt (R_EAX, st->b, 0);
+		break;
+	case OP_STORE_V:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadInt (R_EAX, st->a, k);
+			J_StoreInt (R_EAX, st->b, k);
+		}
+		break;
+
+	case OP_STOREP_F:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_S:
+	case OP_STOREP_FNC:
+	case OP_STOREP_V:
+		J_LoadSigned (R_EAX, st->b);			// movsxd rax, [b]
+		for (k = 0; k < ((st->op == OP_STOREP_V) ? 12 : 4); k += 4)
+		{
+			J_LoadInt (R_ECX, st->a, k);
+			J_Bytes ("\x41\x89\x4c\x04", 4);	// mov [r12 + rax + k], ecx
+			*pr_jitout++ = k;
+		}
+		break;
+
+	case OP_ADDRESS:
+		J_LoadInt (R_EAX, st->a, 0);
+		J_Bytes ("\x85\xc0\x75\x20", 4);		// test eax, eax; jnz ok
+		J_Bytes ("\x48\xb9", 2);			// mov rcx, &sv.state
+		J_Ptr (&sv.state);
+		J_Bytes ("\x83\x39", 2);			// cmp dword [rcx], ss_active
+		*pr_jitout++ = ss_active;
+		J_Bytes ("\x75\x11", 2);			// jne ok
+		J_Helper (PR_JitWorldAssign, s);
+		J_LoadInt (R_EAX, st->a, 0);			// ok:
+		J_LoadInt (R_ECX, st->b, 0);
+		J_Bytes ("\x8d\x84\x88", 3);			// lea eax, [rax + rcx*4 + v]
+		J_Int ((int)offsetof(edict_t, v));
+		J_StoreInt (R_EAX, st->c, 0);
+		J_Bytes ("\x83\xe9", 2);			// sub ecx, PR_WATCHFIRST
+		*pr_jitout++ = PR_WATCHFIRST;
+		J_Bytes ("\x83\xf9", 2);			// cmp ecx, PR_WATCHLAST - PR_WATCHFIRST
+		*pr_jitout++ = PR_WATCHLAST - PR_WATCHFIRST;
+		J_Bytes ("\x77\x11", 2);			// ja done
+		J_Helper (PR_JitFieldWritten, s);
+		break;
+
+	case OP_LOAD_F:
+	case OP_LOAD_FLD:
+	case OP_LOAD_ENT:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:
+	case OP_LOAD_V:
+		J_LoadSigned (R_EAX, st->a);			// movsxd rax, [a]
+		J_LoadSigned (R_ECX, st->b);			// movsxd rcx, [b]
+		J_Bytes ("\x4c\x01\xe0", 3);			// add rax, r12
+		J_Bytes ("\x48\x8d\x84\x88", 4);		// lea rax, [rax + rcx*4 + v]
+		J_Int ((int)offsetof(edict_t, v));
+		for (k = 0; k < ((st->op == OP_LOAD_V) ? 12 : 4); k += 4)
+		{
+			J_Bytes ("\x8b\x50", 2);		// mov edx, [rax + k]
+			*pr_jitout++ = k;
+			J_StoreInt (R_EDX, st->c, k);
+		}
+		break;
+
+	case OP_IF:
+	case OP_IFNOT:
+		J_Global ("\x83", 1, 7, st->a, 0);		// cmp dword [a], 0
+		*pr_jitout++ = 0;
+		target = s + st->b;
+		if (target <= s)
+		{ // skip the loop check when not branching
+			J_Bytes ((st->op == OP_IF) ? "\x74\x1b" : "\x75\x1b", 2);	// je/jne past the jmp
+			J_LoopCheck (s);
+			J_Jump ("\xe9", 1, target);			// jmp
+		}
+		else
+			J_Jump ((st->op == OP_IF) ? "\x0f\x85" : "\x0f\x84", 2, target);	// jne/je
+		break;
+
+	case OP_GOTO:
+		target = s + st->a;
+		if (target <= s)
+			J_LoopCheck (s);
+		J_Jump ("\xe9", 1, target);	// jmp
+		break;
+
+	case OP_CALL0:
+	case OP_CALL1:
+	case OP_CALL2:
+	case OP_CALL3:
+	case OP_CALL4:
+	case OP_CALL5:
+	case OP_CALL6:
+	case OP_CALL7:
+	case OP_CALL8:
+		J_Helper (PR_JitCall, s);
+		break;
+
+	case OP_DONE:
+	case OP_RETURN:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadInt (R_EAX, st->a, k);
+			J_StoreInt (R_EAX, OFS_RETURN, k);
+		}
+		J_Helper (PR_JitLeave, s);
+		J_Leave ();
+		break;
+	}
+}
+
+#elif defined(__aarch64__)
+
+//
+// AArch64 code generation
+//
+
+enum { R_W0, R_W1, R_W2 };	// and s0, s1, s2 by number
+
+#define	R_ADDR		9	// x9, for offsets too far for one instruction
+#define	R_CALL		16	// x16, the helper address
+#define	R_GLOBALS	19	// x19 = pr_globals
+#define	R_EDICTS	20	// x20 = sv.edicts
+#define	R_LOOPS		21	// w21 = backward branches left
+
+enum { C_EQ, C_NE, C_HS, C_LO, C_MI, C_PL, C_VS, C_VC, C_HI, C_LS, C_GE, C_LT, C_GT, C_LE };
+
+static void J_Insn (unsigned int insn)
+{
+	memcpy (pr_jitout, &insn, 4);
+	pr_jitout += 4;
+}
+
+/* movz/movk wreg, i */
+static void J_MovInt (int reg, int i)
+{
+	J_Insn (0x52800000 | ((i & 0xffff) << 5) | reg);			// movz wreg, #lo
+	J_Insn (0x72a00000 | (((unsigned int)i >> 16) << 5) | reg);		// movk wreg, #hi, lsl #16
+}
+
+/* movz/movk xreg, p */
+static void J_MovPtr (int reg, const void *p)
+{
+	uintptr_t	v = (uintptr_t)p;
+	int		k;
+
+	J_Insn (0xd2800000 | ((unsigned int)(v & 0xffff) << 5) | reg);		// movz xreg, #part
+	for (k = 1; k < 4; k++)
+		J_Insn (0xf2800000 | (k << 21) | ((unsigned int)((v >> (k * 16)) & 0xffff) << 5) | reg);	// movk xreg, #part, lsl #k*16
+}
+
+/* op rt, [xbase + ofs], a 4 byte load or store */
+static void J_Mem (unsigned int op, int rt, int base, int ofs)
+{
+	if (ofs >= 4096 * 4)
+	{
+		J_Insn (0x91400000 | ((ofs >> 12) << 10) | (base << 5) | R_ADDR);	// add x9, xbase, #ofs >> 12, lsl #12
+		base = R_ADDR;
+		ofs &= 4095;
+	}
+	J_Insn (op | ((ofs >> 2) << 10) | (base << 5) | rt);
+}
+
+/* op reg, [x19 + global * 4 + extra] */
+#define	J_Global(op, reg, global, extra)	J_Mem (op, reg, R_GLOBALS, (unsigned short)(global) * 4 + (extra))
+
+#define	LDR_W	0xb9400000
+#define	STR_W	0xb9000000
+#define	LDR_S	0xbd400000
+#define	STR_S	0xbd000000
+#define	LDRSW	0xb9800000
+
+#define	J_LoadInt(reg, g, x)	J_Global (LDR_W, reg, g, x)		// ldr wreg, [g]
+#define	J_StoreInt(reg, g, x)	J_Global (STR_W, reg, g, x)		// str wreg, [g]
+#define	J_LoadFloat(sreg, g, x)	J_Global (LDR_S, sreg, g, x)		// ldr sreg, [g]
+#define	J_StoreFloat(sreg, g, x) J_Global (STR_S, sreg, g, x)		// str sreg, [g]
+#define	J_LoadSigned(reg, g)	J_Global (LDRSW, reg, g, 0)		// ldrsw xreg, [g]
+#define	J_FloatOp(op, d, n, m)	J_Insn ((op) | ((m) << 16) | ((n) << 5) | (d))	// fadd etc. sd, sn, sm
+#define	J_CompareFloat(n, m)	J_Insn (0x1e202000 | ((m) << 16) | ((n) << 5))	// fcmp sn, sm
+#define	J_Set(reg, cond)	J_Insn (0x1a9f07e0 | (((cond) ^ 1) << 12) | (reg))	// cset wreg, cond
+#define	J_Logic(op, d, n, m)	J_Insn ((op) | ((m) << 16) | ((n) << 5) | (d))	// and etc. wd, wn, wm
+
+#define	FADD	0x1e202800
+#define	FSUB	0x1e203800
+#define	FMUL	0x1e200800
+#define	FDIV	0x1e201800
+#define	AND_W	0x0a000000
+#define	ORR_W	0x2a000000
+
+/* calls helper (s) */
+static void J_Helper (void (*helper) (int), int s)
+{
+	J_MovInt (R_W0, s);
+	J_MovPtr (R_CALL, (const void *)helper);
+	J_Insn (0xd63f0200);		// blr x16
+}
+
+/* a branch over the code that follows, for J_Land to point at where it ends */
+static byte *J_Skip (unsigned int insn)
+{
+	byte	*at = pr_jitout;
+
+	J_Insn (insn);
+	return at;
+}
+
+static void J_Land (byte *at)
+{
+	unsigned int	insn;
+
+	memcpy (&insn, at, 4);
+	insn |= (((unsigned int)(pr_jitout - at) >> 2) & 0x7ffff) << 5;	// b.cond, cbz and cbnz
+	memcpy (at, &insn, 4);
+}
+
+/* w0 = (s0 compared with [g]) is equal or not equal, counting NaNs as unequal */
+static void J_FloatEqual (int g, int x, qboolean equal)
+{
+	J_LoadFloat (1, g, x);
+	J_CompareFloat (0, 1);
+	J_Set (R_W0, equal ? C_EQ : C_NE);
+}
+
+/* w0 = [g] != 0.0 */
+static void J_FloatTrue (int g, int x)
+{
+	J_LoadFloat (0, g, x);
+	J_Insn (0x1e202008);		// fcmp s0, #0.0
+	J_Set (R_W0, C_NE);
+}
+
+/* [g] = w0 ? 1.0 : 0.0 */
+static void J_StoreBool (int g)
+{
+	J_Insn (0x1e230000);		// ucvtf s0, w0
+	J_StoreFloat (0, g, 0);
+}
+
+/* jumps to statement target, leaving the offset for PR_JitCompile to fill in */
+static void J_Jump (int target)
+{
+	pr_jitfixtargets[pr_jitnumfixups] = target;
+	pr_jitfixups[pr_jitnumfixups++] = (int)(pr_jitout - pr_jitbase - pr_jitused);
+	J_Insn (0x14000000);		// b
+}
+
+/* points the jump J_Jump left at at the code dist bytes further */
+static void J_Patch (byte *at, int dist)
+{
+	unsigned int	insn = 0x14000000 | ((dist >> 2) & 0x3ffffff);
+
+	memcpy (at, &insn, 4);
+}
+
+/* counts a backward branch */
+static void J_LoopCheck (int s)
+{
+	byte	*skip;
+
+	J_Insn (0x71000400 | (R_LOOPS << 5) | R_LOOPS);	// subs w21, w21, #1
+	skip = J_Skip (0x54000000 | C_NE);		// b.ne past the helper call
+	J_Helper (PR_JitRunaway, s);
+	J_Land (skip);
+}
+
+static void J_Enter (void)
+{
+	J_Insn (0xa9bd7bfd);		// stp x29, x30, [sp, #-48]!
+	J_Insn (0x910003fd);		// mov x29, sp
+	J_Insn (0xa90153f3);		// stp x19, x20, [sp, #16]
+	J_Insn (0xf90013f5);		// str x21, [sp, #32]
+	J_MovPtr (R_GLOBALS, pr_globals);
+	J_MovPtr (R_EDICTS, &sv.edicts);
+	J_Insn (0xf9400294);		// ldr x20, [x20]
+	J_MovInt (R_LOOPS, PR_JIT_MAXLOOPS);
+}
+
+static void J_Leave (void)
+{
+	J_Insn (0xf94013f5);		// ldr x21, [sp, #32]
+	J_Insn (0xa94153f3);		// ldp x19, x20, [sp, #16]
+	J_Insn (0xa8c37bfd);		// ldp x29, x30, [sp], #48
+	J_Insn (0xd65f03c0);		// ret
+}
+
+/* the instruction cache doesn't see stores */
+static void J_Flush (byte *start, byte *end)
+{
+	__builtin___clear_cache ((char *)start, (char *)end);
+}
+
+static void J_Statement (int s)
+{
+	dstatement_t	*st = &pr_statements[s];
+	unsigned int	op;
+	byte		*skip, *inactive;
+	int		k, target;
+
+	switch (st->op)
+	{
+	case OP_ADD_F:
+	case OP_SUB_F:
+	case OP_MUL_F:
+	case OP_DIV_F:
+		op = (st->op == OP_ADD_F) ? FADD : (st->op == OP_SUB_F) ? FSUB : (st->op == OP_MUL_F) ? FMUL : FDIV;
+		J_LoadFloat (0, st->a, 0);
+		J_LoadFloat (1, st->b, 0);
+		J_FloatOp (op, 0, 0, 1);
+		J_StoreFloat (0, st->c, 0);
+		break;
+	case OP_ADD_V:
+	case OP_SUB_V:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadFloat (0, st->a, k);
+			J_LoadFloat (1, st->b, k);
+			J_FloatOp ((st->op == OP_ADD_V) ? FADD : FSUB, 0, 0, 1);
+			J_StoreFloat (0, st->c, k);
+		}
+		break;
+	case OP_MUL_V:
+		J_LoadFloat (0, st->a, 0);
+		J_LoadFloat (1, st->b, 0);
+		J_FloatOp (FMUL, 0, 0, 1);
+		for (k = 4; k < 12; k += 4)
+		{
+			J_LoadFloat (1, st->a, k);
+			J_LoadFloat (2, st->b, k);
+			J_FloatOp (FMUL, 1, 1, 2);
+			J_FloatOp (FADD, 0, 0, 1);
+		}
+		J_StoreFloat (0, st->c, 0);
+		break;
+	case OP_MUL_FV:
+	case OP_MUL_VF:
+		for (k = 0; k < 12; k += 4)
+		{
+			if (st->op == OP_MUL_FV)
+			{
+				J_LoadFloat (0, st->a, 0);
+				J_LoadFloat (1, st->b, k);
+			}
+			else
+			{
+				J_LoadFloat (0, st->b, 0);
+				J_LoadFloat (1, st->a, k);
+			}
+			J_FloatOp (FMUL, 0, 0, 1);
+			J_StoreFloat (0, st->c, k);
+		}
+		break;
+
+	case OP_BITAND:
+	case OP_BITOR:
+		J_LoadFloat (0, st->a, 0);
+		J_LoadFloat (1, st->b, 0);
+		J_Insn (0x1e380000);			// fcvtzs w0, s0
+		J_Insn (0x1e380021);			// fcvtzs w1, s1
+		J_Logic ((st->op == OP_BITAND) ? AND_W : ORR_W, R_W0, R_W0, R_W1);
+		J_Insn (0x1e220000);			// scvtf s0, w0
+		J_StoreFloat (0, st->c, 0);
+		break;
+
+	case OP_GE:
+	case OP_GT:
+		J_LoadFloat (0, st->a, 0);
+		J_LoadFloat (1, st->b, 0);
+		J_CompareFloat (0, 1);
+		J_Set (R_W0, (st->op == OP_GE) ? C_GE : C_GT);	// false if unordered
+		J_StoreBool (st->c);
+		break;
+	case OP_LE:
+	case OP_LT:
+		J_LoadFloat (0, st->b, 0);
+		J_LoadFloat (1, st->a, 0);
+		J_CompareFloat (0, 1);
+		J_Set (R_W0, (st->op == OP_LE) ? C_GE : C_GT);
+		J_StoreBool (st->c);
+		break;
+	case OP_EQ_F:
+	case OP_NE_F:
+		J_LoadFloat (0, st->a, 0);
+		J_FloatEqual (st->b, 0, st->op == OP_EQ_F);
+		J_StoreBool (st->c);
+		break;
+	case OP_EQ_V:
+	case OP_NE_V:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadFloat (0, st->a, k);
+			J_FloatEqual (st->b, k, st->op == OP_EQ_V);
+			if (!k)
+				J_Logic (ORR_W, R_W2, 31, R_W0);	// mov w2, w0
+			else
+				J_Logic ((st->op == OP_EQ_V) ? AND_W : ORR_W, R_W2, R_W2, R_W0);
+		}
+		J_Logic (ORR_W, R_W0, 31, R_W2);		// mov w0, w2
+		J_StoreBool (st->c);
+		break;
+	case OP_AND:
+	case OP_OR:
+		J_FloatTrue (st->a, 0);
+		J_Logic (ORR_W, R_W2, 31, R_W0);		// mov w2, w0
+		J_FloatTrue (st->b, 0);
+		J_Logic ((st->op == OP_AND) ? AND_W : ORR_W, R_W0, R_W0, R_W2);
+		J_StoreBool (st->c);
+		break;
+	case OP_NOT_F:
+		J_FloatTrue (st->a, 0);
+		J_Insn (0x52000000);			// eor w0, w0, #1
+		J_StoreBool (st->c);
+		break;
+	case OP_NOT_V:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_FloatTrue (st->a, k);
+			J_Logic (ORR_W, R_W2, k ? R_W2 : 31, R_W0);	// orr/mov w2, w0
+		}
+		J_Insn (0x52000040);			// eor w0, w2, #1
+		J_StoreBool (st->c);
+		break;
+	case OP_EQ_E:
+	case OP_EQ_FNC:
+	case OP_NE_E:
+	case OP_NE_FNC:
+		J_LoadInt (R_W0, st->a, 0);
+		J_LoadInt (R_W1, st->b, 0);
+		J_Insn (0x6b01001f);			// cmp w0, w1
+		J_Set (R_W0, (st->op == OP_EQ_E || st->op == OP_EQ_FNC) ? C_EQ : C_NE);
+		J_StoreBool (st->c);
+		break;
+	case OP_NOT_FNC:
+	case OP_NOT_ENT:
+		J_LoadInt (R_W0, st->a, 0);
+		J_Insn (0x7100001f);			// cmp w0, #0
+		J_Set (R_W0, C_EQ);
+		J_StoreBool (st->c);
+		break;
+
+	case OP_NOT_S:
+	case OP_EQ_S:
+	case OP_NE_S:
+	case OP_STATE:
+		J_Helper (PR_JitStatement, s);
+		break;
+
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:
+		J_LoadInt (R_W0, st->a, 0);
+		J_StoreInt (R_W0, st->b, 0);
+		break;
+	case OP_STORE_V:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadInt (R_W0, st->a, k);
+			J_StoreInt (R_W0, st->b, k);
+		}
+		break;
+
+	case OP_STOREP_F:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_S:
+	case OP_STOREP_FNC:
+	case OP_STOREP_V:
+		J_LoadSigned (R_W0, st->b);			// ldrsw x0, [b]
+		J_Insn (0x8b000280);				// add x0, x20, x0
+		for (k = 0; k < ((st->op == OP_STOREP_V) ? 12 : 4); k += 4)
+		{
+			J_LoadInt (R_W1, st->a, k);
+			J_Mem (STR_W, R_W1, 0, k);		// str w1, [x0, #k]
+		}
+		break;
+
+	case OP_ADDRESS:
+		J_LoadInt (R_W0, st->a, 0);
+		skip = J_Skip (0x35000000);			// cbnz w0, ok
+		J_MovPtr (1, &sv.state);
+		J_Insn (0xb9400021);				// ldr w1, [x1]
+		J_Insn (0x7100003f | (ss_active << 10));	// cmp w1, #ss_active
+		inactive = J_Skip (0x54000000 | C_NE);		// b.ne ok
+		J_Helper (PR_JitWorldAssign, s);
+		J_Land (skip);
+		J_Land (inactive);
+		J_LoadInt (R_W0, st->a, 0);			// ok:
+		J_LoadInt (R_W1, st->b, 0);
+		J_Insn (0x0b010800);				// add w0, w0, w1, lsl #2
+		J_Insn (0x11000000 | ((int)offsetof(edict_t, v) << 10));	// add w0, w0, #v
+		J_StoreInt (R_W0, st->c, 0);
+		J_Insn (0x51000021 | (PR_WATCHFIRST << 10));	// sub w1, w1, #PR_WATCHFIRST
+		J_Insn (0x7100003f | ((PR_WATCHLAST - PR_WATCHFIRST) << 10));	// cmp w1, #PR_WATCHLAST - PR_WATCHFIRST
+		skip = J_Skip (0x54000000 | C_HI);		// b.hi done
+		J_Helper (PR_JitFieldWritten, s);
+		J_Land (skip);
+		break;
+
+	case OP_LOAD_F:
+	case OP_LOAD_FLD:
+	case OP_LOAD_ENT:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:
+	case OP_LOAD_V:
+		J_LoadSigned (R_W0, st->a);			// ldrsw x0, [a]
+		J_LoadSigned (R_W1, st->b);			// ldrsw x1, [b]
+		J_Insn (0x8b000280);				// add x0, x20, x0
+		J_Insn (0x8b010800);				// add x0, x0, x1, lsl #2
+		for (k = 0; k < ((st->op == OP_LOAD_V) ? 12 : 4); k += 4)
+		{
+			J_Mem (LDR_W, R_W2, 0, (int)offsetof(edict_t, v) + k);	// ldr w2, [x0, #v + k]
+			J_StoreInt (R_W2, st->c, k);
+		}
+		break;
+
+	case OP_IF:
+	case OP_IFNOT:
+		J_LoadInt (R_W0, st->a, 0);
+		skip = J_Skip ((st->op == OP_IF) ? 0x34000000 : 0x35000000);	// cbz/cbnz w0, past the b
+		target = s + st->b;
+		if (target <= s)
+			J_LoopCheck (s);
+		J_Jump (target);
+		J_Land (skip);
+		break;
+
+	case OP_GOTO:
+		target = s + st->a;
+		if (target <= s)
+			J_LoopCheck (s);
+		J_Jump (target);
+		break;
+
+	case OP_CALL0:
+	case OP_CALL1:
+	case OP_CALL2:
+	case OP_CALL3:
+	case OP_CALL4:
+	case OP_CALL5:
+	case OP_CALL6:
+	case OP_CALL7:
+	case OP_CALL8:
+		J_Helper (PR_JitCall, s);
+		break;
+
+	case OP_DONE:
+	case OP_RETURN:
+		for (k = 0; k < 12; k += 4)
+		{
+			J_LoadInt (R_W0, st->a, k);
+			J_StoreInt (R_W0, OFS_RETURN, k);
+		}
+		J_Helper (PR_JitLeave, s);
+		J_Leave ();
+		break;
+	}
+}
+
+#endif
+
+/*
+====================
+PR_JitCompile
+
+Returns NULL if the function has anything that can't be compiled, or if
+the code space is used up
+====================
+*/
+static prjitfunc_t PR_JitCompile (int fnum)
+{
+	dfunction_t	*f = &pr_functions[fnum];
+	dstatement_t	*st;
+	int		first, last, s, k, target, size;
+	int		*offsets;
+	byte		*start;
+	prjitfunc_t	func;
+
+// find the end of the function, and make sure nothing jumps out of it
+	first = f->first_statement;
+	for (last = first; last < progs->numstatements && pr_statements[last].op != OP_DONE; last++)
+		;
+	if (last == progs->numstatements)
+		goto fail;
+	for (s = first; s <= last; s++)
+	{
+		st = &pr_statements[s];
+		if (st->op > OP_BITOR)
+			goto fail;
+		if (st->op == OP_IF || st->op == OP_IFNOT)
+			target = s + st->b;
+		else if (st->op == OP_GOTO)
+			target = s + st->a;
+		else
+			continue;
+		if (target < first || target > last)
+			goto fail;
+	}
+
+// make room
+	if (!pr_jitbase)
+	{
+		pr_jitbase = (byte *) Sys_MemReserve (PR_JIT_RESERVE);
+		if (!pr_jitbase)
+		{
+			Con_Printf ("pr_jit: couldn't reserve code space\n");
+			Cvar_SetValueQuick (&pr_jit, 0);
+			return NULL;
+		}
+	}
+// every function starts on a page of its own, the ones before may be
+// running further up the stack and have to stay executable
+	size = 64 + (last - first + 1) * PR_JIT_MAXSTMTBYTES;
+	size = (size + PR_JIT_PAGE - 1) & ~(PR_JIT_PAGE - 1);
+	if (pr_jitused + size > PR_JIT_RESERVE)
+		goto fail;
+	start = pr_jitbase + pr_jitused;
+	if (!Sys_MemCommit (start, size))
+		goto fail;
+	if (pr_jitused + size > pr_jitcommit)
+	{
+		Mem_Track (MEMPOOL_MALLOC, "qcjit", pr_jitused + size - pr_jitcommit);
+		pr_jitcommit = pr_jitused + size;
+	}
+
+	offsets = (int *) malloc ((last - first + 1) * sizeof(int));
+	pr_jitfixups = (int *) malloc ((last - first + 1) * 2 * sizeof(int));
+	pr_jitfixtargets = (int *) malloc ((last - first + 1) * 2 * sizeof(int));
+	pr_jitnumfixups = 0;
+
+	pr_jitout = start;
+	J_Enter ();
+	for (s = first; s <= last; s++)
+	{
+		offsets[s - first] = (int)(pr_jitout - start);
+		J_Statement (s);
+	}
+
+// point the branches at their statements
+	for (k = 0; k < pr_jitnumfixups; k++)
+		J_Patch (start + pr_jitfixups[k], offsets[pr_jitfixtargets[k] - first] - pr_jitfixups[k]);
+	free (offsets);
+	free (pr_jitfixups);
+	free (pr_jitfixtargets);
+	J_Flush (start, pr_jitout);
+
+	size = (int)(pr_jitout - start);
+	size = (size + PR_JIT_PAGE - 1) & ~(PR_JIT_PAGE - 1);
+	func = (prjitfunc_t) start;
+	pr_jitused += size;
+
+	if (!Sys_MemExecutable (start, size))
+	{
+		Con_Printf ("pr_jit: couldn't make code executable\n");
+		Cvar_SetValueQuick (&pr_jit, 0);
+		return NULL;
+	}
+	pr_jitcode[fnum] = func;
+	pr_jitstats.compiled++;
+	return func;
+
+fail:
+	pr_jitstats.failed++;
+	return NULL;
+}
+
+/*
+====================
+PR_JitEnter
+
+Runs f as compiled code if it is or has just become hot enough to be,
+returns false to leave it to the interpreter. f hasn't been entered yet.
+====================
+*/
+static qboolean PR_JitEnter (dfunction_t *f)
+{
+	prjitfunc_t	func;
+	int		fnum;
+
+	if (!pr_jit.value || !pr_jitcode || pr_jitcheck_state == JITCHECK_RECORD || pr_jitcheck_state == JITCHECK_BUILTIN)
+		return false;
+
+	fnum = f - pr_functions;
+	func = pr_jitcode[fnum];
+	if (!func)
+	{
+		if (++pr_jitcalls[fnum] != PR_JIT_HOTCALLS)
+			return false;
+		func = PR_JitCompile (fnum);
+		if (!func)
+			return false;
+	}
+
+	PR_EnterFunction (f);
+	func ();
+	return true;
+}
+
+//
+// pr_jit 2
+//
+
+typedef struct
+{
+	int	builtin, argc;
+	int	parms[MAX_PARMS * 3];
+	int	numedicts;	// after the call
+	int	firstchange, numchanges;
+} prjitcall_t;
+
+typedef struct
+{
+	int	ofs;		// in ints, edicts following the globals
+	int	value;
+} prjitchange_t;
+
+static struct
+{
+	int		*before, *interp, *temp;	// globals followed by edicts
+	int		size;
+	prjitcall_t	*calls;
+	int		numcalls, maxcalls, replayed;
+	prjitchange_t	*changes;
+	int		numchanges, maxchanges;
+	qboolean	diverged;
+} pr_jitcheck;
+
+static int PR_JitCheckSize (int numedicts)
+{
+	return progs->numglobals + numedicts * pr_edict_size / 4;
+}
+
+static void PR_JitCheckSave (int *buf, int numedicts)
+{
+	memcpy (buf, pr_globals, progs->numglobals * 4);
+	memcpy (buf + progs->numglobals, sv.edicts, numedicts * pr_edict_size);
+}
+
+static void PR_JitCheckRestore (const int *buf, int numedicts)
+{
+	memcpy (pr_globals, buf, progs->numglobals * 4);
+	memcpy (sv.edicts, buf + progs->numglobals, numedicts * pr_edict_size);
+	sv.num_edicts = numedicts;
+}
+
+static int PR_JitCheckValue (int ofs)
+{
+	if (ofs < progs->numglobals)
+		return ((int *)pr_globals)[ofs];
+	return ((int *)sv.edicts)[ofs - progs->numglobals];
+}
+
+static qboolean PR_JitCheckSame (int a, int b)
+{
+	return a == b || ((a & 0x7fffffff) > 0x7f800000 && (b & 0x7fffffff) > 0x7f800000);	// both NaN
+}
+
+static void PR_JitCheckAlloc (void)
+{
+	int	size = PR_JitCheckSize (sv.max_edicts);
+
+	if (size > pr_jitcheck.size)
+	{
+		free (pr_jitcheck.before);
+		free (pr_jitcheck.interp);
+		free (pr_jitcheck.temp);
+		pr_jitcheck.before = (int *) malloc (size * 4);
+		pr_jitcheck.interp = (int *) malloc (size * 4);
+		pr_jitcheck.temp = (int *) malloc (size * 4);
+		if (!pr_jitcheck.before || !pr_jitcheck.interp || !pr_jitcheck.temp)
+			Sys_Error ("PR_JitCheck: out of memory");
+		pr_jitcheck.size = size;
+	}
+}
+
+/*
+====================
+PR_JitCheckBuiltin
+
+Calls builtin i and records what it did while the interpreter runs, replays
+that while the compiled code does
+====================
+*/
+static void PR_JitCheckBuiltin (int i)
+{
+	prjitcall_t	*call;
+	prjitchange_t	*change;
+	int		numedicts, ofs, end;
+
+	if (pr_jitcheck_state == JITCHECK_RECORD)
+	{
+		if (pr_jitcheck.numcalls == pr_jitcheck.maxcalls)
+		{
+			pr_jitcheck.maxcalls = q_max (pr_jitcheck.maxcalls * 2, 256);
+			pr_jitcheck.calls = (prjitcall_t *) realloc (pr_jitcheck.calls, pr_jitcheck.maxcalls * sizeof(prjitcall_t));
+			if (!pr_jitcheck.calls)
+				Sys_Error ("PR_JitCheck: out of memory");
+		}
+		call = &pr_jitcheck.calls[pr_jitcheck.numcalls++];
+		call->builtin = i;
+		call->argc = pr_argc;
+		memcpy (call->parms, &pr_globals[OFS_PARM0], sizeof(call->parms));
+
+		numedicts = sv.num_edicts;
+		PR_JitCheckSave (pr_jitcheck.temp, numedicts);
+		pr_jitcheck_state = JITCHECK_BUILTIN;	// QC the builtin runs is part of it
+		pr_builtins[i] ();
+		pr_jitcheck_state = JITCHECK_RECORD;
+
+		call->numedicts = sv.num_edicts;
+		call->firstchange = pr_jitcheck.numchanges;
+		end = PR_JitCheckSize (q_max (numedicts, sv.num_edicts));
+		for (ofs = 0; ofs < end; ofs++)
+		{
+			if (ofs < PR_JitCheckSize (numedicts) && pr_jitcheck.temp[ofs] == PR_JitCheckValue (ofs))
+				continue;
+			if (pr_jitcheck.numchanges == pr_jitcheck.maxchanges)
+			{
+				pr_jitcheck.maxchanges = q_max (pr_jitcheck.maxchanges * 2, 4096);
+				pr_jitcheck.changes = (prjitchange_t *) realloc (pr_jitcheck.changes, pr_jitcheck.maxchanges * sizeof(prjitchange_t));
+				if (!pr_jitcheck.changes)
+					Sys_Error ("PR_JitCheck: out of memory");
+			}
+			change = &pr_jitcheck.changes[pr_jitcheck.numchanges++];
+			change->ofs = ofs;
+			change->value = PR_JitCheckValue (ofs);
+		}
+		call->numchanges = pr_jitcheck.numchanges - call->firstchange;
+		return;
+	}
+
+// replaying
+	if (pr_jitcheck.diverged)
+		return;
+	call = &pr_jitcheck.calls[pr_jitcheck.replayed];
+	if (pr_jitcheck.replayed == pr_jitcheck.numcalls || call->builtin != i || call->argc != pr_argc ||
+	    memcmp (call->parms, &pr_globals[OFS_PARM0], pr_argc * 3 * 4))
+	{
+		Con_Printf ("pr_jit: %s: builtin call %i differs from the interpreter's\n",
+			    PR_GetString(pr_xfunction->s_name), pr_jitcheck.replayed);
+		pr_jitcheck.diverged = true;
+		return;
+	}
+	pr_jitcheck.replayed++;
+	sv.num_edicts = call->numedicts;
+	for (change = &pr_jitcheck.changes[call->firstchange]; change < &pr_jitcheck.changes[call->firstchange + call->numchanges]; change++)
+	{
+		if (change->ofs < progs->numglobals)
+			((int *)pr_globals)[change->ofs] = change->value;
+		else
+			((int *)sv.edicts)[change->ofs - progs->numglobals] = change->value;
+	}
+}
+
+/*
+====================
+PR_JitCheck
+
+Runs f with the interpreter and again with compiled code, and compares
+====================
+*/
+static void PR_JitCheck (dfunction_t *f)
+{
+	int		numedicts, interpedicts, ofs, size, reported;
+
+	PR_JitCheckAlloc ();
+	pr_jitcheck.numcalls = pr_jitcheck.numchanges = pr_jitcheck.replayed = 0;
+	pr_jitcheck.diverged = false;
+
+	numedicts = sv.num_edicts;
+	PR_JitCheckSave (pr_jitcheck.before, numedicts);
+
+	pr_jitcheck_state = JITCHECK_RECORD;
+	PR_RunFunction (f);
+	interpedicts = sv.num_edicts;
+	PR_JitCheckSave (pr_jitcheck.interp, interpedicts);
+
+// edicts spawned by the interpreter are written again by the replayed spawn
+	PR_JitCheckRestore (pr_jitcheck.before, numedicts);
+	pr_jitcheck_state = JITCHECK_REPLAY;
+	PR_RunFunction (f);
+	pr_jitcheck_state = JITCHECK_NONE;
+
+	pr_jitstats.checks++;
+	reported = 0;
+	size = PR_JitCheckSize (interpedicts);
+	for (ofs = 0; ofs < size; ofs++)
+	{
+		if (PR_JitCheckSame (pr_jitcheck.interp[ofs], PR_JitCheckValue (ofs)))
+			continue;
+		if (++reported > 8)
+			continue;
+		if (ofs < progs->numglobals)
+			Con_Printf ("pr_jit: %s: global %i is %08x, interpreter %08x\n", PR_GetString(f->s_name),
+				    ofs, PR_JitCheckValue (ofs), pr_jitcheck.interp[ofs]);
+		else
+			Con_Printf ("pr_jit: %s: edict %i +%i is %08x, interpreter %08x\n", PR_GetString(f->s_name),
+				    (ofs - progs->numglobals) * 4 / pr_edict_size, (ofs - progs->numglobals) * 4 % pr_edict_size,
+				    PR_JitCheckValue (ofs), pr_jitcheck.interp[ofs]);
+	}
+	if (reported || pr_jitcheck.diverged)
+		pr_jitstats.mismatches++;
+
+// the interpreter's results are the ones that count
+	PR_JitCheckRestore (pr_jitcheck.interp, interpedicts);
+}
+
+/*
+====================
+PR_JitStats_f
+====================
+*/
+static void PR_JitStats_f (void)
+{
+	Con_Printf ("%i functions compiled, %i not compiled\n", pr_jitstats.compiled, pr_jitstats.failed);
+	Con_Printf ("%i KB of code, %i KB committed\n", pr_jitused / 1024, pr_jitcommit / 1024);
+	if (pr_jitstats.checks)
+		Con_Printf ("%i calls checked, %i mismatched\n", pr_jitstats.checks, pr_jitstats.mismatches);
+}
+
+void PR_JitInit (void)
+{
+	Cvar_RegisterVariable (&pr_jit);
+	Cmd_AddCommand ("pr_jitstats", PR_JitStats_f);
+}
+
+#else	/* !PR_JIT */
+
+static void PR_JitStats_f (void)
+{
+	Con_Printf ("the QuakeC JIT is not available on this platform\n");
+}
+
+static void PR_Jit_f (cvar_t *var)
+{
+	if (var->value)
+		PR_JitStats_f ();
+}
+
+void PR_JitInit (void)
+{
+	Cvar_RegisterVariable (&pr_jit);
+	Cvar_SetCallback (&pr_jit, PR_Jit_f);
+	Cmd_AddCommand ("pr_jitstats", PR_JitStats_f);
+}
+
+#endif	/* PR_JIT */
+
+/*
+====================
+PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteProgram (func_t fnum)
+{
+	dfunction_t	*f;
+
+	if (!fnum || fnum >= progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
+	}
+
+	f = &pr_functions[fnum];
+
+	pr_trace = false;
+
+	if (!pr_depth && pr_profdepth)
+		PR_ProfileUnwind ();	// a Host_Error left calls behind
+
+#ifdef PR_JIT
+	if (!pr_depth)
+		pr_jitcheck_state = JITCHECK_NONE;	// in case a check ended in Host_Error
+	if (pr_jit.value >= 2 && pr_jitcode && pr_jitcheck_state == JITCHECK_NONE)
+	{
+		PR_JitCheck (f);
+		return;
+	}
+#endif
+	PR_RunFunction (f);
+}
@@ -71,24 +71,33 @@ extern	int		pr_edict_size;	/* in bytes */
 void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
+void PR_DecodeStatements (void);
+void PR_JitInit (void);
 void PR_LoadProgs (void);
 
 const char *PR_GetString (int num);
 int PR_SetEngineString (const char *s);
 int PR_AllocString (int bufferlength, char **ptr);
+void PR_FreeString (int num);
+qboolean PR_StringIsStable (int num);
 
 void PR_Profile_f (void);
+int PR_ActiveFunction (void);	// index of the QC function running, or 0
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
+void ED_RebuildFreeQueue (void);
 
 void ED_Print (edict_t *ed);
-void ED_Write (FILE *f, edict_t *ed);
+void ED_Write (sizebuf_t *buf, edict_t *ed);
 const char *ED_ParseEdict (const char *data, edict_t *ent);
 
-void ED_WriteGlobals (FILE *f);
+void ED_WriteGlobals (sizebuf_t *buf);
 const char *ED_ParseGlobals (const char *data);
 
+void ED_SaveBinary (sizebuf_t *buf);
+void ED_LoadBinary (sizebuf_t *buf);
+
 void ED_LoadFromFile (const char *data);
 
 /*
@@ -125,6 +134,8 @@ extern	int		pr_numbuiltins;
 extern	int		pr_argc;
 
 extern	qboolean	pr_trace;
+extern	cvar_t		pr_engine;
+extern	cvar_t		pr_jit;
 extern	dfunction_t	*pr_xfunction;
 extern	int		pr_xstatement;
 
@@ -138,7 +149,37 @@ FUNC_NORETURN void PR_RunError (const char *error, ...) FUNC_PRINTF(1,2);
 void ED_PrintEdicts (void);
 void ED_PrintNum (int ent);
 
-eval_t *GetEdictFieldValue(edict_t *ed, const char *field);
+// the span of entvars_t, solid to maxs, that find and findradius keep
+// indexes on: OP_ADDRESS into it goes through PR_FieldWritten
+#define	PR_WATCHFIRST		((int)(offsetof(entvars_t, solid) / 4))
+#define	PR_WATCHLAST		((int)(offsetof(entvars_t, maxs) / 4) + 2)
+#define	PR_WATCHED(field)	((unsigned int)((field) - PR_WATCHFIRST) <= (unsigned int)(PR_WATCHLAST - PR_WATCHFIRST))
+
+extern	cvar_t		pr_findindex;
+
+void PR_FieldWritten (edict_t *ed, int field);
+void PR_FindMark (edict_t *ed);
+void PR_ClearFindIndex (void);
+
+// fields outside of entvars_t that the engine uses when the progs have
+// them, as offsets in ints from ed->v resolved by PR_LoadProgs, or -1
+typedef struct
+{
+	int	alpha;
+	int	gravity;
+	int	items2;
+	int	ammo_shells1;		// rogue
+	int	ammo_nails1;
+	int	ammo_lava_nails;
+	int	ammo_rockets1;
+	int	ammo_multi_rockets;
+	int	ammo_cells1;
+	int	ammo_plasma;
+} extfields_t;
+
+extern	extfields_t	pr_extfields;
+
+eval_t *GetEdictFieldValue(edict_t *ed, int fieldofs);
 
 #endif	/* _QUAKE_PROGS_H */
 
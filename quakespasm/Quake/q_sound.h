@@ -105,6 +105,7 @@ void S_UnblockSound (void);
 
 sfx_t *S_PrecacheSound (const char *sample);
 void S_TouchSound (const char *sample);
+void S_PrefetchSound (const char *sample);
 void S_ClearPrecache (void);
 void S_BeginPrecaching (void);
 void S_EndPrecaching (void);
@@ -202,6 +202,7 @@ typedef struct
 	char	**argv;
 	void	*membase;
 	int	memsize;
+	qboolean	memreserved;	// membase is only reserved, the hunk commits it as needed
 	int	numcpus;
 	int	errstate;
 } quakeparms_t;
@@ -321,6 +322,7 @@ void Host_Quit_f (void);
 void Host_ClientCommands (const char *fmt, ...) FUNC_PRINTF(1,2);
 void Host_ShutdownServer (qboolean crash);
 void Host_WriteConfiguration (void);
+void Host_FinishSave (qboolean wait);
 
 void ExtraMaps_Init (void);
 void Modlist_Init (void);
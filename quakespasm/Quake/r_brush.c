@@ -729,6 +729,7 @@ int AllocBlock (int w, int h, int *x, int *y)
 			/* FIXME: we leave 'gaps' in malloc()ed data,  CRC_Block() later accesses
 			 * that uninitialized data and valgrind complains for it.  use calloc() ? */
 			lightmap[texnum].data = (byte *) malloc(4*LMBLOCK_WIDTH*LMBLOCK_HEIGHT);
+			Mem_Track (MEMPOOL_MALLOC, "lightmaps", 4*LMBLOCK_WIDTH*LMBLOCK_HEIGHT);
 			//as we're only tracking one texture, we don't need multiple copies of allocated any more.
 			memset(allocated, 0, sizeof(allocated));
 		}
@@ -884,6 +885,7 @@ void GL_BuildLightmaps (void)
 	//Spike -- wipe out all the lightmap data (johnfitz -- the gltexture objects were already freed by Mod_ClearAll)
 	for (i=0; i < lightmap_count; i++)
 		free(lightmap[i].data);
+	Mem_Track (MEMPOOL_MALLOC, "lightmaps", -lightmap_count * 4*LMBLOCK_WIDTH*LMBLOCK_HEIGHT);
 	free(lightmap);
 	lightmap = NULL;
 	last_lightmap_allocated = 0;
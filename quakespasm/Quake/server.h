@@ -192,6 +192,7 @@ extern	edict_t		*sv_player;
 //===========================================================
 
 void SV_Init (void);
+void SV_Shutdown (void);
 
 void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count);
 void SV_StartSound (edict_t *entity, int channel, const char *sample, int volume,
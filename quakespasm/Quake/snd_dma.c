@@ -316,6 +316,35 @@ void S_TouchSound (const char *name)
 	Cache_Check (&sfx->cache);
 }
 
+/*
+==================
+S_PrefetchSound
+
+Starts reading a sound that is about to be precached in the background.
+==================
+*/
+void S_PrefetchSound (const char *name)
+{
+	char	namebuffer[MAX_QPATH];
+	int		i;
+
+	if (!sound_started || nosound.value || !precache.value)
+		return;
+
+	for (i = 0; i < num_sfx; i++)
+	{
+		if (!Q_strcmp(known_sfx[i].name, name))
+		{
+			if (Cache_Check (&known_sfx[i].cache))
+				return;
+			break;
+		}
+	}
+
+	q_snprintf (namebuffer, sizeof(namebuffer), "sound/%s", name);
+	COM_PrefetchFile (namebuffer);
+}
+
 /*
 ==================
 S_PrecacheSound
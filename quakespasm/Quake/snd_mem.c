@@ -99,6 +99,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	float	stepscale;
 	sfxcache_t	*sc;
 	byte	stackbuf[1*1024];		// avoid dirtying the cache heap
+	const char	*requester;
 
 // see if still in memory
 	sc = (sfxcache_t *) Cache_Check (&s->cache);
@@ -113,7 +114,9 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 //	Con_Printf ("loading %s\n",namebuffer);
 
+	requester = COM_SetFileRequester ("sound");
 	data = COM_LoadStackFile(namebuffer, stackbuf, sizeof(stackbuf), NULL);
+	COM_SetFileRequester (requester);
 
 	if (!data)
 	{
@@ -32,6 +32,8 @@ int		sv_protocol = PROTOCOL_FITZQUAKE; //johnfitz
 
 extern qboolean	pr_alpha_supported; //johnfitz
 
+static void SV_PVSStats_f (void);
+
 //============================================================================
 
 /*
@@ -86,6 +88,8 @@ void SV_Init (void)
 	extern	cvar_t	sv_idealpitchscale;
 	extern	cvar_t	sv_aim;
 	extern	cvar_t	sv_altnoclip; //johnfitz
+	extern	cvar_t	sv_areatree;
+	extern	cvar_t	sv_parallelsnapshots;
 
 	sv.edicts = NULL; // ericw -- sv.edicts switched to use malloc()
 
@@ -104,8 +108,14 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_nostep);
 	Cvar_RegisterVariable (&sv_freezenonclients);
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
+	Cvar_RegisterVariable (&sv_areatree);
+	Cvar_RegisterVariable (&sv_parallelsnapshots);
 
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand ("sv_areastats", SV_AreaStats_f);
+	Cmd_AddCommand ("sv_tracestats", SV_TraceStats_f);
+	Cmd_AddCommand ("sv_tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("sv_pvsstats", SV_PVSStats_f);
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -523,6 +533,186 @@ byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel) //johnfitz -- added worldmode
 	return fatpvs;
 }
 
+/*
+Each client keeps the fat PVS it was last given, along with the leafs within
+8 units of the point it was made for.  The leafs are cheap to find, and only
+when they change do their rows have to be or'd together again.
+*/
+#define	MAX_FATLEAFS	32	// more than this and the client isn't cached
+
+typedef struct
+{
+	int		numleafs;	// -1 = nothing cached
+	int		leafs[MAX_FATLEAFS];
+	byte	*pvs;
+} fatcache_t;
+
+static fatcache_t	*sv_fatcache;		// [sv_numfatcache]
+static int		sv_numfatcache;
+static byte		*sv_fatcachepvs;	// a row for each of them
+static int		sv_fatcachebytes;	// in each row
+
+static int		sv_fatleafs[MAX_FATLEAFS];
+static int		sv_numfatleafs;
+
+static struct
+{
+	double	hits, misses, uncached;
+} sv_fatstats;
+
+static void SV_FindFatLeafs (vec3_t org, mnode_t *node, qmodel_t *worldmodel)
+{
+	mplane_t	*plane;
+	float	d;
+
+	while (1)
+	{
+		if (node->contents < 0)
+		{
+			if (node->contents != CONTENTS_SOLID)
+			{
+				if (sv_numfatleafs < MAX_FATLEAFS)
+					sv_fatleafs[sv_numfatleafs] = (mleaf_t *)node - worldmodel->leafs;
+				sv_numfatleafs++;
+			}
+			return;
+		}
+
+		plane = node->plane;
+		d = DotProduct (org, plane->normal) - plane->dist;
+		if (d > 8)
+			node = node->children[0];
+		else if (d < -8)
+			node = node->children[1];
+		else
+		{	// go down both
+			SV_FindFatLeafs (org, node->children[0], worldmodel);
+			node = node->children[1];
+		}
+	}
+}
+
+/*
+=============
+SV_ClearFatPVSCache
+
+Called when the world model changes
+=============
+*/
+static void SV_ClearFatPVSCache (void)
+{
+	int		i;
+
+	for (i = 0; i < sv_numfatcache; i++)
+		sv_fatcache[i].numleafs = -1;
+}
+
+static void SV_AllocFatPVSCache (int count, int bytes)
+{
+	int		i;
+
+	Mem_Track (MEMPOOL_MALLOC, "fatpvs", -sv_numfatcache * (int)(sizeof(fatcache_t) + sv_fatcachebytes));
+	free (sv_fatcache);
+	free (sv_fatcachepvs);
+	sv_numfatcache = count;
+	sv_fatcachebytes = bytes;
+	sv_fatcache = (fatcache_t *) malloc (count * sizeof(fatcache_t));
+	sv_fatcachepvs = (byte *) malloc (count * bytes);
+	if (!sv_fatcache || !sv_fatcachepvs)
+		Sys_Error ("SV_AllocFatPVSCache: failed on %i rows of %i bytes", count, bytes);
+	Mem_Track (MEMPOOL_MALLOC, "fatpvs", count * (int)(sizeof(fatcache_t) + bytes));
+
+	for (i = 0; i < count; i++)
+		sv_fatcache[i].pvs = sv_fatcachepvs + i * bytes;
+	SV_ClearFatPVSCache ();
+}
+
+/*
+=============
+SV_ClientFatPVS
+
+SV_FatPVS in the server's world for the given client, which keeps the row
+until it asks again
+=============
+*/
+static byte *SV_ClientFatPVS (int clientnum, vec3_t org)
+{
+	fatcache_t	*fat;
+	byte	*pvs;
+	int		i, j;
+
+	fatbytes = (sv.worldmodel->numleafs+7)>>3;
+	if (clientnum >= sv_numfatcache || fatbytes > sv_fatcachebytes)
+		SV_AllocFatPVSCache (q_max(svs.maxclients, clientnum + 1), q_max(fatbytes, sv_fatcachebytes));
+	fat = &sv_fatcache[clientnum];
+
+	sv_numfatleafs = 0;
+	SV_FindFatLeafs (org, sv.worldmodel->nodes, sv.worldmodel);
+	if (sv_numfatleafs > MAX_FATLEAFS)
+	{
+		sv_fatstats.uncached++;
+		fat->numleafs = -1;
+		memcpy (fat->pvs, SV_FatPVS (org, sv.worldmodel), fatbytes);
+		return fat->pvs;
+	}
+
+	if (fat->numleafs == sv_numfatleafs && !memcmp (fat->leafs, sv_fatleafs, sv_numfatleafs * sizeof(int)))
+	{
+		sv_fatstats.hits++;
+		return fat->pvs;
+	}
+	sv_fatstats.misses++;
+
+	Q_memset (fat->pvs, 0, fatbytes);
+	for (i = 0; i < sv_numfatleafs; i++)
+	{
+		pvs = Mod_LeafPVS (sv.worldmodel->leafs + sv_fatleafs[i], sv.worldmodel);
+		for (j = 0; j < fatbytes; j++)
+			fat->pvs[j] |= pvs[j];
+	}
+	fat->numleafs = sv_numfatleafs;
+	memcpy (fat->leafs, sv_fatleafs, sv_numfatleafs * sizeof(int));
+	return fat->pvs;
+}
+
+/*
+=============
+SV_EdictFatPVS
+
+The fat PVS from an edict's eyes, cached if it is a client
+=============
+*/
+static byte *SV_EdictFatPVS (edict_t *ent)
+{
+	vec3_t	org;
+	int		num;
+
+	VectorAdd (ent->v.origin, ent->v.view_ofs, org);
+	num = NUM_FOR_EDICT (ent);
+	if (num < 1 || num > svs.maxclients)
+		return SV_FatPVS (org, sv.worldmodel);
+	return SV_ClientFatPVS (num - 1, org);
+}
+
+/*
+=============
+SV_PVSStats_f
+
+How often the fat PVS of a client and the PVS rows could be reused since the
+last sv_pvsstats
+=============
+*/
+static void SV_PVSStats_f (void)
+{
+	double	total;
+
+	total = q_max (sv_fatstats.hits + sv_fatstats.misses + sv_fatstats.uncached, 1);
+	Con_Printf ("%8.0f client fat PVS, %5.1f%% reused, %5.1f%% rebuilt, %5.1f%% too many leafs\n", total,
+		sv_fatstats.hits * 100 / total, sv_fatstats.misses * 100 / total, sv_fatstats.uncached * 100 / total);
+	memset (&sv_fatstats, 0, sizeof(sv_fatstats));
+	Mod_PVSCacheStats ();
+}
+
 /*
 =============
 SV_VisibleToClient -- johnfitz
@@ -536,8 +726,13 @@ qboolean SV_VisibleToClient (edict_t *client, edict_t *test, qmodel_t *worldmode
 	vec3_t	org;
 	int		i;
 
-	VectorAdd (client->v.origin, client->v.view_ofs, org);
-	pvs = SV_FatPVS (org, worldmodel);
+	if (worldmodel == sv.worldmodel)
+		pvs = SV_EdictFatPVS (client);
+	else
+	{
+		VectorAdd (client->v.origin, client->v.view_ofs, org);
+		pvs = SV_FatPVS (org, worldmodel);
+	}
 
 	for (i=0 ; i < test->num_leafs ; i++)
 		if (pvs[test->leafnums[i] >> 3] & (1 << (test->leafnums[i]&7) ))
@@ -550,23 +745,90 @@ qboolean SV_VisibleToClient (edict_t *client, edict_t *test, qmodel_t *worldmode
 
 /*
 =============
-SV_WriteEntitiesToClient
+SV_PrepareEntities
 
+Run once a frame before any datagram is built.  Brings each edict's alpha up
+to date and works out whether it has a model that can be sent at all, so
+that writing the entity updates only reads the edicts.
 =============
 */
-void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
+static byte	*sv_entsendable;	// [sv.max_edicts]
+static int	sv_entsendablemax;
+static int	sv_entupdatemax;	// the most bytes one entity update can take
+
+static void SV_PrepareEntities (void)
+{
+	int		e, coord, angle;
+	edict_t	*ent;
+	eval_t	*val;
+
+	// header, entity number, five bytes, origin, angles and the four
+	// FitzQuake bytes: 24 with the usual coords and angles
+	if (sv.protocolflags & (PRFL_FLOATCOORD|PRFL_INT32COORD))
+		coord = 4;
+	else if (sv.protocolflags & PRFL_24BITCOORD)
+		coord = 3;
+	else
+		coord = 2;
+	if (sv.protocolflags & PRFL_FLOATANGLE)
+		angle = 4;
+	else if (sv.protocolflags & PRFL_SHORTANGLE)
+		angle = 2;
+	else
+		angle = 1;
+	sv_entupdatemax = q_max(24, 15 + 3*coord + 3*angle);
+
+	if (sv_entsendablemax < sv.max_edicts)
+	{
+		if (sv_entsendable)
+		{
+			free (sv_entsendable);
+			Mem_Track (MEMPOOL_MALLOC, "snapshots", -sv_entsendablemax);
+		}
+		sv_entsendablemax = sv.max_edicts;
+		sv_entsendable = (byte *) malloc (sv_entsendablemax);
+		if (!sv_entsendable)
+			Sys_Error ("SV_PrepareEntities: failed on allocation of %i bytes", sv_entsendablemax);
+		Mem_Track (MEMPOOL_MALLOC, "snapshots", sv_entsendablemax);
+	}
+
+	ent = NEXT_EDICT(sv.edicts);
+	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	{
+		//johnfitz -- alpha
+		if (pr_alpha_supported)
+		{
+			val = GetEdictFieldValue(ent, pr_extfields.alpha);
+			if (val)
+				ent->alpha = ENTALPHA_ENCODE(val->_float);
+		}
+
+		// ignore ents without visible models
+		if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+			sv_entsendable[e] = false;
+		//johnfitz -- don't send model>255 entities if protocol is 15
+		else if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
+			sv_entsendable[e] = false;
+		else
+			sv_entsendable[e] = true;
+	}
+}
+
+/*
+=============
+SV_WriteEntities
+
+Adds the update of every entity in pvs to msg, returns false if it ran out
+of room.  Only reads the edicts, so it is safe on the snapshot threads.
+=============
+*/
+static qboolean SV_WriteEntities (edict_t *clent, byte *pvs, sizebuf_t *msg)
 {
 	int		e, i;
 	int		bits;
-	byte	*pvs;
-	vec3_t	org;
 	float	miss;
 	edict_t	*ent;
 
-// find the client's PVS
-	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-	pvs = SV_FatPVS (org, sv.worldmodel);
-
 // send over all entities (excpet the client) that touch the pvs
 	ent = NEXT_EDICT(sv.edicts);
 	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
@@ -574,12 +836,7 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 
 		if (ent != clent)	// clent is ALLWAYS sent
 		{
-			// ignore ents without visible models
-			if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
-				continue;
-
-			//johnfitz -- don't send model>255 entities if protocol is 15
-			if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
+			if (!sv_entsendable[e])
 				continue;
 
 			// ignore if not touching a PV leaf
@@ -599,17 +856,9 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 
 		//johnfitz -- max size for protocol 15 is 18 bytes, not 16 as originally
 		//assumed here.  And, for protocol 85 the max size is actually 24 bytes.
-		if (msg->cursize + 24 > msg->maxsize)
-		{
-			//johnfitz -- less spammy overflow message
-			if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
-			{
-				Con_Printf ("Packet overflow!\n");
-				dev_overflows.packetsize = realtime;
-			}
-			goto stats;
-			//johnfitz
-		}
+		//More with the RMQ coord and angle flags, see SV_PrepareEntities.
+		if (msg->cursize + sv_entupdatemax > msg->maxsize)
+			return false;
 
 // send an update
 		bits = 0;
@@ -649,15 +898,6 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 			bits |= U_MODEL;
 
 		//johnfitz -- alpha
-		if (pr_alpha_supported)
-		{
-			// TODO: find a cleaner place to put this code
-			eval_t	*val;
-			val = GetEdictFieldValue(ent, "alpha");
-			if (val)
-				ent->alpha = ENTALPHA_ENCODE(val->_float);
-		}
-
 		//don't send invisible entities unless they have effects
 		if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
 			continue;
@@ -737,8 +977,30 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 		//johnfitz
 	}
 
+	return true;
+}
+
+/*
+=============
+SV_EntitiesWritten
+
+The console side of SV_WriteEntities, back on the main thread
+=============
+*/
+static void SV_EntitiesWritten (sizebuf_t *msg, qboolean overflowed)
+{
+	//johnfitz -- less spammy overflow message
+	if (overflowed)
+	{
+		if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
+		{
+			Con_Printf ("Packet overflow!\n");
+			dev_overflows.packetsize = realtime;
+		}
+	}
+	//johnfitz
+
 	//johnfitz -- devstats
-stats:
 	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
 		Con_DWarning ("%i byte packet exceeds standard limit of 1024 (max = %d).\n", msg->cursize, msg->maxsize);
 	dev_stats.packetsize = msg->cursize;
@@ -746,6 +1008,22 @@ stats:
 	//johnfitz
 }
 
+/*
+=============
+SV_WriteEntitiesToClient
+
+=============
+*/
+void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
+{
+	byte	*pvs;
+
+// find the client's PVS
+	pvs = SV_EdictFatPVS (clent);
+
+	SV_EntitiesWritten (msg, !SV_WriteEntities (clent, pvs, msg));
+}
+
 /*
 =============
 SV_CleanupEnts
@@ -818,7 +1096,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 
 // stuff the sigil bits into the high bits of items for sbar, or else
 // mix in items2
-	val = GetEdictFieldValue(ent, "items2");
+	val = GetEdictFieldValue(ent, pr_extfields.items2);
 
 	if (val)
 		items = (int)ent->v.items | ((int)val->_float << 23);
@@ -948,37 +1226,46 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 
 /*
 =======================
-SV_SendClientDatagram
+SV_StartClientDatagram
+
+Everything in a client's datagram before the entity updates
 =======================
 */
-qboolean SV_SendClientDatagram (client_t *client)
+static void SV_StartClientDatagram (client_t *client, sizebuf_t *msg, byte *buf)
 {
-	byte		buf[MAX_DATAGRAM];
-	sizebuf_t	msg;
-
-	msg.data = buf;
-	msg.maxsize = sizeof(buf);
-	msg.cursize = 0;
+	msg->allowoverflow = false;
+	msg->overflowed = false;
+	msg->data = buf;
+	msg->maxsize = MAX_DATAGRAM;
+	msg->cursize = 0;
 
 	//johnfitz -- if client is nonlocal, use smaller max size so packets aren't fragmented
 	if (Q_strcmp(NET_QSocketGetAddressString(client->netconnection), "LOCAL") != 0)
-		msg.maxsize = DATAGRAM_MTU;
+		msg->maxsize = DATAGRAM_MTU;
 	//johnfitz
 
-	MSG_WriteByte (&msg, svc_time);
-	MSG_WriteFloat (&msg, sv.time);
+	MSG_WriteByte (msg, svc_time);
+	MSG_WriteFloat (msg, sv.time);
 
 // add the client specific data to the datagram
-	SV_WriteClientdataToMessage (client->edict, &msg);
+	SV_WriteClientdataToMessage (client->edict, msg);
+}
 
-	SV_WriteEntitiesToClient (client->edict, &msg);
+/*
+=======================
+SV_FinishClientDatagram
 
+Everything after the entity updates, and the send
+=======================
+*/
+static qboolean SV_FinishClientDatagram (client_t *client, sizebuf_t *msg)
+{
 // copy the server datagram if there is space
-	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
-		SZ_Write (&msg, sv.datagram.data, sv.datagram.cursize);
+	if (msg->cursize + sv.datagram.cursize < msg->maxsize)
+		SZ_Write (msg, sv.datagram.data, sv.datagram.cursize);
 
 // send the datagram
-	if (NET_SendUnreliableMessage (client->netconnection, &msg) == -1)
+	if (NET_SendUnreliableMessage (client->netconnection, msg) == -1)
 	{
 		SV_DropClient (true);// if the message couldn't send, kick off
 		return false;
@@ -987,6 +1274,21 @@ qboolean SV_SendClientDatagram (client_t *client)
 	return true;
 }
 
+/*
+=======================
+SV_SendClientDatagram
+=======================
+*/
+qboolean SV_SendClientDatagram (client_t *client)
+{
+	byte		buf[MAX_DATAGRAM];
+	sizebuf_t	msg;
+
+	SV_StartClientDatagram (client, &msg, buf);
+	SV_WriteEntitiesToClient (client->edict, &msg);
+	return SV_FinishClientDatagram (client, &msg);
+}
+
 /*
 =======================
 SV_UpdateToReliableMessages
@@ -1050,6 +1352,264 @@ void SV_SendNop (client_t *client)
 	client->last_message = realtime;
 }
 
+/*
+=============================================================================
+
+PARALLEL SNAPSHOTS
+
+With two or more spawned clients, SV_SendClientMessages writes each one's
+clientdata and works out its fat PVS in client order on the main thread,
+then the snapshot threads and the main thread share out the entity updates,
+which walk every edict for every client but only read them.  The datagrams
+are finished and sent in client order afterwards, so they hold the same
+bytes as SV_SendClientDatagram's.
+=============================================================================
+*/
+
+cvar_t	sv_parallelsnapshots = {"sv_parallelsnapshots", "1", CVAR_NONE};
+
+#define	MAX_SNAPSHOT_THREADS	8
+
+typedef struct
+{
+	client_t	*client;	// NULL if no datagram is built for this slot
+	sizebuf_t	msg;
+	byte		*pvs;
+	qboolean	overflowed;	// ran out of room for entity updates
+	float		dmg_take, dmg_save, fixangle;	// cleared when it is sent
+	byte		buf[MAX_DATAGRAM];
+} snapshot_t;
+
+static snapshot_t	*sv_snapshots;		// [svs.maxclients]
+static int		sv_numsnapshots;
+
+static int		snapshot_count, snapshot_next, snapshot_left;
+static int		snapshot_numthreads;
+static SDL_Thread	*snapshot_threads[MAX_SNAPSHOT_THREADS];
+static qboolean		snapshot_quit;		// SV_Shutdown wants the threads back
+static qboolean		snapshot_busy;		// the main thread is in SV_WriteSnapshots
+static SDL_mutex	*snapshot_lock;
+static SDL_cond		*snapshot_wake;		// a batch was queued
+static SDL_cond		*snapshot_done;		// a batch was finished
+
+static void SV_WriteSnapshot (snapshot_t *snap)
+{
+	if (snap->client)
+		snap->overflowed = !SV_WriteEntities (snap->client->edict, snap->pvs, &snap->msg);
+}
+
+static int SV_SnapshotThread (void *unused)
+{
+	snapshot_t	*snap;
+
+	SDL_LockMutex (snapshot_lock);
+	while (!snapshot_quit)
+	{
+		if (snapshot_next == snapshot_count)
+		{
+			SDL_CondWait (snapshot_wake, snapshot_lock);
+			continue;
+		}
+
+		snap = &sv_snapshots[snapshot_next++];
+		SDL_UnlockMutex (snapshot_lock);
+		SV_WriteSnapshot (snap);
+		SDL_LockMutex (snapshot_lock);
+		if (!--snapshot_left)
+			SDL_CondSignal (snapshot_done);
+	}
+	SDL_UnlockMutex (snapshot_lock);
+	return 0;
+}
+
+static qboolean SV_StartSnapshotThreads (void)
+{
+	SDL_Thread	*thread;
+
+	if (snapshot_numthreads)
+		return snapshot_numthreads > 0;
+	if (host_parms->numcpus < 2)
+	{
+		snapshot_numthreads = -1;
+		return false;
+	}
+
+	snapshot_lock = SDL_CreateMutex ();
+	snapshot_wake = SDL_CreateCond ();
+	snapshot_done = SDL_CreateCond ();
+	if (!snapshot_lock || !snapshot_wake || !snapshot_done)
+	{
+		snapshot_numthreads = -1;
+		return false;
+	}
+	while (snapshot_numthreads < CLAMP(1, host_parms->numcpus - 1, MAX_SNAPSHOT_THREADS))
+	{
+#if defined(USE_SDL2)
+		thread = SDL_CreateThread (SV_SnapshotThread, "snapshot", NULL);
+#else
+		thread = SDL_CreateThread (SV_SnapshotThread, NULL);
+#endif
+		if (!thread)
+			break;
+		snapshot_threads[snapshot_numthreads++] = thread;
+	}
+	if (!snapshot_numthreads)
+	{
+		snapshot_numthreads = -1;
+		return false;
+	}
+	return true;
+}
+
+/*
+=============
+SV_WriteSnapshots
+
+Writes the entity updates of the first count snapshots, with the main
+thread taking its share, and returns when all are done
+=============
+*/
+static void SV_WriteSnapshots (int count)
+{
+	snapshot_t	*snap;
+
+	snapshot_busy = true;
+	SDL_LockMutex (snapshot_lock);
+	snapshot_count = count;
+	snapshot_next = 0;
+	snapshot_left = count;
+	SDL_CondBroadcast (snapshot_wake);
+
+	while (snapshot_next < snapshot_count)
+	{
+		snap = &sv_snapshots[snapshot_next++];
+		SDL_UnlockMutex (snapshot_lock);
+		SV_WriteSnapshot (snap);
+		SDL_LockMutex (snapshot_lock);
+		snapshot_left--;
+	}
+	while (snapshot_left)
+		SDL_CondWait (snapshot_done, snapshot_lock);
+	SDL_UnlockMutex (snapshot_lock);
+	snapshot_busy = false;
+}
+
+/*
+=============
+SV_Shutdown
+
+Stops the snapshot threads.  Left alone when a Sys_Error comes from inside
+a batch, since the threads may be the ones erroring.
+=============
+*/
+void SV_Shutdown (void)
+{
+	int		i;
+
+	if (snapshot_numthreads <= 0 || snapshot_busy)
+		return;
+
+	SDL_LockMutex (snapshot_lock);
+	snapshot_quit = true;
+	SDL_CondBroadcast (snapshot_wake);
+	SDL_UnlockMutex (snapshot_lock);
+	for (i = 0; i < snapshot_numthreads; i++)
+		SDL_WaitThread (snapshot_threads[i], NULL);
+
+	SDL_DestroyCond (snapshot_done);
+	SDL_DestroyCond (snapshot_wake);
+	SDL_DestroyMutex (snapshot_lock);
+	snapshot_numthreads = -1;
+}
+
+/*
+=============
+SV_BuildSnapshots
+
+Builds the datagrams of all spawned clients up to SV_FinishClientDatagram.
+Returns false to leave this frame to SV_SendClientDatagram, which is also
+done when a client is going to be dropped: the QC that runs then must be
+seen by the clients after it.  A client can still be dropped by a failed
+send, so the damage and fixangle fields that SV_WriteClientdataToMessage
+clears are put back until the snapshot is sent, and SV_SendClientDatagram
+can build the rest from scratch.
+=============
+*/
+static qboolean SV_BuildSnapshots (void)
+{
+	client_t	*client;
+	snapshot_t	*snap;
+	int			i, count;
+
+	if (!sv_parallelsnapshots.value)
+		return false;
+
+	for (i = count = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active)
+			continue;
+		if (client->dropasap || client->message.overflowed)
+			return false;
+		if (client->spawned)
+			count++;
+	}
+	if (count < 2 || !SV_StartSnapshotThreads ())
+		return false;
+
+	if (sv_numsnapshots < svs.maxclients)
+	{
+		if (sv_snapshots)
+		{
+			free (sv_snapshots);
+			Mem_Track (MEMPOOL_MALLOC, "snapshots", -sv_numsnapshots * (int)sizeof(snapshot_t));
+		}
+		sv_numsnapshots = svs.maxclients;
+		sv_snapshots = (snapshot_t *) malloc (sv_numsnapshots * sizeof(snapshot_t));
+		if (!sv_snapshots)
+			Sys_Error ("SV_BuildSnapshots: failed on allocation of %i snapshots", sv_numsnapshots);
+		Mem_Track (MEMPOOL_MALLOC, "snapshots", sv_numsnapshots * (int)sizeof(snapshot_t));
+	}
+
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		snap = &sv_snapshots[i];
+		if (!client->active || !client->spawned)
+		{
+			snap->client = NULL;
+			continue;
+		}
+		snap->client = client;
+		snap->dmg_take = client->edict->v.dmg_take;
+		snap->dmg_save = client->edict->v.dmg_save;
+		snap->fixangle = client->edict->v.fixangle;
+		SV_StartClientDatagram (client, &snap->msg, snap->buf);
+		client->edict->v.dmg_take = snap->dmg_take;
+		client->edict->v.dmg_save = snap->dmg_save;
+		client->edict->v.fixangle = snap->fixangle;
+
+		snap->pvs = SV_EdictFatPVS (client->edict);	// kept until this client asks again
+	}
+
+	SV_WriteSnapshots (svs.maxclients);
+	return true;
+}
+
+/*
+=======================
+SV_SendSnapshot
+=======================
+*/
+static qboolean SV_SendSnapshot (snapshot_t *snap)
+{
+	edict_t	*ent = snap->client->edict;
+
+	ent->v.dmg_take = 0;
+	ent->v.dmg_save = 0;
+	ent->v.fixangle = 0;
+	SV_EntitiesWritten (&snap->msg, snap->overflowed);
+	return SV_FinishClientDatagram (snap->client, &snap->msg);
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -1058,19 +1618,40 @@ SV_SendClientMessages
 void SV_SendClientMessages (void)
 {
 	int			i;
+	qboolean	snapshots;
+	client_t	*last;
 
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+	SV_PrepareEntities ();
+	snapshots = SV_BuildSnapshots ();
+
 // build individual updates
+	last = NULL;
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
+	// the disconnect QC of a dropped client may have changed the edicts,
+	// so the snapshots of the ones after it are stale
+		if (last && !last->active)
+		{
+			SV_PrepareEntities ();
+			snapshots = false;
+		}
+		last = NULL;
+
 		if (!host_client->active)
 			continue;
+		last = host_client;
 
 		if (host_client->spawned)
 		{
-			if (!SV_SendClientDatagram (host_client))
+			if (snapshots && sv_snapshots[i].client == host_client)
+			{
+				if (!SV_SendSnapshot (&sv_snapshots[i]))
+					continue;
+			}
+			else if (!SV_SendClientDatagram (host_client))
 				continue;
 		}
 		else
@@ -1361,6 +1942,7 @@ void SV_SpawnServer (const char *server)
 //
 	//memset (&sv, 0, sizeof(sv));
 	Host_ClearMemory ();
+	Mem_BeginMap (server);
 
 	q_strlcpy (sv.name, server, sizeof(sv.name));
 
@@ -1397,6 +1979,8 @@ void SV_SpawnServer (const char *server)
 // leave slots at start for clients only
 	sv.num_edicts = svs.maxclients+1;
 	memset(sv.edicts, 0, sv.num_edicts*pr_edict_size); // ericw -- sv.edicts switched to use malloc()
+	ED_RebuildFreeQueue ();
+	PR_ClearFindIndex ();
 	for (i=0 ; i<svs.maxclients ; i++)
 	{
 		ent = EDICT_NUM(i+1);
@@ -1410,7 +1994,9 @@ void SV_SpawnServer (const char *server)
 
 	q_strlcpy (sv.name, server, sizeof(sv.name));
 	q_snprintf (sv.modelname, sizeof(sv.modelname), "maps/%s.bsp", server);
+	Mod_Prefetch (sv.modelname);	// the .lit and .ent load in the meantime
 	sv.worldmodel = Mod_ForName (sv.modelname, false);
+	COM_FlushPrefetch ();
 	if (!sv.worldmodel)
 	{
 		Con_Printf ("Couldn't spawn server %s\n", sv.modelname);
@@ -1423,6 +2009,7 @@ void SV_SpawnServer (const char *server)
 // clear world interaction links
 //
 	SV_ClearWorld ();
+	SV_ClearFatPVSCache ();
 
 	sv.sound_precache[0] = dummy;
 	sv.model_precache[0] = dummy;
@@ -1479,6 +2066,9 @@ void SV_SpawnServer (const char *server)
 		if (host_client->active)
 			SV_SendServerinfo (host_client);
 
+	if (cls.state == ca_dedicated)	// otherwise the client dumps once it has loaded too
+		COM_DumpFileStats (sv.name);
+
 	Con_DPrintf ("Server spawned.\n");
 }
 
@@ -396,6 +396,7 @@ void SV_MoveToGoal (void)
 {
 	edict_t		*ent, *goal;
 	float		dist;
+	int		oldsource;
 
 	ent = PROG_TO_EDICT(pr_global_struct->self);
 	goal = PROG_TO_EDICT(ent->v.goalentity);
@@ -411,11 +412,16 @@ void SV_MoveToGoal (void)
 	if ( PROG_TO_EDICT(ent->v.enemy) != sv.edicts &&  SV_CloseEnough (ent, goal, dist) )
 		return;
 
+	oldsource = sv_tracesource;
+	sv_tracesource = TRACE_MOVETOGOAL;
+
 // bump around...
 	if ( (rand()&3)==1 ||
 	!SV_StepDirection (ent, ent->v.ideal_yaw, dist))
 	{
 		SV_NewChaseDir (ent, goal, dist);
 	}
+
+	sv_tracesource = oldsource;
 }
 
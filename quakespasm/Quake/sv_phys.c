@@ -102,6 +102,7 @@ void SV_CheckVelocity (edict_t *ent)
 		{
 			Con_Printf ("Got a NaN origin on %s\n", PR_GetString(ent->v.classname));
 			ent->v.origin[i] = 0;
+			SV_MarkEdictMoved (ent);
 		}
 		if (ent->v.velocity[i] > sv_maxvelocity.value)
 			ent->v.velocity[i] = sv_maxvelocity.value;
@@ -283,6 +284,7 @@ int SV_FlyMove (edict_t *ent, float time, trace_t *steptrace)
 		if (trace.fraction > 0)
 		{	// actually covered some distance
 			VectorCopy (trace.endpos, ent->v.origin);
+			SV_MarkEdictMoved (ent);	// touch functions run before it is linked
 			VectorCopy (ent->v.velocity, original_velocity);
 			numplanes = 0;
 		}
@@ -388,7 +390,7 @@ void SV_AddGravity (edict_t *ent)
 	float	ent_gravity;
 	eval_t	*val;
 
-	val = GetEdictFieldValue(ent, "gravity");
+	val = GetEdictFieldValue(ent, pr_extfields.gravity);
 	if (val && val->_float)
 		ent_gravity = val->_float;
 	else
@@ -476,9 +478,9 @@ void SV_PushMove (edict_t *pusher, float movetime)
 	SV_LinkEdict (pusher, false);
 
 	//johnfitz -- dynamically allocate
-	mark = Hunk_LowMark ();
-	moved_edict = (edict_t **) Hunk_Alloc (sv.num_edicts*sizeof(edict_t *));
-	moved_from = (vec3_t *) Hunk_Alloc (sv.num_edicts*sizeof(vec3_t));
+	mark = Scratch_Mark ();
+	moved_edict = (edict_t **) Scratch_Alloc (sv.num_edicts*sizeof(edict_t *));
+	moved_from = (vec3_t *) Scratch_Alloc (sv.num_edicts*sizeof(vec3_t));
 	//johnfitz
 
 // see if any solid entities are inside the final position
@@ -534,6 +536,7 @@ void SV_PushMove (edict_t *pusher, float movetime)
 			{	// corpse
 				check->v.mins[0] = check->v.mins[1] = 0;
 				VectorCopy (check->v.mins, check->v.maxs);
+				SV_MarkEdictMoved (check);
 				continue;
 			}
 
@@ -559,12 +562,12 @@ void SV_PushMove (edict_t *pusher, float movetime)
 				VectorCopy (moved_from[i], moved_edict[i]->v.origin);
 				SV_LinkEdict (moved_edict[i], false);
 			}
-			Hunk_FreeToLowMark (mark); //johnfitz
+			Scratch_Release (mark); //johnfitz
 			return;
 		}
 	}
 
-	Hunk_FreeToLowMark (mark); //johnfitz
+	Scratch_Release (mark); //johnfitz
 
 }
 
@@ -664,6 +667,7 @@ void SV_CheckStuck (edict_t *ent)
 			}
 
 	VectorCopy (org, ent->v.origin);
+	SV_MarkEdictMoved (ent);
 	Con_DPrintf ("player is stuck.\n");
 }
 
@@ -891,6 +895,7 @@ void SV_WalkMove (edict_t *ent)
 // cause the player to hop up higher on a slope too steep to climb
 		VectorCopy (nosteporg, ent->v.origin);
 		VectorCopy (nostepvel, ent->v.velocity);
+		SV_MarkEdictMoved (ent);
 	}
 }
 
@@ -1205,6 +1210,11 @@ void SV_Physics (void)
 			SV_LinkEdict (ent, true);	// force retouch even for stationary
 		}
 
+		if (ent->v.movetype >= MOVETYPE_NONE && ent->v.movetype <= MOVETYPE_BOUNCE)
+			sv_tracesource = TRACE_MOVETYPE + (int)ent->v.movetype;
+		else
+			sv_tracesource = TRACE_ENGINE;
+
 		if (i > 0 && i <= svs.maxclients)
 			SV_Physics_Client (ent, i);
 		else if (ent->v.movetype == MOVETYPE_PUSH)
@@ -1223,6 +1233,7 @@ void SV_Physics (void)
 		else
 			Sys_Error ("SV_Physics: bad movetype %i", (int)ent->v.movetype);
 	}
+	sv_tracesource = TRACE_ENGINE;
 
 	if (pr_global_struct->force_retouch)
 		pr_global_struct->force_retouch--;
@@ -42,6 +42,22 @@ int Sys_FileWrite (int handle,const void *data, int count);
 int Sys_FileTime (const char *path);
 void Sys_mkdir (const char *path);
 
+// maps a whole file into memory copy-on-write, so writes to the
+// mapping stay private to the process. returns NULL if the file
+// can't be mapped or the platform doesn't support it.
+void *Sys_FileMap (const char *path, int *size);
+void Sys_FileUnmap (void *base, int size);
+
+void *Sys_MemReserve (int size);
+// reserves address space without backing it with memory, NULL if
+// it's not supported. Sys_MemCommit makes parts of it usable, and
+// Sys_MemDecommit gives them back; they read as zeros when committed again
+qboolean Sys_MemCommit (void *base, int size);
+void Sys_MemDecommit (void *base, int size);
+qboolean Sys_MemExecutable (void *base, int size);
+// turns committed memory into read-only code; Sys_MemCommit makes it
+// writable again. false if the platform doesn't allow it
+
 //
 // system IO
 //
@@ -57,6 +73,8 @@ void Sys_Printf (const char *fmt, ...) FUNC_PRINTF(1,2);
 // send text to the console
 
 double Sys_DoubleTime (void);
+double Sys_PreciseTime (void);
+// high resolution time for profiling, not tied to Sys_DoubleTime's epoch
 
 const char *Sys_ConsoleInput (void);
 
@@ -142,6 +142,35 @@ int Sys_FileTime (const char *path)
 	return -1;
 }
 
+void *Sys_FileMap (const char *path, int *size)
+{
+	/* no file mapping on horizon, fall back to plain reads */
+	return NULL;
+}
+
+void Sys_FileUnmap (void *base, int size)
+{
+}
+
+void *Sys_MemReserve (int size)
+{
+	return NULL;
+}
+
+qboolean Sys_MemCommit (void *base, int size)
+{
+	return false;
+}
+
+void Sys_MemDecommit (void *base, int size)
+{
+}
+
+qboolean Sys_MemExecutable (void *base, int size)
+{
+	return false;
+}
+
 static int Sys_NumCPUs (void)
 {
 	int numcpus = 1;
@@ -251,6 +280,15 @@ double Sys_DoubleTime (void)
 	return SDL_GetTicks() / 1000.0;
 }
 
+double Sys_PreciseTime (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return (double) SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+#else
+	return SDL_GetTicks() / 1000.0;
+#endif
+}
+
 const char *Sys_ConsoleInput (void)
 {
 	static char	con_text[256];
@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <libgen.h>	/* dirname() and basename() */
 #endif
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <fcntl.h>
 #include <time.h>
@@ -155,6 +156,65 @@ int Sys_FileTime (const char *path)
 	return -1;
 }
 
+void *Sys_FileMap (const char *path, int *size)
+{
+	struct stat	st;
+	void	*base;
+	int	fd;
+
+	fd = open (path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+	if (fstat (fd, &st) == -1 || st.st_size <= 0 || st.st_size > INT_MAX)
+	{
+		close (fd);
+		return NULL;
+	}
+	base = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close (fd);	/* the mapping keeps its own reference */
+	if (base == MAP_FAILED)
+		return NULL;
+
+	*size = (int) st.st_size;
+	return base;
+}
+
+void Sys_FileUnmap (void *base, int size)
+{
+	munmap (base, size);
+}
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE	0
+#endif
+
+void *Sys_MemReserve (int size)
+{
+	void	*base;
+
+	base = mmap (NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return (base == MAP_FAILED) ? NULL : base;
+}
+
+qboolean Sys_MemCommit (void *base, int size)
+{
+	return mprotect (base, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void Sys_MemDecommit (void *base, int size)
+{
+/* mapping fresh pages over the range releases the old ones */
+	mmap (base, size, PROT_NONE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+}
+
+qboolean Sys_MemExecutable (void *base, int size)
+{
+	return mprotect (base, size, PROT_READ | PROT_EXEC) == 0;
+}
+
 
 #if defined(__linux__) || defined(__sun) || defined(sun) || defined(_AIX)
 static int Sys_NumCPUs (void)
@@ -413,6 +473,15 @@ double Sys_DoubleTime (void)
 	return SDL_GetTicks() / 1000.0;
 }
 
+double Sys_PreciseTime (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return (double) SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+#else
+	return SDL_GetTicks() / 1000.0;
+#endif
+}
+
 const char *Sys_ConsoleInput (void)
 {
 	static char	con_text[256];
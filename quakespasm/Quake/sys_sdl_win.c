@@ -154,6 +154,65 @@ int Sys_FileTime (const char *path)
 	return -1;
 }
 
+void *Sys_FileMap (const char *path, int *size)
+{
+	HANDLE	file, mapping;
+	DWORD	len, high;
+	void	*base;
+
+	file = CreateFileA (path, GENERIC_READ, FILE_SHARE_READ, NULL,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	len = GetFileSize (file, &high);
+	if (len == INVALID_FILE_SIZE || high || !len || len > INT_MAX)
+	{
+		CloseHandle (file);
+		return NULL;
+	}
+	mapping = CreateFileMappingA (file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle (file);
+	if (!mapping)
+		return NULL;
+	base = MapViewOfFile (mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle (mapping);	/* the view keeps its own reference */
+	if (!base)
+		return NULL;
+
+	*size = (int) len;
+	return base;
+}
+
+void Sys_FileUnmap (void *base, int size)
+{
+	UnmapViewOfFile (base);
+}
+
+void *Sys_MemReserve (int size)
+{
+	return VirtualAlloc (NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+qboolean Sys_MemCommit (void *base, int size)
+{
+	return VirtualAlloc (base, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+void Sys_MemDecommit (void *base, int size)
+{
+	VirtualFree (base, size, MEM_DECOMMIT);
+}
+
+qboolean Sys_MemExecutable (void *base, int size)
+{
+	DWORD	old;
+
+	if (!VirtualProtect (base, size, PAGE_EXECUTE_READ, &old))
+		return false;
+	FlushInstructionCache (GetCurrentProcess (), base, size);
+	return true;
+}
+
 static char	cwd[1024];
 
 static void Sys_GetBasedir (char *argv0, char *dst, size_t dstsize)
@@ -363,6 +422,15 @@ double Sys_DoubleTime (void)
 	return SDL_GetTicks() / 1000.0;
 }
 
+double Sys_PreciseTime (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+	return (double) SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+#else
+	return SDL_GetTicks() / 1000.0;
+#endif
+}
+
 const char *Sys_ConsoleInput (void)
 {
 	static char	con_text[256];
@@ -72,12 +72,15 @@ void W_LoadWadFile (void) //johnfitz -- filename is now hard-coded for honesty
 	int			i;
 	int			infotableofs;
 	const char		*filename = WADFILENAME;
+	const char		*requester;
 
 	//johnfitz -- modified to use malloc
 	//TODO: use cache_alloc
 	if (wad_base)
 		free (wad_base);
+	requester = COM_SetFileRequester ("wad");
 	wad_base = COM_LoadMallocFile (filename, NULL);
+	COM_SetFileRequester (requester);
 	if (!wad_base)
 		Sys_Error ("W_LoadWadFile: couldn't load %s\n\n"
 			   "Basedir is: %s\n\n"
@@ -59,6 +59,8 @@ HULL BOXES
 static	hull_t		box_hull;
 static	mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
 static	mplane_t	box_planes[6];
+static	mhullnode_t	box_hullnodes[6];
+static	int			box_hullremap[6] = {0, 1, 2, 3, 4, 5};
 
 /*
 ===================
@@ -77,6 +79,8 @@ void SV_InitBoxHull (void)
 	box_hull.planes = box_planes;
 	box_hull.firstclipnode = 0;
 	box_hull.lastclipnode = 5;
+	box_hull.hullnodes = box_hullnodes;
+	box_hull.hullremap = box_hullremap;
 
 	for (i=0 ; i<6 ; i++)
 	{
@@ -92,6 +96,11 @@ void SV_InitBoxHull (void)
 
 		box_planes[i].type = i>>1;
 		box_planes[i].normal[i>>1] = 1;
+
+		VectorCopy (box_planes[i].normal, box_hullnodes[i].normal);
+		box_hullnodes[i].type = box_planes[i].type;
+		box_hullnodes[i].children[0] = box_clipnodes[i].children[0];
+		box_hullnodes[i].children[1] = box_clipnodes[i].children[1];
 	}
 
 }
@@ -114,6 +123,13 @@ hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
 	box_planes[4].dist = maxs[2];
 	box_planes[5].dist = mins[2];
 
+	box_hullnodes[0].dist = maxs[0];
+	box_hullnodes[1].dist = mins[0];
+	box_hullnodes[2].dist = maxs[1];
+	box_hullnodes[3].dist = mins[1];
+	box_hullnodes[4].dist = maxs[2];
+	box_hullnodes[5].dist = mins[2];
+
 	return &box_hull;
 }
 
@@ -183,20 +199,58 @@ ENTITY AREA CHECKING
 ===============================================================================
 */
 
+// children[0] holds the boxes entirely above lodist and children[1] those
+// entirely below hidist, so a box that crosses dist by less than the overlap
+// still goes down the tree instead of being checked by every move through
+// the node.  With sv_areatree 0 the overlap is zero and the tree is id's
+// fixed four levels.
 typedef struct areanode_s
 {
 	int		axis;		// -1 = leaf node
 	float	dist;
+	float	lodist, hidist;
 	struct areanode_s	*children[2];
 	link_t	trigger_edicts;
 	link_t	solid_edicts;
 } areanode_t;
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+#define	AREA_DEPTH		4	// sv_areatree 0, and the least for 1
+#define	AREA_MAXDEPTH	12
+#define	AREA_MINSIZE	256	// sv_areatree 1 doesn't split nodes smaller than twice this
+#define	AREA_LOOSE		0.25	// of a node's size, the overlap of its children
+
+cvar_t	sv_areatree = {"sv_areatree", "1", CVAR_NONE};
 
-static	areanode_t	sv_areanodes[AREA_NODES];
+static	areanode_t	*sv_areanodes;
 static	int			sv_numareanodes;
+static	int			sv_areadepth;		// of the deepest leaf
+static	int			sv_areamaxdepth;
+static	qboolean	sv_arealoose;		// sv_areatree when the level started
+
+// for sv_areastats, since the last one
+static struct
+{
+	double	traces, tracenodes, tracechecks, traceclips;
+	double	touches, touchnodes, touchchecks;
+	double	radius, radiusnodes, radiuschecks;
+} sv_areastats;
+
+static void SV_TraceClear (void);
+static void SV_TraceBenchClear (void);
+
+// findradius only walks the area nodes around the sphere, which finds every
+// edict whose center is still inside the box it was linked with.  Edicts that
+// may not be (unlinked, moved behind SV_LinkEdict's back, or linked with a
+// center outside of their box) are kept on the moved list, and checked by
+// every findradius until they are linked again.
+#define	MOVED_NO		0
+#define	MOVED_YES		1
+#define	MOVED_LINKED	2	// still on the list, dropped by the next findradius
+
+static	byte		*sv_edictmoved;		// MOVED_*, by edict number
+static	int			*sv_movedlist;
+static	int			sv_nummoved;
+static	int			sv_movedmax;		// edicts the two above have room for
 
 /*
 ===============
@@ -209,27 +263,35 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	areanode_t	*anode;
 	vec3_t		size;
 	vec3_t		mins1, maxs1, mins2, maxs2;
+	float		overlap;
 
 	anode = &sv_areanodes[sv_numareanodes];
 	sv_numareanodes++;
+	sv_areadepth = q_max (sv_areadepth, depth);
 
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
 
-	if (depth == AREA_DEPTH)
-	{
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
-	}
-
 	VectorSubtract (maxs, mins, size);
 	if (size[0] > size[1])
 		anode->axis = 0;
 	else
 		anode->axis = 1;
+	if (sv_arealoose && size[2] > size[anode->axis])
+		anode->axis = 2;
+
+	if (depth == sv_areamaxdepth
+	|| (sv_arealoose && depth >= AREA_DEPTH && size[anode->axis] < 2 * AREA_MINSIZE))
+	{
+		anode->axis = -1;
+		anode->children[0] = anode->children[1] = NULL;
+		return anode;
+	}
 
 	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
+	overlap = sv_arealoose ? size[anode->axis] * AREA_LOOSE : 0;
+	anode->lodist = anode->dist - overlap;
+	anode->hidist = anode->dist + overlap;
 	VectorCopy (mins, mins1);
 	VectorCopy (mins, mins2);
 	VectorCopy (maxs, maxs1);
@@ -253,9 +315,53 @@ void SV_ClearWorld (void)
 {
 	SV_InitBoxHull ();
 
-	memset (sv_areanodes, 0, sizeof(sv_areanodes));
+// sv_areatree 1 goes a level deeper for every doubling of max_edicts
+// past 128, until the nodes get down to AREA_MINSIZE
+	sv_arealoose = (sv_areatree.value != 0);
+	sv_areamaxdepth = AREA_DEPTH;
+	if (sv_arealoose)
+	{
+		while (sv_areamaxdepth < AREA_MAXDEPTH && (128 << (sv_areamaxdepth - AREA_DEPTH)) < sv.max_edicts)
+			sv_areamaxdepth++;
+	}
+	sv_areanodes = (areanode_t *) Hunk_AllocName (((2 << sv_areamaxdepth) - 1) * sizeof(areanode_t), "areanodes");
 	sv_numareanodes = 0;
+	sv_areadepth = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+	SV_TraceClear ();	// the function numbers are the last progs'
+	SV_TraceBenchClear ();	// and the hulls the last map's
+
+	if (sv_movedmax != sv.max_edicts)
+	{
+		Mem_Track (MEMPOOL_MALLOC, "movedlist", (sv.max_edicts - sv_movedmax) * (int)(sizeof(byte) + sizeof(int)));
+		sv_movedmax = sv.max_edicts;
+		sv_edictmoved = (byte *) realloc (sv_edictmoved, sv_movedmax * sizeof(byte));
+		sv_movedlist = (int *) realloc (sv_movedlist, sv_movedmax * sizeof(int));
+		if (!sv_edictmoved || !sv_movedlist)
+			Sys_Error ("SV_ClearWorld: out of memory for %d edicts", sv_movedmax);
+	}
+	memset (sv_edictmoved, MOVED_NO, sv_movedmax * sizeof(byte));
+	sv_nummoved = 0;
+}
+
+
+/*
+===============
+SV_MarkEdictMoved
+
+===============
+*/
+void SV_MarkEdictMoved (edict_t *ent)
+{
+	int		num;
+
+	num = NUM_FOR_EDICT(ent);
+	if (!num || num >= sv_movedmax)
+		return;		// the world, or no server yet
+	if (sv_edictmoved[num] == MOVED_NO)
+		sv_movedlist[sv_nummoved++] = num;
+	sv_edictmoved[num] = MOVED_YES;
 }
 
 
@@ -271,6 +377,7 @@ void SV_UnlinkEdict (edict_t *ent)
 		return;		// not linked in anywhere
 	RemoveLink (&ent->area);
 	ent->area.prev = ent->area.next = NULL;
+	SV_MarkEdictMoved (ent);
 }
 
 
@@ -288,11 +395,14 @@ SV_AreaTriggerEdicts ( edict_t *ent, areanode_t *node, edict_t **list, int *list
 	link_t		*l, *next;
 	edict_t		*touch;
 
+	sv_areastats.touchnodes++;
+
 // touch linked edicts
 	for (l = node->trigger_edicts.next ; l != &node->trigger_edicts ; l = next)
 	{
 		next = l->next;
 		touch = EDICT_FROM_AREA(l);
+		sv_areastats.touchchecks++;
 		if (touch == ent)
 			continue;
 		if (!touch->v.touch || touch->v.solid != SOLID_TRIGGER)
@@ -316,9 +426,9 @@ SV_AreaTriggerEdicts ( edict_t *ent, areanode_t *node, edict_t **list, int *list
 	if (node->axis == -1)
 		return;
 
-	if ( ent->v.absmax[node->axis] > node->dist )
+	if ( ent->v.absmax[node->axis] > node->lodist )
 		SV_AreaTriggerEdicts ( ent, node->children[0], list, listcount, listspace );
-	if ( ent->v.absmin[node->axis] < node->dist )
+	if ( ent->v.absmin[node->axis] < node->hidist )
 		SV_AreaTriggerEdicts ( ent, node->children[1], list, listcount, listspace );
 }
 
@@ -340,10 +450,11 @@ void SV_TouchLinks (edict_t *ent)
 	int		i, listcount;
 	int		mark;
 	
-	mark = Hunk_LowMark ();
-	list = (edict_t **) Hunk_Alloc (sv.num_edicts*sizeof(edict_t *));
+	mark = Scratch_Mark ();
+	list = (edict_t **) Scratch_Alloc (sv.num_edicts*sizeof(edict_t *));
 	
 	listcount = 0;
+	sv_areastats.touches++;
 	SV_AreaTriggerEdicts (ent, sv_areanodes, list, &listcount, sv.num_edicts);
 
 	for (i = 0; i < listcount; i++)
@@ -374,8 +485,8 @@ void SV_TouchLinks (edict_t *ent)
 		pr_global_struct->other = old_other;
 	}
 
-// free hunk-allocated edicts array
-	Hunk_FreeToLowMark (mark);
+// free the scratch edicts array
+	Scratch_Release (mark);
 }
 
 
@@ -432,6 +543,8 @@ SV_LinkEdict
 void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 {
 	areanode_t	*node;
+	double		center;
+	int			i, num;
 
 	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
@@ -468,6 +581,20 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 		ent->v.absmax[2] += 1;
 	}
 
+// findradius can find it through the area nodes if its center, worked out
+// the way PF_findradius does, is inside the box
+	for (i = 0; i < 3; i++)
+	{
+		center = ent->v.origin[i] + (ent->v.mins[i] + ent->v.maxs[i]) * 0.5;
+		if (!(center >= ent->v.absmin[i] && center <= ent->v.absmax[i]))
+			break;
+	}
+	num = NUM_FOR_EDICT(ent);
+	if (i < 3)
+		SV_MarkEdictMoved (ent);
+	else if (num < sv_movedmax && sv_edictmoved[num] == MOVED_YES)
+		sv_edictmoved[num] = MOVED_LINKED;
+
 // link to PVS leafs
 	ent->num_leafs = 0;
 	if (ent->v.modelindex)
@@ -476,15 +603,18 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
+// find the first node that the ent's box crosses, going to the side its
+// center is on when it fits in both
 	node = sv_areanodes;
 	while (1)
 	{
 		if (node->axis == -1)
 			break;
-		if (ent->v.absmin[node->axis] > node->dist)
+		if (ent->v.absmin[node->axis] > node->lodist
+		&& (ent->v.absmax[node->axis] >= node->hidist
+		|| ent->v.absmin[node->axis] + ent->v.absmax[node->axis] > 2 * node->dist))
 			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
+		else if (ent->v.absmax[node->axis] < node->hidist)
 			node = node->children[1];
 		else
 			break;		// crosses the node
@@ -502,6 +632,437 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 		SV_TouchLinks ( ent );
 }
 
+/*
+====================
+SV_AreaRadiusEdicts
+
+====================
+*/
+static void SV_AreaRadiusEdicts (areanode_t *node, const double *mins, const double *maxs, int *list, int *count)
+{
+	link_t		*l, *start;
+	edict_t		*touch;
+	int			i, num;
+
+	sv_areastats.radiusnodes++;
+	for (i = 0; i < 2; i++)
+	{
+		start = i ? &node->trigger_edicts : &node->solid_edicts;
+		for (l = start->next ; l != start ; l = l->next)
+		{
+			touch = EDICT_FROM_AREA(l);
+			num = NUM_FOR_EDICT(touch);
+			sv_areastats.radiuschecks++;
+			if (sv_edictmoved[num] != MOVED_NO)
+				continue;	// on the moved list
+			if (touch->v.absmax[0] < mins[0] || touch->v.absmin[0] > maxs[0]
+			|| touch->v.absmax[1] < mins[1] || touch->v.absmin[1] > maxs[1]
+			|| touch->v.absmax[2] < mins[2] || touch->v.absmin[2] > maxs[2])
+				continue;
+			list[(*count)++] = num;
+		}
+	}
+
+	if (node->axis == -1)
+		return;
+
+	if (maxs[node->axis] > node->lodist)
+		SV_AreaRadiusEdicts (node->children[0], mins, maxs, list, count);
+	if (mins[node->axis] < node->hidist)
+		SV_AreaRadiusEdicts (node->children[1], mins, maxs, list, count);
+}
+
+static int SV_CompareEdictNums (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+====================
+SV_FindRadiusEdicts
+
+A linked edict whose center is within rad of org has its center, and so its
+box, inside the cube around org, padded by a unit for PF_findradius's float
+rounding. A radius of 65536 or more, or an org far outside of any map or not
+a number at all, is left to the caller.
+====================
+*/
+int SV_FindRadiusEdicts (const float *org, float rad, int *list)
+{
+	double		mins[3], maxs[3];
+	edict_t		*ent;
+	int			i, j, num, count;
+
+	if (!sv_movedmax || !(rad < 65536))
+		return -1;
+	for (i = 0; i < 3; i++)
+	{
+		if (!(fabs(org[i]) < 1000000))
+			return -1;
+		mins[i] = (double)org[i] - rad - 1;
+		maxs[i] = (double)org[i] + rad + 1;
+	}
+
+	count = 0;
+	for (i = j = 0; i < sv_nummoved; i++)
+	{
+		num = sv_movedlist[i];
+		ent = EDICT_NUM(num);
+		// free and SOLID_NOT edicts can't be found, and anything bringing
+		// them back puts them on the list again
+		if (sv_edictmoved[num] == MOVED_LINKED || num >= sv.num_edicts
+		|| ent->free || ent->v.solid == SOLID_NOT)
+		{
+			sv_edictmoved[num] = MOVED_NO;
+			continue;
+		}
+		sv_movedlist[j++] = num;
+		list[count++] = num;
+	}
+	sv_nummoved = j;
+
+	sv_areastats.radius++;
+	SV_AreaRadiusEdicts (sv_areanodes, mins, maxs, list, &count);
+	qsort (list, count, sizeof(int), SV_CompareEdictNums);
+
+	return count;
+}
+
+
+/*
+====================
+SV_AreaStats_f
+
+How much checking moves, trigger touches and findradius have done in the
+area nodes since the last sv_areastats, and where the linked edicts are
+====================
+*/
+static void SV_AreaNodeCounts (areanode_t *node, int depth, int *counts)
+{
+	link_t	*l;
+
+	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = l->next)
+		counts[depth]++;
+	for (l = node->trigger_edicts.next ; l != &node->trigger_edicts ; l = l->next)
+		counts[depth]++;
+	if (node->axis == -1)
+		return;
+	SV_AreaNodeCounts (node->children[0], depth + 1, counts);
+	SV_AreaNodeCounts (node->children[1], depth + 1, counts);
+}
+
+void SV_AreaStats_f (void)
+{
+	int	counts[AREA_MAXDEPTH + 1];
+	int	i;
+
+	if (!sv.active)
+	{
+		Con_Printf ("sv_areastats: no server running\n");
+		return;
+	}
+
+	memset (counts, 0, sizeof(counts));
+	SV_AreaNodeCounts (sv_areanodes, 0, counts);
+	Con_Printf ("%i area nodes, %i deep%s\n", sv_numareanodes, sv_areadepth, sv_arealoose ? ", loose" : "");
+	Con_Printf ("linked by depth:");
+	for (i = 0; i <= sv_areadepth; i++)
+		Con_Printf (" %i", counts[i]);
+	Con_Printf ("\n");
+
+	Con_Printf ("%8.0f moves, per move %6.1f nodes %6.1f edicts %6.1f clipped\n", sv_areastats.traces,
+		sv_areastats.tracenodes / q_max(sv_areastats.traces, 1),
+		sv_areastats.tracechecks / q_max(sv_areastats.traces, 1),
+		sv_areastats.traceclips / q_max(sv_areastats.traces, 1));
+	Con_Printf ("%8.0f touches, per touch %5.1f nodes %6.1f edicts\n", sv_areastats.touches,
+		sv_areastats.touchnodes / q_max(sv_areastats.touches, 1),
+		sv_areastats.touchchecks / q_max(sv_areastats.touches, 1));
+	Con_Printf ("%8.0f findradius, per call %4.1f nodes %6.1f edicts\n", sv_areastats.radius,
+		sv_areastats.radiusnodes / q_max(sv_areastats.radius, 1),
+		sv_areastats.radiuschecks / q_max(sv_areastats.radius, 1));
+
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+}
+
+
+/*
+===============================================================================
+
+TRACE STATISTICS
+
+SV_Move, SV_ClipMoveToEntity, SV_RecursiveHullCheck and the point contents
+functions always count themselves. While sv_tracestats is running, the
+outermost of them also adds what was counted inside it, and the time it
+took, to the bucket for sv_tracesource and the QC function that is running.
+===============================================================================
+*/
+
+int		sv_tracesource = TRACE_ENGINE;
+
+static const char *sv_tracesources[TRACE_NUMSOURCES] =
+{
+	"engine",
+	"MOVETYPE_NONE", "MOVETYPE_ANGLENOCLIP", "MOVETYPE_ANGLECLIP", "MOVETYPE_WALK",
+	"MOVETYPE_STEP", "MOVETYPE_FLY", "MOVETYPE_TOSS", "MOVETYPE_PUSH",
+	"MOVETYPE_NOCLIP", "MOVETYPE_FLYMISSILE", "MOVETYPE_BOUNCE",
+	"client input",
+	"traceline", "walkmove", "droptofloor", "aim", "movetogoal", "checkbottom", "pointcontents"
+};
+
+typedef struct
+{
+	int		moves, clips, nodes, points;
+} tracecounts_t;
+
+typedef struct
+{
+	int		source;		// TRACE_*, -1 = unused
+	int		fnum;		// QC function running, 0 if none
+	tracecounts_t	frame;
+	double		frametime;
+	double		moves, clips, nodes, points, time;	// totals, without this frame
+} tracestat_t;
+
+#define	MAX_TRACESTATS	1024	// power of two
+
+static	tracecounts_t	sv_tracecounts;		// always counting
+static	tracecounts_t	sv_tracebase;		// at the start of the outermost call
+static	double		sv_tracestart;
+static	int		sv_tracenest;
+static	qboolean	sv_tracing;
+static	tracestat_t	sv_tracestats[MAX_TRACESTATS];
+static	tracestat_t	sv_traceoverflow;	// whatever didn't fit in the table
+static	int		sv_traceframes;
+static	FILE		*sv_tracecsv;
+
+static void SV_TraceClear (void)
+{
+	int	i;
+
+	memset (sv_tracestats, 0, sizeof(sv_tracestats));
+	for (i = 0; i < MAX_TRACESTATS; i++)
+		sv_tracestats[i].source = -1;
+	memset (&sv_traceoverflow, 0, sizeof(sv_traceoverflow));
+	sv_traceoverflow.source = -1;
+	sv_traceframes = 0;
+	sv_tracenest = 0;
+}
+
+static tracestat_t *SV_TraceStat (int source, int fnum)
+{
+	tracestat_t	*stat;
+	int		i, n;
+
+	i = (fnum * 31 + source) & (MAX_TRACESTATS - 1);
+	for (n = 0; n < MAX_TRACESTATS / 2; n++, i = (i + 1) & (MAX_TRACESTATS - 1))
+	{
+		stat = &sv_tracestats[i];
+		if (stat->source == source && stat->fnum == fnum)
+			return stat;
+		if (stat->source == -1)
+		{
+			stat->source = source;
+			stat->fnum = fnum;
+			return stat;
+		}
+	}
+	sv_traceoverflow.source = TRACE_ENGINE;
+	return &sv_traceoverflow;
+}
+
+/*
+====================
+SV_TraceAbort
+
+Host_Error and Host_EndGame can leave a traced call without SV_TraceLeave
+====================
+*/
+void SV_TraceAbort (void)
+{
+	sv_tracenest = 0;
+	sv_tracesource = TRACE_ENGINE;
+}
+
+static void SV_TraceEnter (void)
+{
+	if (sv_tracenest++)
+		return;
+	sv_tracebase = sv_tracecounts;
+	sv_tracestart = Sys_PreciseTime ();
+}
+
+static void SV_TraceLeave (void)
+{
+	tracestat_t	*stat;
+
+	if (--sv_tracenest)
+		return;
+	stat = SV_TraceStat (sv_tracesource, PR_ActiveFunction ());
+	stat->frame.moves += sv_tracecounts.moves - sv_tracebase.moves;
+	stat->frame.clips += sv_tracecounts.clips - sv_tracebase.clips;
+	stat->frame.nodes += sv_tracecounts.nodes - sv_tracebase.nodes;
+	stat->frame.points += sv_tracecounts.points - sv_tracebase.points;
+	stat->frametime += Sys_PreciseTime () - sv_tracestart;
+}
+
+static const char *SV_TraceSource (tracestat_t *stat)
+{
+	return (stat == &sv_traceoverflow) ? "other" : sv_tracesources[stat->source];
+}
+
+static const char *SV_TraceFunction (tracestat_t *stat)
+{
+	return (stat->fnum && stat != &sv_traceoverflow) ? PR_GetString (pr_functions[stat->fnum].s_name) : "";
+}
+
+static void SV_TraceStatFrame (tracestat_t *stat)
+{
+	if (stat->source == -1 || (!stat->frame.moves && !stat->frame.clips && !stat->frame.points))
+		return;
+	if (sv_tracecsv)
+		fprintf (sv_tracecsv, "%i,%.4f,%s,%s,%i,%i,%i,%i,%.1f\n", sv_traceframes, sv.time,
+			SV_TraceSource (stat), SV_TraceFunction (stat), stat->frame.moves,
+			stat->frame.clips, stat->frame.nodes, stat->frame.points, stat->frametime * 1000000);
+	stat->moves += stat->frame.moves;
+	stat->clips += stat->frame.clips;
+	stat->nodes += stat->frame.nodes;
+	stat->points += stat->frame.points;
+	stat->time += stat->frametime;
+	memset (&stat->frame, 0, sizeof(stat->frame));
+	stat->frametime = 0;
+}
+
+/*
+====================
+SV_TraceStatsFrame
+
+Called at the end of each server frame, writes its CSV lines
+====================
+*/
+void SV_TraceStatsFrame (void)
+{
+	int		i;
+
+	if (!sv_tracing)
+		return;
+
+	for (i = 0; i < MAX_TRACESTATS; i++)
+		SV_TraceStatFrame (&sv_tracestats[i]);
+	SV_TraceStatFrame (&sv_traceoverflow);
+	sv_traceframes++;
+}
+
+static int SV_TraceCompare (const void *a, const void *b)
+{
+	const tracestat_t	*sa = *(const tracestat_t * const *)a;
+	const tracestat_t	*sb = *(const tracestat_t * const *)b;
+
+	if (sa->time != sb->time)
+		return (sa->time < sb->time) ? 1 : -1;
+	if (sa->source != sb->source)
+		return sa->source - sb->source;
+	return sa->fnum - sb->fnum;
+}
+
+static void SV_TraceStatsPrint (int count)
+{
+	tracestat_t	*sorted[MAX_TRACESTATS + 1];
+	tracestat_t	*stat;
+	double		time, frames;
+	int		i, num;
+
+	time = 0;
+	for (i = num = 0; i < MAX_TRACESTATS; i++)
+	{
+		if (sv_tracestats[i].source == -1 || !sv_tracestats[i].time)
+			continue;
+		sorted[num++] = &sv_tracestats[i];
+		time += sv_tracestats[i].time;
+	}
+	if (sv_traceoverflow.time)
+	{
+		sorted[num++] = &sv_traceoverflow;
+		time += sv_traceoverflow.time;
+	}
+	if (!num)
+	{
+		Con_Printf ("No trace stats, use \"sv_tracestats start\"\n");
+		return;
+	}
+	qsort (sorted, num, sizeof(sorted[0]), SV_TraceCompare);
+
+	frames = q_max (sv_traceframes, 1);
+	Con_Printf ("%i frames, %.3f ms of traces per frame%s\n", sv_traceframes, time * 1000 / frames,
+		sv_tracing ? ", still running" : "");
+	Con_Printf ("  ms/frame  moves/f  clips/f  nodes/f points/f caller\n");
+	for (i = 0; i < num && i < count; i++)
+	{
+		stat = sorted[i];
+		Con_Printf ("%10.4f %8.1f %8.1f %8.0f %8.1f %s%s%s\n", stat->time * 1000 / frames,
+			stat->moves / frames, stat->clips / frames, stat->nodes / frames, stat->points / frames,
+			SV_TraceSource (stat), SV_TraceFunction (stat)[0] ? " / " : "", SV_TraceFunction (stat));
+	}
+}
+
+static void SV_TraceStatsCSV (const char *filename)
+{
+	char	name[MAX_OSPATH];
+
+	if (strstr(filename, ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, filename);
+	sv_tracecsv = fopen (name, "w");
+	if (!sv_tracecsv)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+	fprintf (sv_tracecsv, "frame,time,source,function,moves,clips,nodes,points,usec\n");
+	Con_Printf ("Writing trace stats to %s\n", name);
+}
+
+/*
+====================
+SV_TraceStats_f
+====================
+*/
+void SV_TraceStats_f (void)
+{
+	const char	*cmd = Cmd_Argv (1);
+
+	if (!sv.active)
+		return;
+
+	if (Cmd_Argc () < 2 || !strcmp (cmd, "print"))
+	{
+		SV_TraceStatsPrint (Cmd_Argc () > 2 ? atoi (Cmd_Argv (2)) : 20);
+		return;
+	}
+	if (strcmp (cmd, "start") && strcmp (cmd, "stop") && strcmp (cmd, "csv"))
+	{
+		Con_Printf ("usage: sv_tracestats [start | stop | print [count] | csv [file]]\n");
+		return;
+	}
+
+	if (sv_tracecsv)
+	{
+		fclose (sv_tracecsv);
+		sv_tracecsv = NULL;
+	}
+	sv_tracing = false;
+	if (!strcmp (cmd, "stop"))
+		return;
+
+	SV_TraceClear ();
+	sv_tracing = true;
+	if (!strcmp (cmd, "csv"))
+		SV_TraceStatsCSV (Cmd_Argc () > 2 ? Cmd_Argv (2) : "tracestats.csv");
+	Con_Printf ("Counting traces\n");
+}
 
 
 /*
@@ -514,11 +1075,36 @@ POINT TESTING IN HULLS
 
 /*
 ==================
-SV_HullPointContents
+SV_PackedPointContents
 
+num is a hullnodes index, which Mod_PackHull has already checked
 ==================
 */
-int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
+static inline int SV_PackedPointContents (const mhullnode_t *nodes, int num, const float *p)
+{
+	const mhullnode_t	*node;
+	float		d;
+
+	while (num >= 0)
+	{
+		node = nodes + num;
+		if (node->type < 3)
+			d = p[node->type] - node->dist;
+		else
+			d = DoublePrecisionDotProduct (node->normal, p) - node->dist;
+		num = node->children[d < 0];
+	}
+
+	return num;
+}
+
+/*
+==================
+SV_ClipnodePointContents
+
+==================
+*/
+static int SV_ClipnodePointContents (hull_t *hull, int num, vec3_t p)
 {
 	float		d;
 	mclipnode_t	*node; //johnfitz -- was dclipnode_t
@@ -545,6 +1131,21 @@ int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
 	return num;
 }
 
+/*
+==================
+SV_HullPointContents
+
+==================
+*/
+int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
+{
+	if (num < 0)
+		return num;
+	if (hull->hullnodes && num >= hull->firstclipnode && num <= hull->lastclipnode && hull->hullremap[num] >= 0)
+		return SV_PackedPointContents (hull->hullnodes, hull->hullremap[num], p);
+	return SV_ClipnodePointContents (hull, num, p);
+}
+
 
 /*
 ==================
@@ -556,7 +1157,7 @@ int SV_PointContents (vec3_t p)
 {
 	int		cont;
 
-	cont = SV_HullPointContents (&sv.worldmodel->hulls[0], 0, p);
+	cont = SV_TruePointContents (p);
 	if (cont <= CONTENTS_CURRENT_0 && cont >= CONTENTS_CURRENT_DOWN)
 		cont = CONTENTS_WATER;
 	return cont;
@@ -564,7 +1165,15 @@ int SV_PointContents (vec3_t p)
 
 int SV_TruePointContents (vec3_t p)
 {
-	return SV_HullPointContents (&sv.worldmodel->hulls[0], 0, p);
+	int		cont;
+
+	sv_tracecounts.points++;
+	if (!sv_tracing)
+		return SV_HullPointContents (&sv.worldmodel->hulls[0], 0, p);
+	SV_TraceEnter ();
+	cont = SV_HullPointContents (&sv.worldmodel->hulls[0], 0, p);
+	SV_TraceLeave ();
+	return cont;
 }
 
 //===========================================================================
@@ -614,6 +1223,8 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 	int			side;
 	float		midf;
 
+	sv_tracecounts.nodes++;
+
 // check for empty
 	if (num < 0)
 	{
@@ -691,7 +1302,7 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 	}
 #endif
 
-	if (SV_HullPointContents (hull, node->children[side^1], mid)
+	if (SV_ClipnodePointContents (hull, node->children[side^1], mid)
 	!= CONTENTS_SOLID)
 // go past the node
 		return SV_RecursiveHullCheck (hull, node->children[side^1], midf, p2f, mid, p2, trace);
@@ -713,7 +1324,7 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 		trace->plane.dist = -plane->dist;
 	}
 
-	while (SV_HullPointContents (hull, hull->firstclipnode, mid)
+	while (SV_ClipnodePointContents (hull, hull->firstclipnode, mid)
 	== CONTENTS_SOLID)
 	{ // shouldn't really happen, but does occasionally
 		frac -= 0.1;
@@ -735,6 +1346,333 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 	return false;
 }
 
+/*
+==================
+SV_HullCheck
+
+SV_RecursiveHullCheck over a packed hull without recursion, and with the same
+results to the bit.  A node the line crosses pushes a frame for the near side
+and keeps it while the far side is traced, as the recursion keeps its mid.
+==================
+*/
+typedef struct
+{
+	const mhullnode_t	*node;
+	int		side;
+	qboolean	far;		// near side done, tracing the far side
+	float	frac, p1f, p2f, midf;
+	float	*p1, *p2;
+	vec3_t	mid;
+} hullframe_t;
+
+qboolean SV_HullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
+{
+	hullframe_t	stack[MAX_HULLDEPTH];
+	hullframe_t	*frame;
+	const mhullnode_t	*nodes, *node;
+	float		t1, t2;
+	float		frac;
+	int			i, depth;
+
+	if (!hull->hullnodes || num < hull->firstclipnode || num > hull->lastclipnode || hull->hullremap[num] < 0)
+		return SV_RecursiveHullCheck (hull, num, p1f, p2f, p1, p2, trace);
+
+	nodes = hull->hullnodes;
+	num = hull->hullremap[num];
+	depth = 0;
+
+	for (;;)
+	{
+		sv_tracecounts.nodes++;
+
+	// check for empty
+		if (num < 0)
+		{
+			if (num != CONTENTS_SOLID)
+			{
+				trace->allsolid = false;
+				if (num == CONTENTS_EMPTY)
+					trace->inopen = true;
+				else
+					trace->inwater = true;
+			}
+			else
+				trace->startsolid = true;
+
+		// this side was empty, so go back to the last node whose far side
+		// is still to be traced
+			while (depth && stack[depth-1].far)
+				depth--;
+			if (!depth)
+				return true;
+			frame = &stack[depth-1];
+			frame->far = true;
+			node = frame->node;
+
+			if (SV_PackedPointContents (nodes, node->children[frame->side^1], frame->mid) != CONTENTS_SOLID)
+			{
+			// go past the node
+				num = node->children[frame->side^1];
+				p1f = frame->midf;
+				p2f = frame->p2f;
+				p1 = frame->mid;
+				p2 = frame->p2;
+				continue;
+			}
+
+			if (trace->allsolid)
+				return false;		// never got out of the solid area
+
+		// the other side of the node is solid, this is the impact point
+			if (!frame->side)
+			{
+				VectorCopy (node->normal, trace->plane.normal);
+				trace->plane.dist = node->dist;
+			}
+			else
+			{
+				VectorSubtract (vec3_origin, node->normal, trace->plane.normal);
+				trace->plane.dist = -node->dist;
+			}
+
+			frac = frame->frac;
+			while (SV_PackedPointContents (nodes, hull->hullremap[hull->firstclipnode], frame->mid)
+			== CONTENTS_SOLID)
+			{ // shouldn't really happen, but does occasionally
+				frac -= 0.1;
+				if (frac < 0)
+				{
+					trace->fraction = frame->midf;
+					VectorCopy (frame->mid, trace->endpos);
+					Con_DPrintf ("backup past 0\n");
+					return false;
+				}
+				frame->midf = frame->p1f + (frame->p2f - frame->p1f)*frac;
+				for (i=0 ; i<3 ; i++)
+					frame->mid[i] = frame->p1[i] + frac*(frame->p2[i] - frame->p1[i]);
+			}
+
+			trace->fraction = frame->midf;
+			VectorCopy (frame->mid, trace->endpos);
+			return false;
+		}
+
+	// find the point distances
+		node = nodes + num;
+		if (node->type < 3)
+		{
+			t1 = p1[node->type] - node->dist;
+			t2 = p2[node->type] - node->dist;
+		}
+		else
+		{
+			t1 = DoublePrecisionDotProduct (node->normal, p1) - node->dist;
+			t2 = DoublePrecisionDotProduct (node->normal, p2) - node->dist;
+		}
+
+		if (t1 >= 0 && t2 >= 0)
+		{
+			num = node->children[0];
+			continue;
+		}
+		if (t1 < 0 && t2 < 0)
+		{
+			num = node->children[1];
+			continue;
+		}
+
+	// put the crosspoint DIST_EPSILON pixels on the near side
+		if (t1 < 0)
+			frac = (t1 + DIST_EPSILON)/(t1-t2);
+		else
+			frac = (t1 - DIST_EPSILON)/(t1-t2);
+		if (frac < 0)
+			frac = 0;
+		if (frac > 1)
+			frac = 1;
+
+		frame = &stack[depth++];
+		frame->node = node;
+		frame->side = (t1 < 0);
+		frame->far = false;
+		frame->frac = frac;
+		frame->p1f = p1f;
+		frame->p2f = p2f;
+		frame->p1 = p1;
+		frame->p2 = p2;
+		frame->midf = p1f + (p2f - p1f)*frac;
+		for (i=0 ; i<3 ; i++)
+			frame->mid[i] = p1[i] + frac*(p2[i] - p1[i]);
+
+	// move up to the node
+		num = node->children[frame->side];
+		p2f = frame->midf;
+		p2 = frame->mid;
+	}
+}
+
+/*
+===============================================================================
+
+TRACE BENCHMARK
+
+"sv_tracebench record" keeps the hull traces SV_ClipMoveToEntity makes from
+then on, and "sv_tracebench run" replays them through SV_RecursiveHullCheck
+and SV_HullCheck, checks that both give the same trace_t and times them.
+===============================================================================
+*/
+
+typedef struct
+{
+	hull_t		*hull;		// NULL for the box hull
+	int			num;
+	vec3_t		boxmins, boxmaxs;
+	vec3_t		start, end;
+} tracerecord_t;
+
+static	tracerecord_t	*sv_tracerecords;
+static	int		sv_numtracerecords, sv_maxtracerecords;
+static	qboolean	sv_tracerecording;
+
+static void SV_TraceBenchClear (void)
+{
+	if (sv_tracerecords)
+	{
+		free (sv_tracerecords);
+		Mem_Track (MEMPOOL_MALLOC, "tracebench", -sv_maxtracerecords * (int)sizeof(tracerecord_t));
+	}
+	sv_tracerecords = NULL;
+	sv_numtracerecords = sv_maxtracerecords = 0;
+	sv_tracerecording = false;
+}
+
+static void SV_TraceRecord (hull_t *hull, vec3_t start, vec3_t end)
+{
+	tracerecord_t	*rec;
+
+	rec = &sv_tracerecords[sv_numtracerecords];
+	if (hull == &box_hull)
+	{
+		rec->hull = NULL;
+		rec->boxmaxs[0] = box_planes[0].dist;
+		rec->boxmins[0] = box_planes[1].dist;
+		rec->boxmaxs[1] = box_planes[2].dist;
+		rec->boxmins[1] = box_planes[3].dist;
+		rec->boxmaxs[2] = box_planes[4].dist;
+		rec->boxmins[2] = box_planes[5].dist;
+	}
+	else
+		rec->hull = hull;
+	rec->num = hull->firstclipnode;
+	VectorCopy (start, rec->start);
+	VectorCopy (end, rec->end);
+
+	if (++sv_numtracerecords == sv_maxtracerecords)
+	{
+		sv_tracerecording = false;
+		Con_Printf ("Recorded %i traces\n", sv_numtracerecords);
+	}
+}
+
+static hull_t *SV_TraceBenchStart (tracerecord_t *rec, trace_t *trace)
+{
+	memset (trace, 0, sizeof(trace_t));
+	trace->fraction = 1;
+	trace->allsolid = true;
+	VectorCopy (rec->end, trace->endpos);
+
+	return rec->hull ? rec->hull : SV_HullForBox (rec->boxmins, rec->boxmaxs);
+}
+
+static void SV_TraceBenchRun (int passes)
+{
+	tracerecord_t	*rec;
+	trace_t		a, b;
+	hull_t		*hull;
+	double		start, recursive, packed;
+	int			i, pass, differ;
+
+	if (!sv_numtracerecords)
+	{
+		Con_Printf ("No traces recorded, use \"sv_tracebench record\"\n");
+		return;
+	}
+
+	differ = 0;
+	for (i = 0, rec = sv_tracerecords; i < sv_numtracerecords; i++, rec++)
+	{
+		hull = SV_TraceBenchStart (rec, &a);
+		SV_RecursiveHullCheck (hull, rec->num, 0, 1, rec->start, rec->end, &a);
+		hull = SV_TraceBenchStart (rec, &b);
+		SV_HullCheck (hull, rec->num, 0, 1, rec->start, rec->end, &b);
+		if (memcmp (&a, &b, sizeof(a)))
+			differ++;
+	}
+
+	recursive = packed = 0;
+	for (pass = 0; pass < passes; pass++)
+	{
+		start = Sys_PreciseTime ();
+		for (i = 0, rec = sv_tracerecords; i < sv_numtracerecords; i++, rec++)
+		{
+			hull = SV_TraceBenchStart (rec, &a);
+			SV_RecursiveHullCheck (hull, rec->num, 0, 1, rec->start, rec->end, &a);
+		}
+		recursive += Sys_PreciseTime () - start;
+
+		start = Sys_PreciseTime ();
+		for (i = 0, rec = sv_tracerecords; i < sv_numtracerecords; i++, rec++)
+		{
+			hull = SV_TraceBenchStart (rec, &b);
+			SV_HullCheck (hull, rec->num, 0, 1, rec->start, rec->end, &b);
+		}
+		packed += Sys_PreciseTime () - start;
+	}
+
+	Con_Printf ("%i traces x %i passes\n", sv_numtracerecords, passes);
+	Con_Printf ("recursive %8.3f ms, %6.3f us/trace\n", recursive * 1000, recursive * 1000000 / ((double)sv_numtracerecords * passes));
+	Con_Printf ("packed    %8.3f ms, %6.3f us/trace\n", packed * 1000, packed * 1000000 / ((double)sv_numtracerecords * passes));
+	if (differ)
+		Con_Printf ("%i traces gave different results!\n", differ);
+}
+
+/*
+====================
+SV_TraceBench_f
+====================
+*/
+void SV_TraceBench_f (void)
+{
+	const char	*cmd = Cmd_Argv (1);
+	int			count;
+
+	if (!sv.active)
+		return;
+
+	if (!strcmp (cmd, "record"))
+	{
+		count = (Cmd_Argc () > 2) ? atoi (Cmd_Argv (2)) : 100000;
+		if (count < 1)
+			count = 1;
+		SV_TraceBenchClear ();
+		sv_tracerecords = (tracerecord_t *) malloc (count * sizeof(tracerecord_t));
+		if (!sv_tracerecords)
+		{
+			Con_Printf ("Couldn't allocate %i trace records\n", count);
+			return;
+		}
+		Mem_Track (MEMPOOL_MALLOC, "tracebench", count * (int)sizeof(tracerecord_t));
+		sv_maxtracerecords = count;
+		sv_tracerecording = true;
+		Con_Printf ("Recording the next %i traces\n", count);
+	}
+	else if (!strcmp (cmd, "run"))
+		SV_TraceBenchRun (q_max ((Cmd_Argc () > 2) ? atoi (Cmd_Argv (2)) : 10, 1));
+	else
+		Con_Printf ("usage: sv_tracebench [record [count] | run [passes]]\n"
+			"%i traces recorded%s\n", sv_numtracerecords, sv_tracerecording ? ", still recording" : "");
+}
+
 
 /*
 ==================
@@ -751,6 +1689,10 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	vec3_t		start_l, end_l;
 	hull_t		*hull;
 
+	sv_tracecounts.clips++;
+	if (sv_tracing)
+		SV_TraceEnter ();
+
 // fill in a default trace
 	memset (&trace, 0, sizeof(trace_t));
 	trace.fraction = 1;
@@ -764,7 +1706,9 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	VectorSubtract (end, offset, end_l);
 
 // trace a line through the apropriate clipping hull
-	SV_RecursiveHullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace);
+	if (sv_tracerecording)
+		SV_TraceRecord (hull, start_l, end_l);
+	SV_HullCheck (hull, hull->firstclipnode, 0, 1, start_l, end_l, &trace);
 
 // fix trace up by the offset
 	if (trace.fraction != 1)
@@ -774,6 +1718,8 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	if (trace.fraction < 1 || trace.startsolid  )
 		trace.ent = ent;
 
+	if (sv_tracing)
+		SV_TraceLeave ();
 	return trace;
 }
 
@@ -792,11 +1738,14 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 	edict_t		*touch;
 	trace_t		trace;
 
+	sv_areastats.tracenodes++;
+
 // touch linked edicts
 	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
 	{
 		next = l->next;
 		touch = EDICT_FROM_AREA(l);
+		sv_areastats.tracechecks++;
 		if (touch->v.solid == SOLID_NOT)
 			continue;
 		if (touch == clip->passedict)
@@ -829,6 +1778,7 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 				continue;	// don't clip against owner
 		}
 
+		sv_areastats.traceclips++;
 		if ((int)touch->v.flags & FL_MONSTER)
 			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
 		else
@@ -853,9 +1803,9 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 	if (node->axis == -1)
 		return;
 
-	if ( clip->boxmaxs[node->axis] > node->dist )
+	if ( clip->boxmaxs[node->axis] > node->lodist )
 		SV_ClipToLinks ( node->children[0], clip );
-	if ( clip->boxmins[node->axis] < node->dist )
+	if ( clip->boxmins[node->axis] < node->hidist )
 		SV_ClipToLinks ( node->children[1], clip );
 }
 
@@ -900,6 +1850,10 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	moveclip_t	clip;
 	int			i;
 
+	sv_tracecounts.moves++;
+	if (sv_tracing)
+		SV_TraceEnter ();
+
 	memset ( &clip, 0, sizeof ( moveclip_t ) );
 
 // clip to world
@@ -930,8 +1884,11 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
 
 // clip to entities
+	sv_areastats.traces++;
 	SV_ClipToLinks ( sv_areanodes, &clip );
 
+	if (sv_tracing)
+		SV_TraceLeave ();
 	return clip.trace;
 }
 
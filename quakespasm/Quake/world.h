@@ -60,6 +60,36 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers);
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
 
+void SV_MarkEdictMoved (edict_t *ent);
+// call when origin, mins, maxs or solid change without SV_LinkEdict following
+
+int SV_FindRadiusEdicts (const float *org, float rad, int *list);
+// fills list with the edict numbers, in ascending order, that findradius has
+// to check, returns -1 if it has to check them all
+
+void SV_AreaStats_f (void);
+// area node counters for the sv_areastats command, reset by it
+
+// what SV_Move and the point contents functions are being called for, for
+// sv_tracestats: SV_Physics sets the movetype and builtins their own, and
+// the QC function running is added to it
+#define	TRACE_ENGINE		0
+#define	TRACE_MOVETYPE		1	// + MOVETYPE_*, up to MOVETYPE_BOUNCE
+#define	TRACE_CLIENT		12	// SV_RunClients
+#define	TRACE_TRACELINE		13
+#define	TRACE_WALKMOVE		14
+#define	TRACE_DROPTOFLOOR	15
+#define	TRACE_AIM			16
+#define	TRACE_MOVETOGOAL	17
+#define	TRACE_CHECKBOTTOM	18
+#define	TRACE_POINTCONTENTS	19
+#define	TRACE_NUMSOURCES	20
+
+extern int sv_tracesource;
+void SV_TraceStats_f (void);
+void SV_TraceStatsFrame (void);	// at the end of each server frame
+void SV_TraceAbort (void);	// when Host_Error or Host_EndGame unwind
+
 int SV_PointContents (vec3_t p);
 int SV_TruePointContents (vec3_t p);
 // returns the CONTENTS_* value from the world at the given point.
@@ -82,6 +112,11 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
 qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace);
+qboolean SV_HullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace);
+// SV_HullCheck is the same trace without recursion, over the hull's packed
+// nodes when Mod_PackHull could build them
+
+void SV_TraceBench_f (void);
 
 #endif	/* _QUAKE_WORLD_H */
 
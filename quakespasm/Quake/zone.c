@@ -26,26 +26,66 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	DYNAMIC_SIZE	(4 * 1024 * 1024) // ericw -- was 512KB (64-bit) / 384KB (32-bit)
 
 #define	ZONEID	0x1d4a11
+#define	SLOTID	0x1d4a12	// small allocation in use
+#define	SLOTFREEID	0x1d4a13	// small allocation on a free list
 #define MINFRAGMENT	64
 
+#define	ZONE_NUMBINS	32	// free block bins, one per power of two
+#define	ZONE_BINPROBES	8	// blocks to try in a bin before going up
+#define	ZONE_NUMCLASSES	10
+#define	ZONE_MAXSMALL	512	// largest size served from a size class
+#define	ZONE_PAGESIZE	(16 * 1024)
+#define	ZONE_PAGETAG	2	// tag of blocks holding small allocations
+
 typedef struct memblock_s
 {
 	int	size;		// including the header and possibly tiny fragments
 	int	tag;		// a tag of 0 is a free block
-	int	id;		// should be ZONEID
-	int	pad;		// pad to 64 bit boundary
 	struct	memblock_s	*next, *prev;
+	int	pad;		// pad to 64 bit boundary
+	int	id;		// should be ZONEID, right before the data
 } memblock_t;
 
+typedef struct
+{
+	memblock_t	*next, *prev;	// in the bin, kept in the data of free blocks
+} memfree_t;
+
+typedef struct memslot_s
+{
+	int	page;		// offset back to the mempage_t
+	int	id;		// SLOTID or SLOTFREEID, right before the data
+} memslot_t;
+
+typedef struct mempage_s
+{
+	int	sclass;
+	int	used;		// slots handed out
+	int	carved;		// slots ever handed out, the rest was never touched
+	int	pad;
+	memslot_t	*free;		// freed slots, linked through their data
+	struct mempage_s	*next, *prev;	// pages of the class with free slots
+} mempage_t;
+
+#define	ZONE_PAGEHEADER	(((int)sizeof(mempage_t) + 7) & ~7)
+#define	FREELINK(b)	((memfree_t *)((b) + 1))
+#define	SLOTLINK(s)	(*(memslot_t **)((s) + 1))
+
 typedef struct
 {
 	int		size;		// total bytes malloced, including header
 	memblock_t	blocklist;	// start / end cap for linked list
-	memblock_t	*rover;
+	memblock_t	*bins[ZONE_NUMBINS];	// free blocks by log2 of their size
+	unsigned int	binmask;	// bit set for each non-empty bin
+	mempage_t	*partial[ZONE_NUMCLASSES];	// pages with free slots
+	int		numpages[ZONE_NUMCLASSES];
+	int		numslots[ZONE_NUMCLASSES];	// slots in use
+	int		smallallocs, largeallocs;
 } memzone_t;
 
 void Cache_FreeLow (int new_low_hunk);
 void Cache_FreeHigh (int new_high_hunk);
+static int Cache_TopOffset (void);
 
 
 /*
@@ -56,7 +96,18 @@ void Cache_FreeHigh (int new_high_hunk);
 There is never any space between memblocks, and there will never be two
 contiguous free memblocks.
 
-The rover can be left pointing at a non-empty block
+Free blocks are kept in bins by the power of two of their size, so a
+large allocation looks at a few blocks of its own bin and then takes the
+first block of the next non-empty bin up, which always fits.
+
+Allocations up to ZONE_MAXSMALL bytes come from pages (ordinary blocks
+tagged ZONE_PAGETAG) that are split into slots of one size class. Every
+class keeps a list of its pages with free slots, so small allocations
+and frees never search. A page is given back when its last slot is freed,
+unless it is the only page of its class with free slots.
+
+Both kinds of allocation have their id right before the data, which is
+how Z_Free tells them apart.
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
@@ -65,78 +116,208 @@ all big things are allocated on the hunk.
 
 static memzone_t	*mainzone;
 
+static const int	zone_classsize[ZONE_NUMCLASSES] =
+{
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+static byte	zone_classfor[ZONE_MAXSMALL / 16 + 1];	// by (size + 15) / 16
 
-/*
-========================
-Z_Free
-========================
-*/
-void Z_Free (void *ptr)
+static int Z_SlotsPerPage (int sclass)
 {
-	memblock_t	*block, *other;
+	return (ZONE_PAGESIZE - ZONE_PAGEHEADER) / (zone_classsize[sclass] + (int) sizeof(memslot_t));
+}
 
-	if (!ptr)
-		Sys_Error ("Z_Free: NULL pointer");
+static int Z_BinForSize (int size)
+{
+	int	bin;
 
-	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
-	if (block->id != ZONEID)
-		Sys_Error ("Z_Free: freed a pointer without ZONEID");
-	if (block->tag == 0)
-		Sys_Error ("Z_Free: freed a freed pointer");
+	for (bin = 0; size > 1; size >>= 1)
+		bin++;
+	return bin;
+}
+
+static void Z_LinkFree (memblock_t *block)
+{
+	int	bin = Z_BinForSize (block->size);
+
+	FREELINK(block)->prev = NULL;
+	FREELINK(block)->next = mainzone->bins[bin];
+	if (mainzone->bins[bin])
+		FREELINK(mainzone->bins[bin])->prev = block;
+	mainzone->bins[bin] = block;
+	mainzone->binmask |= 1u << bin;
+}
+
+static void Z_UnlinkFree (memblock_t *block)
+{
+	int	bin = Z_BinForSize (block->size);
+
+	if (FREELINK(block)->prev)
+		FREELINK(FREELINK(block)->prev)->next = FREELINK(block)->next;
+	else
+		mainzone->bins[bin] = FREELINK(block)->next;
+	if (FREELINK(block)->next)
+		FREELINK(FREELINK(block)->next)->prev = FREELINK(block)->prev;
+	if (!mainzone->bins[bin])
+		mainzone->binmask &= ~(1u << bin);
+}
+
+static void Z_FreeBlock (memblock_t *block)
+{
+	memblock_t	*other;
 
 	block->tag = 0;		// mark as free
 
 	other = block->prev;
 	if (!other->tag)
 	{	// merge with previous free block
+		Z_UnlinkFree (other);
 		other->size += block->size;
 		other->next = block->next;
 		other->next->prev = other;
-		if (block == mainzone->rover)
-			mainzone->rover = other;
 		block = other;
 	}
 
 	other = block->next;
 	if (!other->tag)
 	{	// merge the next free block onto the end
+		Z_UnlinkFree (other);
 		block->size += other->size;
 		block->next = other->next;
 		block->next->prev = block;
-		if (other == mainzone->rover)
-			mainzone->rover = block;
 	}
+
+	Z_LinkFree (block);
+}
+
+static void Z_FreeSlot (memslot_t *slot)
+{
+	mempage_t	*page;
+	memblock_t	*block;
+	int		sclass;
+
+	page = (mempage_t *) ((byte *)slot - slot->page);
+	block = (memblock_t *) page - 1;
+	if (block->id != ZONEID || block->tag != ZONE_PAGETAG)
+		Sys_Error ("Z_Free: freed a pointer with a trashed header");
+	sclass = page->sclass;
+
+	slot->id = SLOTFREEID;
+	SLOTLINK(slot) = page->free;
+	page->free = slot;
+	mainzone->numslots[sclass]--;
+
+	if (page->used-- == Z_SlotsPerPage (sclass))
+	{	// it was full, so it isn't in the partial list yet
+		page->prev = NULL;
+		page->next = mainzone->partial[sclass];
+		if (page->next)
+			page->next->prev = page;
+		mainzone->partial[sclass] = page;
+	}
+	else if (!page->used && (page->prev || page->next))
+	{	// give it back, there are other pages with room
+		if (page->prev)
+			page->prev->next = page->next;
+		else
+			mainzone->partial[sclass] = page->next;
+		if (page->next)
+			page->next->prev = page->prev;
+		mainzone->numpages[sclass]--;
+		Z_FreeBlock (block);
+	}
+}
+
+/* bytes that can be used at ptr */
+static int Z_Capacity (void *ptr)
+{
+	memslot_t	*slot;
+	memblock_t	*block;
+
+	switch (((int *)ptr)[-1])
+	{
+	case SLOTID:
+		slot = (memslot_t *)ptr - 1;
+		return zone_classsize[((mempage_t *) ((byte *)slot - slot->page))->sclass];
+	case ZONEID:
+		block = (memblock_t *) ((byte *)ptr - sizeof(memblock_t));
+		if (block->tag && block->tag != ZONE_PAGETAG)
+			return block->size - (4 + (int)sizeof(memblock_t));	/* see Z_TagMalloc() */
+	}
+	return -1;
+}
+
+/*
+========================
+Z_Free
+========================
+*/
+void Z_Free (void *ptr)
+{
+	memblock_t	*block;
+
+	if (!ptr)
+		Sys_Error ("Z_Free: NULL pointer");
+
+	switch (((int *)ptr)[-1])
+	{
+	case SLOTID:
+		Mem_Track (MEMPOOL_ZONE, NULL, -Z_Capacity (ptr));
+		Z_FreeSlot ((memslot_t *)ptr - 1);
+		return;
+	case SLOTFREEID:
+		Sys_Error ("Z_Free: freed a freed pointer");
+		return;
+	case ZONEID:
+		break;
+	default:
+		Sys_Error ("Z_Free: freed a pointer without ZONEID");
+	}
+
+	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
+	if (block->tag == 0)
+		Sys_Error ("Z_Free: freed a freed pointer");
+	if (block->tag == ZONE_PAGETAG)
+		Sys_Error ("Z_Free: freed a pointer without ZONEID");
+
+	Mem_Track (MEMPOOL_ZONE, NULL, -Z_Capacity (ptr));
+	Z_FreeBlock (block);
 }
 
 
 static void *Z_TagMalloc (int size, int tag)
 {
-	int		extra;
-	memblock_t	*start, *rover, *newblock, *base;
+	int		extra, bin, i;
+	unsigned int	mask;
+	memblock_t	*base, *newblock;
 
 	if (!tag)
 		Sys_Error ("Z_TagMalloc: tried to use a 0 tag");
 
-//
-// scan through the block list looking for the first free block
-// of sufficient size
-//
 	size += sizeof(memblock_t);	// account for size of block header
 	size += 4;					// space for memory trash tester
 	size = (size + 7) & ~7;		// align to 8-byte boundary
 
-	base = rover = mainzone->rover;
-	start = base->prev;
-
-	do
+//
+// the own bin can have blocks that are too small, look at a few of them,
+// then take any block of a larger bin
+//
+	bin = Z_BinForSize (size);
+	for (base = mainzone->bins[bin], i = 0; base && i < ZONE_BINPROBES; base = FREELINK(base)->next, i++)
+	{
+		if (base->size >= size)
+			break;
+	}
+	if (!base || base->size < size)
 	{
-		if (rover == start)	// scaned all the way around the list
+		mask = mainzone->binmask & ~((2u << bin) - 1);
+		if (!mask)
 			return NULL;
-		if (rover->tag)
-			base = rover = rover->next;
-		else
-			rover = rover->next;
-	} while (base->tag || base->size < size);
+		for (bin++; !(mask & (1u << bin)); bin++)
+			;
+		base = mainzone->bins[bin];
+	}
+	Z_UnlinkFree (base);
 
 //
 // found a block big enough
@@ -153,12 +334,11 @@ static void *Z_TagMalloc (int size, int tag)
 		newblock->next->prev = newblock;
 		base->next = newblock;
 		base->size = size;
+		Z_LinkFree (newblock);
 	}
 
 	base->tag = tag;				// no longer a free block
 
-	mainzone->rover = base->next;	// next allocation will start looking here
-
 	base->id = ZONEID;
 
 // marker for memory trash testing
@@ -167,6 +347,49 @@ static void *Z_TagMalloc (int size, int tag)
 	return (void *) ((byte *)base + sizeof(memblock_t));
 }
 
+static void *Z_SlotMalloc (int sclass)
+{
+	mempage_t	*page;
+	memslot_t	*slot;
+
+	page = mainzone->partial[sclass];
+	if (!page)
+	{
+		page = (mempage_t *) Z_TagMalloc (ZONE_PAGESIZE, ZONE_PAGETAG);
+		if (!page)
+			return NULL;
+		memset (page, 0, sizeof(mempage_t));
+		page->sclass = sclass;
+		mainzone->partial[sclass] = page;
+		mainzone->numpages[sclass]++;
+	}
+
+	if (page->free)
+	{
+		slot = page->free;
+		page->free = SLOTLINK(slot);
+	}
+	else
+	{
+		slot = (memslot_t *) ((byte *)page + ZONE_PAGEHEADER +
+			page->carved * (zone_classsize[sclass] + (int) sizeof(memslot_t)));
+		page->carved++;
+	}
+	slot->page = (byte *)slot - (byte *)page;
+	slot->id = SLOTID;
+	mainzone->numslots[sclass]++;
+
+	if (++page->used == Z_SlotsPerPage (sclass))
+	{	// full, take it off the list
+		mainzone->partial[sclass] = page->next;
+		if (page->next)
+			page->next->prev = NULL;
+		page->next = page->prev = NULL;
+	}
+
+	return (void *) (slot + 1);
+}
+
 /*
 ========================
 Z_CheckHeap
@@ -175,9 +398,24 @@ Z_CheckHeap
 static void Z_CheckHeap (void)
 {
 	memblock_t	*block;
+	mempage_t	*page;
+	int		i, numfree, numbinned;
 
+	numfree = 0;
 	for (block = mainzone->blocklist.next ; ; block = block->next)
 	{
+		if (!block->tag)
+			numfree++;
+		if (block->id != ZONEID)
+			Sys_Error ("Z_CheckHeap: block without ZONEID\n");
+		if (block->tag == ZONE_PAGETAG)
+		{
+			page = (mempage_t *) (block + 1);
+			if (page->sclass < 0 || page->sclass >= ZONE_NUMCLASSES ||
+			    page->used < 0 || page->used > page->carved ||
+			    page->carved > Z_SlotsPerPage (page->sclass))
+				Sys_Error ("Z_CheckHeap: trashed page header\n");
+		}
 		if (block->next == &mainzone->blocklist)
 			break;			// all blocks have been hit
 		if ( (byte *)block + block->size != (byte *)block->next)
@@ -187,6 +425,19 @@ static void Z_CheckHeap (void)
 		if (!block->tag && !block->next->tag)
 			Sys_Error ("Z_CheckHeap: two consecutive free blocks\n");
 	}
+
+	numbinned = 0;
+	for (i = 0; i < ZONE_NUMBINS; i++)
+	{
+		for (block = mainzone->bins[i]; block; block = FREELINK(block)->next)
+		{
+			if (block->tag || Z_BinForSize (block->size) != i)
+				Sys_Error ("Z_CheckHeap: bad block in free bin\n");
+			numbinned++;
+		}
+	}
+	if (numbinned != numfree)
+		Sys_Error ("Z_CheckHeap: free blocks missing from the bins\n");
 }
 
 
@@ -199,11 +450,24 @@ void *Z_Malloc (int size)
 {
 	void	*buf;
 
-	Z_CheckHeap ();	// DEBUG
-	buf = Z_TagMalloc (size, 1);
+	if (size < 0)
+		Sys_Error ("Z_Malloc: bad size %i", size);
+	if (size <= ZONE_MAXSMALL)
+	{	// constant time, the pages are checked when a new one is made
+		buf = Z_SlotMalloc (zone_classfor[(size + 15) >> 4]);
+		mainzone->smallallocs++;
+	}
+	else
+	{
+		Z_CheckHeap ();	// DEBUG
+		buf = Z_TagMalloc (size, 1);
+		mainzone->largeallocs++;
+	}
 	if (!buf)
 		Sys_Error ("Z_Malloc: failed on allocation of %i bytes",size);
-	Q_memset (buf, 0, size);
+	size = Z_Capacity (buf);
+	Q_memset (buf, 0, size);	// Z_Realloc relies on zeroed slack
+	Mem_Track (MEMPOOL_ZONE, NULL, size);
 
 	return buf;
 }
@@ -217,30 +481,35 @@ void *Z_Realloc(void *ptr, int size)
 {
 	int old_size;
 	void *old_ptr;
-	memblock_t *block;
 
 	if (!ptr)
 		return Z_Malloc (size);
 
-	block = (memblock_t *) ((byte *) ptr - sizeof (memblock_t));
-	if (block->id != ZONEID)
+	switch (((int *)ptr)[-1])
+	{
+	case SLOTFREEID:
+		Sys_Error ("Z_Realloc: realloced a freed pointer");
+		break;
+	case SLOTID:
+	case ZONEID:
+		break;
+	default:
 		Sys_Error ("Z_Realloc: realloced a pointer without ZONEID");
-	if (block->tag == 0)
+	}
+	old_size = Z_Capacity (ptr);
+	if (old_size < 0)
 		Sys_Error ("Z_Realloc: realloced a freed pointer");
 
-	old_size = block->size;
-	old_size -= (4 + (int)sizeof(memblock_t));	/* see Z_TagMalloc() */
-	old_ptr = ptr;
-
-	Z_Free (ptr);
-	ptr = Z_TagMalloc (size, 1);
-	if (!ptr)
-		Sys_Error ("Z_Realloc: failed on allocation of %i bytes", size);
+	if (size <= old_size && (size > ZONE_MAXSMALL || old_size <= ZONE_MAXSMALL))
+	{	// still fits, keep the bytes past the end zeroed
+		memset ((byte *)ptr + size, 0, old_size - size);
+		return ptr;
+	}
 
-	if (ptr != old_ptr)
-		memmove (ptr, old_ptr, q_min(old_size, size));
-	if (old_size < size)
-		memset ((byte *)ptr + old_size, 0, size - old_size);
+	old_ptr = ptr;
+	ptr = Z_Malloc (size);
+	memcpy (ptr, old_ptr, q_min(old_size, size));
+	Z_Free (old_ptr);
 
 	return ptr;
 }
@@ -281,6 +550,51 @@ void Z_Print (memzone_t *zone)
 	}
 }
 
+/*
+========================
+Z_Stats_f
+
+Prints how full and how fragmented the zone is, and how well the size
+class pages are used.
+========================
+*/
+static void Z_Stats_f (void)
+{
+	memblock_t	*block;
+	int		i, used, usedblocks, free, freeblocks, largest, slots;
+
+	used = usedblocks = free = freeblocks = largest = 0;
+	for (block = mainzone->blocklist.next ; block != &mainzone->blocklist ; block = block->next)
+	{
+		if (block->tag)
+		{
+			used += block->size;
+			usedblocks++;
+		}
+		else
+		{
+			free += block->size;
+			freeblocks++;
+			if (block->size > largest)
+				largest = block->size;
+		}
+	}
+
+	Con_Printf ("zone size: %iK\n", mainzone->size / 1024);
+	Con_Printf ("used: %7i bytes in %i blocks\n", used, usedblocks);
+	Con_Printf ("free: %7i bytes in %i blocks, largest %i\n", free, freeblocks, largest);
+	Con_Printf ("fragmentation: %.1f%%\n", free ? 100.0 * (1.0 - (double)largest / free) : 0.0);
+	Con_Printf ("allocations: %i small, %i large\n", mainzone->smallallocs, mainzone->largeallocs);
+	Con_Printf ("class pages   slots  in use\n");
+	for (i = 0; i < ZONE_NUMCLASSES; i++)
+	{
+		slots = mainzone->numpages[i] * Z_SlotsPerPage (i);
+		Con_Printf ("%5i %5i %7i %6.1f%%\n", zone_classsize[i],
+			mainzone->numpages[i], mainzone->numslots[i],
+			slots ? 100.0 * mainzone->numslots[i] / slots : 0.0);
+	}
+}
+
 
 //============================================================================
 
@@ -303,6 +617,70 @@ int		hunk_high_used;
 qboolean	hunk_tempactive;
 int		hunk_tempmark;
 
+/*
+When the hunk is only reserved address space (see Sys_MemReserve), memory
+is committed in HUNK_COMMITSTEP steps from the bottom as the low hunk and
+the cache grow, and from the top as the high hunk grows. The two committed
+ranges never overlap. Hunk_FreeToLowMark gives back what is above both the
+low hunk and the cache; the high side is kept, since temp allocations come
+and go there all the time.
+*/
+#define	HUNK_COMMITSTEP	(1024 * 1024)
+
+static qboolean	hunk_reserved;
+static int	hunk_lowcommit;		// bytes committed from the bottom
+static int	hunk_highcommit;	// bytes committed from the top
+
+/* makes the first "end" bytes of the hunk usable */
+static void Hunk_CommitLow (int end)
+{
+	int	commit;
+
+	if (!hunk_reserved || end <= hunk_lowcommit)
+		return;
+	commit = (end + HUNK_COMMITSTEP - 1) & ~(HUNK_COMMITSTEP - 1);
+	if (commit > hunk_size - hunk_highcommit)
+		commit = hunk_size - hunk_highcommit;	// the rest is committed from the top
+	if (commit <= hunk_lowcommit)
+		return;
+	if (!Sys_MemCommit (hunk_base + hunk_lowcommit, commit - hunk_lowcommit))
+		Sys_Error ("Hunk_CommitLow: couldn't commit %i bytes", commit - hunk_lowcommit);
+	hunk_lowcommit = commit;
+}
+
+/* makes the last "used" bytes of the hunk usable */
+static void Hunk_CommitHigh (int used)
+{
+	int	commit;
+
+	if (!hunk_reserved || used <= hunk_highcommit)
+		return;
+	commit = (used + HUNK_COMMITSTEP - 1) & ~(HUNK_COMMITSTEP - 1);
+	if (commit > hunk_size - hunk_lowcommit)
+		commit = hunk_size - hunk_lowcommit;
+	if (commit <= hunk_highcommit)
+		return;
+	if (!Sys_MemCommit (hunk_base + hunk_size - commit, commit - hunk_highcommit))
+		Sys_Error ("Hunk_CommitHigh: couldn't commit %i bytes", commit - hunk_highcommit);
+	hunk_highcommit = commit;
+}
+
+/* returns where decommitting may start, everything above is unused */
+static int Hunk_DecommitLow (int end)
+{
+	int	keep;
+
+	if (!hunk_reserved)
+		return hunk_size;	// all of it stays usable
+	keep = (end + HUNK_COMMITSTEP - 1) & ~(HUNK_COMMITSTEP - 1);
+	if (keep < hunk_lowcommit)
+	{
+		Sys_MemDecommit (hunk_base + keep, hunk_lowcommit - keep);
+		hunk_lowcommit = keep;
+	}
+	return keep;
+}
+
 /*
 ==============
 Hunk_Check
@@ -349,6 +727,8 @@ void Hunk_Print (qboolean all)
 	endhigh = (hunk_t *)(hunk_base + hunk_size);
 
 	Con_Printf ("          :%8i total hunk size\n", hunk_size);
+	if (hunk_reserved)
+		Con_Printf ("          :%8i committed\n", hunk_lowcommit + hunk_highcommit);
 	Con_Printf ("-------------------------\n");
 
 	while (1)
@@ -445,12 +825,14 @@ void *Hunk_AllocName (int size, const char *name)
 	hunk_low_used += size;
 
 	Cache_FreeLow (hunk_low_used);
+	Hunk_CommitLow (hunk_low_used);
 
 	memset (h, 0, size);
 
 	h->size = size;
 	h->sentinal = HUNK_SENTINAL;
 	q_strlcpy (h->name, name, HUNKNAME_LEN);
+	Mem_Track (MEMPOOL_HUNK, h->name, size);
 
 	return (void *)(h+1);
 }
@@ -472,9 +854,19 @@ int	Hunk_LowMark (void)
 
 void Hunk_FreeToLowMark (int mark)
 {
+	hunk_t	*h;
+	int		end;
+
 	if (mark < 0 || mark > hunk_low_used)
 		Sys_Error ("Hunk_FreeToLowMark: bad mark %i", mark);
-	memset (hunk_base + mark, 0, hunk_low_used - mark);
+	for (h = (hunk_t *)(hunk_base + mark); (byte *)h < hunk_base + hunk_low_used; h = (hunk_t *)((byte *)h + h->size))
+		Mem_Track (MEMPOOL_HUNK, h->name, -h->size);
+
+// the cache sits right above the low hunk
+	end = q_max(Cache_TopOffset (), mark);
+	end = q_min(Hunk_DecommitLow (end), hunk_low_used);
+	if (end > mark)
+		memset (hunk_base + mark, 0, end - mark);
 	hunk_low_used = mark;
 }
 
@@ -491,6 +883,8 @@ int	Hunk_HighMark (void)
 
 void Hunk_FreeToHighMark (int mark)
 {
+	hunk_t	*h;
+
 	if (hunk_tempactive)
 	{
 		hunk_tempactive = false;
@@ -498,6 +892,8 @@ void Hunk_FreeToHighMark (int mark)
 	}
 	if (mark < 0 || mark > hunk_high_used)
 		Sys_Error ("Hunk_FreeToHighMark: bad mark %i", mark);
+	for (h = (hunk_t *)(hunk_base + hunk_size - hunk_high_used); (byte *)h < hunk_base + hunk_size - mark; h = (hunk_t *)((byte *)h + h->size))
+		Mem_Track (MEMPOOL_HUNK, h->name, -h->size);
 	memset (hunk_base + hunk_size - hunk_high_used, 0, hunk_high_used - mark);
 	hunk_high_used = mark;
 }
@@ -535,6 +931,7 @@ void *Hunk_HighAllocName (int size, const char *name)
 
 	hunk_high_used += size;
 	Cache_FreeHigh (hunk_high_used);
+	Hunk_CommitHigh (hunk_high_used);
 
 	h = (hunk_t *)(hunk_base + hunk_size - hunk_high_used);
 
@@ -542,6 +939,7 @@ void *Hunk_HighAllocName (int size, const char *name)
 	h->size = size;
 	h->sentinal = HUNK_SENTINAL;
 	q_strlcpy (h->name, name, HUNKNAME_LEN);
+	Mem_Track (MEMPOOL_HUNK, h->name, size);
 
 	return (void *)(h+1);
 }
@@ -605,6 +1003,14 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
 
 cache_system_t	cache_head;
 
+/* end of the highest cache block in the hunk, 0 if the cache is empty */
+static int Cache_TopOffset (void)
+{
+	if (cache_head.prev == &cache_head)
+		return 0;
+	return (byte *)cache_head.prev + cache_head.prev->size - hunk_base;
+}
+
 /*
 ===========
 Cache_Move
@@ -623,6 +1029,7 @@ void Cache_Move ( cache_system_t *c)
 		Q_memcpy ( new_cs+1, c+1, c->size - sizeof(cache_system_t) );
 		new_cs->user = c->user;
 		Q_memcpy (new_cs->name, c->name, sizeof(new_cs->name));
+		Mem_Track (MEMPOOL_CACHE, new_cs->name, new_cs->size);	// Cache_Free takes the old one off
 		Cache_Free (c->user, false); //johnfitz -- added second argument
 		new_cs->user->data = (void *)(new_cs+1);
 	}
@@ -727,6 +1134,7 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
 			Sys_Error ("Cache_TryAlloc: %i is greater then free hunk", size);
 
 		new_cs = (cache_system_t *) (hunk_base + hunk_low_used);
+		Hunk_CommitLow ((byte *)new_cs + size - hunk_base);
 		memset (new_cs, 0, sizeof(*new_cs));
 		new_cs->size = size;
 
@@ -748,6 +1156,7 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
 		{
 			if ( (byte *)cs - (byte *)new_cs >= size)
 			{	// found space
+				Hunk_CommitLow ((byte *)new_cs + size - hunk_base);
 				memset (new_cs, 0, sizeof(*new_cs));
 				new_cs->size = size;
 
@@ -771,6 +1180,7 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom)
 // try to allocate one at the very end
 	if ( hunk_base + hunk_size - hunk_high_used - (byte *)new_cs >= size)
 	{
+		Hunk_CommitLow ((byte *)new_cs + size - hunk_base);
 		memset (new_cs, 0, sizeof(*new_cs));
 		new_cs->size = size;
 
@@ -856,6 +1266,7 @@ void Cache_Free (cache_user_t *c, qboolean freetextures) //johnfitz -- added sec
 		Sys_Error ("Cache_Free: not allocated");
 
 	cs = ((cache_system_t *)c->data) - 1;
+	Mem_Track (MEMPOOL_CACHE, cs->name, -cs->size);
 
 	cs->prev->next = cs->next;
 	cs->next->prev = cs->prev;
@@ -920,6 +1331,7 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 		if (cs)
 		{
 			q_strlcpy (cs->name, name, CACHENAME_LEN);
+			Mem_Track (MEMPOOL_CACHE, cs->name, cs->size);
 			c->data = (void *)(cs+1);
 			cs->user = c;
 			break;
@@ -937,24 +1349,707 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name)
 
 //============================================================================
 
+/*
+==============================================================================
+
+						MEMORY TELEMETRY
+
+Every pool keeps its current size and high-water marks for the current
+map and overall, and so does every named allocation in it: hunk blocks
+by hunk name, cache entries by cache name, GL textures by the model they
+belong to. The zone is only tracked as a whole. Mem_BeginMap files the
+peaks of the map that is left, and mem_timeline samples all pools every
+so many frames. "memstats" shows it all and dumps it to files.
+
+The zone lives in a hunk block, so it isn't added to the total.
+
+==============================================================================
+*/
+
+#define	MEM_MAXTAGS	1024	// power of two
+#define	MEM_TAGLEN	32
+#define	MEM_MAXMAPS	64
+#define	MEM_MAXSAMPLES	8192
+
+typedef struct
+{
+	int	current;
+	int	mappeak;	// since Mem_BeginMap
+	int	peak;
+} memcount_t;
+
+typedef struct
+{
+	char		name[MEM_TAGLEN];
+	int		pool;
+	memcount_t	count;
+} memtag_t;
+
+typedef struct
+{
+	char	name[MEM_TAGLEN];
+	int	peaks[NUM_MEMPOOLS];
+	int	totalpeak;
+} memmap_t;
+
+typedef struct
+{
+	float	time;
+	int	pools[NUM_MEMPOOLS];
+} memsample_t;
+
+static const char	*mem_poolnames[NUM_MEMPOOLS] = {"hunk", "zone", "cache", "malloc", "gl"};
+
+static memcount_t	mem_pools[NUM_MEMPOOLS];
+static memcount_t	mem_total;
+static memtag_t		mem_tags[MEM_MAXTAGS];
+static int		mem_numtags;
+static memmap_t		mem_maps[MEM_MAXMAPS];	// oldest first
+static int		mem_nummaps;
+static char		mem_mapname[MEM_TAGLEN];
+static memsample_t	mem_samples[MEM_MAXSAMPLES];	// a ring
+static int		mem_numsamples;
+
+cvar_t	mem_timeline = {"mem_timeline", "0", CVAR_NONE};	// sample every n frames
+
+static void Mem_Count (memcount_t *count, int delta)
+{
+	count->current += delta;
+	if (count->current > count->mappeak)
+		count->mappeak = count->current;
+	if (count->current > count->peak)
+		count->peak = count->current;
+}
+
+static memtag_t *Mem_FindTag (int pool, const char *name)
+{
+	char		key[MEM_TAGLEN];
+	memtag_t	*tag;
+	unsigned int	i;
+
+	q_strlcpy (key, name, sizeof(key));
+	for (i = COM_HashString (key) + pool; ; i++)
+	{
+		tag = &mem_tags[i & (MEM_MAXTAGS - 1)];
+		if (!tag->name[0])
+			break;
+		if (tag->pool == pool && !strcmp (tag->name, key))
+			return tag;
+	}
+
+	if (mem_numtags >= MEM_MAXTAGS * 3 / 4 && strcmp (name, "other"))
+		return Mem_FindTag (pool, "other");	// the last quarter is for these
+	mem_numtags++;
+	q_strlcpy (tag->name, key, sizeof(tag->name));
+	tag->pool = pool;
+	return tag;
+}
+
+/*
+========================
+Mem_Track
+
+Adds delta bytes to a pool, and to the named allocation in it if name
+isn't NULL.
+========================
+*/
+void Mem_Track (int pool, const char *name, int delta)
+{
+	Mem_Count (&mem_pools[pool], delta);
+	if (pool != MEMPOOL_ZONE)
+		Mem_Count (&mem_total, delta);
+	if (name)
+		Mem_Count (&Mem_FindTag (pool, name)->count, delta);
+}
+
+/*
+========================
+Mem_BeginMap
+
+Files the peaks of the previous map and starts tracking new ones.
+========================
+*/
+void Mem_BeginMap (const char *mapname)
+{
+	memmap_t	*map;
+	int		i;
+
+	if (mem_mapname[0])
+	{
+		if (mem_nummaps == MEM_MAXMAPS)
+		{
+			memmove (mem_maps, mem_maps + 1, (MEM_MAXMAPS - 1) * sizeof(memmap_t));
+			mem_nummaps--;
+		}
+		map = &mem_maps[mem_nummaps++];
+		q_strlcpy (map->name, mem_mapname, sizeof(map->name));
+		for (i = 0; i < NUM_MEMPOOLS; i++)
+			map->peaks[i] = mem_pools[i].mappeak;
+		map->totalpeak = mem_total.mappeak;
+	}
+
+	q_strlcpy (mem_mapname, mapname, sizeof(mem_mapname));
+	for (i = 0; i < NUM_MEMPOOLS; i++)
+		mem_pools[i].mappeak = mem_pools[i].current;
+	mem_total.mappeak = mem_total.current;
+	for (i = 0; i < MEM_MAXTAGS; i++)
+		mem_tags[i].count.mappeak = mem_tags[i].count.current;
+}
+
+/*
+========================
+Mem_Frame
+
+Samples the pools for the timeline.
+========================
+*/
+void Mem_Frame (void)
+{
+	memsample_t	*sample;
+	int		i;
+
+	if (mem_timeline.value < 1 || host_framecount % (int)mem_timeline.value)
+		return;
+
+	sample = &mem_samples[mem_numsamples++ % MEM_MAXSAMPLES];
+	sample->time = realtime;
+	for (i = 0; i < NUM_MEMPOOLS; i++)
+		sample->pools[i] = mem_pools[i].current;
+}
+
+static int Mem_CompareTags (const void *a, const void *b)
+{
+	return (*(const memtag_t **)b)->count.peak - (*(const memtag_t **)a)->count.peak;
+}
+
+/* returns the used tags sorted by peak, biggest first. free() it. */
+static memtag_t **Mem_SortedTags (void)
+{
+	memtag_t	**list;
+	int		i, count;
+
+	list = (memtag_t **) malloc ((mem_numtags + 1) * sizeof(memtag_t *));
+	if (!list)
+		return NULL;
+	for (i = count = 0; i < MEM_MAXTAGS; i++)
+	{
+		if (mem_tags[i].name[0])
+			list[count++] = &mem_tags[i];
+	}
+	qsort (list, count, sizeof(memtag_t *), Mem_CompareTags);
+	return list;
+}
+
+static void Mem_PrintCount (const char *pool, const char *name, const memcount_t *count)
+{
+	Con_Printf ("%-6s %-20s %7.2f %7.2f %7.2f\n", pool, name,
+		count->current / (1024.0 * 1024.0),
+		count->mappeak / (1024.0 * 1024.0),
+		count->peak / (1024.0 * 1024.0));
+}
+
+/* hunk and cache names are file names, this is enough for JSON */
+static const char *Mem_JSONString (const char *s)
+{
+	static char	buf[MEM_TAGLEN];
+	int		i;
+
+	for (i = 0; s[i] && i < MEM_TAGLEN - 1; i++)
+		buf[i] = (s[i] == '"' || s[i] == '\\' || (byte)s[i] < ' ') ? '_' : s[i];
+	buf[i] = 0;
+	return buf;
+}
+
+static qboolean Mem_WriteJSON (const char *filename)
+{
+	memtag_t	**list;
+	memsample_t	*sample;
+	FILE		*f;
+	int		i, j, first;
+
+	list = Mem_SortedTags ();
+	if (!list)
+		return false;
+	f = fopen (filename, "w");
+	if (!f)
+	{
+		free (list);
+		return false;
+	}
+
+	fprintf (f, "{\n\t\"map\": \"%s\",\n\t\"pools\": [\n", Mem_JSONString (mem_mapname));
+	for (i = 0; i < NUM_MEMPOOLS; i++)
+	{
+		fprintf (f, "\t\t{\"name\": \"%s\", \"current\": %i, \"mappeak\": %i, \"peak\": %i},\n",
+			mem_poolnames[i], mem_pools[i].current, mem_pools[i].mappeak, mem_pools[i].peak);
+	}
+	fprintf (f, "\t\t{\"name\": \"total\", \"current\": %i, \"mappeak\": %i, \"peak\": %i}\n\t],\n",
+		mem_total.current, mem_total.mappeak, mem_total.peak);
+
+	fprintf (f, "\t\"tags\": [\n");
+	for (i = 0; i < mem_numtags; i++)
+	{
+		fprintf (f, "\t\t{\"pool\": \"%s\", \"name\": \"%s\", \"current\": %i, \"mappeak\": %i, \"peak\": %i}%s\n",
+			mem_poolnames[list[i]->pool], Mem_JSONString (list[i]->name),
+			list[i]->count.current, list[i]->count.mappeak, list[i]->count.peak,
+			(i < mem_numtags - 1) ? "," : "");
+	}
+
+	fprintf (f, "\t],\n\t\"maps\": [\n");
+	for (i = 0; i < mem_nummaps; i++)
+	{
+		fprintf (f, "\t\t{\"name\": \"%s\", \"total\": %i", Mem_JSONString (mem_maps[i].name), mem_maps[i].totalpeak);
+		for (j = 0; j < NUM_MEMPOOLS; j++)
+			fprintf (f, ", \"%s\": %i", mem_poolnames[j], mem_maps[i].peaks[j]);
+		fprintf (f, "}%s\n", (i < mem_nummaps - 1) ? "," : "");
+	}
+
+	fprintf (f, "\t],\n\t\"timeline\": [\n");
+	i = q_max(0, mem_numsamples - MEM_MAXSAMPLES);
+	for (first = i; i < mem_numsamples; i++)
+	{
+		sample = &mem_samples[i % MEM_MAXSAMPLES];
+		fprintf (f, "%s\t\t[%.3f", (i > first) ? ",\n" : "", sample->time);
+		for (j = 0; j < NUM_MEMPOOLS; j++)
+			fprintf (f, ", %i", sample->pools[j]);
+		fprintf (f, "]");
+	}
+	fprintf (f, "\n\t]\n}\n");
+
+	fclose (f);
+	free (list);
+	return true;
+}
+
+static qboolean Mem_WriteTimeline (const char *filename)
+{
+	memsample_t	*sample;
+	FILE		*f;
+	int		i, j;
+
+	f = fopen (filename, "w");
+	if (!f)
+		return false;
+	fprintf (f, "time");
+	for (j = 0; j < NUM_MEMPOOLS; j++)
+		fprintf (f, ",%s", mem_poolnames[j]);
+	fprintf (f, "\n");
+	for (i = q_max(0, mem_numsamples - MEM_MAXSAMPLES); i < mem_numsamples; i++)
+	{
+		sample = &mem_samples[i % MEM_MAXSAMPLES];
+		fprintf (f, "%.3f", sample->time);
+		for (j = 0; j < NUM_MEMPOOLS; j++)
+			fprintf (f, ",%i", sample->pools[j]);
+		fprintf (f, "\n");
+	}
+	fclose (f);
+	return true;
+}
+
+/*
+========================
+Mem_Stats_f
+
+memstats [all]			pools and the biggest allocations, in MB
+memstats maps			peaks of the last maps
+memstats dump <file.json>	everything, written into the game dir
+memstats timeline <file.csv>	the sampled timeline
+memstats reset			peaks drop to the current sizes
+========================
+*/
+static void Mem_Stats_f (void)
+{
+	memtag_t	**list;
+	const char	*cmd = (Cmd_Argc() > 1) ? Cmd_Argv(1) : "";
+	char		name[MAX_OSPATH];
+	int		i, j;
+
+	if (!strcmp (cmd, "reset"))
+	{
+		for (i = 0; i < NUM_MEMPOOLS; i++)
+			mem_pools[i].peak = mem_pools[i].mappeak = mem_pools[i].current;
+		mem_total.peak = mem_total.mappeak = mem_total.current;
+		for (i = 0; i < MEM_MAXTAGS; i++)
+			mem_tags[i].count.peak = mem_tags[i].count.mappeak = mem_tags[i].count.current;
+		mem_nummaps = mem_numsamples = 0;
+		return;
+	}
+
+	if (!strcmp (cmd, "dump") || !strcmp (cmd, "timeline"))
+	{
+		if (Cmd_Argc() != 3 || strstr (Cmd_Argv(2), ".."))
+		{
+			Con_Printf ("usage: memstats %s <file>\n", cmd);
+			return;
+		}
+		q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv(2));
+		if (cmd[0] == 'd' ? Mem_WriteJSON (name) : Mem_WriteTimeline (name))
+			Con_Printf ("wrote %s\n", name);
+		else
+			Con_Printf ("couldn't write %s\n", name);
+		return;
+	}
+
+	if (!strcmp (cmd, "maps"))
+	{
+		Con_Printf ("map                total    hunk   cache  malloc      gl  (peak MB)\n");
+		for (i = 0; i <= mem_nummaps; i++)
+		{
+			if (i < mem_nummaps)
+			{
+				Con_Printf ("%-16s %7.2f", mem_maps[i].name, mem_maps[i].totalpeak / (1024.0 * 1024.0));
+				for (j = 0; j < NUM_MEMPOOLS; j++)
+				{
+					if (j != MEMPOOL_ZONE)
+						Con_Printf (" %7.2f", mem_maps[i].peaks[j] / (1024.0 * 1024.0));
+				}
+			}
+			else if (mem_mapname[0])
+			{
+				Con_Printf ("%-16s %7.2f", mem_mapname, mem_total.mappeak / (1024.0 * 1024.0));
+				for (j = 0; j < NUM_MEMPOOLS; j++)
+				{
+					if (j != MEMPOOL_ZONE)
+						Con_Printf (" %7.2f", mem_pools[j].mappeak / (1024.0 * 1024.0));
+				}
+				Con_Printf ("  (current)");
+			}
+			else
+				break;
+			Con_Printf ("\n");
+		}
+		return;
+	}
+
+	Con_Printf ("pool   name                 current  mappeak    peak  (MB)\n");
+	for (i = 0; i < NUM_MEMPOOLS; i++)
+		Mem_PrintCount (mem_poolnames[i], "", &mem_pools[i]);
+	Mem_PrintCount ("total", "", &mem_total);
+
+	list = Mem_SortedTags ();
+	if (!list)
+		return;
+	Con_Printf ("\n");
+	for (i = 0; i < mem_numtags && (i < 20 || !strcmp (cmd, "all")); i++)
+		Mem_PrintCount (mem_poolnames[list[i]->pool], list[i]->name, &list[i]->count);
+	if (i < mem_numtags)
+		Con_Printf ("%i more, see \"memstats all\"\n", mem_numtags - i);
+	free (list);
+}
+
+/*
+==============================================================================
+
+						SCRATCH ARENA
+
+A bump allocator for memory that is only needed for a little while: scratch
+space used inside a function, va() strings, colormapped and resampled
+textures. Everything in it is thrown away when the next host frame starts,
+and Scratch_Mark / Scratch_Release give it back earlier, nested like the
+hunk's low marks. Unlike Hunk_Alloc it never flushes the cache to make room
+and doesn't have to be freed in order with loading.
+
+When the hunk is reserved address space the arena gets its own reservation
+and is committed as it grows; a frame that needed much less than what is
+committed gives the rest back. Otherwise it is a fixed hunk block, and
+-scratch <kb> sets its size. An allocation that doesn't fit is malloc'd
+and freed along with the mark it was made under, so a big texture upload
+costs a malloc instead of an error.
+
+==============================================================================
+*/
+
+#define	SCRATCH_RESERVE		(64 * 1024 * 1024)
+#define	SCRATCH_FIXEDSIZE	(2 * 2048 * 2048 * 4)	// a 2048x2048 upload and its resample
+#define	SCRATCH_COMMITSTEP	(256 * 1024)
+#define	SCRATCH_KEEP		(1024 * 1024)	// stays committed between frames
+
+static byte	*scratch_base;
+static int	scratch_size;
+static int	scratch_used;
+static int	scratch_commit;		// == scratch_size unless reserved
+static qboolean	scratch_reserved;
+static int	scratch_marks;		// outstanding Scratch_Mark calls
+
+typedef struct scratchblock_s
+{
+	struct scratchblock_s	*next;
+	int			depth;		// scratch_marks when it was taken
+	int			size;
+} scratchblock_t;
+
+#define	SCRATCH_BLOCKHEADER	((int)(sizeof(scratchblock_t) + 15) & ~15)
+
+static scratchblock_t	*scratch_blocks;	// what didn't fit, newest first
+
+static struct
+{
+	int	frames;
+	int	allocs;
+	int	frameallocs, lastallocs;	// this and the previous frame
+	int	framepeak, lastpeak;
+	int	peak;
+	int	fallbacks;		// Scratch_TryAlloc calls turned down
+	int	oversize;		// Scratch_Alloc calls that were malloc'd
+	int	largest;		// the biggest of them
+} scratch_stats;
+
+static void Scratch_Commit (int end)
+{
+	int	commit, delta;
+
+	if (end <= scratch_commit)
+		return;
+	commit = (end + SCRATCH_COMMITSTEP - 1) & ~(SCRATCH_COMMITSTEP - 1);
+	if (commit > scratch_size)
+		commit = scratch_size;
+	delta = commit - scratch_commit;
+	if (!Sys_MemCommit (scratch_base + scratch_commit, delta))
+		Sys_Error ("Scratch_Commit: couldn't commit %i bytes", delta);
+	scratch_commit = commit;
+	Mem_Track (MEMPOOL_MALLOC, "scratch", delta);
+}
+
+static void *Scratch_Take (int size)
+{
+	byte	*buf;
+
+	size = (size + 15) & ~15;
+	if (scratch_reserved)
+		Scratch_Commit (scratch_used + size);
+	buf = scratch_base + scratch_used;
+	scratch_used += size;
+	if (scratch_used > scratch_stats.framepeak)
+		scratch_stats.framepeak = scratch_used;
+	scratch_stats.allocs++;
+	scratch_stats.frameallocs++;
+	return buf;
+}
+
+static void *Scratch_AllocBlock (int size)
+{
+	scratchblock_t	*block;
+
+	block = (scratchblock_t *) malloc (SCRATCH_BLOCKHEADER + size);
+	if (!block)
+		Sys_Error ("Scratch_Alloc: failed on %i bytes", size);
+	Mem_Track (MEMPOOL_MALLOC, "scratch", size);
+	block->depth = scratch_marks;
+	block->size = size;
+	block->next = scratch_blocks;
+	scratch_blocks = block;
+
+	scratch_stats.allocs++;
+	scratch_stats.frameallocs++;
+	scratch_stats.oversize++;
+	if (size > scratch_stats.largest)
+		scratch_stats.largest = size;
+	return (byte *)block + SCRATCH_BLOCKHEADER;
+}
+
+/* frees the blocks taken under Scratch_Mark depth and deeper */
+static void Scratch_FreeBlocks (int depth)
+{
+	scratchblock_t	*block;
+
+	while (scratch_blocks && scratch_blocks->depth >= depth)
+	{
+		block = scratch_blocks;
+		scratch_blocks = block->next;
+		Mem_Track (MEMPOOL_MALLOC, "scratch", -block->size);
+		free (block);
+	}
+}
+
+/*
+====================
+Scratch_Alloc
+
+Returns uninitialized memory that is good until the frame ends or the
+enclosing Scratch_Mark is released
+====================
+*/
+void *Scratch_Alloc (int size)
+{
+	if (size < 0)
+		Sys_Error ("Scratch_Alloc: bad size: %i", size);
+	if (size > scratch_size - scratch_used)
+		return Scratch_AllocBlock (size);
+	return Scratch_Take (size);
+}
+
+/*
+====================
+Scratch_TryAlloc
+
+Like Scratch_Alloc, but returns NULL before the arena is set up, or when the
+allocation would eat into the last half of it. For callers that have
+somewhere else to go.
+====================
+*/
+void *Scratch_TryAlloc (int size)
+{
+	if (!scratch_base || size > scratch_size / 2 - scratch_used)
+	{
+		scratch_stats.fallbacks++;
+		return NULL;
+	}
+	return Scratch_Take (size);
+}
+
+/*
+====================
+Scratch_Shrink
+
+Gives back the tail of the last allocation when less of it was used
+====================
+*/
+void Scratch_Shrink (void *buf, int size)
+{
+	int	start = (byte *)buf - scratch_base;
+	int	end = start + ((size + 15) & ~15);
+
+	if (start < 0 || end > scratch_used)
+		Sys_Error ("Scratch_Shrink: bad buffer");
+	scratch_used = end;
+}
+
+int Scratch_Mark (void)
+{
+	scratch_marks++;
+	return scratch_used;
+}
+
+void Scratch_Release (int mark)
+{
+	if (mark < 0 || mark > scratch_used || scratch_marks <= 0)
+		Sys_Error ("Scratch_Release: bad mark %i", mark);
+	Scratch_FreeBlocks (scratch_marks);
+	scratch_marks--;
+	scratch_used = mark;
+}
+
+/*
+====================
+Scratch_Reset
+
+Empties the arena, called at the start of every host frame. Marks left over
+from a Host_Error are dropped too.
+====================
+*/
+void Scratch_Reset (void)
+{
+	int	keep;
+
+	if (scratch_stats.framepeak > scratch_stats.peak)
+		scratch_stats.peak = scratch_stats.framepeak;
+	if (scratch_reserved)
+	{
+		keep = q_max (scratch_stats.framepeak, SCRATCH_KEEP);
+		keep = (keep + SCRATCH_COMMITSTEP - 1) & ~(SCRATCH_COMMITSTEP - 1);
+		if (keep < scratch_commit)
+		{
+			Sys_MemDecommit (scratch_base + keep, scratch_commit - keep);
+			Mem_Track (MEMPOOL_MALLOC, "scratch", keep - scratch_commit);
+			scratch_commit = keep;
+		}
+	}
+	scratch_stats.lastpeak = scratch_stats.framepeak;
+	scratch_stats.lastallocs = scratch_stats.frameallocs;
+	scratch_stats.framepeak = 0;
+	scratch_stats.frameallocs = 0;
+	scratch_stats.frames++;
+	Scratch_FreeBlocks (0);
+	scratch_used = 0;
+	scratch_marks = 0;
+}
+
+/*
+====================
+Scratch_Stats_f
+====================
+*/
+static void Scratch_Stats_f (void)
+{
+	Con_Printf ("scratch: %4.1f MB %s, %4.1f MB committed\n",
+		    scratch_size / (float)0x100000, scratch_reserved ? "reserved" : "fixed",
+		    scratch_commit / (float)0x100000);
+	Con_Printf ("in use : %i bytes, %i marks\n", scratch_used, scratch_marks);
+	Con_Printf ("frame  : %i bytes peak in %i allocs\n", scratch_stats.lastpeak, scratch_stats.lastallocs);
+	Con_Printf ("peak   : %i bytes over %i frames, %i allocs\n",
+		    q_max (scratch_stats.peak, scratch_stats.framepeak), scratch_stats.frames, scratch_stats.allocs);
+	Con_Printf ("refused: %i\n", scratch_stats.fallbacks);
+	if (scratch_stats.oversize)
+		Con_Printf ("malloc : %i allocs didn't fit, largest %i bytes, see -scratch <kb>\n",
+			    scratch_stats.oversize, scratch_stats.largest);
+}
+
+static void Scratch_Init (qboolean reserved)
+{
+	int	p;
+
+	p = COM_CheckParm ("-scratch");
+	if (p)
+	{
+		if (p < com_argc-1)
+			scratch_size = Q_atoi (com_argv[p+1]) * 1024;
+		else
+			Sys_Error ("Memory_Init: you must specify a size in KB after -scratch");
+		scratch_size = (scratch_size + 15) & ~15;
+		reserved = false;
+	}
+	else	// bigger uploads are malloc'd, don't starve a small -heapsize
+		scratch_size = q_min (SCRATCH_FIXEDSIZE, (hunk_size / 4) & ~15);
+
+	scratch_base = reserved ? (byte *) Sys_MemReserve (SCRATCH_RESERVE) : NULL;
+	if (scratch_base)
+	{
+		scratch_size = SCRATCH_RESERVE;
+		scratch_reserved = true;
+		scratch_commit = 0;
+	}
+	else
+	{
+		scratch_base = (byte *) Hunk_AllocName (scratch_size, "scratch");
+		scratch_reserved = false;
+		scratch_commit = scratch_size;
+	}
+	scratch_used = 0;
+
+	Cmd_AddCommand ("scratch_stats", Scratch_Stats_f);
+}
+
+//============================================================================
+
 
 static void Memory_InitZone (memzone_t *zone, int size)
 {
 	memblock_t	*block;
+	int		i, sclass;
 
 // set the entire zone to one free block
 
+	memset (zone, 0, sizeof(memzone_t));
+	zone->size = size;
 	zone->blocklist.next = zone->blocklist.prev = block =
 		(memblock_t *)( (byte *)zone + sizeof(memzone_t) );
 	zone->blocklist.tag = 1;	// in use block
 	zone->blocklist.id = 0;
 	zone->blocklist.size = 0;
-	zone->rover = block;
 
 	block->prev = block->next = &zone->blocklist;
 	block->tag = 0;			// free block
 	block->id = ZONEID;
 	block->size = size - sizeof(memzone_t);
+	mainzone = zone;
+	Z_LinkFree (block);
+
+	for (i = 0, sclass = 0; i <= ZONE_MAXSMALL / 16; i++)
+	{
+		while (zone_classsize[sclass] < i * 16)
+			sclass++;
+		zone_classfor[i] = sclass;
+	}
 }
 
 /*
@@ -962,7 +2057,7 @@ static void Memory_InitZone (memzone_t *zone, int size)
 Memory_Init
 ========================
 */
-void Memory_Init (void *buf, int size)
+void Memory_Init (void *buf, int size, qboolean reserved)
 {
 	int p;
 	int zonesize = DYNAMIC_SIZE;
@@ -971,6 +2066,10 @@ void Memory_Init (void *buf, int size)
 	hunk_size = size;
 	hunk_low_used = 0;
 	hunk_high_used = 0;
+	hunk_reserved = reserved;
+	if (reserved)	// commit steps have to line up at the top too
+		hunk_size &= ~(HUNK_COMMITSTEP - 1);
+	hunk_lowcommit = hunk_highcommit = 0;
 
 	Cache_Init ();
 	p = COM_CheckParm ("-zone");
@@ -983,7 +2082,11 @@ void Memory_Init (void *buf, int size)
 	}
 	mainzone = (memzone_t *) Hunk_AllocName (zonesize, "zone" );
 	Memory_InitZone (mainzone, zonesize);
+	Scratch_Init (reserved);
 
 	Cmd_AddCommand ("hunk_print", Hunk_Print_f); //johnfitz
+	Cmd_AddCommand ("zone_stats", Z_Stats_f);
+	Cmd_AddCommand ("memstats", Mem_Stats_f);
+	Cvar_RegisterVariable (&mem_timeline);
 }
 
@@ -42,8 +42,10 @@ server allocations when changing to a higher video mode.
 
 
 Z_??? Zone memory functions used for small, dynamic allocations like text
-strings from command input.  There is only about 48K for it, allocated at
-the very bottom of the hunk.
+strings from command input.  There is only a few MB for it, allocated at
+the very bottom of the hunk.  Allocations up to 512 bytes are served from
+size class pages in constant time, "zone_stats" shows how well they are
+used and how fragmented the rest of the zone is.
 
 Cache_??? Cache memory is for objects that can be dynamically loaded and
 can usefully stay persistant between levels.  The size of the cache
@@ -89,7 +91,7 @@ Zone block
 
 */
 
-void Memory_Init (void *buf, int size);
+void Memory_Init (void *buf, int size, qboolean reserved);
 
 void Z_Free (void *ptr);
 void *Z_Malloc (int size);			// returns 0 filled memory
@@ -111,6 +113,13 @@ void *Hunk_TempAlloc (int size);
 
 void Hunk_Check (void);
 
+void *Scratch_Alloc (int size);		// uninitialized, gone when the frame ends
+void *Scratch_TryAlloc (int size);	// NULL instead of an error
+void Scratch_Shrink (void *buf, int size);
+int Scratch_Mark (void);
+void Scratch_Release (int mark);
+void Scratch_Reset (void);
+
 typedef struct cache_user_s
 {
 	void	*data;
@@ -130,5 +139,21 @@ void *Cache_Alloc (cache_user_t *c, int size, const char *name);
 
 void Cache_Report (void);
 
+typedef enum
+{
+	MEMPOOL_HUNK,
+	MEMPOOL_ZONE,
+	MEMPOOL_CACHE,
+	MEMPOOL_MALLOC,
+	MEMPOOL_GL,
+	NUM_MEMPOOLS
+} mempool_t;
+
+void Mem_Track (int pool, const char *name, int delta);
+// adds delta bytes to the pool, and to the allocation called name in it
+// if it isn't NULL. the hunk, zone and cache track themselves
+void Mem_BeginMap (const char *mapname);
+void Mem_Frame (void);
+
 #endif	/* __ZZONE_H */
 